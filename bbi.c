@@ -9,207 +9,354 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 #include "bbi.h"
 
 bbi_chunk *_bbi_chunk_create() {
-    bbi_chunk *ptr = malloc(sizeof(bbi_chunk));
-    ptr->val = 0;       /* TODO C rules for assigning a literal to a type */
-    ptr->left = NULL;
-    ptr->right = NULL;
+    bbi_chunk *ptr = _bbi_alloc_chunks(1);
+    ptr->limbs[0] = 0;
+    ptr->len = 1;
+    ptr->sign = 0;
     return ptr;
 }
 
+/* Make sure the chunk array has room for at least nchunks, without changing its length. Capacity
+   at least doubles each time so a run of small extensions costs amortized O(1) per chunk. */
+void _bbi_reserve(bbi_chunk *list, unsigned int nchunks) {
+    unsigned int newcap;
+
+    if (nchunks <= list->cap) {
+        return;
+    }
+    newcap = list->cap * 2;
+    if (newcap < nchunks) {
+        newcap = nchunks;
+    }
+    _bbi_realloc_chunks(list, newcap);
+}
+
 bbi_chunk *bbi_create() {
+    BBI_STAT_SCOPE(BBI_STAT_CREATE, 1);
     return _bbi_chunk_create();
 }
 
 bbi_chunk *bbi_create_nchunks(unsigned int nchunks) {
-    unsigned int diff;
-    
+    bbi_chunk *ptr;
+    BBI_STAT_SCOPE(BBI_STAT_CREATE, nchunks);
+
     if (nchunks == 0 || nchunks == 1) {
-        return bbi_create();
+        return _bbi_chunk_create();
     }
-    diff = nchunks - 1;
-    bbi_chunk *ptr = _bbi_chunk_create();
-    return bbi_extend(ptr, diff);
+    /* One allocation for the whole run of chunks, rather than growing one at a time */
+    ptr = _bbi_alloc_chunks(nchunks);
+    memset(ptr->limbs, 0, nchunks * sizeof(bbi_limb));
+    ptr->len = nchunks;
+    ptr->sign = 0;
+    return ptr;
+}
+
+/* Extend a list (always on the left) by nchunks, new chunks are 0 */
+bbi_chunk *bbi_extend(bbi_chunk *list, unsigned int nchunks) {
+    BBI_STAT_SCOPE(BBI_STAT_EXTEND, nchunks);
+
+    assert(nchunks > 0);    /* TODO assertion disabling */
+    _bbi_reserve(list, list->len + nchunks);
+    memset(&list->limbs[list->len], 0, nchunks * sizeof(bbi_limb));
+    list->len += nchunks;
+    return list;
 }
 
-/* TODO optimization: chunk lists store their current length */
-unsigned int _bbi_count_chunks(bbi_chunk *list) {
-    unsigned int count = 0;
-   
-    list = _find_left(list);
-    count = 1;
-    while (list->right != NULL) {
-        list = list->right;
-        count++;
+/* Pad list_a only to be at least as long as list_b,
+   This was repeated in bbi_{and,or,xor}_inplace() - factor it out */
+bbi_chunk *bbi_pad_first(bbi_chunk *list_a, bbi_chunk *list_b) {
+    if (list_a->len >= list_b->len) {
+        return list_a;
     }
-    return count;
+    BBI_STAT_COUNT(pads, 1);
+    bbi_extend(list_a, list_b->len - list_a->len);
+    assert(list_a->len == list_b->len);
+    return list_a;
 }
 
-/* 
- * Following the principle "be conservative in what you send, and liberal in what you accept",
- * functions take any chunk in a list to operate on the chunk list, but always return the 
- * least-significant-bit chunk 
- */
+/* Pad lists a and b to be the same length, whichever is currently longest */
+void bbi_pad_both(bbi_chunk *list_a, bbi_chunk *list_b) {
+    if (list_a->len != list_b->len) {
+        BBI_STAT_COUNT(pads, 1);
+    }
+    if (list_a->len < list_b->len) {
+        bbi_extend(list_a, list_b->len - list_a->len);
+    }
+    if (list_b->len < list_a->len) {
+        bbi_extend(list_b, list_a->len - list_b->len);
+    }
+}
 
-/* Get the leftmost chunk (Most-Significant Bit) of a chunk list */
-bbi_chunk *_find_left(bbi_chunk *list) {
-    while (list->left != NULL) {
-        list = list->left;
+bbi_chunk *bbi_copy(bbi_chunk *list) {
+    bbi_chunk *newlist = _bbi_alloc_chunks(list->len);
+    BBI_STAT_SCOPE(BBI_STAT_COPY, list->len);
+
+    newlist->len = list->len;
+
+    memcpy(newlist->limbs, list->limbs, list->len * sizeof(bbi_limb));
+    newlist->sign = list->sign;
+    return newlist;
+}
+
+/* Single-chunk add/subtract with carry in and out. On x86-64 these map onto adc/sbb through
+   the intrinsics, elsewhere the compiler's overflow builtins give the same result. */
+static inline bbi_limb _bbi_addc(bbi_limb a, bbi_limb b, bbi_limb carry, bbi_limb *carry_out) {
+#if defined(__x86_64__) && BBI_LIMB_BITS == 64
+    unsigned long long r;
+    *carry_out = _addcarry_u64((unsigned char) carry, a, b, &r);
+    return r;
+#else
+    bbi_limb r;
+    bbi_limb c1 = __builtin_add_overflow(a, b, &r);
+    bbi_limb c2 = __builtin_add_overflow(r, carry, &r);
+    *carry_out = c1 | c2;
+    return r;
+#endif
+}
+
+static inline bbi_limb _bbi_subb(bbi_limb a, bbi_limb b, bbi_limb borrow, bbi_limb *borrow_out) {
+#if defined(__x86_64__) && BBI_LIMB_BITS == 64
+    unsigned long long r;
+    *borrow_out = _subborrow_u64((unsigned char) borrow, a, b, &r);
+    return r;
+#else
+    bbi_limb r;
+    bbi_limb b1 = __builtin_sub_overflow(a, b, &r);
+    bbi_limb b2 = __builtin_sub_overflow(r, borrow, &r);
+    *borrow_out = b1 | b2;
+    return r;
+#endif
+}
+
+bbi_limb _bbi_add_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    unsigned int i;
+    bbi_limb carry = 0;
+
+    for (i = 0; i < n; i++) {
+        rp[i] = _bbi_addc(ap[i], bp[i], carry, &carry);
     }
-    return list;
+    return carry;
 }
 
-/* Get the rightmost chunk (Least-Significant Bit) of a chunk list */
-bbi_chunk *_find_right(bbi_chunk *list) {
-    while (list->right != NULL) {
-        list = list->right;
+/* Stops as soon as the carry dies out - the remaining chunks only need copying, and not even
+   that when working in place */
+bbi_limb _bbi_add_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b) {
+    unsigned int i;
+
+    for (i = 0; i < n && b != 0; i++) {
+        b = __builtin_add_overflow(ap[i], b, &rp[i]);
     }
-    return list;
+    if (rp != ap && i < n) {
+        memcpy(&rp[i], &ap[i], (n - i) * sizeof(bbi_limb));
+    }
+    return b;
 }
 
-/* Extend a list (always on the left) by nchunks */
-bbi_chunk *bbi_extend(bbi_chunk *list, unsigned int nchunks) {
+bbi_limb _bbi_sub_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
     unsigned int i;
-    bbi_chunk *ptr;
+    bbi_limb borrow = 0;
 
-    assert(nchunks > 0);    /* TODO assertion disabling */
-    list = _find_left(list);
-    for (i = 0; i < nchunks; i++) {
-        ptr = _bbi_chunk_create();
-        list->left = ptr;
-        ptr->right = list;
-        list = ptr;
+    for (i = 0; i < n; i++) {
+        rp[i] = _bbi_subb(ap[i], bp[i], borrow, &borrow);
     }
-    /* Always return rightmost (Least-Significant Bit) chunk as pointer */
-    return _find_right(list);
+    return borrow;
 }
 
-/* Pad list_a only to be at least as long as list_b,
-   This was repeated in bbi_{and,or,xor}_inplace() - factor it out */
-bbi_chunk *bbi_pad_first(bbi_chunk *list_a, bbi_chunk *list_b) {
-    unsigned int len_a;
-    unsigned int len_b;
+bbi_limb _bbi_sub_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b) {
+    unsigned int i;
 
-    len_a = _bbi_count_chunks(list_a);
-    len_b = _bbi_count_chunks(list_b);
-    if (len_a > len_b || len_a == len_b) {
-        return _find_right(list_a);
+    for (i = 0; i < n && b != 0; i++) {
+        b = __builtin_sub_overflow(ap[i], b, &rp[i]);
     }
-    bbi_extend(list_a, len_b - len_a);
-    assert(_bbi_count_chunks(list_a) == _bbi_count_chunks(list_b));
-    return _find_right(list_a);
+    if (rp != ap && i < n) {
+        memcpy(&rp[i], &ap[i], (n - i) * sizeof(bbi_limb));
+    }
+    return b;
 }
 
-/* Pad lists a and b to be the same length, whichever is currently longest */
-void bbi_pad_both(bbi_chunk *list_a, bbi_chunk *list_b) {
-    unsigned int list_a_len;
-    unsigned int list_b_len;
-    unsigned int diff;
-    
-    list_a_len = _bbi_count_chunks(list_a);
-    list_b_len = _bbi_count_chunks(list_b);
-    if (list_a_len == list_b_len) {
-        return;
+bbi_limb _bbi_lshift(bbi_limb *rp, const bbi_limb *ap, unsigned int n, unsigned int cnt) {
+    bbi_limb out;
+    unsigned int i;
+
+    assert(n > 0 && cnt > 0 && cnt < BBI_LIMB_BITS);
+    /* Top down, so rp == ap works */
+    out = ap[n - 1] >> (BBI_LIMB_BITS - cnt);
+    for (i = n - 1; i > 0; i--) {
+        rp[i] = (ap[i] << cnt) | (ap[i - 1] >> (BBI_LIMB_BITS - cnt));
     }
-    if (list_a_len < list_b_len) {
-        diff = list_b_len - list_a_len;
-        bbi_extend(list_a, diff);
+    rp[0] = ap[0] << cnt;
+    return out;
+}
+
+bbi_limb _bbi_rshift(bbi_limb *rp, const bbi_limb *ap, unsigned int n, unsigned int cnt) {
+    bbi_limb out;
+    unsigned int i;
+
+    assert(n > 0 && cnt > 0 && cnt < BBI_LIMB_BITS);
+    out = ap[0] << (BBI_LIMB_BITS - cnt);
+    for (i = 0; i < n - 1; i++) {
+        rp[i] = (ap[i] >> cnt) | (ap[i + 1] << (BBI_LIMB_BITS - cnt));
     }
-    if (list_b_len < list_a_len) {
-        diff = list_a_len - list_b_len;
-        bbi_extend(list_b, diff);
+    rp[n - 1] = ap[n - 1] >> cnt;
+    return out;
+}
+
+/* Number of chunks once leading (most-significant) 0 chunks are dropped - 0 for the value 0 */
+unsigned int _bbi_normalized_len(const bbi_limb *ap, unsigned int n) {
+    while (n > 0 && ap[n - 1] == 0) {
+        n--;
     }
+    return n;
 }
 
-bbi_chunk *bbi_copy(bbi_chunk *list) {
-    unsigned int listlen = _bbi_count_chunks(list);
-    bbi_chunk *newlist = bbi_create_nchunks(listlen);
+/* Compare two magnitudes, which may have different numbers of leading 0 chunks.
+   Returns <0, 0 or >0 like strcmp(). */
+int _bbi_cmp(const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn) {
+    an = _bbi_normalized_len(ap, an);
+    bn = _bbi_normalized_len(bp, bn);
+    if (an != bn) {
+        return an < bn ? -1 : 1;
+    }
+    while (an > 0) {
+        an--;
+        if (ap[an] != bp[an]) {
+            return ap[an] < bp[an] ? -1 : 1;
+        }
+    }
+    return 0;
+}
 
-    list = _find_right(list);
-    while (list->left != NULL) {
-        newlist->val = list->val;
-        list = list->left;
-        newlist = newlist->left;
+/* A zero result is always non-negative, whatever path produced it */
+static void _bbi_fix_zero_sign(bbi_chunk *list) {
+    if (_bbi_normalized_len(list->limbs, list->len) == 0) {
+        list->sign = 0;
     }
-    /* Copy final value */
-    newlist->val = list->val;
-    return _find_right(newlist);
 }
 
-/* Reuse general structure for "do things to pairs of lists" */
-bbi_chunk *bbi_add_inplace(bbi_chunk *list_a, bbi_chunk *list_b) {
-    unsigned int len_a;
-    unsigned int len_b;
-    unsigned int tmp;
-    unsigned int carry;
-
-    /* 1. add mod (2**chunkbitsize)
-       2. if result is less than either arg, there's a carry bit
-       3. ...
-       */
-    len_a = _bbi_count_chunks(list_a);
-    len_b = _bbi_count_chunks(list_b);
-    if (len_a < len_b) {
-        bbi_extend(list_a, len_b - len_a);
+/* Add the magnitude of list_b to that of list_a. list_a is first padded to the length of list_b; it
+   only grows by one more chunk if the carry out of the top chunk needs it. */
+static void _bbi_add_mag(bbi_chunk *list_a, bbi_chunk *list_b) {
+    unsigned int len_b = list_b->len;
+    bbi_limb carry;
+
+    bbi_pad_first(list_a, list_b);
+    carry = _bbi_add_n(list_a->limbs, list_a->limbs, list_b->limbs, len_b);
+    carry = _bbi_add_1(&list_a->limbs[len_b], &list_a->limbs[len_b], list_a->len - len_b, carry);
+    if (carry) {
+        bbi_extend(list_a, 1);
+        *_find_left(list_a) = carry;
+    }
+}
+
+/* Replace the magnitude of list_a with |list_a| - |list_b|. If list_b is the larger, list_a ends up
+   holding |list_b| - |list_a| instead and 1 is returned, so the caller can flip the sign. */
+static int _bbi_sub_mag(bbi_chunk *list_a, bbi_chunk *list_b) {
+    unsigned int len_b = _bbi_normalized_len(list_b->limbs, list_b->len);
+    bbi_limb borrow;
+
+    if (_bbi_cmp(list_a->limbs, list_a->len, list_b->limbs, len_b) >= 0) {
+        /* list_a >= list_b, so list_b has no more significant chunks than list_a */
+        borrow = _bbi_sub_n(list_a->limbs, list_a->limbs, list_b->limbs, len_b);
+        borrow = _bbi_sub_1(&list_a->limbs[len_b], &list_a->limbs[len_b], list_a->len - len_b, borrow);
+        assert(borrow == 0);
+        return 0;
     }
+    /* list_a < list_b: every chunk of list_a beyond len_b is 0 */
+    if (list_a->len < len_b) {
+        bbi_extend(list_a, len_b - list_a->len);
+    }
+    borrow = _bbi_sub_n(list_a->limbs, list_b->limbs, list_a->limbs, len_b);
+    assert(borrow == 0);
+    return 1;
+}
+
+/* Single-chunk operands, the usual case for small values: add or subtract the magnitudes without
+   any loops. A carry out lands in the second chunk, which the inline storage already has room for. */
+static void _bbi_add_mag_1(bbi_chunk *list_a, bbi_chunk *list_b) {
+    bbi_limb r = list_a->limbs[0] + list_b->limbs[0];
+
+    if (r < list_b->limbs[0]) {
+        _bbi_reserve(list_a, 2);
+        list_a->limbs[1] = 1;
+        list_a->len = 2;
+    }
+    list_a->limbs[0] = r;
+}
 
-    list_a = _find_right(list_a);
-    list_b = _find_right(list_b);
-    while (list_a->left != NULL && list_b->left != NULL) {
-        tmp = list_a->val + list_b->val;
-        list_a = list_a->left;
-        list_b = list_b->left;
+static void _bbi_sub_mag_1(bbi_chunk *list_a, bbi_chunk *list_b) {
+    if (list_a->limbs[0] >= list_b->limbs[0]) {
+        list_a->limbs[0] -= list_b->limbs[0];
+    } else {
+        list_a->limbs[0] = list_b->limbs[0] - list_a->limbs[0];
+        list_a->sign ^= 1;
     }
 }
 
+/* Add two signed values, storing the result in the first operand. Like signs add magnitudes and
+   keep the sign; unlike signs subtract the smaller magnitude from the larger, which sets the sign. */
+bbi_chunk *bbi_add_inplace(bbi_chunk *list_a, bbi_chunk *list_b) {
+    BBI_STAT_SCOPE(BBI_STAT_ADD, list_a->len + list_b->len);
+
+    if (list_a->len == 1 && list_b->len == 1) {
+        if (list_a->sign == list_b->sign) {
+            _bbi_add_mag_1(list_a, list_b);
+        } else {
+            _bbi_sub_mag_1(list_a, list_b);
+        }
+        if (list_a->len == 1 && list_a->limbs[0] == 0) {
+            list_a->sign = 0;
+        }
+        return list_a;
+    }
+    if (list_a->sign == list_b->sign) {
+        _bbi_add_mag(list_a, list_b);
+    } else {
+        list_a->sign ^= _bbi_sub_mag(list_a, list_b);
+    }
+    _bbi_fix_zero_sign(list_a);
+    return list_a;
+}
+
 bbi_chunk *bbi_add(bbi_chunk *list_a, bbi_chunk *list_b) {
     bbi_chunk *result = bbi_copy(list_a);
     return bbi_add_inplace(result, list_b);
 }
 
-/* Load a value from a string, in decimal - caller must bbi_destory()! */
-/* More usefully, a general-case function to handle at least binary, octal, decimal and hex
-   is a good idea, but this is a starting point */
-/*
- * Converting a string representation of an integer to an actual value is trivial in any base. 
-   The general algorithm is:
-   - initialise the value variable to 0
-   - start at the right-most digit, and walk to the left-most digit one digit at a time, for each digit
-        - multiply the value variable by the base (e.g. 10)
-        - add the value of the digit to the value variable
-   
-   The challenge is to do this across chunks - because we can't just use one "value variable",
-   we have to use many.
-
-   We know how many chunks we need - the maximum numbers of bits needed to hold to multiplication 
-   of two binary values is the sum of the bits used in the operands, excluding leading 0 bits. For
-   convenience we can assume that there's no leading 0 bits, and sum the number chunks in the operands
-   to get the number of chunks needed to store the result.
+/* Subtract list_b from list_a, storing the result in the first operand - a + (-b), so e.g. for two
+   non-negative values with list_b the larger, list_a ends up holding list_b - list_a with its sign
+   set. */
+bbi_chunk *bbi_sub_inplace(bbi_chunk *list_a, bbi_chunk *list_b) {
+    BBI_STAT_SCOPE(BBI_STAT_SUB, list_a->len + list_b->len);
 
+    if (list_a->len == 1 && list_b->len == 1) {
+        if (list_a->sign != list_b->sign) {
+            _bbi_add_mag_1(list_a, list_b);
+        } else {
+            _bbi_sub_mag_1(list_a, list_b);
+        }
+        if (list_a->len == 1 && list_a->limbs[0] == 0) {
+            list_a->sign = 0;
+        }
+        return list_a;
+    }
+    if (list_a->sign != list_b->sign) {
+        _bbi_add_mag(list_a, list_b);
+    } else {
+        list_a->sign ^= _bbi_sub_mag(list_a, list_b);
+    }
+    _bbi_fix_zero_sign(list_a);
+    return list_a;
+}
 
-*/
-bbi_chunk *bbi_fromstring_dec(const unsigned char *s) {
-    size_t slen = strlen(s); 
-    size_t sidx;
-    unsigned int curval;
-    unsigned int oldcurval;
-    
-    bbi_chunk *list = bbi_create();
-    sidx = 0;
-    curval = 0;
-
-    while (sidx < slen) {
-        curval *= 10;
-        /* ASCII Arabic numeral representation has the nice property that you can get the actual value
-           of the digit represented by the character by substracting 0x30, or more clearly, '0' */
-        curval += (s[sidx] - '0');
-        sidx++;
-    };
-
-    list->val = curval;
-    return list;
+bbi_chunk *bbi_sub(bbi_chunk *list_a, bbi_chunk *list_b) {
+    bbi_chunk *result = bbi_copy(list_a);
+    return bbi_sub_inplace(result, list_b);
 }
 
 /* Convert a value to a string represenation in binary - caller must handle memory */
@@ -234,22 +381,23 @@ void _bbi_dump_binary_val(unsigned char *buf, unsigned int val) {
     *buf = '\0';
 }
 
-/* Walk chunks from most-significant bit to least, outputing one per line */
+/* Walk chunks from most-significant bit to least, outputing one per line. Chunks wider than 32 bits
+   are shown as their 32-bit pieces, most-significant first. */
 void bbi_dump_binary(bbi_chunk *list) {
     unsigned char buf[sizeof(unsigned int)*8+3+1];  /* TODO assumes 32-bit unsigned int */
-    unsigned int chunknum = 0;
-    while (list->left != NULL) {
-        list = list->left;
-    }
-    while (list->right != NULL) {
-        _bbi_dump_binary_val(buf, list->val);
-        printf("%03d: %s (%p)\n", chunknum, buf, list); 
-        chunknum++;
-        list = list->right;
-    } 
-    /* Handle single chunk */
-    _bbi_dump_binary_val(buf, list->val);
-    printf("%03d: %s (%p)\n", chunknum, buf, list); 
+    unsigned int chunknum;
+    unsigned int i;
+    int shift;
+
+    for (chunknum = 0; chunknum < list->len; chunknum++) {
+        i = list->len - 1 - chunknum;
+        printf("%03d:", chunknum);
+        for (shift = BBI_LIMB_BITS - 32; shift >= 0; shift -= 32) {
+            _bbi_dump_binary_val(buf, (unsigned int) (list->limbs[i] >> shift));
+            printf(" %s", buf);
+        }
+        printf(" (%p)\n", (void *) &list->limbs[i]);
+    }
 
     putchar('\n');
 }
@@ -264,43 +412,42 @@ unsigned int max(unsigned int a, unsigned int b) {
 }
 
 void bbi_destroy(bbi_chunk *list) {
-    bbi_chunk *to_free;
-    
-    list = _find_left(list);
-    while (list->right != NULL) {
-        to_free = list;
-        list = list->right;
-        assert(to_free != NULL);
-        free(to_free);
-        to_free = NULL;
-    }
     assert(list != NULL);
-    free(list);
-    list = NULL;
-}
+    BBI_STAT_SCOPE(BBI_STAT_DESTROY, list->len);
 
-/* Abstract the "operate on two lists, doing something to each pair of values at a time",
-   Takes a pair of lists and a function pointer taking two values and returning a value. */
-/*
-bbi_chunk *bbi_for_inplace(bbi_chunk *list_a, bbi_chunk *list_b, unsigned int (*func)(unsigned int x, unsigned int y)) {
-    ...
+    _bbi_free_chunks(list);
 }
-*/
+
+/* The "operate on two lists, doing something to each pair of values at a time" abstraction is
+   the BBI_BITOP macro in bbi_kernel.c, which stamps out each operation's loop for every vector
+   width at compile time rather than calling through a function pointer per chunk. */
 
 /* Bitwise operations have two functions for each operation - an in-place operation, and one
    that produces a new bigint, Binary in-place operations store the result in the
-   first operand */
+   first operand.
+
+   Values behave as if stored in two's complement with infinitely many sign bits, as Python's ints
+   and GMP's mpz_and() etc. do: ~x == -x-1, -1 is all 1 bits, and e.g. -5 & 3 == 3. Non-negative
+   operands, the common case, go straight to the vector kernels on the magnitudes. */
 
-/* Bitwise NOT a value */
+/* Bitwise NOT a value, ~x == -x-1: a non-negative value's magnitude goes up by one and becomes
+   negative, a negative value's goes down by one and becomes non-negative */
 bbi_chunk *bbi_not_inplace(bbi_chunk *list) {
-    bbi_chunk *list_right;
-    list = list_right = _find_right(list);
-    while (list->left != NULL) {
-        list->val = ~ list->val;
-        list = list->left;
+    bbi_limb carry;
+    BBI_STAT_SCOPE(BBI_STAT_NOT, list->len);
+
+    if (!list->sign || _bbi_normalized_len(list->limbs, list->len) == 0) {
+        carry = _bbi_add_1(list->limbs, list->limbs, list->len, 1);
+        if (carry) {
+            bbi_extend(list, 1);
+            *_find_left(list) = carry;
+        }
+        list->sign = 1;
+    } else {
+        _bbi_sub_1(list->limbs, list->limbs, list->len, 1);
+        list->sign = 0;
     }
-    list->val = ~ list->val;
-    return list_right;
+    return list;
 }
 
 bbi_chunk *bbi_not(bbi_chunk *list) {
@@ -308,21 +455,136 @@ bbi_chunk *bbi_not(bbi_chunk *list) {
     return bbi_not_inplace(result);
 }
 
+#define BBI_OP_AND 0
+#define BBI_OP_OR 1
+#define BBI_OP_XOR 2
+
+/* A bitwise kernel over a long run of chunks, cut into one slice per thread */
+struct bbi_bitop_task {
+    void (*kernel)(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+    bbi_limb *rp;
+    const bbi_limb *ap;
+    const bbi_limb *bp;
+    unsigned int n;
+    unsigned int slice;
+};
+
+static void _bbi_bitop_slice(void *arg, unsigned int i) {
+    struct bbi_bitop_task *t = arg;
+    unsigned int start = i * t->slice;
+    unsigned int n = t->n - start < t->slice ? t->n - start : t->slice;
+
+    t->kernel(&t->rp[start], &t->ap[start], &t->bp[start], n);
+}
+
+/* Run a bitwise kernel, across the thread pool if there is one and n is big enough. Slices are
+   whole cache lines so threads never write to the same one. */
+static void _bbi_bitop_n(void (*kernel)(bbi_limb *, const bbi_limb *, const bbi_limb *, unsigned int),
+                         bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    struct bbi_bitop_task t;
+    unsigned int nthreads = bbi_threads();
+
+    if (nthreads == 1 || n < _bbi_par_bitwise_threshold) {
+        kernel(rp, ap, bp, n);
+        return;
+    }
+    t.kernel = kernel;
+    t.rp = rp;
+    t.ap = ap;
+    t.bp = bp;
+    t.n = n;
+    t.slice = ((n + nthreads - 1) / nthreads + 7) & ~7u;
+    _bbi_par_run(_bbi_bitop_slice, &t, (n + t.slice - 1) / t.slice);
+}
+
+/* AND/OR/XOR with at least one negative operand. The two's complement of a negative magnitude m is
+   ~(m - 1), so each operand's chunks are complemented as they're read, with the borrow of the - 1
+   carried along, and a negative result is turned back into a magnitude by ~r + 1 as it's written -
+   no complemented copy of either operand is made. Above the longer operand both inputs are just
+   sign bits, so one extra chunk is enough to hold the carry out of the final + 1. */
+static bbi_chunk *_bbi_bitop_signed(bbi_chunk *list_a, bbi_chunk *list_b, int op) {
+    unsigned int an = _bbi_normalized_len(list_a->limbs, list_a->len);
+    unsigned int bn = _bbi_normalized_len(list_b->limbs, list_b->len);
+    unsigned int rn = an > bn ? an : bn;
+    int sa = list_a->sign && an > 0;
+    int sb = list_b->sign && bn > 0;
+    int sr;
+    bbi_limb borrow_a = sa;
+    bbi_limb borrow_b = sb;
+    bbi_limb carry;
+    bbi_limb x;
+    bbi_limb y;
+    bbi_limb r;
+    unsigned int i;
+
+    sr = op == BBI_OP_AND ? sa & sb : op == BBI_OP_OR ? sa | sb : sa ^ sb;
+    carry = sr;
+    _bbi_reserve(list_a, rn + 1);
+    for (i = 0; i < rn; i++) {
+        x = i < an ? list_a->limbs[i] : 0;
+        y = i < bn ? list_b->limbs[i] : 0;
+        if (sa) {
+            r = x - borrow_a;
+            borrow_a = x < borrow_a;
+            x = ~r;
+        }
+        if (sb) {
+            r = y - borrow_b;
+            borrow_b = y < borrow_b;
+            y = ~r;
+        }
+        r = op == BBI_OP_AND ? x & y : op == BBI_OP_OR ? x | y : x ^ y;
+        if (sr) {
+            r = ~r + carry;
+            carry = r < carry;
+        }
+        list_a->limbs[i] = r;
+    }
+    list_a->limbs[rn] = sr ? carry : 0;
+    list_a->len = _bbi_normalized_len(list_a->limbs, rn + 1);
+    if (list_a->len == 0) {
+        list_a->len = 1;
+        sr = 0;
+    }
+    list_a->sign = sr;
+    return list_a;
+}
+
+/* Both operands a single non-negative chunk: no loop, no kernel dispatch */
+static inline int _bbi_both_small(bbi_chunk *list_a, bbi_chunk *list_b) {
+    return list_a->len == 1 && list_b->len == 1 && !list_a->sign && !list_b->sign;
+}
+
+/* Either operand negative (and not -0) */
+static int _bbi_any_negative(bbi_chunk *list_a, bbi_chunk *list_b) {
+    return (list_a->sign && _bbi_normalized_len(list_a->limbs, list_a->len) > 0) ||
+           (list_b->sign && _bbi_normalized_len(list_b->limbs, list_b->len) > 0);
+}
+
 /* Bitwise AND two values. If one chunk list is longer than the other, the missing values are implicitly 
    all 0 bits. In-place version stores result in first operand, and extends to length of second operand
-   if it's smaller. */
+   if it's smaller. Since x&0 == 0, only the chunks both operands have are ANDed - anything beyond
+   that is just 0. */
 bbi_chunk *bbi_and_inplace(bbi_chunk *list_a, bbi_chunk *list_b) {
-    list_a = bbi_pad_first(list_a, list_b);
-    list_b = _find_right(list_b);
-    while (list_a->left != NULL && list_b->left != NULL) {
-        list_a->val &= list_b->val;
-        list_a = list_a->left;
-        list_b = list_b->left;
+    unsigned int len_a = list_a->len;
+    unsigned int len_b = list_b->len;
+    BBI_STAT_SCOPE(BBI_STAT_AND, len_a + len_b);
+
+    if (_bbi_both_small(list_a, list_b)) {
+        list_a->limbs[0] &= list_b->limbs[0];
+        return list_a;
+    }
+    if (_bbi_any_negative(list_a, list_b)) {
+        return _bbi_bitop_signed(list_a, list_b, BBI_OP_AND);
+    }
+    _bbi_bitop_n(_bbi_and_n, list_a->limbs, list_a->limbs, list_b->limbs, len_a < len_b ? len_a : len_b);
+    if (len_a > len_b) {
+        memset(&list_a->limbs[len_b], 0, (len_a - len_b) * sizeof(bbi_limb));
+    } else if (len_b > len_a) {
+        bbi_extend(list_a, len_b - len_a);
     }
-    /* TODO optimization: if list lengths were originally unequal, just copy 0 values, since x&0 == 0 - 
-       similar for bbi_or_inplace(), bbi_xor_inplace() */
-    list_a->val &= list_b->val;     
-    return _find_right(list_a);
+    list_a->sign = 0;
+    return list_a;
 }
 
 bbi_chunk *bbi_and(bbi_chunk *list_a, bbi_chunk *list_b) {
@@ -330,17 +592,37 @@ bbi_chunk *bbi_and(bbi_chunk *list_a, bbi_chunk *list_b) {
     return bbi_and_inplace(result, list_b);
 }
 
+/* Pad list_a to the length of list_b by copying list_b's extra chunks, since x|0 == x^0 == x -
+   shared by bbi_or_inplace() and bbi_xor_inplace(). Returns the number of chunks both had. */
+static unsigned int _bbi_pad_copy(bbi_chunk *list_a, bbi_chunk *list_b) {
+    unsigned int len_a = list_a->len;
+    unsigned int len_b = list_b->len;
+
+    list_a->sign = 0;
+    if (len_a >= len_b) {
+        return len_b;
+    }
+    _bbi_reserve(list_a, len_b);
+    memcpy(&list_a->limbs[len_a], &list_b->limbs[len_a], (len_b - len_a) * sizeof(bbi_limb));
+    list_a->len = len_b;
+    return len_a;
+}
+
 /* Bitwise OR two values, calling semantics as bbi_and_inplace(). */
 bbi_chunk *bbi_or_inplace(bbi_chunk *list_a, bbi_chunk *list_b) {
-    list_a = bbi_pad_first(list_a, list_b);
-    list_b = _find_right(list_b);
-    while (list_a->left != NULL && list_b->left != NULL) {
-        list_a->val |= list_b->val;
-        list_a = list_a->left;
-        list_b = list_b->left;
+    unsigned int n;
+    BBI_STAT_SCOPE(BBI_STAT_OR, list_a->len + list_b->len);
+
+    if (_bbi_both_small(list_a, list_b)) {
+        list_a->limbs[0] |= list_b->limbs[0];
+        return list_a;
+    }
+    if (_bbi_any_negative(list_a, list_b)) {
+        return _bbi_bitop_signed(list_a, list_b, BBI_OP_OR);
     }
-    list_a->val |= list_b->val;
-    return _find_right(list_a);
+    n = _bbi_pad_copy(list_a, list_b);
+    _bbi_bitop_n(_bbi_or_n, list_a->limbs, list_a->limbs, list_b->limbs, n);
+    return list_a;
 }
 
 bbi_chunk *bbi_or(bbi_chunk *list_a, bbi_chunk *list_b) {
@@ -348,19 +630,20 @@ bbi_chunk *bbi_or(bbi_chunk *list_a, bbi_chunk *list_b) {
     return bbi_or_inplace(result, list_b);
 }
 
-/* These now have identical structure apart from the operation used. This is a prime example
-   of where generic types should be used, but C doesn't have them */
 bbi_chunk *bbi_xor_inplace(bbi_chunk *list_a, bbi_chunk *list_b) {
-    list_a = bbi_pad_first(list_a, list_b);
-    list_b = _find_right(list_b);
-    while (list_a->left != NULL && list_b->left != NULL) {
-        list_a->val ^= list_b->val;
-        list_a = list_a->left;
-        list_b = list_b->left;
-    }
-    list_a->val ^= list_b->val;
-    return _find_right(list_a);
+    unsigned int n;
+    BBI_STAT_SCOPE(BBI_STAT_XOR, list_a->len + list_b->len);
 
+    if (_bbi_both_small(list_a, list_b)) {
+        list_a->limbs[0] ^= list_b->limbs[0];
+        return list_a;
+    }
+    if (_bbi_any_negative(list_a, list_b)) {
+        return _bbi_bitop_signed(list_a, list_b, BBI_OP_XOR);
+    }
+    n = _bbi_pad_copy(list_a, list_b);
+    _bbi_bitop_n(_bbi_xor_n, list_a->limbs, list_a->limbs, list_b->limbs, n);
+    return list_a;
 }
 
 bbi_chunk *bbi_xor(bbi_chunk *list_a, bbi_chunk *list_b) {
@@ -368,43 +651,242 @@ bbi_chunk *bbi_xor(bbi_chunk *list_a, bbi_chunk *list_b) {
     return bbi_xor_inplace(result, list_b);
 }
 
+/* The bit accessors below read and write a negative value as its infinite two's complement, as
+   the bitwise operations do: bit i of -m is bit i of ~(m - 1). Chunk i of that is 0 below the
+   lowest non-zero chunk z of m (where the borrow of the - 1 is still running), -m[z] at z, ~m[i]
+   above it and all 1 bits past the top. Writes count chunks of it from chunk first into rp, for a
+   list with n chunks after normalizing. */
+static void _bbi_twos_chunks(bbi_limb *rp, const bbi_chunk *list, unsigned int n, unsigned int first,
+                             unsigned int count) {
+    unsigned int z = 0;
+    unsigned int i;
+
+    while (list->limbs[z] == 0) {
+        z++;
+    }
+    for (i = first; i < first + count; i++) {
+        rp[i - first] = i >= n ? ~(bbi_limb) 0 : i < z ? 0 : i == z ? -list->limbs[i] : ~list->limbs[i];
+    }
+}
+
 /* Get the bit with index bitidx from a chunk list. Bit index 0 is the
-   rightmost (least significant) bit, to the left is bit index 1, and so on. */
+   rightmost (least significant) bit, to the left is bit index 1, and so on. The containing chunk
+   is indexed directly. A negative value reads as two's complement, so bits past its top are 1. */
 unsigned int bbi_get_bit(bbi_chunk *list, unsigned int bitidx) {
-    unsigned int chunkbitsize = sizeof(unsigned int) * 8;   /* TODO 8-bit byte assumption */
-    unsigned int i;
+    unsigned int chunkbitsize = sizeof(bbi_limb) * 8;   /* TODO 8-bit byte assumption */
     unsigned int containing_chunk;
     unsigned int mask = 1;
-    unsigned int tmpval;
+    bbi_limb tmpval;
 
-    /* Find chunk with bit requested - chunk 0 is chunk with least
-       significant bit. */
-    containing_chunk = bitidx / chunkbitsize;
-    i = 0;
-    while (list->left != NULL && i != containing_chunk) { 
-        list = list->left;
-        i++;
+    if (list->sign) {
+        return (unsigned int) bbi_get_bits(list, bitidx, 1);
     }
-    if (i != containing_chunk) {
+    /* Chunk 0 is chunk with least significant bit. */
+    containing_chunk = bitidx / chunkbitsize;
+    if (containing_chunk >= list->len) {
         /* Requested a non-stored bit index - implicitly 0 */
         return 0;
     }
     /* Get the desired bit in this chunk */
     bitidx %= chunkbitsize;
-    tmpval = list->val;
+    tmpval = list->limbs[containing_chunk];
     tmpval >>= bitidx;
     return tmpval & mask;
 }
 
+/* Get nbits (1 to BBI_LIMB_BITS) bits starting at index bitidx as one value, for scanning a value
+   a window at a time rather than a bit at a time. Bits past the stored chunks are 0, or 1 for a
+   negative value, which reads as two's complement. */
+bbi_limb bbi_get_bits(bbi_chunk *list, unsigned int bitidx, unsigned int nbits) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    bbi_limb window[2];
+
+    if (!list->sign || n == 0) {
+        return _bbi_get_bits(list->limbs, list->len, bitidx, nbits);
+    }
+    /* The window covers at most the chunk bitidx is in and the one above it */
+    _bbi_twos_chunks(window, list, n, bitidx / BBI_LIMB_BITS, 2);
+    return _bbi_get_bits(window, 2, bitidx % BBI_LIMB_BITS, nbits);
+}
+
+/* Set (val 1) or clear (val 0) the bit with index bitidx, extending the list if it's past the top.
+   For a negative value it's the two's complement bit: as ~x == -x-1, that's the opposite bit of the
+   magnitude less one, so the magnitude goes down by one, has the bit flipped the other way, and goes
+   back up. The value stays negative. */
+bbi_chunk *bbi_set_bit(bbi_chunk *list, unsigned int bitidx, unsigned int val) {
+    unsigned int i = bitidx / BBI_LIMB_BITS;
+    bbi_limb mask = (bbi_limb) 1 << (bitidx % BBI_LIMB_BITS);
+    int neg = list->sign && _bbi_normalized_len(list->limbs, list->len) > 0;
+    bbi_limb carry;
+
+    if (neg) {
+        _bbi_sub_1(list->limbs, list->limbs, list->len, 1);
+        val = !val;
+    }
+    if (i >= list->len && val) {
+        bbi_extend(list, i + 1 - list->len);
+    }
+    if (i < list->len) {
+        if (val) {
+            list->limbs[i] |= mask;
+        } else {
+            list->limbs[i] &= ~mask;
+        }
+    }
+    if (neg) {
+        carry = _bbi_add_1(list->limbs, list->limbs, list->len, 1);
+        if (carry) {
+            bbi_extend(list, 1);
+            *_find_left(list) = carry;
+        }
+    }
+    list->sign = neg;
+    return list;
+}
+
+/* The len bits starting at index start, as a new non-negative value. A negative value's bits are
+   its two's complement, as bbi_get_bits(). */
+bbi_chunk *bbi_extract_bits(bbi_chunk *list, unsigned int start, unsigned int len) {
+    unsigned int n = (len + BBI_LIMB_BITS - 1) / BBI_LIMB_BITS;
+    unsigned int first = start / BBI_LIMB_BITS;
+    unsigned int ln = _bbi_normalized_len(list->limbs, list->len);
+    int neg = list->sign && ln > 0;
+    const bbi_limb *src;
+    unsigned int avail;
+    bbi_chunk *result;
+    bbi_limb *tmp = NULL;
+
+    if (len == 0 || (first >= list->len && !neg)) {
+        return bbi_create();
+    }
+    result = bbi_create_nchunks(n);
+    /* One chunk more than needed (when there is one) covers the bits shifted down into the top. A
+       negative value always has one, and its chunks are made up as they're needed. */
+    avail = neg || list->len - first >= n + 1 ? n + 1 : list->len - first;
+    if (neg || start % BBI_LIMB_BITS != 0) {
+        tmp = _bbi_alloc(avail * sizeof(bbi_limb));
+    }
+    if (neg) {
+        _bbi_twos_chunks(tmp, list, ln, first, avail);
+        src = tmp;
+    } else {
+        src = &list->limbs[first];
+    }
+    if (start % BBI_LIMB_BITS != 0) {
+        _bbi_rshift(tmp, src, avail, start % BBI_LIMB_BITS);
+        src = tmp;
+    }
+    memcpy(result->limbs, src, (avail < n ? avail : n) * sizeof(bbi_limb));
+    if (tmp != NULL) {
+        _bbi_free(tmp, avail * sizeof(bbi_limb));
+    }
+    if (len % BBI_LIMB_BITS != 0) {
+        result->limbs[n - 1] &= ((bbi_limb) 1 << (len % BBI_LIMB_BITS)) - 1;
+    }
+    return result;
+}
+
+/* Number of bits needed to write the magnitude out, 0 for 0 */
+unsigned int bbi_bit_length(bbi_chunk *list) {
+    return _bbi_bit_length_n(list->limbs, list->len);
+}
+
+/* Number of 1 bits in the magnitude */
+unsigned int bbi_popcount(bbi_chunk *list) {
+    return _bbi_popcount_n(list->limbs, list->len);
+}
+
+/* Index of the lowest 1 bit, ~0 for 0 */
+unsigned int bbi_ctz(bbi_chunk *list) {
+    return _bbi_ctz_n(list->limbs, list->len);
+}
+
+/* Shift left by cnt bits: whole chunks move up with memmove, and the rest of the shift is one pass
+   of _bbi_lshift() in place */
+bbi_chunk *bbi_shl_inplace(bbi_chunk *list, unsigned int cnt) {
+    unsigned int nlimbs = cnt / BBI_LIMB_BITS;
+    unsigned int bits = cnt % BBI_LIMB_BITS;
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    bbi_limb out;
+    BBI_STAT_SCOPE(BBI_STAT_SHL, list->len);
+
+    if (n == 0) {
+        return list;
+    }
+    _bbi_reserve(list, n + nlimbs + 1);
+    if (bits != 0) {
+        out = _bbi_lshift(&list->limbs[nlimbs], list->limbs, n, bits);
+        list->limbs[n + nlimbs] = out;
+        list->len = n + nlimbs + (out != 0);
+    } else {
+        memmove(&list->limbs[nlimbs], list->limbs, n * sizeof(bbi_limb));
+        list->len = n + nlimbs;
+    }
+    memset(list->limbs, 0, nlimbs * sizeof(bbi_limb));
+    return list;
+}
+
+bbi_chunk *bbi_shl(bbi_chunk *list, unsigned int cnt) {
+    bbi_chunk *result = bbi_copy(list);
+    return bbi_shl_inplace(result, cnt);
+}
+
+/* Shift right by cnt bits, the mirror image of bbi_shl_inplace(). Like >> on two's complement
+   this rounds toward -infinity, so a negative value whose shifted-out bits aren't all 0 has one added
+   to its magnitude: -5 >> 1 == -3. */
+bbi_chunk *bbi_shr_inplace(bbi_chunk *list, unsigned int cnt) {
+    unsigned int nlimbs = cnt / BBI_LIMB_BITS;
+    unsigned int bits = cnt % BBI_LIMB_BITS;
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    int round = 0;
+    unsigned int i;
+    BBI_STAT_SCOPE(BBI_STAT_SHR, list->len);
+
+    if (list->sign && n > 0) {
+        for (i = 0; i < nlimbs && i < n && !round; i++) {
+            round = list->limbs[i] != 0;
+        }
+        if (!round && nlimbs < n && bits != 0) {
+            round = (list->limbs[nlimbs] & (((bbi_limb) 1 << bits) - 1)) != 0;
+        }
+    }
+    if (nlimbs >= n) {
+        list->limbs[0] = round;
+        list->len = 1;
+        list->sign = round;
+        return list;
+    }
+    n -= nlimbs;
+    if (bits != 0) {
+        _bbi_rshift(list->limbs, &list->limbs[nlimbs], n, bits);
+    } else {
+        memmove(list->limbs, &list->limbs[nlimbs], n * sizeof(bbi_limb));
+    }
+    list->len = _bbi_normalized_len(list->limbs, n);
+    if (list->len == 0) {
+        list->limbs[0] = 0;
+        list->len = 1;
+        if (!round) {
+            list->sign = 0;
+        }
+    }
+    if (round && _bbi_add_1(list->limbs, list->limbs, list->len, 1)) {
+        bbi_extend(list, 1);
+        *_find_left(list) = 1;
+    }
+    return list;
+}
+
+bbi_chunk *bbi_shr(bbi_chunk *list, unsigned int cnt) {
+    bbi_chunk *result = bbi_copy(list);
+    return bbi_shr_inplace(result, cnt);
+}
+
 /*
 int main() {
     bbi_chunk *list = bbi_create();
     bbi_extend(list, 9);
-    while (list->right != NULL) {
-        list = list->right;
-    }
-    list = list->left;
-    list->val = 4000000000;
+    list->limbs[1] = 4000000000;
     bbi_dump_binary(list);
     bbi_destroy(list);
 }
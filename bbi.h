@@ -1,36 +1,317 @@
 #ifndef BBI_H
 #define BBI_H
 
-/* TODO optimization, maybe, after benchmarking: store chunks in a structure with better cache locality - 
-   contiguously allocated like an array, with sizing chosen to only reallocate, on average, a small
-   percentage of the time (see Java HashMap for example of efficient realloc).
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Chunk ("limb") width in bits. Defaults to the widest integer the platform does native arithmetic
+   in, so each add-with-carry step covers as many bits as possible. Build with -DBBI_LIMB_BITS=32 to
+   get the narrower chunks (e.g. to compare against them in bbi_bench). */
+#ifndef BBI_LIMB_BITS
+#if UINTPTR_MAX > 0xffffffffu && defined(__SIZEOF_INT128__)
+#define BBI_LIMB_BITS 64
+#else
+#define BBI_LIMB_BITS 32
+#endif
+#endif
+
+/* A bigint is stored as a contiguous array of chunks ("limbs"), least-significant chunk first, so
+   every operation is a linear scan over memory rather than a walk over per-chunk nodes.
+
+   The struct is a header for the chunk array, and keeps everything that used to need a walk of the
+   list: len is the number of chunks in use, cap the number allocated, and sign is 1 for a negative
+   value (the chunks always hold the magnitude - sign and magnitude, not two's complement, though
+   the bitwise operations act as if it were two's complement; see bbi.c). Zero is never negative.
+   Every list-management function keeps these current, so the count and both endpoints are
+   constant-time lookups. flags records where the memory came from (see bbi_alloc.c).
+
+   The array grows geometrically (doubling, as Java's HashMap does) so that repeated bbi_extend() calls
+   only reallocate, on average, a small percentage of the time.
+
+   Values of up to BBI_INLINE_LIMBS chunks - most of the numbers real programs deal with - keep their
+   chunks in the header itself (limbs points at inline_limbs, and BBI_FLAG_INLINE is set), so creating
+   one costs no allocation beyond the header and using one touches a single cache line. Growing past
+   that moves the chunks out to the heap. Since limbs may point into the header, a bbi_chunk must never
+   be copied or moved by value - use bbi_copy(). */
+/* bbi_dlimb holds the full product of two chunks */
+#if BBI_LIMB_BITS == 64
+typedef uint64_t bbi_limb;
+typedef unsigned __int128 bbi_dlimb;
+#elif BBI_LIMB_BITS == 32
+typedef uint32_t bbi_limb;
+typedef uint64_t bbi_dlimb;
+#else
+#error "BBI_LIMB_BITS must be 32 or 64"
+#endif
+
+/* Chunks held inline in the header. Two covers 128 bits with 64-bit chunks; build with
+   -DBBI_INLINE_LIMBS=0 to always put the chunks on the heap (e.g. to compare in bbi_bench). */
+#ifndef BBI_INLINE_LIMBS
+#define BBI_INLINE_LIMBS 2
+#endif
 
-   The current list-based version is likely more memory-efficient - chunk lists are only extended as needed,
-   but it's possibly slower. */
 struct bbi_chunk {
-    unsigned int val;
-    struct bbi_chunk *left;
-    struct bbi_chunk *right;
+    bbi_limb *limbs;
+    unsigned int len;
+    unsigned int cap;
+    int sign;
+    unsigned int flags;
+#if BBI_INLINE_LIMBS > 0
+    bbi_limb inline_limbs[BBI_INLINE_LIMBS];
+#endif
 };
 typedef struct bbi_chunk bbi_chunk;
 
+/* Header and chunks live in the thread's arena - freed by bbi_arena_reset(), not bbi_destroy() */
+#define BBI_FLAG_ARENA 1
+/* limbs points at inline_limbs, not a separate allocation */
+#define BBI_FLAG_INLINE 2
+/* limbs points into a caller's buffer, which is neither written nor freed - see bbi_view() */
+#define BBI_FLAG_VIEW 4
+
 /* Chunk list management functions */
 bbi_chunk *_bbi_chunk_create();
+void _bbi_reserve(bbi_chunk *list, unsigned int nchunks);
 bbi_chunk *bbi_create();
 bbi_chunk *bbi_create_nchunks(unsigned int nchunks);
-unsigned int _bbi_count_chunks(bbi_chunk *list);
 bbi_chunk *bbi_extend(bbi_chunk *list, unsigned int nchunks);
 bbi_chunk *bbi_pad_first(bbi_chunk *list_a, bbi_chunk *list_b);
 void bbi_pad_both(bbi_chunk *list_a, bbi_chunk *list_b);
 bbi_chunk *bbi_copy(bbi_chunk *list);
 void bbi_destroy(bbi_chunk *list);
 
+/* Memory management */
+void bbi_set_allocator(void *(*alloc)(size_t),
+                       void *(*realloc_fn)(void *, size_t, size_t),
+                       void (*free_fn)(void *, size_t));
+void bbi_arena_begin();
+void bbi_arena_end();
+void bbi_arena_reset();
+void bbi_free_cache();
+void *_bbi_alloc(size_t size);
+void *_bbi_realloc(void *ptr, size_t old_size, size_t new_size);
+void _bbi_free(void *ptr, size_t size);
+bbi_chunk *_bbi_alloc_chunks(unsigned int cap);
+void _bbi_realloc_chunks(bbi_chunk *list, unsigned int newcap);
+void _bbi_free_chunks(bbi_chunk *list);
+
 /* Arithmetic */
 bbi_chunk *bbi_add_inplace(bbi_chunk *list_a, bbi_chunk *list_b);
 bbi_chunk *bbi_add(bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_sub_inplace(bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_sub(bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_mul_inplace(bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_mul(bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_sqr(bbi_chunk *list);
+
+/* Division, rounding towards zero - see bbi_div.c. These return NULL when dividing by 0. */
+bbi_chunk *bbi_divmod(bbi_chunk *list_a, bbi_chunk *list_b, bbi_chunk **rem);
+bbi_chunk *bbi_div(bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_mod(bbi_chunk *list_a, bbi_chunk *list_b);
+
+/* A divisor prepared for dividing many values by it: normalized, with the reciprocal of its top
+   chunk worked out */
+typedef struct bbi_divisor {
+    bbi_limb *limbs;    /* The divisor shifted left by shift, so the top bit is set */
+    unsigned int len;
+    unsigned int shift;
+    bbi_limb inv;       /* _bbi_invert_limb(limbs[len - 1]) */
+    int sign;
+} bbi_divisor;
+
+bbi_divisor *bbi_divisor_create(bbi_chunk *list);
+void bbi_divisor_destroy(bbi_divisor *div);
+bbi_chunk *bbi_divmod_pre(bbi_chunk *list_a, const bbi_divisor *div, bbi_chunk **rem);
+
+/* Modular arithmetic with an odd modulus N of len chunks, for values in Montgomery form aR mod N
+   where R = 2^(len*BBI_LIMB_BITS) - see bbi_mont.c */
+typedef struct bbi_mont_ctx {
+    bbi_limb *mod;      /* N */
+    bbi_limb *one;      /* R mod N, 1 in Montgomery form */
+    bbi_limb *r2;       /* R^2 mod N, for converting into Montgomery form */
+    unsigned int len;
+    bbi_limb ninv;      /* -1/N mod 2^BBI_LIMB_BITS */
+} bbi_mont_ctx;
+
+bbi_mont_ctx *bbi_mont_ctx_create(bbi_chunk *list);
+void bbi_mont_ctx_destroy(bbi_mont_ctx *ctx);
+bbi_chunk *bbi_mont_to(const bbi_mont_ctx *ctx, bbi_chunk *list);
+bbi_chunk *bbi_mont_from(const bbi_mont_ctx *ctx, bbi_chunk *list);
+bbi_chunk *bbi_mont_mul(const bbi_mont_ctx *ctx, bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_mont_sqr(const bbi_mont_ctx *ctx, bbi_chunk *list);
+
+/* Modular exponentiation. BBI_POWMOD_CONSTTIME makes the time taken independent of the
+   exponent's value (for secret exponents). */
+#define BBI_POWMOD_CONSTTIME 1
+bbi_chunk *bbi_powmod_ctx(const bbi_mont_ctx *ctx, bbi_chunk *base, bbi_chunk *exp, unsigned int flags);
+bbi_chunk *bbi_powmod(bbi_chunk *base, bbi_chunk *exp, bbi_chunk *mod);
+
+/* GCD and modular inverse - see bbi_gcd.c. bbi_invert() returns NULL if there's no inverse. */
+bbi_chunk *bbi_gcd(bbi_chunk *list_a, bbi_chunk *list_b);
+bbi_chunk *bbi_gcdext(bbi_chunk *list_a, bbi_chunk *list_b, bbi_chunk **s, bbi_chunk **t);
+bbi_chunk *bbi_invert(bbi_chunk *list_a, bbi_chunk *list_m);
+bbi_limb _bbi_gcd_1(bbi_limb a, bbi_limb b);
+
+/* Roots and perfect powers - see bbi_root.c. bbi_sqrtrem() and bbi_root() return NULL where there's
+   no real root (a negative value, or k = 0), and store the remainder in *rem unless rem is NULL.
+   _bbi_sqrtrem() writes the (nn+1)/2 chunk root of nn chunks to sp and the remainder to rp (if not
+   NULL), returning the remainder's normalized length. */
+bbi_chunk *bbi_sqrtrem(bbi_chunk *list, bbi_chunk **rem);
+bbi_chunk *bbi_root(bbi_chunk *list, unsigned int k, bbi_chunk **rem);
+int bbi_is_square(bbi_chunk *list);
+int bbi_is_perfect_power(bbi_chunk *list);
+unsigned int _bbi_sqrtrem(bbi_limb *sp, bbi_limb *rp, const bbi_limb *np, unsigned int nn);
+
+/* Arithmetic on raw chunk arrays, least-significant chunk first. rp may be the same array as ap or bp.
+   The _n versions work on n chunks of each operand, the _1 versions add/subtract a single chunk b
+   into n chunks of ap. All return the carry (or borrow) out of the top chunk. */
+bbi_limb _bbi_add_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+bbi_limb _bbi_add_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b);
+bbi_limb _bbi_sub_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+bbi_limb _bbi_sub_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b);
+unsigned int _bbi_normalized_len(const bbi_limb *ap, unsigned int n);
+int _bbi_cmp(const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn);
+
+/* Multiplication on raw chunk arrays. _bbi_mul_1() sets rp = ap * b and _bbi_addmul_1() does
+   rp += ap * b, both over n chunks, returning the chunk carried out of the top. _bbi_mul() writes
+   the an+bn chunk product to rp, which must not overlap either operand. */
+bbi_limb _bbi_mul_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b);
+bbi_limb _bbi_addmul_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b);
+void _bbi_mul_basecase(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn);
+void _bbi_mul(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn);
+bbi_limb _bbi_submul_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b);
+void _bbi_sqr_basecase(bbi_limb *rp, const bbi_limb *ap, unsigned int n);
+void _bbi_sqr(bbi_limb *rp, const bbi_limb *ap, unsigned int n);
+
+/* Number-theoretic transform multiplication for very large operands - see bbi_ntt.c. _bbi_mul()
+   picks it by size; it can be called directly for products of at most _bbi_mul_ntt_max() chunks
+   (bp == ap squares). */
+void _bbi_mul_ntt(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn);
+size_t _bbi_mul_ntt_max();
+void _bbi_ntt_free_cache();
+
+/* Crossover points between algorithms - see bbi_tune.h */
+extern unsigned int _bbi_mul_karatsuba_threshold;
+extern unsigned int _bbi_mul_toom3_threshold;
+extern unsigned int _bbi_sqr_karatsuba_threshold;
+extern unsigned int _bbi_sqr_toom3_threshold;
+extern unsigned int _bbi_mul_ntt_threshold;
+extern unsigned int _bbi_sqr_ntt_threshold;
+extern unsigned int _bbi_div_dc_threshold;
+extern unsigned int _bbi_fromdec_dc_threshold;
+extern unsigned int _bbi_todec_dc_threshold;
+extern unsigned int _bbi_gcd_dc_threshold;
+extern unsigned int _bbi_hgcd_threshold;
+
+/* Division on raw chunk arrays. _bbi_divrem_1() divides n chunks of ap by d, writing the quotient to
+   qp and returning the remainder. _bbi_divrem() divides nn chunks of np by dn chunks of dp (whose top
+   chunk must be non-zero, and nn >= dn), writing nn-dn+1 quotient chunks to qp and dn remainder
+   chunks to rp. */
+bbi_limb _bbi_divrem_1(bbi_limb *qp, const bbi_limb *ap, unsigned int n, bbi_limb d);
+void _bbi_divexact_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb d);
+bbi_limb _bbi_mod_1(const bbi_limb *ap, unsigned int n, bbi_limb d);
+void _bbi_divrem(bbi_limb *qp, bbi_limb *rp, const bbi_limb *np, unsigned int nn, const bbi_limb *dp, unsigned int dn);
+
+/* The same with the divisor already normalized (shifted left by shift so its top bit is set) and
+   dinv = _bbi_invert_limb() of its top chunk. qp or rp can be NULL if that part isn't wanted. */
+bbi_limb _bbi_invert_limb(bbi_limb d);
+bbi_limb _bbi_divrem_1_preinv(bbi_limb *qp, const bbi_limb *ap, unsigned int n, bbi_limb dnorm,
+                              unsigned int shift, bbi_limb dinv);
+void _bbi_divrem_preinv(bbi_limb *qp, bbi_limb *rp, const bbi_limb *np, unsigned int nn,
+                        const bbi_limb *vn, unsigned int dn, unsigned int shift, bbi_limb dinv);
+
+/* Montgomery reduction and multiplication on ctx->len chunk arrays. tp is 2*len chunks of scratch
+   (the reduction's input, which it overwrites). ct selects the constant-time versions. */
+void _bbi_mont_redc(bbi_limb *rp, bbi_limb *tp, const bbi_mont_ctx *ctx, int ct);
+void _bbi_mont_mul(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, const bbi_mont_ctx *ctx,
+                   bbi_limb *tp, int ct);
+
+/* Shift n chunks of ap left or right by 0 < cnt < BBI_LIMB_BITS bits into rp (which may be ap),
+   returning the bits shifted out, at the bottom (left shift) or top (right shift) of the chunk. */
+bbi_limb _bbi_lshift(bbi_limb *rp, const bbi_limb *ap, unsigned int n, unsigned int cnt);
+bbi_limb _bbi_rshift(bbi_limb *rp, const bbi_limb *ap, unsigned int n, unsigned int cnt);
+
+/* Bitwise operations on raw chunk arrays, rp[i] = ap[i] OP bp[i] for n chunks. rp may be ap or bp.
+   These use the widest vector instructions the CPU has (see bbi_kernel.c). */
+void _bbi_and_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+void _bbi_or_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+void _bbi_xor_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+void _bbi_not_n(bbi_limb *rp, const bbi_limb *ap, unsigned int n);
+/* rp[i] = ap[i] + bp[i] + cp[i] lane by lane, leaving each lane's carry out in cp[i] */
+void _bbi_add_lanes_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, bbi_limb *cp, unsigned int n);
+
+/* Bit counts over n chunks, using popcnt/lzcnt/tzcnt when the CPU has them. _bbi_bit_length_n() is
+   0 and _bbi_ctz_n() is ~0 for the value 0. */
+unsigned int _bbi_popcount_n(const bbi_limb *ap, unsigned int n);
+unsigned int _bbi_bit_length_n(const bbi_limb *ap, unsigned int n);
+unsigned int _bbi_ctz_n(const bbi_limb *ap, unsigned int n);
+
+/* CPU features the kernels can use */
+#define BBI_CPU_SSE2 1
+#define BBI_CPU_AVX2 2
+#define BBI_CPU_AVX512 4
+#define BBI_CPU_POPCNT 8
+#define BBI_CPU_LZCNT 16
+#define BBI_CPU_BMI 32
+unsigned int _bbi_cpu_features();
+void _bbi_cpu_restrict(unsigned int mask);
+
+/* Number of leading 0 bits in a non-zero chunk */
+static inline unsigned int _bbi_limb_clz(bbi_limb x) {
+#if BBI_LIMB_BITS == 64
+    return __builtin_clzll(x);
+#else
+    return __builtin_clz(x);
+#endif
+}
+
+/* Number of trailing 0 bits in a non-zero chunk */
+static inline unsigned int _bbi_limb_ctz(bbi_limb x) {
+#if BBI_LIMB_BITS == 64
+    return __builtin_ctzll(x);
+#else
+    return __builtin_ctz(x);
+#endif
+}
 
 /* Loading values */
 bbi_chunk *bbi_fromstring_dec(const unsigned char *s);
+bbi_chunk *bbi_fromstring_dec_n(const unsigned char *s, size_t len);
+void _bbi_conv_free_cache();
+
+/* Formatting values */
+size_t bbi_tostring_dec(bbi_chunk *list, char *buf, size_t bufsize);
+size_t bbi_tostring_hex(bbi_chunk *list, char *buf, size_t bufsize);
+
+/* Streaming conversion in base 10 or 16, for values too long to handle as one string - see
+   bbi_conv.c. A parser is fed the input in pieces, and bbi_format() hands the output to write() in
+   pieces. */
+typedef struct bbi_parser bbi_parser;
+typedef int (*bbi_write_fn)(void *ctx, const char *s, size_t len);
+bbi_parser *bbi_parser_create(unsigned int base);
+int bbi_parser_feed(bbi_parser *p, const char *s, size_t len);
+bbi_chunk *bbi_parser_finish(bbi_parser *p);
+bbi_chunk *bbi_fromfile(FILE *f, unsigned int base);
+int bbi_format(bbi_chunk *list, unsigned int base, bbi_write_fn write, void *ctx);
+int bbi_format_file(bbi_chunk *list, unsigned int base, FILE *f);
+
+/* Binary import/export and the wire format - see bbi_bytes.c. Word order and byte order are given
+   as for GMP's mpz_import/mpz_export. */
+#define BBI_ORDER_MSW_FIRST 1
+#define BBI_ORDER_LSW_FIRST -1
+#define BBI_ENDIAN_BIG 1
+#define BBI_ENDIAN_LITTLE -1
+#define BBI_ENDIAN_NATIVE 0
+bbi_chunk *bbi_import_bytes(const void *data, size_t count, int order, size_t size, int endian);
+size_t bbi_export_bytes(bbi_chunk *list, void *buf, size_t bufsize, int order, size_t size, int endian);
+size_t bbi_serialize(bbi_chunk *list, unsigned char *buf, size_t bufsize);
+bbi_chunk *bbi_deserialize(const unsigned char *buf, size_t len, size_t *used);
+bbi_chunk *bbi_view(const void *buf, size_t nbytes);
 
 /* Bitwise operations */
 bbi_chunk *bbi_not(bbi_chunk *list);
@@ -45,13 +326,173 @@ bbi_chunk *bbi_or_inplace(bbi_chunk *list_a, bbi_chunk *list_b);
 bbi_chunk *bbi_xor(bbi_chunk *list_a, bbi_chunk *list_b);
 bbi_chunk *bbi_xor_inplace(bbi_chunk *list_a, bbi_chunk *list_b);
 
+/* Single bits and bit fields. A negative value reads and writes as its infinite two's complement,
+   like the operations above (as GMP's mpz_tstbit() and mpz_setbit() do); the bit counts are of the
+   magnitude. */
 unsigned int bbi_get_bit(bbi_chunk *list, unsigned int bitidx);
+bbi_limb bbi_get_bits(bbi_chunk *list, unsigned int bitidx, unsigned int nbits);
+bbi_chunk *bbi_set_bit(bbi_chunk *list, unsigned int bitidx, unsigned int val);
+bbi_chunk *bbi_extract_bits(bbi_chunk *list, unsigned int start, unsigned int len);
+unsigned int bbi_bit_length(bbi_chunk *list);
+unsigned int bbi_popcount(bbi_chunk *list);
+unsigned int bbi_ctz(bbi_chunk *list);
+
+/* Shifts, by whole chunks plus one pass for the bits left over */
+bbi_chunk *bbi_shl(bbi_chunk *list, unsigned int cnt);
+bbi_chunk *bbi_shl_inplace(bbi_chunk *list, unsigned int cnt);
+bbi_chunk *bbi_shr(bbi_chunk *list, unsigned int cnt);
+bbi_chunk *bbi_shr_inplace(bbi_chunk *list, unsigned int cnt);
+
+/* Threads - see bbi_pool.c for what's safe to share. Large operations can be split across a pool
+   of worker threads started with bbi_threads_init(). */
+int bbi_threads_init(unsigned int nthreads);
+void bbi_threads_shutdown();
+unsigned int bbi_threads();
+void _bbi_par_run(void (*fn)(void *arg, unsigned int i), void *arg, unsigned int ntasks);
+extern unsigned int _bbi_par_bitwise_threshold;
+extern unsigned int _bbi_par_mul_threshold;
+extern unsigned int _bbi_par_conv_threshold;
+
+/* Batches of non-negative values, stored a chunk of each value per row so operations run across
+   values - see bbi_batch.c */
+typedef struct bbi_batch {
+    bbi_limb *limbs;        /* Chunk i of value j is limbs[i * count + j] */
+    unsigned int count;
+    unsigned int len;
+} bbi_batch;
+
+bbi_batch *bbi_batch_create(unsigned int count, unsigned int len);
+void bbi_batch_destroy(bbi_batch *batch);
+bbi_batch *bbi_batch_load(bbi_chunk **values, unsigned int count);
+void bbi_batch_store(const bbi_batch *batch, bbi_chunk **out);
+bbi_batch *bbi_batch_and(bbi_batch *batch_a, const bbi_batch *batch_b);
+bbi_batch *bbi_batch_or(bbi_batch *batch_a, const bbi_batch *batch_b);
+bbi_batch *bbi_batch_xor(bbi_batch *batch_a, const bbi_batch *batch_b);
+bbi_batch *bbi_batch_add(bbi_batch *batch_a, const bbi_batch *batch_b);
+bbi_batch *bbi_batch_and_all(bbi_batch *batch, bbi_chunk *list);
+bbi_batch *bbi_batch_or_all(bbi_batch *batch, bbi_chunk *list);
+bbi_batch *bbi_batch_xor_all(bbi_batch *batch, bbi_chunk *list);
+bbi_batch *bbi_batch_add_all(bbi_batch *batch, bbi_chunk *list);
+bbi_batch *bbi_batch_mod(bbi_batch *batch, const bbi_divisor *div);
+bbi_chunk **bbi_and_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count);
+bbi_chunk **bbi_or_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count);
+bbi_chunk **bbi_xor_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count);
+bbi_chunk **bbi_add_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count);
+bbi_chunk **bbi_mod_array(bbi_chunk **out, bbi_chunk **values, const bbi_divisor *div, unsigned int count);
+
+/* Deferred expressions of bitwise operations, additions and subtractions, evaluated in a single pass
+   without intermediate values - see bbi_expr.c. Each call adds a node and returns its number, for
+   use as an operand of later ones, or -1 if an operand isn't a node of the expression. An expression
+   keeps its scratch space between evaluations, so one thread at a time may evaluate it. */
+typedef struct bbi_expr bbi_expr;
+
+bbi_expr *bbi_expr_create();
+void bbi_expr_destroy(bbi_expr *e);
+void bbi_expr_reset(bbi_expr *e);
+int bbi_expr_value(bbi_expr *e, bbi_chunk *list);
+int bbi_expr_not(bbi_expr *e, int x);
+int bbi_expr_and(bbi_expr *e, int x, int y);
+int bbi_expr_or(bbi_expr *e, int x, int y);
+int bbi_expr_xor(bbi_expr *e, int x, int y);
+int bbi_expr_add(bbi_expr *e, int x, int y);
+int bbi_expr_sub(bbi_expr *e, int x, int y);
+bbi_chunk *bbi_expr_eval(bbi_expr *e, int root, bbi_chunk *dst);
+
+/* Instrumentation - see bbi_stats.c. Counting is compiled in by building the library with
+   -DBBI_STATS; the BBI_STAT_* indexes name the operations in the per-function arrays. Allocating
+   wrappers count as the in-place operation plus a copy, e.g. bbi_add() is one copy and one add. */
+enum {
+    BBI_STAT_CREATE, BBI_STAT_EXTEND, BBI_STAT_COPY, BBI_STAT_DESTROY, BBI_STAT_ADD, BBI_STAT_SUB,
+    BBI_STAT_MUL, BBI_STAT_SQR, BBI_STAT_DIVMOD, BBI_STAT_NOT, BBI_STAT_AND, BBI_STAT_OR, BBI_STAT_XOR,
+    BBI_STAT_SHL, BBI_STAT_SHR, BBI_STAT_POWMOD, BBI_STAT_FROMSTRING, BBI_STAT_TOSTRING, BBI_STAT_GCD,
+    BBI_STAT_ROOT, BBI_STAT_EXPR,
+    BBI_STAT_NFUNCS
+};
+
+typedef struct bbi_stats {
+    uint64_t calls[BBI_STAT_NFUNCS];
+    uint64_t limbs[BBI_STAT_NFUNCS];    /* Operand chunks passed in */
+    uint64_t cycles[BBI_STAT_NFUNCS];   /* rdtsc ticks (ns off x86), including nested calls */
+    uint64_t headers_alloc;             /* Bigint headers handed out and given back */
+    uint64_t headers_free;
+    uint64_t allocs;                    /* Calls to the allocation functions, and bytes asked for */
+    uint64_t reallocs;
+    uint64_t frees;
+    uint64_t bytes_alloc;
+    uint64_t grows;                     /* Chunk arrays moved to a bigger allocation */
+    uint64_t pads;                      /* bbi_pad_first()/bbi_pad_both() calls that had to extend */
+} bbi_stats;
+
+void bbi_stats_snapshot(bbi_stats *out);
+void bbi_stats_reset();
+const char *bbi_stats_name(unsigned int fn);
+
+/* Hooks. BBI_STAT_SCOPE() goes after a function's declarations and counts the call, its operand
+   chunks, and the cycles until it returns. */
+#ifdef BBI_STATS
+#ifdef __cplusplus
+extern thread_local bbi_stats _bbi_stats;
+#else
+extern _Thread_local bbi_stats _bbi_stats;
+#endif
+struct _bbi_stat_scope {
+    unsigned int fn;
+    uint64_t t0;
+};
+struct _bbi_stat_scope _bbi_stat_begin(unsigned int fn, uint64_t nlimbs);
+void _bbi_stat_end(struct _bbi_stat_scope *scope);
+#define BBI_STAT_SCOPE(fn, nlimbs) \
+    struct _bbi_stat_scope _bbi_stat_scope __attribute__((cleanup(_bbi_stat_end))) = \
+        _bbi_stat_begin(fn, nlimbs)
+#define BBI_STAT_COUNT(field, n) (_bbi_stats.field += (n))
+#else
+#define BBI_STAT_SCOPE(fn, nlimbs)
+#define BBI_STAT_COUNT(field, n) ((void) 0)
+#endif
 
 /* Helper */
 void _bbi_dump_binary_val(unsigned char *buf, unsigned int val);
 void bbi_dump_binary(bbi_chunk *list);
-bbi_chunk *_find_left(bbi_chunk *list);
-bbi_chunk *_find_right(bbi_chunk *list);
+
+/* Header lookups, inline since they're used by nearly every operation. Chunk index 0 is the
+   rightmost (least-significant) chunk, index len-1 the leftmost (most-significant). */
+static inline unsigned int _bbi_count_chunks(const bbi_chunk *list) {
+    return list->len;
+}
+
+/* Get the leftmost chunk (Most-Significant Bit) of a chunk list */
+static inline bbi_limb *_find_left(const bbi_chunk *list) {
+    return &list->limbs[list->len - 1];
+}
+
+/* Get the rightmost chunk (Least-Significant Bit) of a chunk list */
+static inline bbi_limb *_find_right(const bbi_chunk *list) {
+    return &list->limbs[0];
+}
+
+/* nbits (1 to BBI_LIMB_BITS) bits of n chunks of ap, starting at bit index bitidx. At most two
+   chunks are read; bits past the top one are 0. */
+static inline bbi_limb _bbi_get_bits(const bbi_limb *ap, unsigned int n, unsigned int bitidx, unsigned int nbits) {
+    unsigned int i = bitidx / BBI_LIMB_BITS;
+    unsigned int shift = bitidx % BBI_LIMB_BITS;
+    bbi_limb val;
+
+    if (i >= n) {
+        return 0;
+    }
+    val = ap[i] >> shift;
+    if (shift != 0 && shift + nbits > BBI_LIMB_BITS && i + 1 < n) {
+        val |= ap[i + 1] << (BBI_LIMB_BITS - shift);
+    }
+    if (nbits < BBI_LIMB_BITS) {
+        val &= ((bbi_limb) 1 << nbits) - 1;
+    }
+    return val;
+}
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
 
@@ -0,0 +1,737 @@
+/*
+ * C++ interface: bbi::BigInt, a value type over a bbi_chunk. Header-only - link against the C
+ * library as usual.
+ *
+ * A BigInt owns one bbi_chunk and destroys it when it goes out of scope. The chunk is only ever
+ * held by pointer (a bbi_chunk can't be moved by value, since its limbs may point into it - see
+ * bbi.h), so moving a BigInt just hands the pointer over and never touches the chunks. A moved-from
+ * BigInt holds nothing and may only be assigned to or destroyed.
+ *
+ * The compound operators (+=, &=, <<= ...) are the *_inplace functions, which grow the left
+ * operand's chunks only past their capacity. The binary operators copy the left operand and then
+ * do the same, except when an operand is an rvalue: a + b * c reuses the product's chunks for the
+ * sum, and std::move(x) ^ y reuses x's, so a chain of operations allocates once rather than once
+ * per step. Copy assignment likewise copies into the chunks already held when they're big enough.
+ *
+ * Errors the C functions report with NULL become exceptions: std::domain_error for a zero divisor,
+ * a negative square root and the like, std::invalid_argument for a string that isn't a number.
+ *
+ * bbi::UInt<Bits> (C++14 and up) is the fixed-width counterpart, for 256-, 512-, 1024-bit values
+ * and the like: the chunks live in the object, and the arithmetic wraps as unsigned types do.
+ */
+
+#ifndef BBI_HPP
+#define BBI_HPP
+
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "bbi.h"
+
+namespace bbi {
+
+class BigInt {
+public:
+    BigInt() : p_(bbi_create()) {}
+
+    /* Any built-in integer type */
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    BigInt(T v) : p_(bbi_create()) {
+        bool neg = std::is_signed<T>::value && v < T(0);
+        unsigned long long mag = neg ? 0ull - (unsigned long long) v : (unsigned long long) v;
+        unsigned int n = 0;
+
+        _bbi_reserve(p_, sizeof(mag) / sizeof(bbi_limb));
+        p_->limbs[0] = 0;
+        while (mag != 0) {
+            p_->limbs[n++] = (bbi_limb) mag;
+            /* In two steps, since shifting by the whole width of mag is undefined */
+            mag >>= BBI_LIMB_BITS / 2;
+            mag >>= BBI_LIMB_BITS / 2;
+        }
+        p_->len = n > 0 ? n : 1;
+        p_->sign = neg;
+    }
+
+    /* Parse an optional '-' and digits in base 10 or 16 (no "0x"), as bbi_parser_feed() */
+    explicit BigInt(const std::string &s, unsigned int base = 10) : p_(parse(s, base)) {}
+    explicit BigInt(const char *s, unsigned int base = 10) : p_(parse(s, base)) {}
+
+    BigInt(const BigInt &other) : p_(bbi_copy(other.p_)) {}
+    BigInt(BigInt &&other) noexcept : p_(other.p_) {
+        other.p_ = nullptr;
+    }
+
+    ~BigInt() {
+        if (p_ != nullptr) {
+            bbi_destroy(p_);
+        }
+    }
+
+    /* Into the chunks already held, if there are enough of them */
+    BigInt &operator=(const BigInt &other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (p_ == nullptr) {
+            p_ = bbi_copy(other.p_);
+            return *this;
+        }
+        _bbi_reserve(p_, other.p_->len);
+        std::memcpy(p_->limbs, other.p_->limbs, other.p_->len * sizeof(bbi_limb));
+        p_->len = other.p_->len;
+        p_->sign = other.p_->sign;
+        return *this;
+    }
+
+    /* Swapped rather than freed, so other's destructor frees what this held */
+    BigInt &operator=(BigInt &&other) noexcept {
+        std::swap(p_, other.p_);
+        return *this;
+    }
+
+    /* Take ownership of a value from the C interface. Throws std::domain_error for NULL, so the
+       result of a C function that can fail can be passed straight in. */
+    static BigInt adopt(bbi_chunk *list) {
+        if (list == nullptr) {
+            throw std::domain_error("bbi: no result");
+        }
+        return BigInt(list, adopt_tag());
+    }
+
+    /* For calling the C interface directly: get() keeps ownership, release() gives it up */
+    bbi_chunk *get() const {
+        return p_;
+    }
+    bbi_chunk *release() {
+        bbi_chunk *list = p_;
+
+        p_ = nullptr;
+        return list;
+    }
+
+    void swap(BigInt &other) noexcept {
+        std::swap(p_, other.p_);
+    }
+
+    BigInt &operator+=(const BigInt &b) {
+        bbi_add_inplace(p_, b.p_);
+        return *this;
+    }
+    BigInt &operator-=(const BigInt &b) {
+        bbi_sub_inplace(p_, b.p_);
+        return *this;
+    }
+    BigInt &operator*=(const BigInt &b) {
+        bbi_mul_inplace(p_, b.p_);
+        return *this;
+    }
+    BigInt &operator&=(const BigInt &b) {
+        bbi_and_inplace(p_, b.p_);
+        return *this;
+    }
+    BigInt &operator|=(const BigInt &b) {
+        bbi_or_inplace(p_, b.p_);
+        return *this;
+    }
+    BigInt &operator^=(const BigInt &b) {
+        bbi_xor_inplace(p_, b.p_);
+        return *this;
+    }
+    BigInt &operator<<=(unsigned int cnt) {
+        bbi_shl_inplace(p_, cnt);
+        return *this;
+    }
+    BigInt &operator>>=(unsigned int cnt) {
+        bbi_shr_inplace(p_, cnt);
+        return *this;
+    }
+
+    /* Rounding towards zero, as bbi_divmod(). There's no division in place, so these replace the
+       chunks. */
+    BigInt &operator/=(const BigInt &b) {
+        *this = adopt(bbi_div(p_, b.p_));
+        return *this;
+    }
+    BigInt &operator%=(const BigInt &b) {
+        *this = adopt(bbi_mod(p_, b.p_));
+        return *this;
+    }
+
+    BigInt &negate() {
+        if (!is_zero()) {
+            p_->sign ^= 1;
+        }
+        return *this;
+    }
+    BigInt &complement() {
+        bbi_not_inplace(p_);
+        return *this;
+    }
+
+    bool is_zero() const {
+        return _bbi_normalized_len(p_->limbs, p_->len) == 0;
+    }
+    bool is_negative() const {
+        return p_->sign != 0;
+    }
+    explicit operator bool() const {
+        return !is_zero();
+    }
+    unsigned int bit_length() const {
+        return bbi_bit_length(p_);
+    }
+    unsigned int popcount() const {
+        return bbi_popcount(p_);
+    }
+    /* Two's complement for a negative value, as the bitwise operators */
+    bool bit(unsigned int bitidx) const {
+        return bbi_get_bit(p_, bitidx) != 0;
+    }
+
+    /* -1, 0 or 1 as this is less than, equal to or greater than b */
+    int compare(const BigInt &b) const {
+        int c;
+
+        if (p_->sign != b.p_->sign) {
+            return p_->sign ? -1 : 1;
+        }
+        c = _bbi_cmp(p_->limbs, p_->len, b.p_->limbs, b.p_->len);
+        return p_->sign ? -c : c;
+    }
+
+    /* Base 10 or 16 */
+    std::string to_string(unsigned int base = 10) const {
+        size_t (*fn)(bbi_chunk *, char *, size_t) = base == 16 ? bbi_tostring_hex : bbi_tostring_dec;
+        std::string s(fn(p_, nullptr, 0), '\0');
+
+        s.resize(fn(p_, &s[0], s.size()));
+        return s;
+    }
+
+private:
+    struct adopt_tag {};
+
+    BigInt(bbi_chunk *list, adopt_tag) : p_(list) {}
+
+    static bbi_chunk *parse(const std::string &s, unsigned int base) {
+        bbi_parser *p = bbi_parser_create(base);
+        bbi_chunk *list;
+
+        if (p == nullptr) {
+            throw std::invalid_argument("bbi: base must be 10 or 16");
+        }
+        bbi_parser_feed(p, s.data(), s.size());
+        list = bbi_parser_finish(p);
+        if (list == nullptr) {
+            throw std::invalid_argument("bbi: not a number: " + s);
+        }
+        return list;
+    }
+
+    bbi_chunk *p_;
+};
+
+inline void swap(BigInt &a, BigInt &b) noexcept {
+    a.swap(b);
+}
+
+/* Binary operators. Each takes whichever operand is an rvalue as its result, so its chunks are
+   reused; with neither, the left one is copied. */
+#define BBI_HPP_COMMUTATIVE(op)                                              \
+    inline BigInt operator op(const BigInt &a, const BigInt &b) {            \
+        BigInt r(a);                                                         \
+        r op##= b;                                                           \
+        return r;                                                            \
+    }                                                                        \
+    inline BigInt operator op(BigInt &&a, const BigInt &b) {                 \
+        a op##= b;                                                           \
+        return std::move(a);                                                 \
+    }                                                                        \
+    inline BigInt operator op(const BigInt &a, BigInt &&b) {                 \
+        b op##= a;                                                           \
+        return std::move(b);                                                 \
+    }                                                                        \
+    inline BigInt operator op(BigInt &&a, BigInt &&b) {                      \
+        a op##= b;                                                           \
+        return std::move(a);                                                 \
+    }
+
+BBI_HPP_COMMUTATIVE(+)
+BBI_HPP_COMMUTATIVE(*)
+BBI_HPP_COMMUTATIVE(&)
+BBI_HPP_COMMUTATIVE(|)
+BBI_HPP_COMMUTATIVE(^)
+#undef BBI_HPP_COMMUTATIVE
+
+inline BigInt operator-(const BigInt &a, const BigInt &b) {
+    BigInt r(a);
+    r -= b;
+    return r;
+}
+inline BigInt operator-(BigInt &&a, const BigInt &b) {
+    a -= b;
+    return std::move(a);
+}
+/* a - b as -(b - a), in b's chunks */
+inline BigInt operator-(const BigInt &a, BigInt &&b) {
+    b -= a;
+    b.negate();
+    return std::move(b);
+}
+inline BigInt operator-(BigInt &&a, BigInt &&b) {
+    a -= b;
+    return std::move(a);
+}
+
+inline BigInt operator/(const BigInt &a, const BigInt &b) {
+    return BigInt::adopt(bbi_div(a.get(), b.get()));
+}
+inline BigInt operator%(const BigInt &a, const BigInt &b) {
+    return BigInt::adopt(bbi_mod(a.get(), b.get()));
+}
+inline BigInt operator<<(BigInt a, unsigned int cnt) {
+    a <<= cnt;
+    return a;
+}
+inline BigInt operator>>(BigInt a, unsigned int cnt) {
+    a >>= cnt;
+    return a;
+}
+inline BigInt operator-(BigInt a) {
+    a.negate();
+    return a;
+}
+inline BigInt operator~(BigInt a) {
+    a.complement();
+    return a;
+}
+
+inline bool operator==(const BigInt &a, const BigInt &b) {
+    return a.compare(b) == 0;
+}
+inline bool operator!=(const BigInt &a, const BigInt &b) {
+    return a.compare(b) != 0;
+}
+inline bool operator<(const BigInt &a, const BigInt &b) {
+    return a.compare(b) < 0;
+}
+inline bool operator<=(const BigInt &a, const BigInt &b) {
+    return a.compare(b) <= 0;
+}
+inline bool operator>(const BigInt &a, const BigInt &b) {
+    return a.compare(b) > 0;
+}
+inline bool operator>=(const BigInt &a, const BigInt &b) {
+    return a.compare(b) >= 0;
+}
+
+inline std::ostream &operator<<(std::ostream &os, const BigInt &a) {
+    return os << a.to_string(os.flags() & std::ios_base::hex ? 16 : 10);
+}
+
+inline BigInt gcd(const BigInt &a, const BigInt &b) {
+    return BigInt::adopt(bbi_gcd(a.get(), b.get()));
+}
+
+/* floor(sqrt(a)); throws std::domain_error for negative a */
+inline BigInt sqrt(const BigInt &a) {
+    return BigInt::adopt(bbi_sqrtrem(a.get(), nullptr));
+}
+
+/* base^exp mod |mod|; throws std::domain_error for a 0 modulus or a negative exponent */
+inline BigInt powmod(const BigInt &base, const BigInt &exp, const BigInt &mod) {
+    return BigInt::adopt(bbi_powmod(base.get(), exp.get(), mod.get()));
+}
+
+
+#if __cplusplus >= 201402L
+
+namespace detail {
+
+/* True when the code is running rather than being evaluated by the compiler for a constant. Without
+   a way to tell (before C++20 and without the builtin) it's false, and everything stays in the
+   constexpr loops. */
+constexpr bool at_runtime() {
+#if defined(__cpp_lib_is_constant_evaluated)
+    return !std::is_constant_evaluated();
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+    return !__builtin_is_constant_evaluated();
+#else
+    return false;
+#endif
+#else
+    return false;
+#endif
+}
+
+}
+
+/* Chunk counts from which UInt calls the kernels at run time. Below them the unrolled loops are
+   faster: for a few chunks the kernels' call and CPU dispatch cost more than the work. */
+#ifndef BBI_UINT_KERNEL_LIMBS
+#define BBI_UINT_KERNEL_LIMBS 32
+#endif
+#ifndef BBI_UINT_MUL_KERNEL_LIMBS
+#define BBI_UINT_MUL_KERNEL_LIMBS 8
+#endif
+
+/* An unsigned integer of exactly Bits bits (a whole number of chunks), with the chunks in the
+   object itself and arithmetic modulo 2^Bits, as for the built-in unsigned types. With the chunk
+   count fixed the loops unroll and nothing is allocated or length-checked. At run time, from the
+   sizes above, the operations call the same kernels as the dynamic type; in a constant expression
+   they're always plain loops, so everything except division is constexpr. Converts explicitly to
+   and from BigInt. */
+template <unsigned int Bits>
+class UInt {
+    static_assert(Bits > 0 && Bits % BBI_LIMB_BITS == 0, "bbi::UInt needs a whole number of chunks");
+
+public:
+    static constexpr unsigned int nlimbs = Bits / BBI_LIMB_BITS;
+
+    /* Least-significant chunk first, as in a bbi_chunk */
+    bbi_limb limbs[nlimbs];
+
+    constexpr UInt() : limbs() {}
+
+    /* Built-in integers wrap modulo 2^Bits, as converting to an unsigned type does */
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    constexpr UInt(T v) : limbs() {
+        unsigned long long u = (unsigned long long) v;
+        bbi_limb fill = std::is_signed<T>::value && v < T(0) ? ~(bbi_limb) 0 : 0;
+
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            limbs[i] = i < sizeof(u) / sizeof(bbi_limb) ? (bbi_limb) u : fill;
+            /* In two steps, since shifting by the whole width of u is undefined */
+            u >>= BBI_LIMB_BITS / 2;
+            u >>= BBI_LIMB_BITS / 2;
+        }
+    }
+
+    /* From another width, truncated or zero-extended */
+    template <unsigned int OtherBits>
+    constexpr explicit UInt(const UInt<OtherBits> &other) : limbs() {
+        for (unsigned int i = 0; i < nlimbs && i < UInt<OtherBits>::nlimbs; i++) {
+            limbs[i] = other.limbs[i];
+        }
+    }
+
+    /* The low Bits bits of b, in two's complement if it's negative */
+    explicit UInt(const BigInt &b) : limbs() {
+        const bbi_chunk *list = b.get();
+
+        std::memcpy(limbs, list->limbs, (list->len < nlimbs ? list->len : nlimbs) * sizeof(bbi_limb));
+        if (list->sign) {
+            *this = -*this;
+        }
+    }
+
+    explicit operator BigInt() const {
+        bbi_chunk *list = bbi_create_nchunks(nlimbs);
+        unsigned int n = _bbi_normalized_len(limbs, nlimbs);
+
+        std::memcpy(list->limbs, limbs, sizeof(limbs));
+        list->len = n > 0 ? n : 1;
+        return BigInt::adopt(list);
+    }
+
+    std::string to_string(unsigned int base = 10) const {
+        return BigInt(*this).to_string(base);
+    }
+
+    constexpr bool is_zero() const {
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            if (limbs[i] != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    constexpr explicit operator bool() const {
+        return !is_zero();
+    }
+    constexpr bool bit(unsigned int bitidx) const {
+        return bitidx < Bits && (limbs[bitidx / BBI_LIMB_BITS] >> (bitidx % BBI_LIMB_BITS)) & 1;
+    }
+
+    constexpr UInt &operator+=(const UInt &b) {
+        bbi_limb c = 0;
+
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_add_n(limbs, limbs, b.limbs, nlimbs);
+            return *this;
+        }
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            bbi_limb s = limbs[i] + c;
+
+            c = s < c;
+            limbs[i] = s + b.limbs[i];
+            c += limbs[i] < s;
+        }
+        return *this;
+    }
+
+    constexpr UInt &operator-=(const UInt &b) {
+        bbi_limb c = 0;
+
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_sub_n(limbs, limbs, b.limbs, nlimbs);
+            return *this;
+        }
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            bbi_limb s = limbs[i] - c;
+
+            c = limbs[i] < c;
+            c += s < b.limbs[i];
+            limbs[i] = s - b.limbs[i];
+        }
+        return *this;
+    }
+
+    /* Only the low half of the product: row i contributes to chunks i and up */
+    constexpr UInt &operator*=(const UInt &b) {
+        bbi_limb r[nlimbs] = {};
+
+        if (nlimbs >= BBI_UINT_MUL_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_mul_1(r, limbs, nlimbs, b.limbs[0]);
+            for (unsigned int i = 1; i < nlimbs; i++) {
+                _bbi_addmul_1(&r[i], limbs, nlimbs - i, b.limbs[i]);
+            }
+        } else {
+            for (unsigned int i = 0; i < nlimbs; i++) {
+                bbi_limb c = 0;
+
+                for (unsigned int j = 0; i + j < nlimbs; j++) {
+                    bbi_dlimb t = (bbi_dlimb) limbs[j] * b.limbs[i] + r[i + j] + c;
+
+                    r[i + j] = (bbi_limb) t;
+                    c = (bbi_limb) (t >> BBI_LIMB_BITS);
+                }
+            }
+        }
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            limbs[i] = r[i];
+        }
+        return *this;
+    }
+
+    constexpr UInt &operator&=(const UInt &b) {
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_and_n(limbs, limbs, b.limbs, nlimbs);
+            return *this;
+        }
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            limbs[i] &= b.limbs[i];
+        }
+        return *this;
+    }
+
+    constexpr UInt &operator|=(const UInt &b) {
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_or_n(limbs, limbs, b.limbs, nlimbs);
+            return *this;
+        }
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            limbs[i] |= b.limbs[i];
+        }
+        return *this;
+    }
+
+    constexpr UInt &operator^=(const UInt &b) {
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_xor_n(limbs, limbs, b.limbs, nlimbs);
+            return *this;
+        }
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            limbs[i] ^= b.limbs[i];
+        }
+        return *this;
+    }
+
+    /* Whole chunks move first, then the bits left over go through the shift kernel */
+    constexpr UInt &operator<<=(unsigned int cnt) {
+        unsigned int w = cnt / BBI_LIMB_BITS;
+        unsigned int s = cnt % BBI_LIMB_BITS;
+
+        for (unsigned int i = nlimbs; i > 0; i--) {
+            limbs[i - 1] = i - 1 >= w ? limbs[i - 1 - w] : 0;
+        }
+        if (s == 0 || w >= nlimbs) {
+            return *this;
+        }
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_lshift(&limbs[w], &limbs[w], nlimbs - w, s);
+            return *this;
+        }
+        for (unsigned int i = nlimbs - 1; i > w; i--) {
+            limbs[i] = (limbs[i] << s) | (limbs[i - 1] >> (BBI_LIMB_BITS - s));
+        }
+        limbs[w] <<= s;
+        return *this;
+    }
+
+    constexpr UInt &operator>>=(unsigned int cnt) {
+        unsigned int w = cnt / BBI_LIMB_BITS;
+        unsigned int s = cnt % BBI_LIMB_BITS;
+
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            limbs[i] = w < nlimbs - i ? limbs[i + w] : 0;
+        }
+        if (s == 0 || w >= nlimbs) {
+            return *this;
+        }
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_rshift(limbs, limbs, nlimbs - w, s);
+            return *this;
+        }
+        for (unsigned int i = 0; i + 1 < nlimbs - w; i++) {
+            limbs[i] = (limbs[i] >> s) | (limbs[i + 1] << (BBI_LIMB_BITS - s));
+        }
+        limbs[nlimbs - w - 1] >>= s;
+        return *this;
+    }
+
+    /* Division isn't constexpr: it goes through the dynamic type's division kernels. Throws
+       std::domain_error for a zero divisor. */
+    static void divmod(const UInt &a, const UInt &b, UInt &q, UInt &r) {
+        UInt n(a);
+        UInt d(b);
+        unsigned int nn = _bbi_normalized_len(a.limbs, nlimbs);
+        unsigned int dn = _bbi_normalized_len(b.limbs, nlimbs);
+
+        if (dn == 0) {
+            throw std::domain_error("bbi: division by zero");
+        }
+        q = UInt();
+        r = UInt();
+        if (nn < dn) {
+            r = n;
+        } else if (dn == 1) {
+            r.limbs[0] = _bbi_divrem_1(q.limbs, n.limbs, nn, d.limbs[0]);
+        } else {
+            _bbi_divrem(q.limbs, r.limbs, n.limbs, nn, d.limbs, dn);
+        }
+    }
+    UInt &operator/=(const UInt &b) {
+        UInt r;
+
+        divmod(*this, b, *this, r);
+        return *this;
+    }
+    UInt &operator%=(const UInt &b) {
+        UInt q;
+
+        divmod(*this, b, q, *this);
+        return *this;
+    }
+
+    friend constexpr UInt operator+(UInt a, const UInt &b) {
+        return a += b;
+    }
+    friend constexpr UInt operator-(UInt a, const UInt &b) {
+        return a -= b;
+    }
+    friend constexpr UInt operator*(UInt a, const UInt &b) {
+        return a *= b;
+    }
+    friend constexpr UInt operator&(UInt a, const UInt &b) {
+        return a &= b;
+    }
+    friend constexpr UInt operator|(UInt a, const UInt &b) {
+        return a |= b;
+    }
+    friend constexpr UInt operator^(UInt a, const UInt &b) {
+        return a ^= b;
+    }
+    friend constexpr UInt operator<<(UInt a, unsigned int cnt) {
+        return a <<= cnt;
+    }
+    friend constexpr UInt operator>>(UInt a, unsigned int cnt) {
+        return a >>= cnt;
+    }
+    friend UInt operator/(UInt a, const UInt &b) {
+        return a /= b;
+    }
+    friend UInt operator%(UInt a, const UInt &b) {
+        return a %= b;
+    }
+
+    friend constexpr UInt operator~(UInt a) {
+        if (nlimbs >= BBI_UINT_KERNEL_LIMBS && detail::at_runtime()) {
+            _bbi_not_n(a.limbs, a.limbs, nlimbs);
+            return a;
+        }
+        for (unsigned int i = 0; i < nlimbs; i++) {
+            a.limbs[i] = ~a.limbs[i];
+        }
+        return a;
+    }
+    friend constexpr UInt operator-(const UInt &a) {
+        return ~a + UInt(1);
+    }
+
+    /* -1, 0 or 1 as a is less than, equal to or greater than b */
+    friend constexpr int compare(const UInt &a, const UInt &b) {
+        for (unsigned int i = nlimbs; i > 0; i--) {
+            if (a.limbs[i - 1] != b.limbs[i - 1]) {
+                return a.limbs[i - 1] < b.limbs[i - 1] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+    friend constexpr bool operator==(const UInt &a, const UInt &b) {
+        return compare(a, b) == 0;
+    }
+    friend constexpr bool operator!=(const UInt &a, const UInt &b) {
+        return compare(a, b) != 0;
+    }
+    friend constexpr bool operator<(const UInt &a, const UInt &b) {
+        return compare(a, b) < 0;
+    }
+    friend constexpr bool operator<=(const UInt &a, const UInt &b) {
+        return compare(a, b) <= 0;
+    }
+    friend constexpr bool operator>(const UInt &a, const UInt &b) {
+        return compare(a, b) > 0;
+    }
+    friend constexpr bool operator>=(const UInt &a, const UInt &b) {
+        return compare(a, b) >= 0;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const UInt &a) {
+        return os << BigInt(a);
+    }
+};
+
+/* The full 2*Bits-bit product */
+template <unsigned int Bits>
+constexpr UInt<2 * Bits> mul_wide(const UInt<Bits> &a, const UInt<Bits> &b) {
+    UInt<2 * Bits> r;
+
+    if (UInt<Bits>::nlimbs >= BBI_UINT_MUL_KERNEL_LIMBS && detail::at_runtime()) {
+        _bbi_mul(r.limbs, a.limbs, UInt<Bits>::nlimbs, b.limbs, UInt<Bits>::nlimbs);
+        return r;
+    }
+    for (unsigned int i = 0; i < UInt<Bits>::nlimbs; i++) {
+        bbi_limb c = 0;
+
+        for (unsigned int j = 0; j < UInt<Bits>::nlimbs; j++) {
+            bbi_dlimb t = (bbi_dlimb) a.limbs[j] * b.limbs[i] + r.limbs[i + j] + c;
+
+            r.limbs[i + j] = (bbi_limb) t;
+            c = (bbi_limb) (t >> BBI_LIMB_BITS);
+        }
+        r.limbs[i + UInt<Bits>::nlimbs] = c;
+    }
+    return r;
+}
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Memory management for bigints.
+ *
+ * All memory goes through a replaceable set of allocation functions (bbi_set_allocator()), which
+ * default to malloc/realloc/free. On top of that, each thread has:
+ * - a slab of free bigint headers, so short-lived temporaries don't each cost a malloc/free pair
+ *   for the header
+ * - an optional arena: between bbi_arena_begin() and bbi_arena_end(), every bigint created on the
+ *   thread is bump-allocated from large blocks, bbi_destroy() on it does nothing, and
+ *   bbi_arena_reset() throws away all of them at once
+ * Values small enough for the header's inline chunks need no chunk allocation at all, so with a
+ * warm slab creating and destroying one never calls the allocator.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bbi.h"
+
+/* Arena blocks are at least this big - larger requests get a block of their own size */
+#define BBI_ARENA_BLOCK_SIZE (64 * 1024)
+/* Keep at most this many free headers per thread */
+#define BBI_SLAB_MAX 256
+/* Arena allocations are rounded to this size and offset from the start of their block, which comes
+   from the allocator functions and so is only as aligned as they make it (malloc: 16 bytes). Each
+   allocation is therefore aligned for any chunk type, and to 64 bytes only if the block is. */
+#define BBI_ARENA_ALIGN 64
+
+static void *_bbi_default_alloc(size_t size) {
+    return malloc(size);
+}
+
+static void *_bbi_default_realloc(void *ptr, size_t old_size, size_t new_size) {
+    (void) old_size;
+    return realloc(ptr, new_size);
+}
+
+static void _bbi_default_free(void *ptr, size_t size) {
+    (void) size;
+    free(ptr);
+}
+
+static void *(*alloc_func)(size_t) = _bbi_default_alloc;
+static void *(*realloc_func)(void *, size_t, size_t) = _bbi_default_realloc;
+static void (*free_func)(void *, size_t) = _bbi_default_free;
+
+struct bbi_arena_block {
+    struct bbi_arena_block *next;
+    size_t size;
+    size_t used;
+    /* data follows, at a multiple of BBI_ARENA_ALIGN from the start of the block */
+};
+
+/* Per-thread state. Nothing here is shared between threads, so none of it needs locking. */
+static _Thread_local struct bbi_arena_block *arena_head = NULL;
+static _Thread_local unsigned int arena_depth = 0;
+static _Thread_local bbi_chunk *slab_head = NULL;
+static _Thread_local unsigned int slab_count = 0;
+
+/* Replace the functions used for all memory allocation. Like the GMP equivalent, realloc and free
+   are passed the size of the existing block. Pass NULL for any of them to restore the default.
+   Must be called before any bigints exist, and before any thread has used the arena. */
+void bbi_set_allocator(void *(*alloc)(size_t),
+                       void *(*realloc_fn)(void *, size_t, size_t),
+                       void (*free_fn)(void *, size_t)) {
+    bbi_free_cache();
+    alloc_func = alloc != NULL ? alloc : _bbi_default_alloc;
+    realloc_func = realloc_fn != NULL ? realloc_fn : _bbi_default_realloc;
+    free_func = free_fn != NULL ? free_fn : _bbi_default_free;
+}
+
+void *_bbi_alloc(size_t size) {
+    void *ptr = alloc_func(size);
+    BBI_STAT_COUNT(allocs, 1);
+    BBI_STAT_COUNT(bytes_alloc, size);
+    assert(ptr != NULL);
+    return ptr;
+}
+
+void *_bbi_realloc(void *ptr, size_t old_size, size_t new_size) {
+    ptr = realloc_func(ptr, old_size, new_size);
+    BBI_STAT_COUNT(reallocs, 1);
+    BBI_STAT_COUNT(bytes_alloc, new_size > old_size ? new_size - old_size : 0);
+    assert(ptr != NULL);
+    return ptr;
+}
+
+void _bbi_free(void *ptr, size_t size) {
+    BBI_STAT_COUNT(frees, 1);
+    free_func(ptr, size);
+}
+
+static size_t _bbi_arena_header_size() {
+    return (sizeof(struct bbi_arena_block) + BBI_ARENA_ALIGN - 1) & ~(size_t) (BBI_ARENA_ALIGN - 1);
+}
+
+/* Bump-allocate from the thread's current arena block, starting a new block if it's full */
+static void *_bbi_arena_alloc(size_t size) {
+    struct bbi_arena_block *block = arena_head;
+    size_t header = _bbi_arena_header_size();
+    size_t blocksize;
+    void *ptr;
+
+    size = (size + BBI_ARENA_ALIGN - 1) & ~(size_t) (BBI_ARENA_ALIGN - 1);
+    if (block == NULL || block->size - block->used < size) {
+        blocksize = size > BBI_ARENA_BLOCK_SIZE ? size : BBI_ARENA_BLOCK_SIZE;
+        block = _bbi_alloc(header + blocksize);
+        block->size = blocksize;
+        block->used = 0;
+        block->next = arena_head;
+        arena_head = block;
+    }
+    ptr = (char *) block + header + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/* Start allocating this thread's bigints from its arena. Calls nest. */
+void bbi_arena_begin() {
+    arena_depth++;
+}
+
+/* Go back to allocating this thread's bigints individually. Bigints already in the arena stay
+   valid until bbi_arena_reset(). */
+void bbi_arena_end() {
+    assert(arena_depth > 0);
+    arena_depth--;
+}
+
+/* Free every bigint allocated in this thread's arena in one go. Keeps the most recent block for
+   reuse, so a loop of begin/compute/reset settles down to no allocator calls at all. */
+void bbi_arena_reset() {
+    struct bbi_arena_block *block;
+    struct bbi_arena_block *next;
+
+    if (arena_head == NULL) {
+        return;
+    }
+    for (block = arena_head->next; block != NULL; block = next) {
+        next = block->next;
+        _bbi_free(block, _bbi_arena_header_size() + block->size);
+    }
+    arena_head->next = NULL;
+    arena_head->used = 0;
+}
+
+/* Release memory this thread is holding on to for reuse: free headers, arena blocks and cached
+   tables. Any bigints still in the arena become invalid. */
+void bbi_free_cache() {
+    bbi_chunk *list;
+
+    _bbi_conv_free_cache();
+    _bbi_ntt_free_cache();
+    bbi_arena_reset();
+    if (arena_head != NULL) {
+        _bbi_free(arena_head, _bbi_arena_header_size() + arena_head->size);
+        arena_head = NULL;
+    }
+    while (slab_head != NULL) {
+        list = slab_head;
+        slab_head = (bbi_chunk *) list->limbs;
+        _bbi_free(list, sizeof(bbi_chunk));
+    }
+    slab_count = 0;
+}
+
+/* Allocate a bigint header with room for cap chunks (contents uninitialised). Up to
+   BBI_INLINE_LIMBS chunks live in the header itself. Otherwise, in arena mode the header and chunks
+   come from one bump allocation, and outside it the header comes from the slab. */
+bbi_chunk *_bbi_alloc_chunks(unsigned int cap) {
+    bbi_chunk *list;
+
+    assert(cap > 0);
+    BBI_STAT_COUNT(headers_alloc, 1);
+    if (arena_depth > 0) {
+        if (cap <= BBI_INLINE_LIMBS) {
+            list = _bbi_arena_alloc(sizeof(bbi_chunk));
+        } else {
+            list = _bbi_arena_alloc(sizeof(bbi_chunk) + cap * sizeof(bbi_limb));
+            list->limbs = (bbi_limb *) (list + 1);
+        }
+        list->flags = BBI_FLAG_ARENA;
+    } else {
+        if (slab_head != NULL) {
+            list = slab_head;
+            slab_head = (bbi_chunk *) list->limbs;
+            slab_count--;
+        } else {
+            list = _bbi_alloc(sizeof(bbi_chunk));
+        }
+        if (cap > BBI_INLINE_LIMBS) {
+            list->limbs = _bbi_alloc(cap * sizeof(bbi_limb));
+        }
+        list->flags = 0;
+    }
+#if BBI_INLINE_LIMBS > 0
+    if (cap <= BBI_INLINE_LIMBS) {
+        list->limbs = list->inline_limbs;
+        list->flags |= BBI_FLAG_INLINE;
+        cap = BBI_INLINE_LIMBS;
+    }
+#endif
+    list->cap = cap;
+    return list;
+}
+
+/* Grow the chunk array to newcap chunks, keeping its contents */
+void _bbi_realloc_chunks(bbi_chunk *list, unsigned int newcap) {
+    bbi_limb *limbs;
+
+    BBI_STAT_COUNT(grows, 1);
+    if (list->flags & (BBI_FLAG_ARENA | BBI_FLAG_INLINE | BBI_FLAG_VIEW)) {
+        /* An arena run is left behind until the arena is reset; inline chunks stay unused, and a
+           view's buffer is left to its owner */
+        if (list->flags & BBI_FLAG_ARENA) {
+            limbs = _bbi_arena_alloc(newcap * sizeof(bbi_limb));
+        } else {
+            limbs = _bbi_alloc(newcap * sizeof(bbi_limb));
+        }
+        memcpy(limbs, list->limbs, list->len * sizeof(bbi_limb));
+        list->limbs = limbs;
+        list->flags &= ~(BBI_FLAG_INLINE | BBI_FLAG_VIEW);
+    } else {
+        list->limbs = _bbi_realloc(list->limbs, list->cap * sizeof(bbi_limb), newcap * sizeof(bbi_limb));
+    }
+    list->cap = newcap;
+}
+
+void _bbi_free_chunks(bbi_chunk *list) {
+    BBI_STAT_COUNT(headers_free, 1);
+    if (list->flags & BBI_FLAG_ARENA) {
+        return;
+    }
+    if (!(list->flags & (BBI_FLAG_INLINE | BBI_FLAG_VIEW))) {
+        _bbi_free(list->limbs, list->cap * sizeof(bbi_limb));
+    }
+    if (slab_count < BBI_SLAB_MAX) {
+        list->limbs = (bbi_limb *) slab_head;
+        slab_head = list;
+        slab_count++;
+    } else {
+        _bbi_free(list, sizeof(bbi_chunk));
+    }
+}
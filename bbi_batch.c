@@ -0,0 +1,379 @@
+/*
+ * Batches: the same operation applied to many independent non-negative values at once.
+ *
+ * A batch stores count values of len chunks each in structure-of-arrays form: chunk i of every
+ * value is one contiguous row, limbs[i * count .. i * count + count - 1]. An operation walks the
+ * rows and hands each one to the vector kernels, so a vector holds the same chunk of several values
+ * rather than neighbouring chunks of one. That's what lets add vectorize: each value keeps its own
+ * carry in a row of carries, and a vector's worth of independent carry chains advance together.
+ * Loading and storing do the transposes, and one allocation holds the whole batch instead of one
+ * per value.
+ *
+ * Big batches are split across the thread pool by ranges of values (see bbi_pool.c).
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+
+/* Values per pool task are rounded to this, so tasks don't share cache lines of a row */
+#define BBI_BATCH_LANES 8
+
+/* Make an all-zero batch of count values of len chunks */
+bbi_batch *bbi_batch_create(unsigned int count, unsigned int len) {
+    bbi_batch *batch = _bbi_alloc(sizeof(bbi_batch));
+
+    assert(count > 0 && len > 0);
+    batch->count = count;
+    batch->len = len;
+    batch->limbs = _bbi_alloc((size_t) count * len * sizeof(bbi_limb));
+    memset(batch->limbs, 0, (size_t) count * len * sizeof(bbi_limb));
+    return batch;
+}
+
+void bbi_batch_destroy(bbi_batch *batch) {
+    _bbi_free(batch->limbs, (size_t) batch->count * batch->len * sizeof(bbi_limb));
+    _bbi_free(batch, sizeof(bbi_batch));
+}
+
+/* Gather count values into a new batch, as wide as the widest of them. Returns NULL if any value is
+   negative. */
+bbi_batch *bbi_batch_load(bbi_chunk **values, unsigned int count) {
+    bbi_batch *batch;
+    unsigned int len = 1;
+    unsigned int n;
+    unsigned int i;
+    unsigned int j;
+
+    for (j = 0; j < count; j++) {
+        n = _bbi_normalized_len(values[j]->limbs, values[j]->len);
+        if (values[j]->sign && n > 0) {
+            return NULL;
+        }
+        if (n > len) {
+            len = n;
+        }
+    }
+    batch = bbi_batch_create(count, len);
+    for (j = 0; j < count; j++) {
+        n = values[j]->len < len ? values[j]->len : len;
+        for (i = 0; i < n; i++) {
+            batch->limbs[(size_t) i * count + j] = values[j]->limbs[i];
+        }
+    }
+    return batch;
+}
+
+/* Scatter the batch out to count new bigints in out[], normalized */
+void bbi_batch_store(const bbi_batch *batch, bbi_chunk **out) {
+    unsigned int count = batch->count;
+    unsigned int len = batch->len;
+    unsigned int i;
+    unsigned int j;
+    bbi_chunk *list;
+
+    for (j = 0; j < count; j++) {
+        list = _bbi_alloc_chunks(len);
+        for (i = 0; i < len; i++) {
+            list->limbs[i] = batch->limbs[(size_t) i * count + j];
+        }
+        list->len = _bbi_normalized_len(list->limbs, len);
+        if (list->len == 0) {
+            list->len = 1;
+        }
+        list->sign = 0;
+        out[j] = list;
+    }
+}
+
+/* Widen every value in the batch to len chunks - new rows go on the end, so this is a realloc */
+static void _bbi_batch_widen(bbi_batch *batch, unsigned int len) {
+    size_t old = (size_t) batch->count * batch->len;
+    size_t new = (size_t) batch->count * len;
+
+    batch->limbs = _bbi_realloc(batch->limbs, old * sizeof(bbi_limb), new * sizeof(bbi_limb));
+    memset(&batch->limbs[old], 0, (new - old) * sizeof(bbi_limb));
+    batch->len = len;
+}
+
+#define BBI_BATCH_AND 0
+#define BBI_BATCH_OR 1
+#define BBI_BATCH_XOR 2
+#define BBI_BATCH_ADD 3
+#define BBI_BATCH_MOD 4
+
+/* One operation on a batch, split into pool tasks by ranges of values. The other operand is
+   either another batch of the same count (stride == count) or one value broadcast to all of them
+   (stride == 0), bn chunks either way. */
+struct bbi_batch_task {
+    bbi_batch *batch;
+    int op;
+    const bbi_limb *bp;
+    unsigned int bn;
+    unsigned int stride;
+    const bbi_divisor *div;
+    bbi_limb *carry;        /* One per value, for add */
+    unsigned int lanes;     /* Values per task */
+};
+
+/* Row i of the operand for values [lo, hi): the batch's own row, or for a broadcast value (and
+   rows past the operand's length) that row's chunk copied across scratch */
+static const bbi_limb *_bbi_batch_operand_row(struct bbi_batch_task *t, unsigned int i, bbi_limb *scratch,
+                                              unsigned int lo, unsigned int hi) {
+    bbi_limb c;
+    unsigned int j;
+
+    if (i < t->bn && t->stride != 0) {
+        return &t->bp[(size_t) i * t->stride + lo];
+    }
+    c = i < t->bn ? t->bp[i] : 0;
+    for (j = 0; j < hi - lo; j++) {
+        scratch[j] = c;
+    }
+    return scratch;
+}
+
+/* Bitwise op or add on values [lo, hi), a row at a time with the vector kernels (see
+   bbi_kernel.c), so each step works on a vector's worth of values. For add, each value's carry out
+   of the top row is left in carry[]. */
+static void _bbi_batch_rows(struct bbi_batch_task *t, unsigned int lo, unsigned int hi) {
+    unsigned int count = t->batch->count;
+    unsigned int n = hi - lo;
+    bbi_limb *scratch = NULL;
+    const bbi_limb *brow;
+    bbi_limb *row;
+    unsigned int i;
+
+    if (t->stride == 0 || t->bn < t->batch->len) {
+        scratch = _bbi_alloc(n * sizeof(bbi_limb));
+    }
+    if (t->op == BBI_BATCH_ADD) {
+        memset(&t->carry[lo], 0, n * sizeof(bbi_limb));
+    }
+    for (i = 0; i < t->batch->len; i++) {
+        row = &t->batch->limbs[(size_t) i * count + lo];
+        brow = _bbi_batch_operand_row(t, i, scratch, lo, hi);
+        if (t->op == BBI_BATCH_AND) {
+            _bbi_and_n(row, row, brow, n);
+        } else if (t->op == BBI_BATCH_OR) {
+            _bbi_or_n(row, row, brow, n);
+        } else if (t->op == BBI_BATCH_XOR) {
+            _bbi_xor_n(row, row, brow, n);
+        } else {
+            _bbi_add_lanes_n(row, row, brow, &t->carry[lo], n);
+        }
+    }
+    if (scratch != NULL) {
+        _bbi_free(scratch, n * sizeof(bbi_limb));
+    }
+}
+
+/* Reduce values [lo, hi) one at a time: gather one into a contiguous buffer, divide, scatter the
+   remainder back. Division's steps depend on each other too much to run side by side across
+   values the way add's do. */
+static void _bbi_batch_mod_values(struct bbi_batch_task *t, unsigned int lo, unsigned int hi) {
+    const bbi_divisor *div = t->div;
+    unsigned int count = t->batch->count;
+    unsigned int len = t->batch->len;
+    unsigned int dn = div->len;
+    bbi_limb *val = _bbi_alloc((len + dn) * sizeof(bbi_limb));
+    bbi_limb *rem = &val[len];
+    unsigned int n;
+    unsigned int i;
+    unsigned int j;
+
+    for (j = lo; j < hi; j++) {
+        for (i = 0; i < len; i++) {
+            val[i] = t->batch->limbs[(size_t) i * count + j];
+        }
+        n = _bbi_normalized_len(val, len);
+        if (n < dn) {
+            /* Already reduced */
+            continue;
+        }
+        _bbi_divrem_preinv(NULL, rem, val, n, div->limbs, dn, div->shift, div->inv);
+        for (i = 0; i < len; i++) {
+            t->batch->limbs[(size_t) i * count + j] = i < dn ? rem[i] : 0;
+        }
+    }
+    _bbi_free(val, (len + dn) * sizeof(bbi_limb));
+}
+
+static void _bbi_batch_task(void *arg, unsigned int k) {
+    struct bbi_batch_task *t = arg;
+    unsigned int lo = k * t->lanes;
+    unsigned int hi = t->batch->count - lo < t->lanes ? t->batch->count : lo + t->lanes;
+
+    if (t->op == BBI_BATCH_MOD) {
+        _bbi_batch_mod_values(t, lo, hi);
+    } else {
+        _bbi_batch_rows(t, lo, hi);
+    }
+}
+
+/* Run an operation over the whole batch, split into ranges of values across the thread pool when
+   there's enough work */
+static void _bbi_batch_run(struct bbi_batch_task *t) {
+    unsigned int count = t->batch->count;
+    unsigned int nthreads = bbi_threads();
+
+    t->lanes = count;
+    if (nthreads > 1 && (size_t) count * t->batch->len >= _bbi_par_bitwise_threshold) {
+        t->lanes = ((count + nthreads - 1) / nthreads + BBI_BATCH_LANES - 1) & ~(BBI_BATCH_LANES - 1u);
+    }
+    _bbi_par_run(_bbi_batch_task, t, (count + t->lanes - 1) / t->lanes);
+}
+
+/* Apply op with operand bp/bn/stride (see struct bbi_batch_task) - widens the batch to fit it, and
+   for add by one more chunk if any value carries out of the top */
+static bbi_batch *_bbi_batch_op(bbi_batch *batch, int op, const bbi_limb *bp, unsigned int bn,
+                                unsigned int stride) {
+    struct bbi_batch_task t;
+    unsigned int count = batch->count;
+    unsigned int top;
+    unsigned int j;
+    int carried = 0;
+
+    if (op != BBI_BATCH_AND && bn > batch->len) {
+        _bbi_batch_widen(batch, bn);
+    }
+    t.batch = batch;
+    t.op = op;
+    t.bp = bp;
+    t.bn = bn;
+    t.stride = stride;
+    t.carry = op == BBI_BATCH_ADD ? _bbi_alloc(count * sizeof(bbi_limb)) : NULL;
+    _bbi_batch_run(&t);
+    if (op == BBI_BATCH_ADD) {
+        for (j = 0; j < count; j++) {
+            carried |= t.carry[j] != 0;
+        }
+        if (carried) {
+            top = batch->len;
+            _bbi_batch_widen(batch, top + 1);
+            memcpy(&batch->limbs[(size_t) top * count], t.carry, count * sizeof(bbi_limb));
+        }
+        _bbi_free(t.carry, count * sizeof(bbi_limb));
+    }
+    return batch;
+}
+
+/* Value by value a AND/OR/XOR/+ b, in place in a. The batches must hold the same number of
+   values; a widens to fit b (for AND it doesn't need to), and add widens by one more chunk if
+   any value carries out of the top. */
+bbi_batch *bbi_batch_and(bbi_batch *batch_a, const bbi_batch *batch_b) {
+    assert(batch_a->count == batch_b->count);
+    return _bbi_batch_op(batch_a, BBI_BATCH_AND, batch_b->limbs, batch_b->len, batch_b->count);
+}
+
+bbi_batch *bbi_batch_or(bbi_batch *batch_a, const bbi_batch *batch_b) {
+    assert(batch_a->count == batch_b->count);
+    return _bbi_batch_op(batch_a, BBI_BATCH_OR, batch_b->limbs, batch_b->len, batch_b->count);
+}
+
+bbi_batch *bbi_batch_xor(bbi_batch *batch_a, const bbi_batch *batch_b) {
+    assert(batch_a->count == batch_b->count);
+    return _bbi_batch_op(batch_a, BBI_BATCH_XOR, batch_b->limbs, batch_b->len, batch_b->count);
+}
+
+bbi_batch *bbi_batch_add(bbi_batch *batch_a, const bbi_batch *batch_b) {
+    assert(batch_a->count == batch_b->count);
+    return _bbi_batch_op(batch_a, BBI_BATCH_ADD, batch_b->limbs, batch_b->len, batch_b->count);
+}
+
+/* The same with one value for all of them. Returns NULL if it's negative. */
+static bbi_batch *_bbi_batch_op_all(bbi_batch *batch, bbi_chunk *list, int op) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+
+    if (list->sign && n > 0) {
+        return NULL;
+    }
+    return _bbi_batch_op(batch, op, list->limbs, n, 0);
+}
+
+bbi_batch *bbi_batch_and_all(bbi_batch *batch, bbi_chunk *list) {
+    return _bbi_batch_op_all(batch, list, BBI_BATCH_AND);
+}
+
+bbi_batch *bbi_batch_or_all(bbi_batch *batch, bbi_chunk *list) {
+    return _bbi_batch_op_all(batch, list, BBI_BATCH_OR);
+}
+
+bbi_batch *bbi_batch_xor_all(bbi_batch *batch, bbi_chunk *list) {
+    return _bbi_batch_op_all(batch, list, BBI_BATCH_XOR);
+}
+
+bbi_batch *bbi_batch_add_all(bbi_batch *batch, bbi_chunk *list) {
+    return _bbi_batch_op_all(batch, list, BBI_BATCH_ADD);
+}
+
+/* Reduce each value in the batch mod a prepared divisor (see bbi_divisor_create()), in place. The
+   batch keeps its width. */
+bbi_batch *bbi_batch_mod(bbi_batch *batch, const bbi_divisor *div) {
+    struct bbi_batch_task t;
+
+    t.batch = batch;
+    t.op = BBI_BATCH_MOD;
+    t.div = div;
+    _bbi_batch_run(&t);
+    return batch;
+}
+
+/* out[i] = a[i] op b[i] for i < count, as new bigints, going through batches. Returns out, or
+   NULL if any operand is negative (and then out is left alone). A count of 0 does nothing. */
+static bbi_chunk **_bbi_array_op(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b,
+                                 unsigned int count, int op) {
+    bbi_batch *batch_a;
+    bbi_batch *batch_b;
+
+    if (count == 0) {
+        return out;
+    }
+    batch_a = bbi_batch_load(values_a, count);
+    batch_b = batch_a != NULL ? bbi_batch_load(values_b, count) : NULL;
+    if (batch_b == NULL) {
+        if (batch_a != NULL) {
+            bbi_batch_destroy(batch_a);
+        }
+        return NULL;
+    }
+    _bbi_batch_op(batch_a, op, batch_b->limbs, batch_b->len, batch_b->count);
+    bbi_batch_store(batch_a, out);
+    bbi_batch_destroy(batch_a);
+    bbi_batch_destroy(batch_b);
+    return out;
+}
+
+bbi_chunk **bbi_and_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count) {
+    return _bbi_array_op(out, values_a, values_b, count, BBI_BATCH_AND);
+}
+
+bbi_chunk **bbi_or_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count) {
+    return _bbi_array_op(out, values_a, values_b, count, BBI_BATCH_OR);
+}
+
+bbi_chunk **bbi_xor_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count) {
+    return _bbi_array_op(out, values_a, values_b, count, BBI_BATCH_XOR);
+}
+
+bbi_chunk **bbi_add_array(bbi_chunk **out, bbi_chunk **values_a, bbi_chunk **values_b, unsigned int count) {
+    return _bbi_array_op(out, values_a, values_b, count, BBI_BATCH_ADD);
+}
+
+/* out[i] = values[i] mod div (see bbi_divisor_create()) for i < count. Returns NULL if any value
+   is negative. */
+bbi_chunk **bbi_mod_array(bbi_chunk **out, bbi_chunk **values, const bbi_divisor *div, unsigned int count) {
+    bbi_batch *batch;
+
+    if (count == 0) {
+        return out;
+    }
+    batch = bbi_batch_load(values, count);
+    if (batch == NULL) {
+        return NULL;
+    }
+    bbi_batch_mod(batch, div);
+    bbi_batch_store(batch, out);
+    bbi_batch_destroy(batch);
+    return out;
+}
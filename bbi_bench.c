@@ -0,0 +1,572 @@
+/*
+ * Microbenchmarks. Build with different -DBBI_LIMB_BITS values to compare chunk widths, or with
+ * -DBBI_INLINE_LIMBS=0 to compare against heap-only storage - see the bench target in the Makefile.
+ *
+ * The suite times each public operation on operands from 1 to 10^6 chunks and reports ns/op,
+ * chunks/sec and allocator calls per op. Operands come from a fixed seed, so runs are comparable.
+ *   ./bbi_bench                     suite as a table, then the kernel and algorithm comparisons
+ *   ./bbi_bench --json              suite only, as JSON (see the bench-json target)
+ *   ./bbi_bench --max-limbs N       stop the suite at N chunks
+ *   ./bbi_bench --threads N         run with a pool of N threads (see bbi_pool.c)
+ *   ./bbi_bench small               only the small-value benchmark
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bbi.h"
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Random value of the given number of bits, rounded up to whole chunks */
+static bbi_chunk *random_value(unsigned int nbits) {
+    unsigned int nchunks = (nbits + BBI_LIMB_BITS - 1) / BBI_LIMB_BITS;
+    bbi_chunk *list = bbi_create_nchunks(nchunks);
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < nchunks; i++) {
+        for (j = 0; j < sizeof(bbi_limb); j++) {
+            list->limbs[i] = (list->limbs[i] << 8) | (rand() & 0xff);
+        }
+    }
+    return list;
+}
+
+/* Time the in-place add kernel and the allocating bbi_add() on operands of nbits each */
+static void bench_add(unsigned int nbits) {
+    bbi_chunk *a = random_value(nbits);
+    bbi_chunk *b = random_value(nbits);
+    bbi_chunk *r = bbi_copy(a);
+    unsigned int n = a->len;
+    unsigned long iters = 1 + 200000000UL / (n * 8 + 64);
+    unsigned long i;
+    double start;
+    double kernel_ns;
+    double alloc_ns;
+    volatile bbi_limb sink = 0;
+
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        sink += _bbi_add_n(r->limbs, a->limbs, b->limbs, n);
+    }
+    kernel_ns = (now_ns() - start) / iters;
+
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        bbi_chunk *sum = bbi_add(a, b);
+        sink += sum->limbs[0];
+        bbi_destroy(sum);
+    }
+    alloc_ns = (now_ns() - start) / iters;
+
+    printf("add  %2d-bit chunks  %8u bits  kernel %10.1f ns  (%6.2f bits/ns)  bbi_add %10.1f ns\n",
+           BBI_LIMB_BITS, nbits, kernel_ns, nbits / kernel_ns, alloc_ns);
+    bbi_destroy(a);
+    bbi_destroy(b);
+    bbi_destroy(r);
+}
+
+/* Time the XOR kernel on operands of nbits each, with each instruction set the CPU has */
+static void bench_xor(unsigned int nbits) {
+    static const char *names[] = {"generic", "sse2", "avx2", "avx512"};
+    unsigned int masks[] = {0, BBI_CPU_SSE2, BBI_CPU_SSE2 | BBI_CPU_AVX2, ~0u};
+    bbi_chunk *a = random_value(nbits);
+    bbi_chunk *b = random_value(nbits);
+    unsigned int n = a->len;
+    unsigned long iters = 1 + 200000000UL / (n * 8 + 64);
+    unsigned long i;
+    unsigned int m;
+    unsigned int prev = ~0u;
+    double start;
+    double ns;
+
+    for (m = 0; m < 4; m++) {
+        /* Skip instruction sets this CPU doesn't have */
+        _bbi_cpu_restrict(masks[m]);
+        if (_bbi_cpu_features() == prev) {
+            continue;
+        }
+        prev = _bbi_cpu_features();
+        start = now_ns();
+        for (i = 0; i < iters; i++) {
+            _bbi_xor_n(a->limbs, a->limbs, b->limbs, n);
+        }
+        ns = (now_ns() - start) / iters;
+        printf("xor  %2d-bit chunks  %8u bits  %-8s %10.1f ns  (%6.2f bits/ns)\n",
+               BBI_LIMB_BITS, nbits, names[m], ns, nbits / ns);
+    }
+    _bbi_cpu_restrict(~0u);
+    bbi_destroy(a);
+    bbi_destroy(b);
+}
+
+/* Time (a ^ b) & ~c done one operation at a time, with a bigint for each step, against the same
+   expression evaluated in one pass, into a new value and into an existing one */
+static void bench_expr(unsigned int nbits) {
+    bbi_chunk *a = random_value(nbits);
+    bbi_chunk *b = random_value(nbits);
+    bbi_chunk *c = random_value(nbits);
+    bbi_chunk *r = bbi_create();
+    bbi_expr *e = bbi_expr_create();
+    int root;
+    unsigned int n = a->len;
+    unsigned long iters = 1 + 100000000UL / (n * 8 + 64);
+    unsigned long i;
+    double start;
+    double ops_ns;
+    double expr_ns;
+    double into_ns;
+    volatile bbi_limb sink = 0;
+
+    root = bbi_expr_and(e, bbi_expr_xor(e, bbi_expr_value(e, a), bbi_expr_value(e, b)),
+                        bbi_expr_not(e, bbi_expr_value(e, c)));
+
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        bbi_chunk *x = bbi_xor(a, b);
+        bbi_chunk *y = bbi_not(c);
+        bbi_and_inplace(x, y);
+        sink += x->limbs[0];
+        bbi_destroy(x);
+        bbi_destroy(y);
+    }
+    ops_ns = (now_ns() - start) / iters;
+
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        bbi_chunk *x = bbi_expr_eval(e, root, NULL);
+        sink += x->limbs[0];
+        bbi_destroy(x);
+    }
+    expr_ns = (now_ns() - start) / iters;
+
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        sink += bbi_expr_eval(e, root, r)->limbs[0];
+    }
+    into_ns = (now_ns() - start) / iters;
+
+    printf("expr %2d-bit chunks  %8u bits  (a^b)&~c  ops %10.1f ns  fused %10.1f ns  into dst %10.1f ns\n",
+           BBI_LIMB_BITS, nbits, ops_ns, expr_ns, into_ns);
+    bbi_expr_destroy(e);
+    bbi_destroy(a);
+    bbi_destroy(b);
+    bbi_destroy(c);
+    bbi_destroy(r);
+}
+
+/* Time an ndigits x ndigits multiply with the Toom-3 path (NTT switched off) and with the NTT */
+static void bench_mul(unsigned int ndigits) {
+    bbi_chunk *a = random_value((unsigned int) (ndigits * 3.3219281 + 1));
+    bbi_chunk *b = random_value((unsigned int) (ndigits * 3.3219281 + 1));
+    unsigned int n = a->len;
+    bbi_limb *r = malloc(2 * n * sizeof(bbi_limb));
+    unsigned int saved = _bbi_mul_ntt_threshold;
+    double start;
+    double toom_ns;
+    double ntt_ns;
+
+    _bbi_mul_ntt_threshold = ~0u;
+    start = now_ns();
+    _bbi_mul(r, a->limbs, n, b->limbs, n);
+    toom_ns = now_ns() - start;
+    _bbi_mul_ntt_threshold = 0;
+    start = now_ns();
+    _bbi_mul(r, a->limbs, n, b->limbs, n);
+    ntt_ns = now_ns() - start;
+    _bbi_mul_ntt_threshold = saved;
+
+    printf("mul  %2d-bit chunks  %8u digits  toom3 %12.3f ms  ntt %12.3f ms\n",
+           BBI_LIMB_BITS, ndigits, toom_ns / 1e6, ntt_ns / 1e6);
+    free(r);
+    bbi_destroy(a);
+    bbi_destroy(b);
+}
+
+/* Time base^exp mod N with all three nbits long, N odd, in both exponentiation modes */
+static void bench_powmod(unsigned int nbits) {
+    bbi_chunk *base = random_value(nbits);
+    bbi_chunk *exp = random_value(nbits);
+    bbi_chunk *mod = random_value(nbits);
+    bbi_mont_ctx *ctx;
+    bbi_chunk *result;
+    unsigned int flags;
+    unsigned long iters = 1 + 2000000000UL / ((unsigned long) nbits * nbits * nbits / 64);
+    unsigned long i;
+    double start;
+
+    mod->limbs[0] |= 1;
+    ctx = bbi_mont_ctx_create(mod);
+    for (flags = 0; flags <= BBI_POWMOD_CONSTTIME; flags++) {
+        start = now_ns();
+        for (i = 0; i < iters; i++) {
+            result = bbi_powmod_ctx(ctx, base, exp, flags);
+            bbi_destroy(result);
+        }
+        printf("powmod %2d-bit chunks  %8u bits  %-10s %12.1f us\n", BBI_LIMB_BITS, nbits,
+               flags ? "consttime" : "sliding", (now_ns() - start) / iters / 1e3);
+    }
+    bbi_mont_ctx_destroy(ctx);
+    bbi_destroy(base);
+    bbi_destroy(exp);
+    bbi_destroy(mod);
+}
+
+/* Time bbi_gcd() on two nbits values with and without the half-GCD (Lehmer steps all the way),
+   and bbi_gcdext() and bbi_invert() */
+static void bench_gcd(unsigned int nbits) {
+    bbi_chunk *a = random_value(nbits);
+    bbi_chunk *b = random_value(nbits);
+    bbi_chunk *s;
+    bbi_chunk *t;
+    unsigned int saved = _bbi_gcd_dc_threshold;
+    unsigned long iters = 1 + 4000000000UL / ((unsigned long) nbits * nbits);
+    unsigned long i;
+    double start;
+    double ns[4];
+    int pass;
+
+    a->limbs[0] |= 1;
+    for (pass = 0; pass < 4; pass++) {
+        _bbi_gcd_dc_threshold = pass == 1 ? ~0u : saved;
+        start = now_ns();
+        for (i = 0; i < iters; i++) {
+            if (pass < 2) {
+                bbi_destroy(bbi_gcd(a, b));
+            } else if (pass == 2) {
+                bbi_destroy(bbi_gcdext(a, b, &s, &t));
+                bbi_destroy(s);
+                bbi_destroy(t);
+            } else if ((s = bbi_invert(b, a)) != NULL) {
+                bbi_destroy(s);
+            }
+        }
+        ns[pass] = (now_ns() - start) / iters;
+    }
+    _bbi_gcd_dc_threshold = saved;
+    printf("gcd %2d-bit chunks  %8u bits  %12.1f us  lehmer %12.1f us  gcdext %12.1f us  invert %12.1f us\n",
+           BBI_LIMB_BITS, nbits, ns[0] / 1e3, ns[1] / 1e3, ns[2] / 1e3, ns[3] / 1e3);
+    bbi_destroy(a);
+    bbi_destroy(b);
+}
+
+/* Time bbi_sqrtrem() and bbi_root(3) of an nbits value against one product of two nbits/2 values,
+   the size of the square root, and bbi_is_perfect_power() on it */
+static void bench_root(unsigned int nbits) {
+    bbi_chunk *a = random_value(nbits);
+    bbi_chunk *h = random_value(nbits / 2);
+    bbi_chunk *r;
+    unsigned long iters = 1 + 2000000000UL / ((unsigned long) nbits * nbits / 64 + nbits);
+    unsigned long i;
+    double start;
+    double ns[4];
+    int pass;
+
+    for (pass = 0; pass < 4; pass++) {
+        start = now_ns();
+        for (i = 0; i < iters; i++) {
+            if (pass == 0) {
+                bbi_destroy(bbi_mul(h, h));
+            } else if (pass == 1) {
+                bbi_destroy(bbi_sqrtrem(a, &r));
+                bbi_destroy(r);
+            } else if (pass == 2) {
+                bbi_destroy(bbi_root(a, 3, NULL));
+            } else {
+                bbi_is_perfect_power(a);
+            }
+        }
+        ns[pass] = (now_ns() - start) / iters;
+    }
+    printf("root %2d-bit chunks  %8u bits  mul %12.1f us  sqrtrem %12.1f us (%4.1fx)  cbrt %12.1f us (%4.1fx)  "
+           "is_perfect_power %12.1f us\n",
+           BBI_LIMB_BITS, nbits, ns[0] / 1e3, ns[1] / 1e3, ns[1] / ns[0], ns[2] / 1e3, ns[2] / ns[0], ns[3] / 1e3);
+    bbi_destroy(a);
+    bbi_destroy(h);
+}
+
+/* Every allocation and reallocation goes through here while the suite runs, so each op's
+   allocator calls can be counted - atomically, since pool threads allocate too */
+static unsigned long alloc_calls;
+
+static void *count_alloc(size_t size) {
+    __atomic_fetch_add(&alloc_calls, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static void *count_realloc(void *ptr, size_t old_size, size_t new_size) {
+    (void) old_size;
+    __atomic_fetch_add(&alloc_calls, 1, __ATOMIC_RELAXED);
+    return realloc(ptr, new_size);
+}
+
+static void count_free(void *ptr, size_t size) {
+    (void) size;
+    free(ptr);
+}
+
+enum {
+    OP_CREATE, OP_EXTEND, OP_COPY, OP_NOT, OP_AND, OP_OR, OP_XOR, OP_ADD, OP_SUB, OP_MUL, OP_DIV,
+    OP_PARSE, OP_FORMAT, OP_COUNT
+};
+static const char *op_names[] = {
+    "create", "extend", "copy", "not", "and", "or", "xor", "add", "sub", "mul", "div", "parse", "format"
+};
+
+/* Operands for the current size: a and b of n chunks, a2 of 2n chunks (the dividend), the decimal
+   digits of a, and a buffer big enough to format a */
+static bbi_chunk *op_a;
+static bbi_chunk *op_b;
+static bbi_chunk *op_a2;
+static char *op_str;
+static char *op_buf;
+static size_t op_bufsize;
+
+/* One run of an operation on n-chunk operands, including freeing whatever it creates */
+static void run_op(int op, unsigned int n) {
+    bbi_chunk *r = NULL;
+
+    switch (op) {
+    case OP_CREATE: r = bbi_create_nchunks(n); break;
+    case OP_EXTEND: r = bbi_extend(bbi_create(), n); break;
+    case OP_COPY:   r = bbi_copy(op_a); break;
+    case OP_NOT:    r = bbi_not(op_a); break;
+    case OP_AND:    r = bbi_and(op_a, op_b); break;
+    case OP_OR:     r = bbi_or(op_a, op_b); break;
+    case OP_XOR:    r = bbi_xor(op_a, op_b); break;
+    case OP_ADD:    r = bbi_add(op_a, op_b); break;
+    case OP_SUB:    r = bbi_sub(op_a, op_b); break;
+    case OP_MUL:    r = bbi_mul(op_a, op_b); break;
+    case OP_DIV:    r = bbi_div(op_a2, op_b); break;
+    case OP_PARSE:  r = bbi_fromstring_dec((const unsigned char *) op_str); break;
+    case OP_FORMAT: bbi_tostring_dec(op_a, op_buf, op_bufsize); break;
+    }
+    if (r != NULL) {
+        bbi_destroy(r);
+    }
+}
+
+/* Time an operation: enough runs to fill 20 ms (at least one), best of three batches - or a single
+   batch for ops that take over a second. The cached tables some operations build are made by an
+   untimed warm-up run. */
+static void measure_op(int op, unsigned int n, double *ns, double *allocs) {
+    unsigned long iters = 1;
+    unsigned long i;
+    unsigned long calls;
+    double start;
+    double t;
+    int rep;
+    int reps = 3;
+
+    start = now_ns();
+    run_op(op, n);
+    t = now_ns() - start;
+    if (t < 20e6) {
+        iters = (unsigned long) (20e6 / (t + 1)) + 1;
+    } else if (t > 1e9) {
+        reps = 1;
+    }
+    *ns = 1e30;
+    for (rep = 0; rep < reps; rep++) {
+        calls = alloc_calls;
+        start = now_ns();
+        for (i = 0; i < iters; i++) {
+            run_op(op, n);
+        }
+        t = (now_ns() - start) / iters;
+        *allocs = (double) (alloc_calls - calls) / iters;
+        if (t < *ns) {
+            *ns = t;
+        }
+    }
+}
+
+static void bench_suite(unsigned int max_limbs, int json) {
+    unsigned int n;
+    int op;
+    int first = 1;
+    double ns;
+    double allocs;
+
+    bbi_set_allocator(count_alloc, count_realloc, count_free);
+    if (json) {
+        printf("{\n  \"limb_bits\": %d,\n  \"inline_limbs\": %d,\n  \"threads\": %u,\n  \"results\": [",
+               BBI_LIMB_BITS, BBI_INLINE_LIMBS, bbi_threads());
+    } else {
+        printf("%-8s %10s %14s %16s %12s\n", "op", "chunks", "ns/op", "chunks/sec", "allocs/op");
+    }
+    for (n = 1; n <= max_limbs; n *= 10) {
+        srand(n);
+        op_a = random_value(n * BBI_LIMB_BITS);
+        op_b = random_value(n * BBI_LIMB_BITS);
+        op_a2 = random_value(2 * n * BBI_LIMB_BITS);
+        op_b->limbs[n - 1] |= 1;
+        op_bufsize = bbi_tostring_dec(op_a, NULL, 0);
+        op_str = malloc(op_bufsize);
+        op_buf = malloc(op_bufsize);
+        bbi_tostring_dec(op_a, op_str, op_bufsize);
+        for (op = 0; op < OP_COUNT; op++) {
+            measure_op(op, n, &ns, &allocs);
+            if (json) {
+                printf("%s\n    {\"op\": \"%s\", \"limbs\": %u, \"ns_per_op\": %.1f, \"limbs_per_sec\": %.4g, "
+                       "\"allocs_per_op\": %.2f}", first ? "" : ",", op_names[op], n, ns, n / ns * 1e9, allocs);
+                first = 0;
+            } else {
+                printf("%-8s %10u %14.1f %16.4g %12.2f\n", op_names[op], n, ns, n / ns * 1e9, allocs);
+            }
+            fflush(stdout);
+        }
+        free(op_str);
+        free(op_buf);
+        bbi_destroy(op_a);
+        bbi_destroy(op_b);
+        bbi_destroy(op_a2);
+    }
+    if (json) {
+        printf("\n  ]\n}\n");
+    }
+    bbi_set_allocator(NULL, NULL, NULL);
+}
+
+/* Time a mix of allocating operations on 64-bit values, the kind of work most callers do: each
+   iteration is a multiply, an add, a subtract and an XOR, all producing fresh values */
+static void bench_small() {
+    bbi_chunk *a = random_value(64);
+    bbi_chunk *b = random_value(64);
+    bbi_chunk *r;
+    unsigned long iters = 5000000;
+    unsigned long i;
+    double start;
+    volatile bbi_limb sink = 0;
+
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        a->limbs[0] += i;
+        r = bbi_mul(a, b);
+        sink += r->limbs[0];
+        bbi_destroy(r);
+        r = bbi_add(a, b);
+        sink += r->limbs[0];
+        bbi_destroy(r);
+        r = bbi_sub(a, b);
+        sink += r->limbs[0];
+        bbi_destroy(r);
+        r = bbi_xor(a, b);
+        sink += r->limbs[0];
+        bbi_destroy(r);
+    }
+    printf("small %2d-bit chunks  64-bit values  %d inline chunks  %8.1f ns per mul+add+sub+xor\n",
+           BBI_LIMB_BITS, BBI_INLINE_LIMBS, (now_ns() - start) / iters);
+    bbi_destroy(a);
+    bbi_destroy(b);
+}
+
+/* Time adding 4096 pairs of nbits values one bbi_add_inplace() at a time against one batch add
+   (see bbi_batch.c), not counting loading and storing the batches */
+static void bench_batch(unsigned int nbits) {
+    bbi_chunk *a[4096];
+    bbi_chunk *b[4096];
+    bbi_batch *batch_a;
+    bbi_batch *batch_b;
+    unsigned int count = 4096;
+    unsigned int iters = 200;
+    unsigned int i;
+    unsigned int j;
+    double start;
+    double single;
+    double batched;
+
+    for (j = 0; j < count; j++) {
+        a[j] = random_value(nbits);
+        b[j] = random_value(nbits);
+    }
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < count; j++) {
+            bbi_add_inplace(a[j], b[j]);
+        }
+    }
+    single = (now_ns() - start) / ((double) iters * count);
+
+    batch_a = bbi_batch_load(a, count);
+    batch_b = bbi_batch_load(b, count);
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        bbi_batch_add(batch_a, batch_b);
+    }
+    batched = (now_ns() - start) / ((double) iters * count);
+    printf("batch add %7u bits  %5u values  %8.1f ns/value one at a time  %8.1f ns/value batched\n",
+           nbits, count, single, batched);
+    bbi_batch_destroy(batch_a);
+    bbi_batch_destroy(batch_b);
+    for (j = 0; j < count; j++) {
+        bbi_destroy(a[j]);
+        bbi_destroy(b[j]);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned int nbits;
+    unsigned int ndigits;
+    unsigned int max_limbs = 1000000;
+    int json = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "small") == 0) {
+            bench_small();
+            return 0;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "--max-limbs") == 0 && i + 1 < argc) {
+            max_limbs = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            bbi_threads_init((unsigned int) strtoul(argv[++i], NULL, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--json] [--max-limbs N] [--threads N] | small\n", argv[0]);
+            return 1;
+        }
+    }
+    bench_suite(max_limbs, json);
+    if (json) {
+        bbi_threads_shutdown();
+        bbi_free_cache();
+        return 0;
+    }
+
+    srand(1);
+    bench_small();
+    for (nbits = 256; nbits <= (1u << 20); nbits *= 4) {
+        bench_add(nbits);
+    }
+    for (nbits = 256; nbits <= (1u << 20); nbits *= 16) {
+        bench_xor(nbits);
+    }
+    for (nbits = 256; nbits <= (1u << 20); nbits *= 16) {
+        bench_expr(nbits);
+    }
+    for (nbits = 64; nbits <= 1024; nbits *= 4) {
+        bench_batch(nbits);
+    }
+    for (nbits = 1024; nbits <= 4096; nbits *= 2) {
+        bench_powmod(nbits);
+    }
+    for (ndigits = 10000; ndigits <= 10000000; ndigits *= 10) {
+        bench_mul(ndigits);
+    }
+    for (nbits = 1024; nbits <= (1u << 20); nbits *= 4) {
+        bench_gcd(nbits);
+    }
+    for (nbits = 1024; nbits <= (1u << 22); nbits *= 4) {
+        bench_root(nbits);
+    }
+    bbi_threads_shutdown();
+    bbi_free_cache();
+    return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Binary serialization.
+ *
+ * bbi_import_bytes() and bbi_export_bytes() convert between a value's magnitude and an array of
+ * words of any size, in either word order and byte order, as GMP's mpz_import/mpz_export do. The
+ * common case - least-significant word first, little-endian bytes, on a little-endian machine - is
+ * the chunk array's own layout, and is a plain memcpy.
+ *
+ * bbi_serialize()/bbi_deserialize() are the wire format: a LEB128 varint holding the magnitude's
+ * byte count shifted left one with the sign in bit 0, then the magnitude's bytes, least-significant
+ * first and with no leading zero bytes, so each value has exactly one encoding. Zero is the single
+ * byte 0.
+ *
+ * bbi_view() goes the other way from copying: it wraps a buffer that already holds chunks (say, an
+ * mmap()ed file written by bbi_export_bytes() with BBI_ORDER_LSW_FIRST, sizeof(bbi_limb) and
+ * BBI_ENDIAN_LITTLE) as a bigint without copying it.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+#include "bbi.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BBI_NATIVE_ENDIAN BBI_ENDIAN_LITTLE
+#else
+#define BBI_NATIVE_ENDIAN BBI_ENDIAN_BIG
+#endif
+
+/* Byte i of a magnitude, least-significant first */
+static unsigned char _bbi_mag_byte(const bbi_limb *ap, size_t i) {
+    return (unsigned char) (ap[i / sizeof(bbi_limb)] >> (i % sizeof(bbi_limb) * 8));
+}
+
+/* Offset in a words-of-size array of byte i (least-significant first) of the value */
+static size_t _bbi_byte_offset(size_t i, size_t count, int order, size_t size, int endian) {
+    size_t word = i / size;
+    size_t byte = i % size;
+
+    return (order == BBI_ORDER_LSW_FIRST ? word : count - 1 - word) * size +
+           (endian == BBI_ENDIAN_LITTLE ? byte : size - 1 - byte);
+}
+
+/* Make a non-negative bigint from count words of size bytes at data. order is BBI_ORDER_MSW_FIRST
+   or BBI_ORDER_LSW_FIRST, and endian the byte order within each word, BBI_ENDIAN_BIG,
+   BBI_ENDIAN_LITTLE or BBI_ENDIAN_NATIVE. Returns NULL if the value is too big for a bigint. */
+bbi_chunk *bbi_import_bytes(const void *data, size_t count, int order, size_t size, int endian) {
+    const unsigned char *src = data;
+    size_t nbytes = count * size;
+    size_t nlimbs = (nbytes + sizeof(bbi_limb) - 1) / sizeof(bbi_limb);
+    bbi_chunk *list;
+    size_t i;
+
+    if (endian == BBI_ENDIAN_NATIVE) {
+        endian = BBI_NATIVE_ENDIAN;
+    }
+    if ((size != 0 && nbytes / size != count) || nlimbs > UINT_MAX) {
+        return NULL;
+    }
+    if (nlimbs == 0) {
+        return bbi_create();
+    }
+    list = _bbi_alloc_chunks((unsigned int) nlimbs);
+    list->limbs[nlimbs - 1] = 0;
+    if (BBI_NATIVE_ENDIAN == BBI_ENDIAN_LITTLE && endian == BBI_ENDIAN_LITTLE &&
+        (order == BBI_ORDER_LSW_FIRST || count == 1)) {
+        memcpy(list->limbs, src, nbytes);
+    } else {
+        memset(list->limbs, 0, nlimbs * sizeof(bbi_limb));
+        for (i = 0; i < nbytes; i++) {
+            list->limbs[i / sizeof(bbi_limb)] |=
+                (bbi_limb) src[_bbi_byte_offset(i, count, order, size, endian)] << (i % sizeof(bbi_limb) * 8);
+        }
+    }
+    list->len = _bbi_normalized_len(list->limbs, (unsigned int) nlimbs);
+    if (list->len == 0) {
+        list->len = 1;
+    }
+    list->sign = 0;
+    return list;
+}
+
+/* Write the magnitude of a value (the sign is dropped, as with mpz_export) into buf as words of size
+   bytes, in the given word and byte order (see bbi_import_bytes()). Returns the number of words
+   written - as few as hold the value, and one for 0 - or 0 if they don't fit in bufsize bytes. With
+   buf NULL, returns the number of words needed. */
+size_t bbi_export_bytes(bbi_chunk *list, void *buf, size_t bufsize, int order, size_t size, int endian) {
+    unsigned char *dst = buf;
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    size_t nbytes = ((size_t) _bbi_bit_length_n(list->limbs, n) + 7) / 8;
+    size_t count = nbytes == 0 ? 1 : (nbytes + size - 1) / size;
+    size_t i;
+
+    assert(size > 0);
+    if (endian == BBI_ENDIAN_NATIVE) {
+        endian = BBI_NATIVE_ENDIAN;
+    }
+    if (buf == NULL || bufsize / size < count) {
+        return buf == NULL ? count : 0;
+    }
+    if (BBI_NATIVE_ENDIAN == BBI_ENDIAN_LITTLE && endian == BBI_ENDIAN_LITTLE &&
+        (order == BBI_ORDER_LSW_FIRST || count == 1)) {
+        memcpy(dst, list->limbs, nbytes);
+        memset(&dst[nbytes], 0, count * size - nbytes);
+    } else {
+        for (i = 0; i < count * size; i++) {
+            dst[_bbi_byte_offset(i, count, order, size, endian)] = i < nbytes ? _bbi_mag_byte(list->limbs, i) : 0;
+        }
+    }
+    return count;
+}
+
+/* Write a value in the wire format (see the top of this file) into buf. Returns the number of bytes
+   written, or 0 if they don't fit in bufsize. With buf NULL, returns the number needed. */
+size_t bbi_serialize(bbi_chunk *list, unsigned char *buf, size_t bufsize) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    size_t nbytes = ((size_t) _bbi_bit_length_n(list->limbs, n) + 7) / 8;
+    unsigned long long header = (unsigned long long) nbytes << 1 | (n > 0 && list->sign);
+    size_t needed = nbytes + 1;
+    unsigned long long h;
+    size_t i;
+    size_t j;
+
+    for (h = header >> 7; h != 0; h >>= 7) {
+        needed++;
+    }
+    if (buf == NULL || bufsize < needed) {
+        return buf == NULL ? needed : 0;
+    }
+    i = 0;
+    for (h = header; h >= 0x80; h >>= 7) {
+        buf[i++] = (unsigned char) (h | 0x80);
+    }
+    buf[i++] = (unsigned char) h;
+    if (BBI_NATIVE_ENDIAN == BBI_ENDIAN_LITTLE) {
+        memcpy(&buf[i], list->limbs, nbytes);
+    } else {
+        for (j = 0; j < nbytes; j++) {
+            buf[i + j] = _bbi_mag_byte(list->limbs, j);
+        }
+    }
+    return needed;
+}
+
+/* Read a value in the wire format from the len bytes at buf, storing the number of bytes it took
+   in *used if used isn't NULL. Returns NULL if buf doesn't start with a complete, canonical
+   encoding: a truncated or overlong header, too few bytes, a leading zero byte or a negative 0. */
+bbi_chunk *bbi_deserialize(const unsigned char *buf, size_t len, size_t *used) {
+    unsigned long long header = 0;
+    unsigned int shift = 0;
+    unsigned char byte;
+    size_t nbytes;
+    size_t i = 0;
+    bbi_chunk *list;
+
+    do {
+        /* Past 64 bits, or a last group of 0 (which could have been left off), isn't canonical */
+        if (i == len || shift > 63) {
+            return NULL;
+        }
+        byte = buf[i++];
+        if ((shift == 63 && (byte & 0x7e)) || (i > 1 && byte == 0)) {
+            return NULL;
+        }
+        header |= (unsigned long long) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    nbytes = (size_t) (header >> 1);
+    if (nbytes > len - i || (nbytes == 0 && (header & 1)) || (nbytes > 0 && buf[i + nbytes - 1] == 0)) {
+        return NULL;
+    }
+    list = bbi_import_bytes(&buf[i], nbytes, BBI_ORDER_LSW_FIRST, 1, BBI_ENDIAN_LITTLE);
+    if (list == NULL) {
+        return NULL;
+    }
+    list->sign = nbytes > 0 && (header & 1);
+    if (used != NULL) {
+        *used = i + nbytes;
+    }
+    return list;
+}
+
+/* Wrap nbytes of chunks at buf - aligned for bbi_limb, least-significant chunk first, in the chunk
+   type's little-endian layout - as a non-negative bigint, without copying them. Returns NULL if
+   buf isn't like that (including on a big-endian machine), or nbytes is 0.
+
+   The bigint is read-only: pass it only where a value is read, never as the destination of an
+   in-place operation, which would write into buf. bbi_copy() makes a writable copy. bbi_destroy()
+   frees just the header; buf must outlive the view. */
+bbi_chunk *bbi_view(const void *buf, size_t nbytes) {
+    size_t nlimbs = nbytes / sizeof(bbi_limb);
+    bbi_chunk *list;
+
+    if (BBI_NATIVE_ENDIAN != BBI_ENDIAN_LITTLE || nbytes == 0 || nbytes % sizeof(bbi_limb) != 0 ||
+        (uintptr_t) buf % _Alignof(bbi_limb) != 0 || nlimbs > UINT_MAX) {
+        return NULL;
+    }
+    list = _bbi_alloc_chunks(1);
+    if (!(list->flags & (BBI_FLAG_ARENA | BBI_FLAG_INLINE))) {
+        _bbi_free(list->limbs, list->cap * sizeof(bbi_limb));
+    }
+    list->flags = (list->flags & ~BBI_FLAG_INLINE) | BBI_FLAG_VIEW;
+    list->limbs = (bbi_limb *) buf;
+    list->cap = (unsigned int) nlimbs;
+    list->len = _bbi_normalized_len(list->limbs, (unsigned int) nlimbs);
+    if (list->len == 0) {
+        list->len = 1;
+    }
+    list->sign = 0;
+    return list;
+}
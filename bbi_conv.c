@@ -0,0 +1,948 @@
+/*
+ * Conversion between bigints and string representations.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "bbi.h"
+#include "bbi_tune.h"
+
+/* Decimal digits that always fit in one chunk, and 10 to that power */
+#if BBI_LIMB_BITS == 64
+#define BBI_DEC_DIGITS 19
+#define BBI_DEC_BASE 10000000000000000000ULL
+#else
+#define BBI_DEC_DIGITS 9
+#define BBI_DEC_BASE 1000000000U
+#endif
+
+/* Crossover points, variables so that bbi_tune can adjust them - see bbi_tune.h */
+unsigned int _bbi_fromdec_dc_threshold = BBI_FROMDEC_DC_THRESHOLD;
+unsigned int _bbi_todec_dc_threshold = BBI_TODEC_DC_THRESHOLD;
+
+/* Powers of ten used to recombine the halves of a split string: pow10[j] = 10^(BBI_DEC_DIGITS * 2^j).
+   Built on first use and kept per thread, so no locking is needed. */
+#define BBI_POW10_MAX 32
+struct bbi_pow10 {
+    bbi_limb *limbs;
+    unsigned int len;
+};
+static _Thread_local struct bbi_pow10 pow10[BBI_POW10_MAX];
+/* While a thread pool task converts half of a value, it reads the powers the calling thread has
+   already built rather than building its own copies */
+static _Thread_local const struct bbi_pow10 *pow10_borrowed = NULL;
+
+static const struct bbi_pow10 *_bbi_pow10(unsigned int j) {
+    const struct bbi_pow10 *prev;
+    bbi_limb *sq;
+
+    assert(j < BBI_POW10_MAX);
+    if (pow10_borrowed != NULL && pow10_borrowed[j].limbs != NULL) {
+        return &pow10_borrowed[j];
+    }
+    if (pow10[j].limbs != NULL) {
+        return &pow10[j];
+    }
+    if (j == 0) {
+        pow10[0].limbs = _bbi_alloc(sizeof(bbi_limb));
+        pow10[0].limbs[0] = BBI_DEC_BASE;
+        pow10[0].len = 1;
+        return &pow10[0];
+    }
+    prev = _bbi_pow10(j - 1);
+    sq = _bbi_alloc(2 * prev->len * sizeof(bbi_limb));
+    _bbi_mul(sq, prev->limbs, prev->len, prev->limbs, prev->len);
+    pow10[j].limbs = sq;
+    pow10[j].len = _bbi_normalized_len(sq, 2 * prev->len);
+    return &pow10[j];
+}
+
+/* Free this thread's cached powers - called from bbi_free_cache() */
+void _bbi_conv_free_cache() {
+    unsigned int j;
+
+    for (j = 0; j < BBI_POW10_MAX; j++) {
+        if (pow10[j].limbs != NULL) {
+            _bbi_free(pow10[j].limbs, (j == 0 ? 1 : 2 * pow10[j - 1].len) * sizeof(bbi_limb));
+            pow10[j].limbs = NULL;
+        }
+    }
+}
+
+/* Chunks needed for a len-digit number, with room for the recursive parse to use before the
+   result is normalized */
+static size_t _bbi_dec_room(size_t len) {
+    return len / BBI_DEC_DIGITS + 2;
+}
+
+/* Parse len (at most BBI_DEC_DIGITS) digits into a single chunk */
+static bbi_limb _bbi_dec_word(const unsigned char *s, size_t len) {
+    bbi_limb val = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        /* ASCII Arabic numeral representation has the nice property that you can get the actual value
+           of the digit represented by the character by substracting 0x30, or more clearly, '0' */
+        val = val * 10 + (s[i] - '0');
+    }
+    return val;
+}
+
+/* Horner's rule a chunk's worth of digits at a time: value = value * 10^BBI_DEC_DIGITS + next word.
+   Returns the number of chunks used in rp. */
+static unsigned int _bbi_fromdec_basecase(bbi_limb *rp, const unsigned char *s, size_t len) {
+    unsigned int n = 0;
+    size_t take;
+    bbi_limb word;
+    bbi_limb carry;
+
+    /* The leading group is the short one, so all the others are full words */
+    take = len % BBI_DEC_DIGITS;
+    if (take == 0) {
+        take = BBI_DEC_DIGITS;
+    }
+    while (len > 0) {
+        word = _bbi_dec_word(s, take);
+        /* With n == 0 this is just carry = word */
+        carry = _bbi_mul_1(rp, rp, n, BBI_DEC_BASE);
+        carry += _bbi_add_1(rp, rp, n, word);
+        if (carry != 0) {
+            rp[n++] = carry;
+        }
+        s += take;
+        len -= take;
+        take = BBI_DEC_DIGITS;
+    }
+    return n;
+}
+
+/* The two halves of a divide-and-conquer conversion, as thread pool tasks */
+struct bbi_conv_task {
+    const struct bbi_pow10 *table;
+    bbi_limb *rp[2];
+    const unsigned char *s[2];
+    size_t len[2];
+    unsigned int n[2];
+    char *out[2];
+    const bbi_limb *np[2];
+    size_t width[2];
+};
+
+static unsigned int _bbi_fromdec_dc(bbi_limb *rp, const unsigned char *s, size_t len);
+static char *_bbi_todec_dc(char *out, const bbi_limb *np, unsigned int nn, size_t width);
+
+static void _bbi_fromdec_task(void *arg, unsigned int i) {
+    struct bbi_conv_task *t = arg;
+    const struct bbi_pow10 *saved = pow10_borrowed;
+
+    pow10_borrowed = t->table;
+    t->n[i] = _bbi_fromdec_dc(t->rp[i], t->s[i], t->len[i]);
+    pow10_borrowed = saved;
+}
+
+static void _bbi_todec_task(void *arg, unsigned int i) {
+    struct bbi_conv_task *t = arg;
+    const struct bbi_pow10 *saved = pow10_borrowed;
+
+    pow10_borrowed = t->table;
+    t->out[i] = _bbi_todec_dc(t->out[i], t->np[i], t->n[i], t->width[i]);
+    pow10_borrowed = saved;
+}
+
+/* Big enough to split across the thread pool */
+static int _bbi_conv_par(size_t nchunks) {
+    return nchunks >= _bbi_par_conv_threshold && bbi_threads() > 1;
+}
+
+/* Divide and conquer: value = high * 10^k + low, where low is the last k digits and k is the
+   largest word-multiple power of two below len. Costs a few multiplications of the size of the
+   result, instead of the quadratic basecase. rp has _bbi_dec_room(len) chunks; returns the number
+   used. */
+static unsigned int _bbi_fromdec_dc(bbi_limb *rp, const unsigned char *s, size_t len) {
+    const struct bbi_pow10 *pw;
+    bbi_limb *high;
+    bbi_limb *low;
+    bbi_limb carry;
+    unsigned int highn;
+    unsigned int lown;
+    unsigned int n;
+    size_t k = BBI_DEC_DIGITS;
+    unsigned int j = 0;
+    struct bbi_conv_task task;
+
+    /* Strings up to this many digits are parsed directly */
+    if (len <= _bbi_fromdec_dc_threshold || len <= BBI_DEC_DIGITS) {
+        return _bbi_fromdec_basecase(rp, s, len);
+    }
+    while (2 * k < len) {
+        k *= 2;
+        j++;
+    }
+    high = _bbi_alloc(_bbi_dec_room(len - k) * sizeof(bbi_limb));
+    low = _bbi_alloc(_bbi_dec_room(k) * sizeof(bbi_limb));
+    if (_bbi_conv_par(len / BBI_DEC_DIGITS)) {
+        /* Every power the halves need is below 10^k, so build them all here first */
+        _bbi_pow10(j);
+        task.table = pow10_borrowed != NULL ? pow10_borrowed : pow10;
+        task.rp[0] = high;
+        task.s[0] = s;
+        task.len[0] = len - k;
+        task.rp[1] = low;
+        task.s[1] = s + len - k;
+        task.len[1] = k;
+        _bbi_par_run(_bbi_fromdec_task, &task, 2);
+        highn = task.n[0];
+        lown = task.n[1];
+    } else {
+        highn = _bbi_fromdec_dc(high, s, len - k);
+        lown = _bbi_fromdec_dc(low, s + len - k, k);
+    }
+
+    if (highn == 0) {
+        memcpy(rp, low, lown * sizeof(bbi_limb));
+        n = lown;
+    } else {
+        pw = _bbi_pow10(j);
+        _bbi_mul(rp, pw->limbs, pw->len, high, highn);
+        n = pw->len + highn;
+        /* high * 10^k + low < (high + 1) * 10^k, so adding low never carries out */
+        carry = _bbi_add_n(rp, rp, low, lown);
+        carry = _bbi_add_1(&rp[lown], &rp[lown], n - lown, carry);
+        assert(carry == 0);
+        (void) carry;
+        n = _bbi_normalized_len(rp, n);
+    }
+    _bbi_free(high, _bbi_dec_room(len - k) * sizeof(bbi_limb));
+    _bbi_free(low, _bbi_dec_room(k) * sizeof(bbi_limb));
+    return n;
+}
+
+/* Load a value from a string, in decimal - caller must bbi_destory()! */
+/* More usefully, a general-case function to handle at least binary, octal, decimal and hex
+   is a good idea, but this is a starting point */
+/*
+ * Converting a string representation of an integer to an actual value is trivial in any base. 
+   The general algorithm is:
+   - initialise the value variable to 0
+   - start at the left-most digit, and walk to the right-most digit one digit at a time, for each digit
+        - multiply the value variable by the base (e.g. 10)
+        - add the value of the digit to the value variable
+   
+   The challenge is to do this across chunks - because we can't just use one "value variable",
+   we have to use many.
+
+   We know how many chunks we need - the maximum numbers of bits needed to hold to multiplication 
+   of two binary values is the sum of the bits used in the operands, excluding leading 0 bits. For
+   convenience we can assume that there's no leading 0 bits, and sum the number chunks in the operands
+   to get the number of chunks needed to store the result.
+
+   Two things make this fast:
+   - digits are first gathered into whole chunks (19 digits for 64-bit chunks, 9 for 32-bit), so
+     the multiply-and-add across all the chunks happens once per chunk of digits, not once per digit
+   - long strings are split in half and the halves combined with a multiplication by a cached power
+     of ten, which is subquadratic once multiplication is
+
+   A single leading '-' makes the value negative, and must have digits after it. Returns NULL if the
+   rest of the string contains anything other than digits.
+*/
+bbi_chunk *bbi_fromstring_dec(const unsigned char *s) {
+    return bbi_fromstring_dec_n(s, strlen((const char *) s));
+}
+
+/* As bbi_fromstring_dec(), but parses exactly len characters - s needn't be NUL-terminated */
+bbi_chunk *bbi_fromstring_dec_n(const unsigned char *s, size_t len) {
+    bbi_chunk *list;
+    size_t i;
+    unsigned int n;
+    int sign = 0;
+    BBI_STAT_SCOPE(BBI_STAT_FROMSTRING, _bbi_dec_room(len));
+
+    if (len > 0 && s[0] == '-') {
+        sign = 1;
+        s++;
+        len--;
+        if (len == 0) {
+            return NULL;
+        }
+    }
+    for (i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return NULL;
+        }
+    }
+    /* Leading zeros don't change the value, but would throw off the split points */
+    while (len > 0 && s[0] == '0') {
+        s++;
+        len--;
+    }
+
+    list = _bbi_alloc_chunks(_bbi_dec_room(len));
+    n = _bbi_fromdec_dc(list->limbs, s, len);
+    if (n == 0) {
+        list->limbs[0] = 0;
+        n = 1;
+        sign = 0;
+    }
+    list->len = n;
+    list->sign = sign;
+    return list;
+}
+
+/* Write the decimal digits of one chunk, val < 10^BBI_DEC_DIGITS, right-aligned in width characters
+   (width 0: no padding). Returns the number of characters written. */
+static size_t _bbi_dec_limb(char *out, bbi_limb val, size_t width) {
+    char tmp[BBI_DEC_DIGITS];
+    size_t n = 0;
+
+    do {
+        tmp[BBI_DEC_DIGITS - 1 - n] = '0' + val % 10;
+        val /= 10;
+        n++;
+    } while (val != 0);
+    while (n < width) {
+        tmp[BBI_DEC_DIGITS - 1 - n] = '0';
+        n++;
+    }
+    memcpy(out, &tmp[BBI_DEC_DIGITS - n], n);
+    return n;
+}
+
+/* Repeatedly divide by 10^BBI_DEC_DIGITS, giving the digits a chunk at a time from the bottom.
+   Zero-pads to width characters if width is non-zero. Returns the end of the digits written. */
+static char *_bbi_todec_basecase(char *out, const bbi_limb *np, unsigned int nn, size_t width) {
+    bbi_limb *tmp;
+    bbi_limb *words;
+    unsigned int size = nn;
+    unsigned int nwords = 0;
+    unsigned int i;
+    size_t ndigits;
+
+    if (nn == 0) {
+        memset(out, '0', width);
+        return out + width;
+    }
+    tmp = _bbi_alloc(size * sizeof(bbi_limb));
+    /* A chunk never holds more than two words' worth of decimal digits */
+    words = _bbi_alloc(2 * size * sizeof(bbi_limb));
+    memcpy(tmp, np, nn * sizeof(bbi_limb));
+    while (nn > 0) {
+        words[nwords++] = _bbi_divrem_1(tmp, tmp, nn, BBI_DEC_BASE);
+        nn = _bbi_normalized_len(tmp, nn);
+    }
+
+    /* Leading zeros, then the top word unpadded, then every other word in full */
+    ndigits = _bbi_dec_limb(out, words[nwords - 1], 0) + (size_t) (nwords - 1) * BBI_DEC_DIGITS;
+    if (width > ndigits) {
+        memset(out, '0', width - ndigits);
+        out += width - ndigits;
+    }
+    out += _bbi_dec_limb(out, words[nwords - 1], 0);
+    for (i = nwords - 1; i > 0; i--) {
+        out += _bbi_dec_limb(out, words[i - 1], BBI_DEC_DIGITS);
+    }
+    _bbi_free(tmp, size * sizeof(bbi_limb));
+    _bbi_free(words, 2 * size * sizeof(bbi_limb));
+    return out;
+}
+
+/* Divide and conquer: split the value as high * 10^k + low, with 10^k about half its size, and
+   convert both halves, low zero-padded to exactly k digits. */
+static char *_bbi_todec_dc(char *out, const bbi_limb *np, unsigned int nn, size_t width) {
+    const struct bbi_pow10 *pw;
+    bbi_limb *q;
+    bbi_limb *r;
+    unsigned int qn;
+    size_t k = BBI_DEC_DIGITS;
+    unsigned int j = 0;
+    struct bbi_conv_task task;
+    char *low;
+
+    /* Below this many chunks, peeling off one chunk's worth of digits at a time is quicker */
+    nn = _bbi_normalized_len(np, nn);
+    if (nn < _bbi_todec_dc_threshold || nn < 2) {
+        return _bbi_todec_basecase(out, np, nn, width);
+    }
+    while (_bbi_pow10(j + 1)->len * 2 <= nn) {
+        j++;
+        k *= 2;
+    }
+    pw = _bbi_pow10(j);
+    qn = nn - pw->len + 1;
+    q = _bbi_alloc(qn * sizeof(bbi_limb));
+    r = _bbi_alloc(pw->len * sizeof(bbi_limb));
+    _bbi_divrem(q, r, np, nn, pw->limbs, pw->len);
+    if (_bbi_conv_par(nn)) {
+        /* The high half's length isn't known until it's done, so the low half's exactly k digits
+           go to a buffer of their own and are copied after it. The powers both halves use were
+           all built finding pw. */
+        low = _bbi_alloc(k);
+        task.table = pow10_borrowed != NULL ? pow10_borrowed : pow10;
+        task.out[0] = out;
+        task.np[0] = q;
+        task.n[0] = qn;
+        task.width[0] = width > k ? width - k : 0;
+        task.out[1] = low;
+        task.np[1] = r;
+        task.n[1] = pw->len;
+        task.width[1] = k;
+        _bbi_par_run(_bbi_todec_task, &task, 2);
+        memcpy(task.out[0], low, k);
+        out = task.out[0] + k;
+        _bbi_free(low, k);
+    } else {
+        out = _bbi_todec_dc(out, q, qn, width > k ? width - k : 0);
+        out = _bbi_todec_dc(out, r, pw->len, k);
+    }
+    _bbi_free(q, qn * sizeof(bbi_limb));
+    _bbi_free(r, pw->len * sizeof(bbi_limb));
+    return out;
+}
+
+/* Format a value as a decimal string into buf, which holds bufsize characters.
+
+   Call with buf NULL to find out how big buf needs to be: the result (including the sign and NUL
+   terminator) is an upper bound that only depends on the number of chunks, so one buffer can be
+   sized once and reused for many values. With a buffer, returns the length of the string written
+   (excluding the NUL), or 0 if bufsize is smaller than that bound. */
+size_t bbi_tostring_dec(bbi_chunk *list, char *buf, size_t bufsize) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    /* log10(2) < 1234/4096. 1233/4096 is just below it, and falls a digit short every 217000 or
+       so bits. */
+    size_t bound = (size_t) n * BBI_LIMB_BITS * 1234 / 4096 + 1 + 2;
+    char *out = buf;
+    BBI_STAT_SCOPE(BBI_STAT_TOSTRING, n);
+
+    if (buf == NULL || bufsize < bound) {
+        return buf == NULL ? bound : 0;
+    }
+    if (n == 0) {
+        *out++ = '0';
+    } else {
+        if (list->sign) {
+            *out++ = '-';
+        }
+        out = _bbi_todec_dc(out, list->limbs, n, 0);
+    }
+    *out = '\0';
+    return out - buf;
+}
+
+/* Pairs of hex digits for each byte value */
+static const char hexpairs[] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* Write all 2*sizeof(bbi_limb) hex digits of a chunk. Fixed width with no branches, so the loop
+   over chunks is a straight expansion the compiler can unroll and vectorize. */
+static void _bbi_hex_limb(char *out, bbi_limb val) {
+    unsigned int i;
+
+    for (i = 0; i < sizeof(bbi_limb); i++) {
+        memcpy(&out[2 * (sizeof(bbi_limb) - 1 - i)], &hexpairs[2 * ((val >> (8 * i)) & 0xff)], 2);
+    }
+}
+
+/* Format a value as a lower-case hexadecimal string (no "0x" prefix) into buf. Calling semantics
+   as bbi_tostring_dec(), except the size returned by a query is exact. */
+size_t bbi_tostring_hex(bbi_chunk *list, char *buf, size_t bufsize) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    char top[2 * sizeof(bbi_limb)];
+    size_t topdigits;
+    size_t needed;
+    unsigned int i;
+    char *out = buf;
+    BBI_STAT_SCOPE(BBI_STAT_TOSTRING, n);
+
+    if (n == 0) {
+        needed = 2;
+        topdigits = 0;
+    } else {
+        /* The top chunk is written without its leading zeros */
+        topdigits = (BBI_LIMB_BITS - _bbi_limb_clz(list->limbs[n - 1]) + 3) / 4;
+        needed = (list->sign ? 1 : 0) + topdigits + (size_t) (n - 1) * 2 * sizeof(bbi_limb) + 1;
+    }
+    if (buf == NULL || bufsize < needed) {
+        return buf == NULL ? needed : 0;
+    }
+    if (n == 0) {
+        *out++ = '0';
+    } else {
+        if (list->sign) {
+            *out++ = '-';
+        }
+        _bbi_hex_limb(top, list->limbs[n - 1]);
+        memcpy(out, &top[sizeof(top) - topdigits], topdigits);
+        out += topdigits;
+        for (i = n - 1; i > 0; i--) {
+            _bbi_hex_limb(out, list->limbs[i - 1]);
+            out += 2 * sizeof(bbi_limb);
+        }
+    }
+    *out = '\0';
+    return out - buf;
+}
+
+/*
+ * Streaming conversion, for values too long to hold as one string.
+ *
+ * A bbi_parser takes its input in pieces of any size. Hex digits go straight into chunks. Decimal
+ * digits are gathered into blocks of B = BBI_STREAM_BLOCK, each block is converted with the
+ * divide-and-conquer parser above, and the converted blocks are merged like a binary counter: two
+ * values covering the same number of digits, B * 2^m, become one covering B * 2^(m+1) (high times
+ * a cached power of ten, plus low). That does the same multiplications the whole-string parser
+ * would, and besides the value itself only one block of digits is ever held.
+ *
+ * bbi_format() goes the other way, passing the digits to a callback a bounded piece at a time.
+ * Decimal output splits the value by powers of ten as bbi_tostring_dec() does, but converts only
+ * pieces of at most BBI_STREAM_LEAF chunks into a string at once, in order from the top.
+ */
+
+/* Decimal input is converted BBI_DEC_DIGITS << BBI_STREAM_BLOCK_LOG digits at a time */
+#define BBI_STREAM_BLOCK_LOG 10
+#define BBI_STREAM_BLOCK ((size_t) BBI_DEC_DIGITS << BBI_STREAM_BLOCK_LOG)
+/* Decimal output converts at most this many chunks into a string at once */
+#define BBI_STREAM_LEAF 512
+/* Characters passed to the callback at once for hex output and zero padding, and read at once by
+   bbi_fromfile() */
+#define BBI_STREAM_OUT 4096
+
+#define BBI_PARSE_START 0       /* Nothing but whitespace so far */
+#define BBI_PARSE_SIGN 1        /* Just had the '-' */
+#define BBI_PARSE_DIGITS 2
+#define BBI_PARSE_END 3         /* Whitespace after the digits, so only more can follow */
+#define BBI_PARSE_ERROR 4
+
+/* A converted run of B * 2^level decimal digits (leading zeros included) */
+struct bbi_parse_val {
+    bbi_limb *limbs;
+    unsigned int n;
+    unsigned int size;
+    unsigned int level;
+};
+
+struct bbi_parser {
+    unsigned int base;
+    int state;
+    int sign;
+    /* Decimal: the block being filled, and the converted blocks, most significant first */
+    unsigned char *digits;
+    size_t ndigits;
+    struct bbi_parse_val stack[BBI_POW10_MAX];
+    unsigned int depth;
+    /* Hex: whole chunks in the order they were read (most significant first), and the chunk being
+       filled */
+    bbi_limb *words;
+    unsigned int nwords;
+    unsigned int cap;
+    bbi_limb word;
+    unsigned int nibbles;
+};
+
+/* Start parsing a value in base 10 or 16. Returns NULL for any other base. */
+bbi_parser *bbi_parser_create(unsigned int base) {
+    bbi_parser *p;
+
+    if (base != 10 && base != 16) {
+        return NULL;
+    }
+    p = _bbi_alloc(sizeof(bbi_parser));
+    memset(p, 0, sizeof(bbi_parser));
+    p->base = base;
+    p->state = BBI_PARSE_START;
+    if (base == 10) {
+        p->digits = _bbi_alloc(BBI_STREAM_BLOCK);
+    }
+    return p;
+}
+
+static void _bbi_parser_destroy(bbi_parser *p) {
+    unsigned int i;
+
+    for (i = 0; i < p->depth; i++) {
+        _bbi_free(p->stack[i].limbs, p->stack[i].size * sizeof(bbi_limb));
+    }
+    if (p->digits != NULL) {
+        _bbi_free(p->digits, BBI_STREAM_BLOCK);
+    }
+    if (p->words != NULL) {
+        _bbi_free(p->words, p->cap * sizeof(bbi_limb));
+    }
+    _bbi_free(p, sizeof(bbi_parser));
+}
+
+/* high * 10^(BBI_DEC_DIGITS * 2^j) + low, where low is below that power, into a new value (high and
+   low are freed). The result's level is left to the caller. */
+static struct bbi_parse_val _bbi_parse_join(struct bbi_parse_val high, unsigned int j, struct bbi_parse_val low) {
+    const struct bbi_pow10 *pw;
+    struct bbi_parse_val r;
+    bbi_limb carry;
+
+    if (high.n == 0) {
+        _bbi_free(high.limbs, high.size * sizeof(bbi_limb));
+        return low;
+    }
+    pw = _bbi_pow10(j);
+    r.size = pw->len + high.n;
+    r.limbs = _bbi_alloc(r.size * sizeof(bbi_limb));
+    _bbi_mul(r.limbs, pw->limbs, pw->len, high.limbs, high.n);
+    carry = _bbi_add_n(r.limbs, r.limbs, low.limbs, low.n);
+    carry = _bbi_add_1(&r.limbs[low.n], &r.limbs[low.n], r.size - low.n, carry);
+    assert(carry == 0);
+    (void) carry;
+    r.n = _bbi_normalized_len(r.limbs, r.size);
+    _bbi_free(high.limbs, high.size * sizeof(bbi_limb));
+    _bbi_free(low.limbs, low.size * sizeof(bbi_limb));
+    return r;
+}
+
+/* Convert len digits on their own */
+static struct bbi_parse_val _bbi_parse_block(const unsigned char *s, size_t len) {
+    struct bbi_parse_val v;
+
+    v.size = (unsigned int) _bbi_dec_room(len);
+    v.limbs = _bbi_alloc(v.size * sizeof(bbi_limb));
+    v.n = _bbi_fromdec_dc(v.limbs, s, len);
+    v.level = 0;
+    return v;
+}
+
+/* Convert the full block of digits and merge it in */
+static void _bbi_parser_flush(bbi_parser *p) {
+    struct bbi_parse_val *top;
+    unsigned int level;
+
+    p->stack[p->depth++] = _bbi_parse_block(p->digits, BBI_STREAM_BLOCK);
+    p->ndigits = 0;
+    while (p->depth >= 2 && p->stack[p->depth - 2].level == p->stack[p->depth - 1].level) {
+        top = &p->stack[p->depth - 2];
+        level = top[0].level;
+        *top = _bbi_parse_join(top[0], BBI_STREAM_BLOCK_LOG + level, top[1]);
+        top->level = level + 1;
+        p->depth--;
+    }
+}
+
+static int _bbi_hex_digit(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Feed the next len characters of the value. It's an optional '-' and then digits (either case
+   for hex, no "0x"), and may have whitespace before and after. Returns 0, or -1 once the input
+   has anything else in it - after which the parser only needs bbi_parser_finish(). */
+int bbi_parser_feed(bbi_parser *p, const char *s, size_t len) {
+    const unsigned char *u = (const unsigned char *) s;
+    size_t i;
+    int d;
+
+    for (i = 0; i < len && p->state != BBI_PARSE_ERROR; i++) {
+        if (u[i] == ' ' || u[i] == '\t' || u[i] == '\r' || u[i] == '\n') {
+            if (p->state == BBI_PARSE_SIGN) {
+                p->state = BBI_PARSE_ERROR;
+            } else if (p->state == BBI_PARSE_DIGITS) {
+                p->state = BBI_PARSE_END;
+            }
+            continue;
+        }
+        if (u[i] == '-' && p->state == BBI_PARSE_START) {
+            p->sign = 1;
+            p->state = BBI_PARSE_SIGN;
+            continue;
+        }
+        d = p->base == 10 ? (u[i] >= '0' && u[i] <= '9' ? u[i] - '0' : -1) : _bbi_hex_digit(u[i]);
+        if (d < 0 || p->state == BBI_PARSE_END) {
+            p->state = BBI_PARSE_ERROR;
+            break;
+        }
+        p->state = BBI_PARSE_DIGITS;
+        if (p->base == 10) {
+            p->digits[p->ndigits++] = u[i];
+            if (p->ndigits == BBI_STREAM_BLOCK) {
+                _bbi_parser_flush(p);
+            }
+        } else {
+            p->word = p->word << 4 | (bbi_limb) d;
+            if (++p->nibbles == 2 * sizeof(bbi_limb)) {
+                if (p->nwords == p->cap) {
+                    p->cap = p->cap == 0 ? 16 : 2 * p->cap;
+                    p->words = _bbi_realloc(p->words, p->nwords * sizeof(bbi_limb), p->cap * sizeof(bbi_limb));
+                }
+                p->words[p->nwords++] = p->word;
+                p->word = 0;
+                p->nibbles = 0;
+            }
+        }
+    }
+    return p->state == BBI_PARSE_ERROR ? -1 : 0;
+}
+
+/* Put the decimal blocks and the digits left over together */
+static bbi_chunk *_bbi_parser_finish_dec(bbi_parser *p) {
+    struct bbi_parse_val v;
+    struct bbi_parse_val rest;
+    bbi_limb *limbs;
+    bbi_chunk *list;
+    size_t words;
+    unsigned int size;
+    unsigned int i;
+    unsigned int j;
+    bbi_limb carry;
+    bbi_limb scale = 1;
+
+    if (p->depth == 0) {
+        v = _bbi_parse_block(p->digits, p->ndigits);
+    } else {
+        v = p->stack[0];
+        for (i = 1; i < p->depth; i++) {
+            v = _bbi_parse_join(v, BBI_STREAM_BLOCK_LOG + p->stack[i].level, p->stack[i]);
+        }
+        p->depth = 0;
+        /* Then v * 10^ndigits + the leftover digits, with the power made up from the cached
+           powers of 10^BBI_DEC_DIGITS and one last single-chunk factor */
+        rest = _bbi_parse_block(p->digits, p->ndigits);
+        words = p->ndigits / BBI_DEC_DIGITS;
+        for (j = 0; words >> j != 0; j++) {
+            if ((words >> j & 1) && v.n > 0) {
+                size = _bbi_pow10(j)->len + v.n;
+                limbs = _bbi_alloc(size * sizeof(bbi_limb));
+                _bbi_mul(limbs, _bbi_pow10(j)->limbs, _bbi_pow10(j)->len, v.limbs, v.n);
+                _bbi_free(v.limbs, v.size * sizeof(bbi_limb));
+                v.limbs = limbs;
+                v.size = size;
+                v.n = _bbi_normalized_len(limbs, v.size);
+            }
+        }
+        for (i = 0; i < p->ndigits % BBI_DEC_DIGITS; i++) {
+            scale *= 10;
+        }
+        if (v.n == 0) {
+            /* Every block was zeros, so the leftover digits are the whole value */
+            _bbi_free(v.limbs, v.size * sizeof(bbi_limb));
+            v = rest;
+        } else {
+            limbs = _bbi_alloc((v.n + 2) * sizeof(bbi_limb));
+            limbs[v.n] = _bbi_mul_1(limbs, v.limbs, v.n, scale);
+            limbs[v.n + 1] = 0;
+            carry = _bbi_add_n(limbs, limbs, rest.limbs, rest.n);
+            carry = _bbi_add_1(&limbs[rest.n], &limbs[rest.n], v.n + 2 - rest.n, carry);
+            assert(carry == 0);
+            (void) carry;
+            _bbi_free(v.limbs, v.size * sizeof(bbi_limb));
+            _bbi_free(rest.limbs, rest.size * sizeof(bbi_limb));
+            v.limbs = limbs;
+            v.size = v.n + 2;
+            v.n = _bbi_normalized_len(limbs, v.size);
+        }
+    }
+
+    list = _bbi_alloc_chunks(v.n > 0 ? v.n : 1);
+    memcpy(list->limbs, v.limbs, v.n * sizeof(bbi_limb));
+    list->len = v.n;
+    _bbi_free(v.limbs, v.size * sizeof(bbi_limb));
+    return list;
+}
+
+/* Hex: the whole chunks were read most significant first, so reverse them, then shift the partial
+   chunk in at the bottom */
+static bbi_chunk *_bbi_parser_finish_hex(bbi_parser *p) {
+    unsigned int n = p->nwords;
+    bbi_chunk *list = _bbi_alloc_chunks(n + 1);
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        list->limbs[i] = p->words[n - 1 - i];
+    }
+    list->limbs[n] = 0;
+    if (p->nibbles > 0) {
+        if (n > 0) {
+            list->limbs[n] = _bbi_lshift(list->limbs, list->limbs, n, 4 * p->nibbles);
+        }
+        list->limbs[0] |= p->word;
+    }
+    list->len = _bbi_normalized_len(list->limbs, n + 1);
+    return list;
+}
+
+/* Finish parsing and free the parser. Returns the value, or NULL if the input had anything but the
+   optional sign, digits and surrounding whitespace, or had no digits at all. */
+bbi_chunk *bbi_parser_finish(bbi_parser *p) {
+    bbi_chunk *list = NULL;
+
+    if (p->state == BBI_PARSE_DIGITS || p->state == BBI_PARSE_END) {
+        list = p->base == 10 ? _bbi_parser_finish_dec(p) : _bbi_parser_finish_hex(p);
+        if (list->len == 0) {
+            list->limbs[0] = 0;
+            list->len = 1;
+            list->sign = 0;
+        } else {
+            list->sign = p->sign;
+        }
+    }
+    _bbi_parser_destroy(p);
+    return list;
+}
+
+/* Parse a whole stream in base 10 or 16, reading it a buffer at a time. Returns NULL if it
+   doesn't hold exactly one value, or on a read error. */
+bbi_chunk *bbi_fromfile(FILE *f, unsigned int base) {
+    bbi_parser *p = bbi_parser_create(base);
+    char *buf;
+    size_t got;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    buf = _bbi_alloc(BBI_STREAM_OUT);
+    while ((got = fread(buf, 1, BBI_STREAM_OUT, f)) > 0) {
+        if (bbi_parser_feed(p, buf, got) != 0) {
+            break;
+        }
+    }
+    _bbi_free(buf, BBI_STREAM_OUT);
+    if (ferror(f)) {
+        p->state = BBI_PARSE_ERROR;
+    }
+    return bbi_parser_finish(p);
+}
+
+/* State for one bbi_format() call */
+struct bbi_format_out {
+    bbi_write_fn write;
+    void *ctx;
+    char *buf;          /* BBI_STREAM_OUT characters, or a leaf's worth for decimal */
+    char *zeros;        /* BBI_STREAM_OUT '0's, made when first needed */
+    int err;
+};
+
+static void _bbi_format_emit(struct bbi_format_out *o, const char *s, size_t len) {
+    if (o->err == 0 && len > 0) {
+        o->err = o->write(o->ctx, s, len);
+    }
+}
+
+static void _bbi_format_zeros(struct bbi_format_out *o, size_t count) {
+    size_t take;
+
+    if (o->zeros == NULL) {
+        o->zeros = _bbi_alloc(BBI_STREAM_OUT);
+        memset(o->zeros, '0', BBI_STREAM_OUT);
+    }
+    while (count > 0 && o->err == 0) {
+        take = count < BBI_STREAM_OUT ? count : BBI_STREAM_OUT;
+        _bbi_format_emit(o, o->zeros, take);
+        count -= take;
+    }
+}
+
+/* Decimal digits of nn chunks at np, zero-padded to width, top down as in _bbi_todec_dc() */
+static void _bbi_format_dec(struct bbi_format_out *o, const bbi_limb *np, unsigned int nn, size_t width) {
+    const struct bbi_pow10 *pw;
+    bbi_limb *q;
+    bbi_limb *r;
+    unsigned int qn;
+    size_t k = BBI_DEC_DIGITS;
+    unsigned int j = 0;
+    size_t len;
+
+    nn = _bbi_normalized_len(np, nn);
+    if (o->err != 0) {
+        return;
+    }
+    if (nn <= BBI_STREAM_LEAF) {
+        len = _bbi_todec_dc(o->buf, np, nn, 0) - o->buf;
+        if (width > len) {
+            _bbi_format_zeros(o, width - len);
+        }
+        _bbi_format_emit(o, o->buf, len);
+        return;
+    }
+    while (_bbi_pow10(j + 1)->len * 2 <= nn) {
+        j++;
+        k *= 2;
+    }
+    pw = _bbi_pow10(j);
+    qn = nn - pw->len + 1;
+    q = _bbi_alloc(qn * sizeof(bbi_limb));
+    r = _bbi_alloc(pw->len * sizeof(bbi_limb));
+    _bbi_divrem(q, r, np, nn, pw->limbs, pw->len);
+    _bbi_format_dec(o, q, qn, width > k ? width - k : 0);
+    /* The quotient is done with before the remainder is converted */
+    _bbi_free(q, qn * sizeof(bbi_limb));
+    _bbi_format_dec(o, r, pw->len, k);
+    _bbi_free(r, pw->len * sizeof(bbi_limb));
+}
+
+/* Write a value in base 10 or 16 (lower case, no "0x") through write(ctx, s, len), a bounded
+   piece at a time, with no terminator. Returns 0, -1 for another base, or the first non-zero
+   value write returns, which stops the output there. */
+int bbi_format(bbi_chunk *list, unsigned int base, bbi_write_fn write, void *ctx) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    struct bbi_format_out o;
+    /* Enough for the digits of BBI_STREAM_LEAF chunks - see bbi_tostring_dec() */
+    size_t bufsize = base == 10 ? (size_t) BBI_STREAM_LEAF * BBI_LIMB_BITS * 1234 / 4096 + 1 : BBI_STREAM_OUT;
+    size_t fill = 0;
+    char top[2 * sizeof(bbi_limb)];
+    size_t topdigits;
+    unsigned int i;
+    BBI_STAT_SCOPE(BBI_STAT_TOSTRING, n);
+
+    if (base != 10 && base != 16) {
+        return -1;
+    }
+    o.write = write;
+    o.ctx = ctx;
+    o.zeros = NULL;
+    o.err = 0;
+    if (n == 0) {
+        _bbi_format_emit(&o, "0", 1);
+        return o.err;
+    }
+    if (list->sign) {
+        _bbi_format_emit(&o, "-", 1);
+    }
+    o.buf = _bbi_alloc(bufsize);
+    if (base == 10) {
+        _bbi_format_dec(&o, list->limbs, n, 0);
+    } else {
+        topdigits = (BBI_LIMB_BITS - _bbi_limb_clz(list->limbs[n - 1]) + 3) / 4;
+        _bbi_hex_limb(top, list->limbs[n - 1]);
+        _bbi_format_emit(&o, &top[sizeof(top) - topdigits], topdigits);
+        for (i = n - 1; i > 0; i--) {
+            _bbi_hex_limb(&o.buf[fill], list->limbs[i - 1]);
+            fill += 2 * sizeof(bbi_limb);
+            if (fill + 2 * sizeof(bbi_limb) > bufsize || i == 1) {
+                _bbi_format_emit(&o, o.buf, fill);
+                fill = 0;
+            }
+        }
+    }
+    _bbi_free(o.buf, bufsize);
+    if (o.zeros != NULL) {
+        _bbi_free(o.zeros, BBI_STREAM_OUT);
+    }
+    return o.err;
+}
+
+static int _bbi_format_fwrite(void *ctx, const char *s, size_t len) {
+    return fwrite(s, 1, len, (FILE *) ctx) == len ? 0 : -1;
+}
+
+/* bbi_format() to a stream. Returns 0, or -1 on a write error or a base other than 10 or 16. */
+int bbi_format_file(bbi_chunk *list, unsigned int base, FILE *f) {
+    return bbi_format(list, base, _bbi_format_fwrite, f) == 0 ? 0 : -1;
+}
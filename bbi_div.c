@@ -0,0 +1,434 @@
+/*
+ * Division on raw chunk arrays, least-significant chunk first, and the bbi_divmod() entry points.
+ *
+ * Every path divides by a normalized divisor, shifted so its top bit is set, using a precomputed
+ * reciprocal of its top chunk in place of the hardware's double-width divide (Moller and
+ * Granlund, "Improved division by invariant integers"). Single-chunk divisors go a chunk at a
+ * time, longer ones use Knuth's Algorithm D, and from BBI_DIV_DC_THRESHOLD chunks the quotient is
+ * found recursively, Burnikel-Ziegler style, so the work is done by the fast multiplication.
+ * Normalizing and inverting only depend on the divisor, so a bbi_divisor keeps them for reuse.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+#include "bbi_tune.h"
+
+unsigned int _bbi_div_dc_threshold = BBI_DIV_DC_THRESHOLD;
+
+/* Whether an n-chunk divisor is divided recursively. Below 4 chunks the halves could be single
+   chunks, which Algorithm D doesn't handle. */
+static inline int _bbi_div_use_dc(unsigned int n) {
+    return n >= _bbi_div_dc_threshold && n >= 4;
+}
+
+/* floor((B^2 - 1) / d) - B for a normalized d, where B = 2^BBI_LIMB_BITS */
+bbi_limb _bbi_invert_limb(bbi_limb d) {
+    assert(d >> (BBI_LIMB_BITS - 1));
+    return (bbi_limb) ((((bbi_dlimb) ~d) << BBI_LIMB_BITS | (bbi_limb) ~0) / d);
+}
+
+/* Divide u1:u0 by a normalized d with reciprocal dinv, for u1 < d. Returns the quotient chunk and
+   stores the remainder in *r. */
+static inline bbi_limb _bbi_div_preinv(bbi_limb u1, bbi_limb u0, bbi_limb d, bbi_limb dinv, bbi_limb *r) {
+    bbi_dlimb q = (bbi_dlimb) dinv * u1 + (((bbi_dlimb) u1 << BBI_LIMB_BITS) | u0);
+    bbi_limb q1 = (bbi_limb) (q >> BBI_LIMB_BITS) + 1;
+    bbi_limb q0 = (bbi_limb) q;
+    bbi_limb rem = u0 - q1 * d;
+
+    if (rem > q0) {
+        q1--;
+        rem += d;
+    }
+    if (rem >= d) {
+        q1++;
+        rem -= d;
+    }
+    *r = rem;
+    return q1;
+}
+
+/* Divide n chunks of ap by d, where dnorm = d << shift is normalized and dinv its reciprocal.
+   qp may be ap. */
+bbi_limb _bbi_divrem_1_preinv(bbi_limb *qp, const bbi_limb *ap, unsigned int n, bbi_limb dnorm,
+                              unsigned int shift, bbi_limb dinv) {
+    bbi_limb r = 0;
+    bbi_limb u0;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (shift == 0) {
+        while (n > 0) {
+            n--;
+            qp[n] = _bbi_div_preinv(r, ap[n], dnorm, dinv, &r);
+        }
+        return r;
+    }
+    /* Shift the numerator on the fly - the bits above the top chunk start off the remainder */
+    r = ap[n - 1] >> (BBI_LIMB_BITS - shift);
+    while (--n > 0) {
+        u0 = (ap[n] << shift) | (ap[n - 1] >> (BBI_LIMB_BITS - shift));
+        qp[n] = _bbi_div_preinv(r, u0, dnorm, dinv, &r);
+    }
+    qp[0] = _bbi_div_preinv(r, ap[0] << shift, dnorm, dinv, &r);
+    return r >> shift;
+}
+
+bbi_limb _bbi_divrem_1(bbi_limb *qp, const bbi_limb *ap, unsigned int n, bbi_limb d) {
+    unsigned int shift;
+
+    assert(d != 0);
+    shift = _bbi_limb_clz(d);
+    return _bbi_divrem_1_preinv(qp, ap, n, d << shift, shift, _bbi_invert_limb(d << shift));
+}
+
+/* The remainder of n chunks of ap divided by d, without the quotient */
+bbi_limb _bbi_mod_1(const bbi_limb *ap, unsigned int n, bbi_limb d) {
+    unsigned int shift;
+    bbi_limb dnorm;
+    bbi_limb dinv;
+    bbi_limb r;
+
+    assert(d != 0);
+    if (n == 0) {
+        return 0;
+    }
+    shift = _bbi_limb_clz(d);
+    dnorm = d << shift;
+    dinv = _bbi_invert_limb(dnorm);
+    if (shift == 0) {
+        r = 0;
+        while (n > 0) {
+            n--;
+            _bbi_div_preinv(r, ap[n], dnorm, dinv, &r);
+        }
+        return r;
+    }
+    r = ap[n - 1] >> (BBI_LIMB_BITS - shift);
+    while (--n > 0) {
+        _bbi_div_preinv(r, (ap[n] << shift) | (ap[n - 1] >> (BBI_LIMB_BITS - shift)), dnorm, dinv, &r);
+    }
+    _bbi_div_preinv(r, ap[0] << shift, dnorm, dinv, &r);
+    return r >> shift;
+}
+
+/* Divide n chunks of ap by an odd d that's known to divide it exactly, writing the quotient to rp
+   (which may be ap). Works from the bottom up with d's inverse mod 2^BBI_LIMB_BITS (Hensel
+   division), so it's a multiplication per chunk rather than a division. */
+void _bbi_divexact_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb d) {
+    bbi_limb inv = d;
+    bbi_limb borrow = 0;
+    bbi_limb s;
+    bbi_limb q;
+    unsigned int i;
+
+    assert(d & 1);
+    /* Newton's iteration doubles the number of correct low bits each time: 3 -> 6 -> ... -> 96 */
+    for (i = 0; i < 5; i++) {
+        inv *= 2 - d * inv;
+    }
+    for (i = 0; i < n; i++) {
+        s = ap[i];
+        q = (s - borrow) * inv;
+        borrow = (s < borrow) + (bbi_limb) (((bbi_dlimb) q * d) >> BBI_LIMB_BITS);
+        rp[i] = q;
+    }
+    assert(borrow == 0);
+}
+
+/* Knuth's Algorithm D (TAOCP vol. 2, 4.3.1) on a normalized divisor, in place: divides nn chunks
+   of np by dn >= 2 chunks of dp, writing nn-dn quotient chunks to qp and leaving the remainder in
+   the bottom dn chunks of np. Returns the quotient's top chunk, 0 or 1, which is there when the
+   top dn chunks of np are at least dp. */
+static bbi_limb _bbi_sb_div_qr(bbi_limb *qp, bbi_limb *np, unsigned int nn, const bbi_limb *dp,
+                               unsigned int dn, bbi_limb dinv) {
+    bbi_limb d1 = dp[dn - 1];
+    bbi_limb d0 = dp[dn - 2];
+    bbi_limb qh = 0;
+    bbi_limb qhat;
+    bbi_limb rhat;
+    bbi_limb n1;
+    bbi_limb borrow;
+    unsigned int j;
+    int rhat_carry;
+
+    if (_bbi_cmp(&np[nn - dn], dn, dp, dn) >= 0) {
+        _bbi_sub_n(&np[nn - dn], &np[nn - dn], dp, dn);
+        qh = 1;
+    }
+    j = nn - dn;
+    while (j > 0) {
+        j--;
+        /* Estimate from the top two chunks of the remainder, then refine with the next one, after
+           which qhat is at most 1 too large */
+        n1 = np[j + dn];
+        if (n1 >= d1) {
+            qhat = (bbi_limb) ~0;
+            rhat = np[j + dn - 1] + d1;
+            rhat_carry = rhat < d1;
+        } else {
+            qhat = _bbi_div_preinv(n1, np[j + dn - 1], d1, dinv, &rhat);
+            rhat_carry = 0;
+        }
+        while (!rhat_carry && (bbi_dlimb) qhat * d0 > (((bbi_dlimb) rhat << BBI_LIMB_BITS) | np[j + dn - 2])) {
+            qhat--;
+            rhat += d1;
+            rhat_carry = rhat < d1;
+        }
+
+        /* Multiply and subtract - if that goes negative, qhat was still one too large */
+        borrow = _bbi_submul_1(&np[j], dp, dn, qhat);
+        if (n1 < borrow) {
+            qhat--;
+            _bbi_add_n(&np[j], &np[j], dp, dn);
+        }
+        np[j + dn] = 0;
+        qp[j] = qhat;
+    }
+    return qh;
+}
+
+/* Recursive division of 2n chunks of np by n chunks of a normalized dp, in place like
+   _bbi_sb_div_qr(): the top half of the quotient comes from dividing the top of np by the top half
+   of dp, then correcting with a multiplication by the bottom half, and the bottom half of the
+   quotient the same way from what's left. tp is n chunks of scratch. */
+static bbi_limb _bbi_dc_div_qr_n(bbi_limb *qp, bbi_limb *np, const bbi_limb *dp, unsigned int n,
+                                 bbi_limb dinv, bbi_limb *tp) {
+    unsigned int lo = n / 2;
+    unsigned int hi = n - lo;
+    bbi_limb qh;
+    bbi_limb ql;
+    bbi_limb cy;
+
+    if (_bbi_div_use_dc(hi)) {
+        qh = _bbi_dc_div_qr_n(&qp[lo], &np[2 * lo], &dp[lo], hi, dinv, tp);
+    } else {
+        qh = _bbi_sb_div_qr(&qp[lo], &np[2 * lo], 2 * hi, &dp[lo], hi, dinv);
+    }
+    _bbi_mul(tp, &qp[lo], hi, dp, lo);
+    cy = _bbi_sub_n(&np[lo], &np[lo], tp, n);
+    if (qh != 0) {
+        cy += _bbi_sub_n(&np[n], &np[n], dp, lo);
+    }
+    while (cy != 0) {
+        qh -= _bbi_sub_1(&qp[lo], &qp[lo], hi, 1);
+        cy -= _bbi_add_n(&np[lo], &np[lo], dp, n);
+    }
+
+    if (_bbi_div_use_dc(lo)) {
+        ql = _bbi_dc_div_qr_n(qp, &np[hi], &dp[hi], lo, dinv, tp);
+    } else {
+        ql = _bbi_sb_div_qr(qp, &np[hi], 2 * lo, &dp[hi], lo, dinv);
+    }
+    _bbi_mul(tp, dp, hi, qp, lo);
+    cy = _bbi_sub_n(np, np, tp, n);
+    if (ql != 0) {
+        cy += _bbi_sub_n(&np[lo], &np[lo], dp, hi);
+    }
+    while (cy != 0) {
+        _bbi_sub_1(qp, qp, lo, 1);
+        cy -= _bbi_add_n(np, np, dp, n);
+    }
+    return qh;
+}
+
+/* qn < dn quotient chunks from the qn+dn chunks of np, whose top dn chunks are less than dp, in
+   place like _bbi_sb_div_qr(). Done like the first half of _bbi_dc_div_qr_n(): divide by the top
+   qn chunks of dp, then correct for the rest. tp is dn chunks of scratch. */
+static void _bbi_dc_div_qr_top(bbi_limb *qp, bbi_limb *np, unsigned int qn, const bbi_limb *dp,
+                               unsigned int dn, bbi_limb dinv, bbi_limb *tp) {
+    unsigned int lo = dn - qn;
+    bbi_limb qh;
+    bbi_limb cy;
+
+    if (!_bbi_div_use_dc(qn)) {
+        _bbi_sb_div_qr(qp, np, qn + dn, dp, dn, dinv);
+        return;
+    }
+    qh = _bbi_dc_div_qr_n(qp, &np[lo], &dp[lo], qn, dinv, tp);
+    _bbi_mul(tp, dp, lo, qp, qn);
+    cy = _bbi_sub_n(np, np, tp, dn);
+    if (qh != 0) {
+        cy += _bbi_sub_n(&np[qn], &np[qn], dp, lo);
+    }
+    while (cy != 0) {
+        qh -= _bbi_sub_1(qp, qp, qn, 1);
+        cy -= _bbi_add_n(np, np, dp, dn);
+    }
+    assert(qh == 0);
+}
+
+/* Divide nn chunks of np by dn chunks of dp, normalized as dp << shift into vn, with dinv the
+   reciprocal of vn's top chunk. Writes nn-dn+1 quotient chunks to qp (if not NULL) and dn
+   remainder chunks to rp (if not NULL). */
+void _bbi_divrem_preinv(bbi_limb *qp, bbi_limb *rp, const bbi_limb *np, unsigned int nn,
+                        const bbi_limb *vn, unsigned int dn, unsigned int shift, bbi_limb dinv) {
+    bbi_limb *un;
+    bbi_limb *q;
+    bbi_limb *tp;
+    bbi_limb r;
+    unsigned int qn;
+    unsigned int i;
+
+    assert(dn > 0 && nn >= dn);
+    if (dn == 1) {
+        q = qp != NULL ? qp : _bbi_alloc(nn * sizeof(bbi_limb));
+        r = _bbi_divrem_1_preinv(q, np, nn, vn[0], shift, dinv);
+        if (rp != NULL) {
+            rp[0] = r;
+        }
+        if (qp == NULL) {
+            _bbi_free(q, nn * sizeof(bbi_limb));
+        }
+        return;
+    }
+
+    /* The shifted numerator gets an extra chunk on top, which is less than vn's top chunk, so the
+       quotient never has a top chunk past nn-dn+1 */
+    qn = nn + 1 - dn;
+    un = _bbi_alloc((nn + 1 + (qp == NULL ? qn : 0)) * sizeof(bbi_limb));
+    q = qp != NULL ? qp : &un[nn + 1];
+    if (shift != 0) {
+        un[nn] = _bbi_lshift(un, np, nn, shift);
+    } else {
+        memcpy(un, np, nn * sizeof(bbi_limb));
+        un[nn] = 0;
+    }
+
+    if (!_bbi_div_use_dc(dn)) {
+        _bbi_sb_div_qr(q, un, nn + 1, vn, dn, dinv);
+    } else {
+        /* The quotient comes dn chunks at a time from 2dn by dn divisions, whose top halves are
+           what's left over from the block above, so are less than vn. The qn % dn chunks left over
+           at the top go first. */
+        tp = _bbi_alloc(dn * sizeof(bbi_limb));
+        i = qn % dn;
+        if (i != 0) {
+            _bbi_dc_div_qr_top(&q[qn - i], &un[qn - i], i, vn, dn, dinv, tp);
+        }
+        for (i = qn - i; i > 0; i -= dn) {
+            _bbi_dc_div_qr_n(&q[i - dn], &un[i - dn], vn, dn, dinv, tp);
+        }
+        _bbi_free(tp, dn * sizeof(bbi_limb));
+    }
+
+    if (rp != NULL) {
+        if (shift != 0) {
+            _bbi_rshift(rp, un, dn, shift);
+        } else {
+            memcpy(rp, un, dn * sizeof(bbi_limb));
+        }
+    }
+    _bbi_free(un, (nn + 1 + (qp == NULL ? qn : 0)) * sizeof(bbi_limb));
+}
+
+void _bbi_divrem(bbi_limb *qp, bbi_limb *rp, const bbi_limb *np, unsigned int nn, const bbi_limb *dp, unsigned int dn) {
+    bbi_limb *vn;
+    unsigned int shift;
+
+    assert(dn > 0 && nn >= dn && dp[dn - 1] != 0);
+    shift = _bbi_limb_clz(dp[dn - 1]);
+    vn = _bbi_alloc(dn * sizeof(bbi_limb));
+    if (shift != 0) {
+        _bbi_lshift(vn, dp, dn, shift);
+    } else {
+        memcpy(vn, dp, dn * sizeof(bbi_limb));
+    }
+    _bbi_divrem_preinv(qp, rp, np, nn, vn, dn, shift, _bbi_invert_limb(vn[dn - 1]));
+    _bbi_free(vn, dn * sizeof(bbi_limb));
+}
+
+/* Normalize and invert a divisor once, for dividing many values by it. Returns NULL for 0. */
+bbi_divisor *bbi_divisor_create(bbi_chunk *list) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    bbi_divisor *div;
+
+    if (n == 0) {
+        return NULL;
+    }
+    div = _bbi_alloc(sizeof(bbi_divisor));
+    div->limbs = _bbi_alloc(n * sizeof(bbi_limb));
+    div->len = n;
+    div->shift = _bbi_limb_clz(list->limbs[n - 1]);
+    if (div->shift != 0) {
+        _bbi_lshift(div->limbs, list->limbs, n, div->shift);
+    } else {
+        memcpy(div->limbs, list->limbs, n * sizeof(bbi_limb));
+    }
+    div->inv = _bbi_invert_limb(div->limbs[n - 1]);
+    div->sign = list->sign;
+    return div;
+}
+
+void bbi_divisor_destroy(bbi_divisor *div) {
+    _bbi_free(div->limbs, div->len * sizeof(bbi_limb));
+    _bbi_free(div, sizeof(bbi_divisor));
+}
+
+/* Divide by a prepared divisor - see bbi_divmod() */
+bbi_chunk *bbi_divmod_pre(bbi_chunk *list_a, const bbi_divisor *div, bbi_chunk **rem) {
+    unsigned int an = _bbi_normalized_len(list_a->limbs, list_a->len);
+    unsigned int dn = div->len;
+    bbi_chunk *quot;
+    bbi_chunk *r;
+    BBI_STAT_SCOPE(BBI_STAT_DIVMOD, an + dn);
+
+    if (an < dn) {
+        /* Quotient 0, the remainder is all of a */
+        if (rem != NULL) {
+            *rem = bbi_copy(list_a);
+            (*rem)->len = an > 0 ? an : 1;
+            (*rem)->sign = an > 0 ? list_a->sign : 0;
+        }
+        return bbi_create();
+    }
+    quot = _bbi_alloc_chunks(an - dn + 1);
+    r = rem != NULL ? _bbi_alloc_chunks(dn) : NULL;
+    _bbi_divrem_preinv(quot->limbs, r != NULL ? r->limbs : NULL, list_a->limbs, an, div->limbs, dn,
+                       div->shift, div->inv);
+    quot->len = _bbi_normalized_len(quot->limbs, an - dn + 1);
+    quot->sign = quot->len > 0 ? list_a->sign ^ div->sign : 0;
+    if (quot->len == 0) {
+        quot->len = 1;
+    }
+    if (r != NULL) {
+        r->len = _bbi_normalized_len(r->limbs, dn);
+        r->sign = r->len > 0 ? list_a->sign : 0;
+        if (r->len == 0) {
+            r->len = 1;
+        }
+        *rem = r;
+    }
+    return quot;
+}
+
+/* Divide a by b, rounding towards zero like C's / and %: the quotient is returned and the
+   remainder, which takes a's sign, is stored in *rem if rem isn't NULL. Returns NULL (and leaves
+   *rem alone) if b is 0. */
+bbi_chunk *bbi_divmod(bbi_chunk *list_a, bbi_chunk *list_b, bbi_chunk **rem) {
+    bbi_divisor *div = bbi_divisor_create(list_b);
+    bbi_chunk *quot;
+
+    if (div == NULL) {
+        return NULL;
+    }
+    quot = bbi_divmod_pre(list_a, div, rem);
+    bbi_divisor_destroy(div);
+    return quot;
+}
+
+bbi_chunk *bbi_div(bbi_chunk *list_a, bbi_chunk *list_b) {
+    return bbi_divmod(list_a, list_b, NULL);
+}
+
+bbi_chunk *bbi_mod(bbi_chunk *list_a, bbi_chunk *list_b) {
+    bbi_chunk *rem;
+    bbi_chunk *quot = bbi_divmod(list_a, list_b, &rem);
+
+    if (quot == NULL) {
+        return NULL;
+    }
+    bbi_destroy(quot);
+    return rem;
+}
@@ -0,0 +1,297 @@
+/*
+ * Deferred expressions: chains of bitwise operations and additions evaluated in one pass.
+ *
+ * bbi_xor(bbi_and(a, b), bbi_not(c)) copies a, b's AND into the copy, copies c, complements that,
+ * and XORs the two copies - three allocations and four walks over the chunks for one result. A
+ * bbi_expr records the same operations as a list of nodes instead, and bbi_expr_eval() runs them
+ * all together a block of BBI_EXPR_BLOCK chunks at a time: for each block every node's output is
+ * computed from its operands' outputs for that block, into a small per-node buffer that stays in
+ * the L1 cache, and the root's block is written straight to the destination. Each operand is read
+ * once and the destination written once, whatever the expression's size, and no bigints are made
+ * for the intermediate values.
+ *
+ * Values behave as in bbi_and() and friends, as two's complement with infinitely many sign bits:
+ * a negative value's chunks are complemented as they're read (~(m - 1), as _bbi_bitop_signed()
+ * does), every node then works on plain two's complement chunks - an addition just carries from
+ * block to block - and a negative result is turned back into a magnitude at the end. Above its
+ * top chunk every node's output is its sign bits repeated, so the result needs only as many chunks
+ * as its widest operand, plus one for each addition on the way up and one for the sign.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+
+/* Chunks per block. Every node in use has a buffer this big, or as big as the result if that is
+   shorter. */
+#define BBI_EXPR_BLOCK 256
+
+#define BBI_EXPR_VALUE 0
+#define BBI_EXPR_NOT 1
+#define BBI_EXPR_AND 2
+#define BBI_EXPR_OR 3
+#define BBI_EXPR_XOR 4
+#define BBI_EXPR_ADD 5
+#define BBI_EXPR_SUB 6
+
+struct bbi_expr_node {
+    int op;
+    int x;              /* Operands, as node numbers, for everything but a value */
+    int y;
+    bbi_chunk *list;    /* The value, read when the expression is evaluated */
+};
+
+/* Per-node state while evaluating */
+struct bbi_expr_state {
+    const bbi_limb *out;    /* This block of the node's output */
+    bbi_limb *buf;          /* Where it goes when it isn't read straight from a value */
+    bbi_limb carry;         /* Carry of an addition, borrow of a negative value's - 1 */
+    unsigned int len;       /* Chunks needed to hold the output with its sign */
+    unsigned int vn;        /* A value's normalized length */
+    int neg;                /* A value is negative */
+    int used;               /* The node is part of the expression being evaluated */
+};
+
+struct bbi_expr {
+    struct bbi_expr_node *nodes;
+    unsigned int n;
+    unsigned int alloc;
+    /* Scratch for bbi_expr_eval(), kept between calls so evaluating again doesn't allocate */
+    struct bbi_expr_state *st;
+    unsigned int st_alloc;
+    bbi_limb *bufs;
+    size_t bufs_alloc;
+};
+
+bbi_expr *bbi_expr_create() {
+    bbi_expr *e = _bbi_alloc(sizeof(bbi_expr));
+
+    e->alloc = 8;
+    e->n = 0;
+    e->nodes = _bbi_alloc(e->alloc * sizeof(struct bbi_expr_node));
+    e->st = NULL;
+    e->st_alloc = 0;
+    e->bufs = NULL;
+    e->bufs_alloc = 0;
+    return e;
+}
+
+void bbi_expr_destroy(bbi_expr *e) {
+    _bbi_free(e->nodes, e->alloc * sizeof(struct bbi_expr_node));
+    _bbi_free(e->st, e->st_alloc * sizeof(struct bbi_expr_state));
+    _bbi_free(e->bufs, e->bufs_alloc * sizeof(bbi_limb));
+    _bbi_free(e, sizeof(bbi_expr));
+}
+
+/* Forget every node, to build a new expression with the same builder */
+void bbi_expr_reset(bbi_expr *e) {
+    e->n = 0;
+}
+
+/* Add a node, returning its number, or -1 if an operand isn't a node of this expression */
+static int _bbi_expr_node(bbi_expr *e, int op, int x, int y, bbi_chunk *list) {
+    if (op != BBI_EXPR_VALUE && (x < 0 || (unsigned int) x >= e->n || y < 0 || (unsigned int) y >= e->n)) {
+        return -1;
+    }
+    if (e->n == e->alloc) {
+        e->nodes = _bbi_realloc(e->nodes, e->alloc * sizeof(struct bbi_expr_node),
+                                2 * e->alloc * sizeof(struct bbi_expr_node));
+        e->alloc *= 2;
+    }
+    e->nodes[e->n].op = op;
+    e->nodes[e->n].x = x;
+    e->nodes[e->n].y = y;
+    e->nodes[e->n].list = list;
+    return (int) e->n++;
+}
+
+/* A value, by reference: it's read when the expression is evaluated, not now, so the same
+   expression can be evaluated again after the value changes */
+int bbi_expr_value(bbi_expr *e, bbi_chunk *list) {
+    return _bbi_expr_node(e, BBI_EXPR_VALUE, 0, 0, list);
+}
+
+int bbi_expr_not(bbi_expr *e, int x) {
+    return _bbi_expr_node(e, BBI_EXPR_NOT, x, x, NULL);
+}
+
+int bbi_expr_and(bbi_expr *e, int x, int y) {
+    return _bbi_expr_node(e, BBI_EXPR_AND, x, y, NULL);
+}
+
+int bbi_expr_or(bbi_expr *e, int x, int y) {
+    return _bbi_expr_node(e, BBI_EXPR_OR, x, y, NULL);
+}
+
+int bbi_expr_xor(bbi_expr *e, int x, int y) {
+    return _bbi_expr_node(e, BBI_EXPR_XOR, x, y, NULL);
+}
+
+int bbi_expr_add(bbi_expr *e, int x, int y) {
+    return _bbi_expr_node(e, BBI_EXPR_ADD, x, y, NULL);
+}
+
+int bbi_expr_sub(bbi_expr *e, int x, int y) {
+    return _bbi_expr_node(e, BBI_EXPR_SUB, x, y, NULL);
+}
+
+/* One block of a value's two's complement, from chunk off for n chunks. A non-negative value
+   inside its length is read in place. */
+static void _bbi_expr_load(struct bbi_expr_state *st, const bbi_limb *limbs, unsigned int off, unsigned int n) {
+    unsigned int k = st->vn > off ? st->vn - off : 0;
+    unsigned int i;
+
+    if (k > n) {
+        k = n;
+    }
+    if (!st->neg) {
+        if (k == n) {
+            st->out = &limbs[off];
+            return;
+        }
+        memcpy(st->buf, &limbs[off], k * sizeof(bbi_limb));
+        memset(&st->buf[k], 0, (n - k) * sizeof(bbi_limb));
+    } else {
+        /* ~(m - 1): the borrow stops at the lowest nonzero chunk, which is below vn */
+        for (i = 0; i < k && st->carry; i++) {
+            st->buf[i] = ~(limbs[off + i] - 1);
+            st->carry = limbs[off + i] == 0;
+        }
+        _bbi_not_n(&st->buf[i], &limbs[off + i], k - i);
+        memset(&st->buf[k], 0xff, (n - k) * sizeof(bbi_limb));
+    }
+    st->out = st->buf;
+}
+
+/* Evaluate node root of the expression into dst, which is resized to fit and returned, or into a
+   new value if dst is NULL. dst may be one of the expression's values - each block of them is read
+   before that block of the result is written - but not a view. Returns NULL if root isn't a node
+   of this expression. */
+bbi_chunk *bbi_expr_eval(bbi_expr *e, int root, bbi_chunk *dst) {
+    struct bbi_expr_state *st;
+    struct bbi_expr_node *node;
+    bbi_limb c;
+    unsigned int nbufs;
+    unsigned int block;
+    unsigned int len;
+    unsigned int off;
+    unsigned int n;
+    int i;
+    BBI_STAT_SCOPE(BBI_STAT_EXPR, e->n);
+
+    if (root < 0 || (unsigned int) root >= e->n) {
+        return NULL;
+    }
+
+    /* Mark the nodes the root depends on - operands always come before the nodes using them - and
+       work out how long each one's output is */
+    if (e->st_alloc < (unsigned int) root + 1) {
+        _bbi_free(e->st, e->st_alloc * sizeof(struct bbi_expr_state));
+        e->st_alloc = e->alloc;
+        e->st = _bbi_alloc(e->st_alloc * sizeof(struct bbi_expr_state));
+    }
+    st = e->st;
+    memset(st, 0, (root + 1) * sizeof(struct bbi_expr_state));
+    st[root].used = 1;
+    for (i = root; i >= 0; i--) {
+        if (st[i].used && e->nodes[i].op != BBI_EXPR_VALUE) {
+            st[e->nodes[i].x].used = 1;
+            st[e->nodes[i].y].used = 1;
+        }
+    }
+    nbufs = 0;
+    for (i = 0; i <= root; i++) {
+        node = &e->nodes[i];
+        if (!st[i].used) {
+            continue;
+        }
+        nbufs++;
+        if (node->op == BBI_EXPR_VALUE) {
+            st[i].vn = _bbi_normalized_len(node->list->limbs, node->list->len);
+            st[i].neg = node->list->sign && st[i].vn > 0;
+            st[i].carry = st[i].neg;
+            st[i].len = st[i].vn + 1;
+        } else {
+            len = st[node->x].len > st[node->y].len ? st[node->x].len : st[node->y].len;
+            st[i].len = len + (node->op == BBI_EXPR_ADD || node->op == BBI_EXPR_SUB);
+            st[i].carry = node->op == BBI_EXPR_SUB;
+        }
+    }
+    len = st[root].len;
+    block = len < BBI_EXPR_BLOCK ? len : BBI_EXPR_BLOCK;
+    if (e->bufs_alloc < (size_t) nbufs * block) {
+        _bbi_free(e->bufs, e->bufs_alloc * sizeof(bbi_limb));
+        e->bufs_alloc = (size_t) nbufs * block;
+        e->bufs = _bbi_alloc(e->bufs_alloc * sizeof(bbi_limb));
+    }
+    nbufs = 0;
+    for (i = 0; i <= root; i++) {
+        if (st[i].used) {
+            st[i].buf = &e->bufs[(size_t) nbufs++ * block];
+        }
+    }
+
+    /* Everything about the values is read above, so dst can be resized and written now */
+    if (dst == NULL) {
+        dst = _bbi_alloc_chunks(len);
+    } else {
+        _bbi_reserve(dst, len);
+    }
+
+    for (off = 0; off < len; off += n) {
+        n = len - off < block ? len - off : block;
+        for (i = 0; i <= root; i++) {
+            node = &e->nodes[i];
+            if (!st[i].used) {
+                continue;
+            }
+            switch (node->op) {
+            case BBI_EXPR_VALUE:
+                _bbi_expr_load(&st[i], node->list->limbs, off, n);
+                continue;
+            case BBI_EXPR_NOT:
+                _bbi_not_n(st[i].buf, st[node->x].out, n);
+                break;
+            case BBI_EXPR_AND:
+                _bbi_and_n(st[i].buf, st[node->x].out, st[node->y].out, n);
+                break;
+            case BBI_EXPR_OR:
+                _bbi_or_n(st[i].buf, st[node->x].out, st[node->y].out, n);
+                break;
+            case BBI_EXPR_XOR:
+                _bbi_xor_n(st[i].buf, st[node->x].out, st[node->y].out, n);
+                break;
+            default:
+                /* x - y is x + ~y + 1, the 1 being the first block's carry in */
+                if (node->op == BBI_EXPR_SUB) {
+                    _bbi_not_n(st[i].buf, st[node->y].out, n);
+                    c = _bbi_add_n(st[i].buf, st[node->x].out, st[i].buf, n);
+                } else {
+                    c = _bbi_add_n(st[i].buf, st[node->x].out, st[node->y].out, n);
+                }
+                if (st[i].carry) {
+                    c |= _bbi_add_1(st[i].buf, st[i].buf, n, 1);
+                }
+                st[i].carry = c;
+                break;
+            }
+            st[i].out = st[i].buf;
+        }
+        if (st[root].out != &dst->limbs[off]) {
+            memcpy(&dst->limbs[off], st[root].out, n * sizeof(bbi_limb));
+        }
+    }
+
+    /* A set top bit is a negative result: its magnitude is ~r + 1 */
+    dst->sign = dst->limbs[len - 1] >> (BBI_LIMB_BITS - 1);
+    if (dst->sign) {
+        _bbi_not_n(dst->limbs, dst->limbs, len);
+        _bbi_add_1(dst->limbs, dst->limbs, len, 1);
+    }
+    dst->len = _bbi_normalized_len(dst->limbs, len);
+    if (dst->len == 0) {
+        dst->len = 1;
+        dst->sign = 0;
+    }
+    return dst;
+}
@@ -0,0 +1,1044 @@
+/*
+ * Greatest common divisors and modular inverses.
+ *
+ * Operands of one or two chunks use binary GCD (Stein's algorithm), which needs nothing but shifts
+ * and subtractions. Longer ones use Lehmer's algorithm with double-digit steps: _bbi_hgcd2() runs
+ * Euclid on just the top two chunks of each operand, collecting the quotients into a 2x2 matrix of
+ * single chunks for as long as they're certain to be the quotients the full operands would give -
+ * about a chunk's worth - and the matrix is then applied to the full operands in one pass.
+ *
+ * From BBI_GCD_DC_THRESHOLD chunks the matrix comes from a half-GCD instead: _bbi_hgcd() finds, from
+ * the top half of the operands, a matrix reducing them to about half their length, by recursing on
+ * the top half of that and applying the result with the fast multiplication. The whole GCD is then
+ * O(M(n) log n). This is the algorithm of Moller, "On Schonhage's algorithm and subquadratic integer
+ * gcd computation", which GMP also uses, and the stopping rules are its.
+ *
+ * The matrices M = (m00 m01; m10 m11) have non-negative entries and determinant 1, and relate the
+ * operands a, b on entry to the reduced ones a', b' by (a; b) = M (a'; b'), so
+ * (a'; b') = (m11 a - m01 b; m00 b - m10 a).
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+#include "bbi_tune.h"
+
+unsigned int _bbi_gcd_dc_threshold = BBI_GCD_DC_THRESHOLD;
+unsigned int _bbi_hgcd_threshold = BBI_HGCD_THRESHOLD;
+
+/* A matrix of single chunks, from _bbi_hgcd2() */
+struct bbi_matrix1 {
+    bbi_limb u[2][2];
+};
+
+/* A matrix of multi-chunk entries, each with room for alloc chunks. n is the length of the longest;
+   chunks above n are kept 0. */
+struct bbi_hgcd_matrix {
+    unsigned int alloc;
+    unsigned int n;
+    bbi_limb *p[2][2];
+};
+
+/* Where the quotients of _bbi_gcd_subdiv_step() go: into a half-GCD's matrix, into gcdext's
+   cofactors, or (both NULL) nowhere. gcdext keeps the bottom row (m10 m11) of the matrix of all the
+   steps so far, since the cofactors of a for the values in ap and bp are m11 and -m10. */
+struct bbi_gcd_ctx {
+    struct bbi_hgcd_matrix *m;
+    bbi_limb *u[3];     /* m10, m11 and a spare, each of alloc chunks */
+    unsigned int un;    /* Length of the longer of m10 and m11 */
+    unsigned int alloc;
+    int which;          /* Set when the gcd is found: 0 if it's in ap, 1 if it's in bp */
+};
+
+/* rp = ap - bp (or ap + bp) for an >= bn, returning the borrow (or carry) out of chunk an */
+static bbi_limb _bbi_sub_mn(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn) {
+    bbi_limb borrow = bn > 0 ? _bbi_sub_n(rp, ap, bp, bn) : 0;
+
+    if (an > bn) {
+        if (rp != ap) {
+            memcpy(&rp[bn], &ap[bn], (an - bn) * sizeof(bbi_limb));
+        }
+        borrow = _bbi_sub_1(&rp[bn], &rp[bn], an - bn, borrow);
+    }
+    return borrow;
+}
+
+static bbi_limb _bbi_add_mn(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn) {
+    bbi_limb carry = bn > 0 ? _bbi_add_n(rp, ap, bp, bn) : 0;
+
+    if (an > bn) {
+        if (rp != ap) {
+            memcpy(&rp[bn], &ap[bn], (an - bn) * sizeof(bbi_limb));
+        }
+        carry = _bbi_add_1(&rp[bn], &rp[bn], an - bn, carry);
+    }
+    return carry;
+}
+
+/* Binary GCD of two chunks, or of two double chunks. Either may be 0. */
+bbi_limb _bbi_gcd_1(bbi_limb a, bbi_limb b) {
+    unsigned int k;
+    bbi_limb t;
+
+    if (a == 0 || b == 0) {
+        return a | b;
+    }
+    k = _bbi_limb_ctz(a | b);
+    a >>= _bbi_limb_ctz(a);
+    do {
+        b >>= _bbi_limb_ctz(b);
+        if (a > b) {
+            t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b != 0);
+    return a << k;
+}
+
+static unsigned int _bbi_dlimb_ctz(bbi_dlimb x) {
+    return (bbi_limb) x != 0 ? _bbi_limb_ctz((bbi_limb) x) : BBI_LIMB_BITS + _bbi_limb_ctz((bbi_limb) (x >> BBI_LIMB_BITS));
+}
+
+static bbi_dlimb _bbi_gcd_2(bbi_dlimb a, bbi_dlimb b) {
+    unsigned int k;
+    bbi_dlimb t;
+
+    if (a == 0 || b == 0) {
+        return a | b;
+    }
+    k = _bbi_dlimb_ctz(a | b);
+    a >>= _bbi_dlimb_ctz(a);
+    do {
+        b >>= _bbi_dlimb_ctz(b);
+        if (a > b) {
+            t = a;
+            a = b;
+            b = t;
+        }
+        /* Back to single chunks once both fit */
+        if ((b >> BBI_LIMB_BITS) == 0) {
+            return (bbi_dlimb) _bbi_gcd_1((bbi_limb) a, (bbi_limb) b) << k;
+        }
+        b -= a;
+    } while (b != 0);
+    return a << k;
+}
+
+/* (h:l) -= (bh:bl) on double chunks held as two */
+static inline void _bbi_sub_dd(bbi_limb *h, bbi_limb *l, bbi_limb bh, bbi_limb bl) {
+    *h = *h - bh - (*l < bl);
+    *l -= bl;
+}
+
+/* floor((nh:nl) / (dh:dl)), which must fit a chunk, leaving the remainder in *rh:*rl */
+static bbi_limb _bbi_div_dd(bbi_limb *rh, bbi_limb *rl, bbi_limb nh, bbi_limb nl, bbi_limb dh, bbi_limb dl) {
+    bbi_dlimb n = (bbi_dlimb) nh << BBI_LIMB_BITS | nl;
+    bbi_dlimb d = (bbi_dlimb) dh << BBI_LIMB_BITS | dl;
+    bbi_dlimb q = n / d;
+
+    n -= q * d;
+    *rh = (bbi_limb) (n >> BBI_LIMB_BITS);
+    *rl = (bbi_limb) n;
+    return (bbi_limb) q;
+}
+
+/* The Lehmer step: given the top two chunks ah:al and bh:bl of a and b (the same chunks of each,
+   with the top bit of ah or bh set), find the matrix of the quotients they determine. Reduction
+   stops while both values are still above two chunks' worth of half their size, which is what
+   guarantees those quotients are right for the full a and b - the last one may be one too small,
+   which still leaves a valid reduction. Returns 0 if there's not even one quotient to be had. */
+static int _bbi_hgcd2(bbi_limb ah, bbi_limb al, bbi_limb bh, bbi_limb bl, struct bbi_matrix1 *m) {
+    const unsigned int half = BBI_LIMB_BITS / 2;
+    bbi_limb u00, u01, u10, u11;
+    bbi_limb q;
+    bbi_limb r;
+
+    if (ah < 2 || bh < 2) {
+        return 0;
+    }
+    if (ah > bh || (ah == bh && al > bl)) {
+        _bbi_sub_dd(&ah, &al, bh, bl);
+        if (ah < 2) {
+            return 0;
+        }
+        u00 = u01 = u11 = 1;
+        u10 = 0;
+    } else {
+        _bbi_sub_dd(&bh, &bl, ah, al);
+        if (bh < 2) {
+            return 0;
+        }
+        u00 = u10 = u11 = 1;
+        u01 = 0;
+    }
+
+    /* Double-chunk steps, while the larger value has more than half its top chunk in use. Each
+       tentative subtraction that would take a value below two chunks ends the loop without being
+       recorded. */
+    if (ah < bh) {
+        goto subtract_a;
+    }
+    for (;;) {
+        /* a -= q b, M = M (1 q; 0 1) */
+        if (ah == bh) {
+            goto done;
+        }
+        if (ah < (bbi_limb) 1 << half) {
+            ah = (ah << half) + (al >> half);
+            bh = (bh << half) + (bl >> half);
+            break;
+        }
+        _bbi_sub_dd(&ah, &al, bh, bl);
+        if (ah < 2) {
+            goto done;
+        }
+        if (ah <= bh) {
+            u01 += u00;
+            u11 += u10;
+        } else {
+            q = _bbi_div_dd(&ah, &al, ah, al, bh, bl);
+            if (ah < 2) {
+                /* a would be too small - stop one short */
+                u01 += q * u00;
+                u11 += q * u10;
+                goto done;
+            }
+            q++;
+            u01 += q * u00;
+            u11 += q * u10;
+        }
+    subtract_a:
+        /* b -= q a, M = M (1 0; q 1) */
+        if (ah == bh) {
+            goto done;
+        }
+        if (bh < (bbi_limb) 1 << half) {
+            ah = (ah << half) + (al >> half);
+            bh = (bh << half) + (bl >> half);
+            goto subtract_a1;
+        }
+        _bbi_sub_dd(&bh, &bl, ah, al);
+        if (bh < 2) {
+            goto done;
+        }
+        if (bh <= ah) {
+            u00 += u01;
+            u10 += u11;
+        } else {
+            q = _bbi_div_dd(&bh, &bl, bh, bl, ah, al);
+            if (bh < 2) {
+                u00 += q * u01;
+                u10 += q * u11;
+                goto done;
+            }
+            q++;
+            u00 += q * u01;
+            u10 += q * u11;
+        }
+    }
+
+    /* Single-chunk steps on the top chunk and a half, stopping above half a chunk plus a bit */
+    for (;;) {
+        ah -= bh;
+        if (ah < (bbi_limb) 1 << (half + 1)) {
+            break;
+        }
+        if (ah <= bh) {
+            u01 += u00;
+            u11 += u10;
+        } else {
+            q = ah / bh;
+            r = ah - q * bh;
+            if (r < (bbi_limb) 1 << (half + 1)) {
+                u01 += q * u00;
+                u11 += q * u10;
+                break;
+            }
+            q++;
+            u01 += q * u00;
+            u11 += q * u10;
+            ah = r;
+        }
+    subtract_a1:
+        bh -= ah;
+        if (bh < (bbi_limb) 1 << (half + 1)) {
+            break;
+        }
+        if (bh <= ah) {
+            u00 += u01;
+            u10 += u11;
+        } else {
+            q = bh / ah;
+            r = bh - q * ah;
+            if (r < (bbi_limb) 1 << (half + 1)) {
+                u00 += q * u01;
+                u10 += q * u11;
+                break;
+            }
+            q++;
+            u00 += q * u01;
+            u10 += q * u11;
+            bh = r;
+        }
+    }
+
+done:
+    m->u[0][0] = u00;
+    m->u[0][1] = u01;
+    m->u[1][0] = u10;
+    m->u[1][1] = u11;
+    return 1;
+}
+
+/* (rp; bp) = M^-1 (ap; bp) for a single-chunk M, over n chunks. rp mustn't overlap ap or bp. The
+   result can't go negative, or longer; returns its length (of the longer of the two). */
+static unsigned int _bbi_matrix1_inverse_vector(const struct bbi_matrix1 *m, bbi_limb *rp, const bbi_limb *ap,
+                                                bbi_limb *bp, unsigned int n) {
+    bbi_limb h0;
+    bbi_limb h1;
+
+    h0 = _bbi_mul_1(rp, ap, n, m->u[1][1]);
+    h1 = _bbi_submul_1(rp, bp, n, m->u[0][1]);
+    assert(h0 == h1);
+    h0 = _bbi_mul_1(bp, bp, n, m->u[0][0]);
+    h1 = _bbi_submul_1(bp, ap, n, m->u[1][0]);
+    assert(h0 == h1);
+    (void) h0;
+    (void) h1;
+    return n - ((rp[n - 1] | bp[n - 1]) == 0);
+}
+
+/* (rp, bp) = (ap, bp) M for a single-chunk M, a row vector of n chunks growing to at most n+1 */
+static unsigned int _bbi_matrix1_mul_vector(const struct bbi_matrix1 *m, bbi_limb *rp, const bbi_limb *ap,
+                                            bbi_limb *bp, unsigned int n) {
+    bbi_limb ah;
+    bbi_limb bh;
+
+    ah = _bbi_mul_1(rp, ap, n, m->u[0][0]);
+    ah += _bbi_addmul_1(rp, bp, n, m->u[1][0]);
+    bh = _bbi_mul_1(bp, bp, n, m->u[1][1]);
+    bh += _bbi_addmul_1(bp, ap, n, m->u[0][1]);
+    rp[n] = ah;
+    bp[n] = bh;
+    return n + ((ah | bh) != 0);
+}
+
+/* The identity, with room for the matrix of a half-GCD of n-chunk operands */
+static void _bbi_hgcd_matrix_init(struct bbi_hgcd_matrix *m, unsigned int n) {
+    unsigned int s = (n + 1) / 2 + 1;
+    bbi_limb *p = _bbi_alloc(4 * s * sizeof(bbi_limb));
+
+    memset(p, 0, 4 * s * sizeof(bbi_limb));
+    m->alloc = s;
+    m->n = 1;
+    m->p[0][0] = p;
+    m->p[0][1] = &p[s];
+    m->p[1][0] = &p[2 * s];
+    m->p[1][1] = &p[3 * s];
+    m->p[0][0][0] = 1;
+    m->p[1][1][0] = 1;
+}
+
+static void _bbi_hgcd_matrix_free(struct bbi_hgcd_matrix *m) {
+    _bbi_free(m->p[0][0], 4 * m->alloc * sizeof(bbi_limb));
+}
+
+/* M = M M1 for a single-chunk M1. tp is M->n chunks of scratch. */
+static void _bbi_hgcd_matrix_mul_1(struct bbi_hgcd_matrix *m, const struct bbi_matrix1 *m1, bbi_limb *tp) {
+    unsigned int n0;
+    unsigned int n1;
+
+    memcpy(tp, m->p[0][0], m->n * sizeof(bbi_limb));
+    n0 = _bbi_matrix1_mul_vector(m1, m->p[0][0], tp, m->p[0][1], m->n);
+    memcpy(tp, m->p[1][0], m->n * sizeof(bbi_limb));
+    n1 = _bbi_matrix1_mul_vector(m1, m->p[1][0], tp, m->p[1][1], m->n);
+    m->n = n0 > n1 ? n0 : n1;
+    assert(m->n < m->alloc);
+}
+
+/* Add q times column 1-col of M into column col: M = M (1 q; 0 1) for col 1, M (1 0; q 1) for 0 */
+static void _bbi_hgcd_matrix_update_q(struct bbi_hgcd_matrix *m, const bbi_limb *qp, unsigned int qn, unsigned int col) {
+    bbi_limb c[2];
+    bbi_limb *tp;
+    unsigned int row;
+    unsigned int n;
+
+    if (qn == 1) {
+        c[0] = _bbi_addmul_1(m->p[0][col], m->p[0][1 - col], m->n, qp[0]);
+        c[1] = _bbi_addmul_1(m->p[1][col], m->p[1][1 - col], m->n, qp[0]);
+        m->p[0][col][m->n] = c[0];
+        m->p[1][col][m->n] = c[1];
+        m->n += (c[0] | c[1]) != 0;
+    } else {
+        /* The product needn't be as long as n + qn, so the column is normalized first to keep it
+           within alloc */
+        for (n = m->n; n + qn > m->n && n > 1; n--) {
+            if (m->p[0][1 - col][n - 1] != 0 || m->p[1][1 - col][n - 1] != 0) {
+                break;
+            }
+        }
+        assert(n + qn <= m->alloc);
+        tp = _bbi_alloc((n + qn) * sizeof(bbi_limb));
+        for (row = 0; row < 2; row++) {
+            _bbi_mul(tp, m->p[row][1 - col], n, qp, qn);
+            c[row] = _bbi_add_mn(m->p[row][col], tp, n + qn, m->p[row][col], m->n);
+        }
+        _bbi_free(tp, (n + qn) * sizeof(bbi_limb));
+        n += qn;
+        if ((c[0] | c[1]) != 0) {
+            m->p[0][col][n] = c[0];
+            m->p[1][col][n] = c[1];
+            n++;
+        } else {
+            n -= (m->p[0][col][n - 1] | m->p[1][col][n - 1]) == 0;
+        }
+        m->n = n;
+    }
+    assert(m->n < m->alloc);
+}
+
+/* M = M M1, with the fast multiplication */
+static void _bbi_hgcd_matrix_mul(struct bbi_hgcd_matrix *m, const struct bbi_hgcd_matrix *m1) {
+    unsigned int n = m->n + m1->n;
+    size_t size = (5 * (size_t) n + 4) * sizeof(bbi_limb);
+    bbi_limb *tp = _bbi_alloc(size);
+    bbi_limb *prod = &tp[4 * (n + 1)];
+    bbi_limb *r;
+    unsigned int i;
+    unsigned int j;
+
+    assert(n < m->alloc);
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 2; j++) {
+            r = &tp[(2 * i + j) * (n + 1)];
+            _bbi_mul(r, m->p[i][0], m->n, m1->p[0][j], m1->n);
+            _bbi_mul(prod, m->p[i][1], m->n, m1->p[1][j], m1->n);
+            r[n] = _bbi_add_n(r, r, prod, n);
+        }
+    }
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 2; j++) {
+            memcpy(m->p[i][j], &tp[(2 * i + j) * (n + 1)], (n + 1) * sizeof(bbi_limb));
+        }
+    }
+    _bbi_free(tp, size);
+    for (n++; n > 1; n--) {
+        if ((m->p[0][0][n - 1] | m->p[0][1][n - 1] | m->p[1][0][n - 1] | m->p[1][1][n - 1]) != 0) {
+            break;
+        }
+    }
+    m->n = n;
+}
+
+/* Apply a half-GCD matrix found from the top n-p chunks of a and b, whose reduced values are
+   already in chunks p to n-1: (a; b) = M^-1 (a; b) as a whole, which is the top part plus M^-1
+   applied to the bottom p chunks. Returns the new length, which can be one more than n. */
+static unsigned int _bbi_hgcd_adjust(const struct bbi_hgcd_matrix *m, unsigned int n, bbi_limb *ap, bbi_limb *bp,
+                                     unsigned int p) {
+    size_t size = 2 * ((size_t) p + m->n) * sizeof(bbi_limb);
+    bbi_limb *t0 = _bbi_alloc(size);
+    bbi_limb *t1 = &t0[p + m->n];
+    bbi_limb ah;
+    bbi_limb bh;
+    bbi_limb cy;
+
+    assert(p + m->n < n);
+
+    /* The two products with the bottom of a, before it's overwritten */
+    _bbi_mul(t0, m->p[1][1], m->n, ap, p);
+    _bbi_mul(t1, m->p[1][0], m->n, ap, p);
+
+    /* a = m11 a - m01 b */
+    memcpy(ap, t0, p * sizeof(bbi_limb));
+    ah = _bbi_add_mn(&ap[p], &ap[p], n - p, &t0[p], m->n);
+    _bbi_mul(t0, m->p[0][1], m->n, bp, p);
+    cy = _bbi_sub_mn(ap, ap, n, t0, p + m->n);
+    assert(cy <= ah);
+    ah -= cy;
+
+    /* b = m00 b - m10 a */
+    _bbi_mul(t0, m->p[0][0], m->n, bp, p);
+    memcpy(bp, t0, p * sizeof(bbi_limb));
+    bh = _bbi_add_mn(&bp[p], &bp[p], n - p, &t0[p], m->n);
+    cy = _bbi_sub_mn(bp, bp, n, t1, p + m->n);
+    assert(cy <= bh);
+    bh -= cy;
+    _bbi_free(t0, size);
+
+    if (ah > 0 || bh > 0) {
+        ap[n] = ah;
+        bp[n] = bh;
+        n++;
+    } else if (ap[n - 1] == 0 && bp[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+static bbi_chunk *_bbi_gcd_chunk(const bbi_limb *p, unsigned int n) {
+    bbi_chunk *list;
+
+    n = _bbi_normalized_len(p, n);
+    list = _bbi_alloc_chunks(n > 0 ? n : 1);
+    memcpy(list->limbs, p, n * sizeof(bbi_limb));
+    if (n == 0) {
+        list->limbs[0] = 0;
+        n = 1;
+    }
+    list->len = n;
+    list->sign = 0;
+    return list;
+}
+
+/* u[d] += q u[1-d] on gcdext's row. The entries never grow past the second operand of the gcd. */
+static void _bbi_gcd_row_update_q(struct bbi_gcd_ctx *ctx, const bbi_limb *qp, unsigned int qn, unsigned int d) {
+    bbi_limb *up = ctx->u[d];
+    unsigned int n = ctx->un;
+    unsigned int pn;
+    bbi_limb *tp;
+    bbi_limb c;
+
+    if (qn == 1) {
+        c = _bbi_addmul_1(up, ctx->u[1 - d], n, qp[0]);
+        if (c != 0) {
+            up[ctx->un++] = c;
+        }
+        return;
+    }
+    n = _bbi_normalized_len(ctx->u[1 - d], n);
+    if (n == 0) {
+        return;
+    }
+    tp = _bbi_alloc((n + qn) * sizeof(bbi_limb));
+    _bbi_mul(tp, ctx->u[1 - d], n, qp, qn);
+    pn = _bbi_normalized_len(tp, n + qn);
+    if (pn >= ctx->un) {
+        c = _bbi_add_mn(up, tp, pn, up, ctx->un);
+        ctx->un = pn;
+    } else {
+        c = _bbi_add_mn(up, up, ctx->un, tp, pn);
+    }
+    if (c != 0) {
+        up[ctx->un++] = c;
+    }
+    _bbi_free(tp, (n + qn) * sizeof(bbi_limb));
+    assert(ctx->un < ctx->alloc);
+}
+
+/* (m10 m11) = (m10 m11) M on gcdext's row, for M's entries of n chunks */
+static void _bbi_gcd_row_mul(struct bbi_gcd_ctx *ctx, bbi_limb *const p[2][2], unsigned int n) {
+    unsigned int stride = ctx->un + n + 1;
+    size_t size = 3 * (size_t) stride * sizeof(bbi_limb);
+    bbi_limb *tp = _bbi_alloc(size);
+    bbi_limb *prod = &tp[2 * stride];
+    bbi_limb *r;
+    unsigned int rn;
+    unsigned int j;
+
+    for (j = 0; j < 2; j++) {
+        r = &tp[j * stride];
+        _bbi_mul(r, ctx->u[0], ctx->un, p[0][j], n);
+        _bbi_mul(prod, ctx->u[1], ctx->un, p[1][j], n);
+        r[stride - 1] = _bbi_add_n(r, r, prod, stride - 1);
+    }
+    for (rn = stride; rn > 1 && (tp[rn - 1] | tp[stride + rn - 1]) == 0; rn--) {
+    }
+    assert(rn < ctx->alloc);
+    for (j = 0; j < 2; j++) {
+        memcpy(ctx->u[j], &tp[j * stride], rn * sizeof(bbi_limb));
+    }
+    ctx->un = rn;
+    _bbi_free(tp, size);
+}
+
+/* Record the quotient q of a step that took q times the other value from ap's (into 0) or bp's
+   (into 1): the matrix is multiplied by (1 q; 0 1) or (1 0; q 1) */
+static void _bbi_gcd_record(struct bbi_gcd_ctx *ctx, const bbi_limb *qp, unsigned int qn, unsigned int into) {
+    qn = _bbi_normalized_len(qp, qn);
+    if (qn == 0) {
+        return;
+    }
+    if (ctx->m != NULL) {
+        _bbi_hgcd_matrix_update_q(ctx->m, qp, qn, 1 - into);
+    } else if (ctx->u[0] != NULL) {
+        _bbi_gcd_row_update_q(ctx, qp, qn, 1 - into);
+    }
+}
+
+/* One step of Euclid on the n-chunk a and b (not both with a zero top chunk): the smaller is taken
+   from the larger once, then the larger is divided by it - as long as both stay above s chunks, the
+   last quotient being reduced by one if that's what it takes. Returns the new length, or 0 if no
+   step could be made. With s = 0 that means the gcd has been found: the other value was 0, or they
+   were equal, and ctx->which says where it is. */
+static unsigned int _bbi_gcd_subdiv_step(bbi_limb *ap, bbi_limb *bp, unsigned int n, unsigned int s,
+                                         struct bbi_gcd_ctx *ctx) {
+    unsigned int an = _bbi_normalized_len(ap, n);
+    unsigned int bn = _bbi_normalized_len(bp, n);
+    unsigned int ln;
+    unsigned int sn;
+    unsigned int qn;
+    unsigned int rn;
+    unsigned int into;
+    bbi_limb *lp;
+    bbi_limb *sp;
+    bbi_limb *qp;
+    bbi_limb cy;
+    int c;
+
+    /* l is the larger value, in ap if into is 0 */
+    c = _bbi_cmp(ap, an, bp, bn);
+    if (c == 0) {
+        ctx->which = 0;
+        return 0;
+    }
+    into = c < 0;
+    lp = into ? bp : ap;
+    ln = into ? bn : an;
+    sp = into ? ap : bp;
+    sn = into ? an : bn;
+    if (sn <= s) {
+        ctx->which = (int) into;
+        return 0;
+    }
+
+    cy = _bbi_sub_mn(lp, lp, ln, sp, sn);
+    assert(cy == 0);
+    rn = _bbi_normalized_len(lp, ln);
+    if (rn <= s) {
+        cy = _bbi_add_mn(lp, lp, ln, sp, sn);
+        assert(cy == 0);
+        return 0;
+    }
+    (void) cy;
+    ln = rn;
+    _bbi_gcd_record(ctx, (const bbi_limb[]) {1}, 1, into);
+
+    c = _bbi_cmp(lp, ln, sp, sn);
+    if (c == 0) {
+        /* Both are now the gcd, if s is 0 */
+        ctx->which = (int) into;
+        return s == 0 ? 0 : ln;
+    }
+    if (c < 0) {
+        into ^= 1;
+        lp = into ? bp : ap;
+        sp = into ? ap : bp;
+        rn = ln;
+        ln = sn;
+        sn = rn;
+    }
+
+    qn = ln - sn + 1;
+    qp = _bbi_alloc(qn * sizeof(bbi_limb));
+    _bbi_divrem(qp, lp, lp, ln, sp, sn);
+    memset(&lp[sn], 0, (ln - sn) * sizeof(bbi_limb));
+    rn = _bbi_normalized_len(lp, sn);
+    if (rn <= s) {
+        if (s == 0) {
+            _bbi_free(qp, qn * sizeof(bbi_limb));
+            ctx->which = (int) (into ^ 1);
+            return 0;
+        }
+        /* Take one less of the smaller, which leaves the larger above s chunks */
+        cy = _bbi_add_n(lp, lp, sp, sn);
+        if (cy != 0) {
+            lp[sn] = cy;
+        }
+        _bbi_sub_1(qp, qp, qn, 1);
+    }
+    _bbi_gcd_record(ctx, qp, qn, into);
+    _bbi_free(qp, qn * sizeof(bbi_limb));
+    return _bbi_normalized_len(lp, ln) > sn ? _bbi_normalized_len(lp, ln) : sn;
+}
+
+/* One step of the half-GCD on n chunks, keeping both values above s chunks: a Lehmer step if the
+   top chunks allow it, Euclid otherwise. tp is n chunks of scratch. Returns the new length, or 0 if
+   no step could be made. */
+static unsigned int _bbi_hgcd_step(unsigned int n, bbi_limb *ap, bbi_limb *bp, unsigned int s,
+                                   struct bbi_hgcd_matrix *m, bbi_limb *tp) {
+    struct bbi_matrix1 m1;
+    struct bbi_gcd_ctx ctx = {m, {NULL, NULL, NULL}, 0, 0, 0};
+    bbi_limb mask = ap[n - 1] | bp[n - 1];
+    bbi_limb ah, al, bh, bl;
+    unsigned int shift;
+
+    assert(n > s && mask != 0);
+    if (n == s + 1) {
+        /* Only the top two chunks are above s */
+        if (mask < 4) {
+            return _bbi_gcd_subdiv_step(ap, bp, n, s, &ctx);
+        }
+        ah = ap[n - 1];
+        al = ap[n - 2];
+        bh = bp[n - 1];
+        bl = bp[n - 2];
+    } else if (mask >> (BBI_LIMB_BITS - 1)) {
+        ah = ap[n - 1];
+        al = ap[n - 2];
+        bh = bp[n - 1];
+        bl = bp[n - 2];
+    } else {
+        shift = _bbi_limb_clz(mask);
+        ah = ap[n - 1] << shift | ap[n - 2] >> (BBI_LIMB_BITS - shift);
+        al = ap[n - 2] << shift | ap[n - 3] >> (BBI_LIMB_BITS - shift);
+        bh = bp[n - 1] << shift | bp[n - 2] >> (BBI_LIMB_BITS - shift);
+        bl = bp[n - 2] << shift | bp[n - 3] >> (BBI_LIMB_BITS - shift);
+    }
+    if (_bbi_hgcd2(ah, al, bh, bl, &m1)) {
+        _bbi_hgcd_matrix_mul_1(m, &m1, tp);
+        memcpy(tp, ap, n * sizeof(bbi_limb));
+        return _bbi_matrix1_inverse_vector(&m1, ap, tp, bp, n);
+    }
+    return _bbi_gcd_subdiv_step(ap, bp, n, s, &ctx);
+}
+
+/* Half-GCD: reduce the n-chunk a and b, in place, to values of just over n/2 chunks, multiplying
+   the matrix of the quotients into M (set up by _bbi_hgcd_matrix_init() for n). Returns the new
+   length, or 0 if no reduction was possible. Above _bbi_hgcd_threshold chunks, the top half is
+   reduced recursively twice - the first time to about 3/4 of n, the second to n/2 - with the
+   result applied by _bbi_hgcd_adjust(); what's left is done a Lehmer step at a time. */
+static unsigned int _bbi_hgcd(bbi_limb *ap, bbi_limb *bp, unsigned int n, struct bbi_hgcd_matrix *m) {
+    unsigned int s = n / 2 + 1;
+    unsigned int n2;
+    unsigned int nn;
+    unsigned int p;
+    int success = 0;
+    struct bbi_hgcd_matrix m1;
+    bbi_limb *tp;
+    unsigned int tn = n;
+
+    if (n <= s) {
+        return 0;
+    }
+    tp = _bbi_alloc(tn * sizeof(bbi_limb));
+    if (n >= _bbi_hgcd_threshold && n >= 4) {
+        n2 = 3 * n / 4 + 1;
+        p = n / 2;
+        nn = _bbi_hgcd(&ap[p], &bp[p], n - p, m);
+        if (nn > 0) {
+            n = _bbi_hgcd_adjust(m, p + nn, ap, bp, p);
+            success = 1;
+        }
+        while (n > n2) {
+            nn = _bbi_hgcd_step(n, ap, bp, s, m, tp);
+            if (nn == 0) {
+                goto done;
+            }
+            n = nn;
+            success = 1;
+        }
+        if (n > s + 2) {
+            p = 2 * s - n + 1;
+            _bbi_hgcd_matrix_init(&m1, n - p);
+            nn = _bbi_hgcd(&ap[p], &bp[p], n - p, &m1);
+            if (nn > 0) {
+                n = _bbi_hgcd_adjust(&m1, p + nn, ap, bp, p);
+                _bbi_hgcd_matrix_mul(m, &m1);
+                success = 1;
+            }
+            _bbi_hgcd_matrix_free(&m1);
+        }
+    }
+    for (;;) {
+        nn = _bbi_hgcd_step(n, ap, bp, s, m, tp);
+        if (nn == 0) {
+            break;
+        }
+        n = nn;
+        success = 1;
+    }
+done:
+    _bbi_free(tp, tn * sizeof(bbi_limb));
+    return success ? n : 0;
+}
+
+/* Reduce the n-chunk a and b, both non-zero, to their gcd, returning its length and leaving
+   *gp pointing at it - somewhere in the block ap, bp and tp were carved from, which are each
+   n + 1 chunks and get swapped around. With ctx->u set the cofactors are kept up to date, and
+   ctx->which says which of them goes with the gcd. */
+static unsigned int _bbi_gcd_reduce(bbi_limb *ap, bbi_limb *bp, bbi_limb *tp, unsigned int n,
+                                    struct bbi_gcd_ctx *ctx, bbi_limb **gp) {
+    struct bbi_hgcd_matrix m;
+    struct bbi_matrix1 m1;
+    bbi_limb *tmp;
+    bbi_limb mask;
+    bbi_limb ah, al, bh, bl;
+    bbi_dlimb g;
+    unsigned int shift;
+    unsigned int nn;
+    unsigned int p;
+    unsigned int prev;
+
+    while (n >= _bbi_gcd_dc_threshold && n >= 4) {
+        p = 2 * n / 3;
+        _bbi_hgcd_matrix_init(&m, n - p);
+        nn = _bbi_hgcd(&ap[p], &bp[p], n - p, &m);
+        if (nn > 0) {
+            if (ctx->u[0] != NULL) {
+                _bbi_gcd_row_mul(ctx, m.p, m.n);
+            }
+            n = _bbi_hgcd_adjust(&m, p + nn, ap, bp, p);
+            _bbi_hgcd_matrix_free(&m);
+        } else {
+            _bbi_hgcd_matrix_free(&m);
+            prev = n;
+            n = _bbi_gcd_subdiv_step(ap, bp, n, 0, ctx);
+            if (n == 0) {
+                n = prev;
+                goto found;
+            }
+        }
+    }
+
+    while (n > 2) {
+        mask = ap[n - 1] | bp[n - 1];
+        if (mask >> (BBI_LIMB_BITS - 1)) {
+            ah = ap[n - 1];
+            al = ap[n - 2];
+            bh = bp[n - 1];
+            bl = bp[n - 2];
+        } else {
+            shift = _bbi_limb_clz(mask);
+            ah = ap[n - 1] << shift | ap[n - 2] >> (BBI_LIMB_BITS - shift);
+            al = ap[n - 2] << shift | ap[n - 3] >> (BBI_LIMB_BITS - shift);
+            bh = bp[n - 1] << shift | bp[n - 2] >> (BBI_LIMB_BITS - shift);
+            bl = bp[n - 2] << shift | bp[n - 3] >> (BBI_LIMB_BITS - shift);
+        }
+        if (_bbi_hgcd2(ah, al, bh, bl, &m1)) {
+            if (ctx->u[0] != NULL) {
+                ctx->un = _bbi_matrix1_mul_vector(&m1, ctx->u[2], ctx->u[0], ctx->u[1], ctx->un);
+                tmp = ctx->u[0];
+                ctx->u[0] = ctx->u[2];
+                ctx->u[2] = tmp;
+                assert(ctx->un < ctx->alloc);
+            }
+            n = _bbi_matrix1_inverse_vector(&m1, tp, ap, bp, n);
+            tmp = ap;
+            ap = tp;
+            tp = tmp;
+        } else {
+            prev = n;
+            n = _bbi_gcd_subdiv_step(ap, bp, n, 0, ctx);
+            if (n == 0) {
+                n = prev;
+                goto found;
+            }
+        }
+    }
+
+    if (ctx->u[0] == NULL) {
+        /* Two chunks or less - binary GCD, leaving the result in ap */
+        g = _bbi_gcd_2(n > 1 ? (bbi_dlimb) ap[1] << BBI_LIMB_BITS | ap[0] : ap[0],
+                       n > 1 ? (bbi_dlimb) bp[1] << BBI_LIMB_BITS | bp[0] : bp[0]);
+        ap[0] = (bbi_limb) g;
+        ap[1] = (bbi_limb) (g >> BBI_LIMB_BITS);
+        *gp = ap;
+        return ap[1] != 0 ? 2 : 1;
+    }
+    for (;;) {
+        prev = n;
+        n = _bbi_gcd_subdiv_step(ap, bp, n, 0, ctx);
+        if (n == 0) {
+            n = prev;
+            break;
+        }
+    }
+found:
+    *gp = ctx->which ? bp : ap;
+    return _bbi_normalized_len(*gp, n);
+}
+
+/* Trim a cofactor to its length, flipping its sign if neg is set */
+static bbi_chunk *_bbi_gcd_signed(bbi_chunk *list, int neg) {
+    list->len = _bbi_normalized_len(list->limbs, list->len);
+    if (list->len == 0) {
+        list->len = 1;
+        list->sign = 0;
+    } else {
+        list->sign ^= neg != 0;
+    }
+    return list;
+}
+
+/* The greatest common divisor of a and b, which is never negative; gcd(0, 0) is 0 */
+bbi_chunk *bbi_gcd(bbi_chunk *list_a, bbi_chunk *list_b) {
+    unsigned int an = _bbi_normalized_len(list_a->limbs, list_a->len);
+    unsigned int bn = _bbi_normalized_len(list_b->limbs, list_b->len);
+    bbi_chunk *tmp;
+    bbi_chunk *g;
+    bbi_limb *ap;
+    bbi_limb *gp;
+    bbi_limb r[2];
+    bbi_dlimb g2;
+    struct bbi_gcd_ctx ctx = {NULL, {NULL, NULL, NULL}, 0, 0, 0};
+    unsigned int gn;
+    size_t size;
+    BBI_STAT_SCOPE(BBI_STAT_GCD, an + bn);
+
+    if (an < bn) {
+        tmp = list_a;
+        list_a = list_b;
+        list_b = tmp;
+        gn = an;
+        an = bn;
+        bn = gn;
+    }
+    if (bn == 0) {
+        return _bbi_gcd_chunk(list_a->limbs, an);
+    }
+
+    /* b of one or two chunks: a mod b, then binary GCD */
+    if (bn <= 2) {
+        r[1] = 0;
+        _bbi_divrem(NULL, r, list_a->limbs, an, list_b->limbs, bn);
+        g2 = _bbi_gcd_2((bbi_dlimb) r[1] << BBI_LIMB_BITS | r[0],
+                        bn > 1 ? (bbi_dlimb) list_b->limbs[1] << BBI_LIMB_BITS | list_b->limbs[0] : list_b->limbs[0]);
+        r[0] = (bbi_limb) g2;
+        r[1] = (bbi_limb) (g2 >> BBI_LIMB_BITS);
+        return _bbi_gcd_chunk(r, 2);
+    }
+
+    size = 3 * ((size_t) bn + 1) * sizeof(bbi_limb);
+    ap = _bbi_alloc(size);
+    if (an > bn) {
+        _bbi_divrem(NULL, ap, list_a->limbs, an, list_b->limbs, bn);
+    } else {
+        memcpy(ap, list_a->limbs, bn * sizeof(bbi_limb));
+    }
+    if (_bbi_normalized_len(ap, bn) == 0) {
+        g = _bbi_gcd_chunk(list_b->limbs, bn);
+    } else {
+        memcpy(&ap[bn + 1], list_b->limbs, bn * sizeof(bbi_limb));
+        gn = _bbi_gcd_reduce(ap, &ap[bn + 1], &ap[2 * (bn + 1)], bn, &ctx, &gp);
+        g = _bbi_gcd_chunk(gp, gn);
+    }
+    _bbi_free(ap, size);
+    return g;
+}
+
+/* The gcd g of a and b, as bbi_gcd(), along with cofactors s and t such that a*s + b*t = g, stored
+   in *s and *t when they aren't NULL. The cofactors come from Euclid's algorithm: |s| is at most
+   |b|/g and |t| at most |a|/g, and for a = 0 or b = 0 the one going with the 0 is 0. */
+bbi_chunk *bbi_gcdext(bbi_chunk *list_a, bbi_chunk *list_b, bbi_chunk **s, bbi_chunk **t) {
+    unsigned int an = _bbi_normalized_len(list_a->limbs, list_a->len);
+    unsigned int bn = _bbi_normalized_len(list_b->limbs, list_b->len);
+    int swapped = an < bn || (an == bn && _bbi_cmp(list_a->limbs, an, list_b->limbs, bn) < 0);
+    bbi_chunk *x = swapped ? list_b : list_a;
+    bbi_chunk *y = swapped ? list_a : list_b;
+    unsigned int xn = swapped ? bn : an;
+    unsigned int yn = swapped ? an : bn;
+    bbi_chunk **sx = swapped ? t : s;
+    bbi_chunk **sy = swapped ? s : t;
+    struct bbi_gcd_ctx ctx = {NULL, {NULL, NULL, NULL}, 0, 0, 0};
+    bbi_chunk *g;
+    bbi_chunk *cx;
+    bbi_chunk *cy;
+    bbi_chunk *xabs;
+    bbi_chunk *yabs;
+    bbi_chunk *prod;
+    bbi_chunk *diff;
+    bbi_limb *ap;
+    bbi_limb *gp;
+    bbi_limb *rows;
+    unsigned int gn;
+    size_t size;
+    size_t usize;
+    BBI_STAT_SCOPE(BBI_STAT_GCD, an + bn);
+
+    /* With |x| >= |y|, find g and the cofactor cx of |x|, then cy from that */
+    cy = NULL;
+    if (yn == 0) {
+        g = _bbi_gcd_chunk(x->limbs, xn);
+        cx = bbi_create();
+        cx->limbs[0] = xn > 0;
+        cy = bbi_create();
+    } else {
+        size = 3 * ((size_t) yn + 1) * sizeof(bbi_limb);
+        ap = _bbi_alloc(size);
+        _bbi_divrem(NULL, ap, x->limbs, xn, y->limbs, yn);
+        if (_bbi_normalized_len(ap, yn) == 0) {
+            g = _bbi_gcd_chunk(y->limbs, yn);
+            cx = bbi_create();
+            cy = bbi_create();
+            cy->limbs[0] = 1;
+        } else {
+            /* Starting from the identity, whose bottom row is (0 1) */
+            memcpy(&ap[yn + 1], y->limbs, yn * sizeof(bbi_limb));
+            ctx.alloc = yn + 2;
+            usize = 3 * (size_t) ctx.alloc * sizeof(bbi_limb);
+            rows = _bbi_alloc(usize);
+            memset(rows, 0, usize);
+            ctx.u[0] = rows;
+            ctx.u[1] = &rows[ctx.alloc];
+            ctx.u[2] = &rows[2 * ctx.alloc];
+            ctx.u[1][0] = 1;
+            ctx.un = 1;
+            gn = _bbi_gcd_reduce(ap, &ap[yn + 1], &ap[2 * (yn + 1)], yn, &ctx, &gp);
+            g = _bbi_gcd_chunk(gp, gn);
+            cx = _bbi_gcd_chunk(ctx.u[1 - ctx.which], ctx.un);
+            cx->sign = ctx.which && _bbi_normalized_len(cx->limbs, cx->len) > 0;
+            _bbi_free(rows, usize);
+        }
+        _bbi_free(ap, size);
+    }
+    if (cy == NULL && sy != NULL) {
+        /* cy = (g - cx |x|) / |y|, exactly */
+        xabs = _bbi_gcd_chunk(x->limbs, xn);
+        yabs = _bbi_gcd_chunk(y->limbs, yn);
+        prod = bbi_mul(cx, xabs);
+        diff = bbi_sub(g, prod);
+        cy = bbi_div(diff, yabs);
+        bbi_destroy(xabs);
+        bbi_destroy(yabs);
+        bbi_destroy(prod);
+        bbi_destroy(diff);
+    }
+
+    if (sx != NULL) {
+        *sx = _bbi_gcd_signed(cx, x->sign);
+    } else {
+        bbi_destroy(cx);
+    }
+    if (sy != NULL) {
+        *sy = _bbi_gcd_signed(cy, y->sign);
+    } else if (cy != NULL) {
+        bbi_destroy(cy);
+    }
+    return g;
+}
+
+/* The inverse of a modulo m, in [0, |m|), or NULL if there isn't one: m is 0, or a and m have a
+   common factor */
+bbi_chunk *bbi_invert(bbi_chunk *list_a, bbi_chunk *list_m) {
+    unsigned int mn = _bbi_normalized_len(list_m->limbs, list_m->len);
+    bbi_chunk *mabs;
+    bbi_chunk *r;
+    bbi_chunk *g;
+    bbi_chunk *s;
+    bbi_chunk *inv;
+
+    if (mn == 0) {
+        return NULL;
+    }
+    mabs = _bbi_gcd_chunk(list_m->limbs, mn);
+    r = bbi_mod(list_a, mabs);
+    if (r->sign) {
+        bbi_add_inplace(r, mabs);
+    }
+    g = bbi_gcdext(r, mabs, &s, NULL);
+    inv = NULL;
+    if (g->len == 1 && g->limbs[0] == 1) {
+        if (s->sign) {
+            _bbi_gcd_signed(bbi_add_inplace(s, mabs), 0);
+        }
+        inv = s;
+    } else {
+        bbi_destroy(s);
+    }
+    bbi_destroy(g);
+    bbi_destroy(r);
+    bbi_destroy(mabs);
+    return inv;
+}
@@ -0,0 +1,322 @@
+/*
+ * Chunk-array kernels with several implementations, picked at runtime from the CPU's features.
+ *
+ * The bitwise operations are all one loop with a different operator in the middle, so the loop is
+ * written once as a macro and instantiated for each operation and each vector width. GCC's vector
+ * extensions let the same expression (x & y, ~x, ...) work on single chunks and on 128/256/512-bit
+ * vectors, and the target attribute lets one file hold SSE2, AVX2 and AVX-512 versions regardless of
+ * the flags the library is built with.
+ *
+ * Bit counting works the same way: the compiler builtins become popcnt/lzcnt/tzcnt in functions
+ * built for CPUs that have them, and portable code everywhere else.
+ */
+
+#include <string.h>
+#include "bbi.h"
+
+static unsigned int cpu_features = 0;
+static int cpu_features_known = 0;
+
+/* Bitmask of BBI_CPU_* features this machine has, worked out on first use. Threads racing to do it
+   all compute the same answer, and the atomics make that a benign race. */
+unsigned int _bbi_cpu_features() {
+    unsigned int features = 0;
+
+    if (__atomic_load_n(&cpu_features_known, __ATOMIC_ACQUIRE)) {
+        return __atomic_load_n(&cpu_features, __ATOMIC_RELAXED);
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        features |= BBI_CPU_SSE2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        features |= BBI_CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        features |= BBI_CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        features |= BBI_CPU_POPCNT;
+    }
+    if (__builtin_cpu_supports("abm")) {
+        features |= BBI_CPU_LZCNT;
+    }
+    if (__builtin_cpu_supports("bmi")) {
+        features |= BBI_CPU_BMI;
+    }
+#endif
+    __atomic_store_n(&cpu_features, features, __ATOMIC_RELAXED);
+    __atomic_store_n(&cpu_features_known, 1, __ATOMIC_RELEASE);
+    return features;
+}
+
+/* Pretend the CPU only has the features in mask (ANDed with what it really has) - for testing and
+   benchmarking each implementation */
+void _bbi_cpu_restrict(unsigned int mask) {
+    unsigned int features;
+
+    __atomic_store_n(&cpu_features_known, 0, __ATOMIC_RELAXED);
+    features = _bbi_cpu_features() & mask;
+    __atomic_store_n(&cpu_features, features, __ATOMIC_RELAXED);
+}
+
+typedef bbi_limb bbi_v128 __attribute__((vector_size(16)));
+typedef bbi_limb bbi_v256 __attribute__((vector_size(32)));
+typedef bbi_limb bbi_v512 __attribute__((vector_size(64)));
+
+/* rp[i] = EXPR over n chunks, with x = ap[i] and y = bp[i], VTYPE-sized pieces at a time and then
+   single chunks for the tail. memcpy() is how to say "unaligned vector load/store" portably. */
+#define BBI_BITOP_LOOP(VTYPE, EXPR)                                     \
+    do {                                                                \
+        const unsigned int per = sizeof(VTYPE) / sizeof(bbi_limb);      \
+        unsigned int i = 0;                                             \
+        for (; i + per <= n; i += per) {                                \
+            VTYPE x;                                                    \
+            VTYPE y;                                                    \
+            memcpy(&x, &ap[i], sizeof(VTYPE));                          \
+            memcpy(&y, &bp[i], sizeof(VTYPE));                          \
+            x = (EXPR);                                                 \
+            memcpy(&rp[i], &x, sizeof(VTYPE));                          \
+        }                                                               \
+        for (; i < n; i++) {                                            \
+            bbi_limb x = ap[i];                                         \
+            bbi_limb y = bp[i];                                         \
+            (void) y;                                                   \
+            rp[i] = (EXPR);                                             \
+        }                                                               \
+    } while (0)
+
+typedef void (*bbi_bitop_fn)(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BBI_BITOP_X86(NAME, EXPR)                                                                       \
+    __attribute__((target("sse2")))                                                                     \
+    static void _bbi_##NAME##_sse2(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) { \
+        BBI_BITOP_LOOP(bbi_v128, EXPR);                                                                 \
+    }                                                                                                   \
+    __attribute__((target("avx2")))                                                                     \
+    static void _bbi_##NAME##_avx2(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) { \
+        BBI_BITOP_LOOP(bbi_v256, EXPR);                                                                 \
+    }                                                                                                   \
+    __attribute__((target("avx512f")))                                                                  \
+    static void _bbi_##NAME##_avx512(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) { \
+        BBI_BITOP_LOOP(bbi_v512, EXPR);                                                                 \
+    }
+#define BBI_BITOP_DISPATCH(NAME)                                        \
+    unsigned int features = _bbi_cpu_features();                        \
+    if (features & BBI_CPU_AVX512) {                                    \
+        return _bbi_##NAME##_avx512;                                    \
+    }                                                                   \
+    if (features & BBI_CPU_AVX2) {                                      \
+        return _bbi_##NAME##_avx2;                                      \
+    }                                                                   \
+    if (features & BBI_CPU_SSE2) {                                      \
+        return _bbi_##NAME##_sse2;                                      \
+    }
+#else
+#define BBI_BITOP_X86(NAME, EXPR)
+#define BBI_BITOP_DISPATCH(NAME)
+#endif
+
+/* Define every implementation of one operation, and _bbi_NAME_select() to pick the best one for
+   this CPU */
+#define BBI_BITOP(NAME, EXPR)                                                                           \
+    static void _bbi_##NAME##_generic(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) { \
+        BBI_BITOP_LOOP(bbi_limb, EXPR);                                                                 \
+    }                                                                                                   \
+    BBI_BITOP_X86(NAME, EXPR)                                                                           \
+    static bbi_bitop_fn _bbi_##NAME##_select() {                                                        \
+        BBI_BITOP_DISPATCH(NAME)                                                                        \
+        return _bbi_##NAME##_generic;                                                                   \
+    }
+
+BBI_BITOP(and, x & y)
+BBI_BITOP(or, x | y)
+BBI_BITOP(xor, x ^ y)
+BBI_BITOP(not, ~x)
+
+void _bbi_and_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    _bbi_and_select()(rp, ap, bp, n);
+}
+
+void _bbi_or_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    _bbi_or_select()(rp, ap, bp, n);
+}
+
+void _bbi_xor_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    _bbi_xor_select()(rp, ap, bp, n);
+}
+
+/* Unary NOT goes through the same kernel, with the second operand unused */
+void _bbi_not_n(bbi_limb *rp, const bbi_limb *ap, unsigned int n) {
+    _bbi_not_select()(rp, ap, ap, n);
+}
+
+/* Lane-wise add with carry for batches (see bbi_batch.c): rp[i] = ap[i] + bp[i] + cp[i], with the
+   carry out of each lane left in cp[i]. The lanes are independent values, so unlike a carry chain
+   this vectorizes. A vector compare gives -1 for true, hence the & 1. */
+#define BBI_ADD_LANES_LOOP(VTYPE)                                       \
+    do {                                                                \
+        const unsigned int per = sizeof(VTYPE) / sizeof(bbi_limb);      \
+        unsigned int i = 0;                                             \
+        for (; i + per <= n; i += per) {                                \
+            VTYPE x;                                                    \
+            VTYPE y;                                                    \
+            VTYPE c;                                                    \
+            memcpy(&x, &ap[i], sizeof(VTYPE));                          \
+            memcpy(&y, &bp[i], sizeof(VTYPE));                          \
+            memcpy(&c, &cp[i], sizeof(VTYPE));                          \
+            x += y;                                                     \
+            c = (VTYPE) ((x < y) | (x + c < x)) & 1;                    \
+            memcpy(&y, &cp[i], sizeof(VTYPE));                          \
+            x += y;                                                     \
+            memcpy(&rp[i], &x, sizeof(VTYPE));                          \
+            memcpy(&cp[i], &c, sizeof(VTYPE));                          \
+        }                                                               \
+        for (; i < n; i++) {                                            \
+            bbi_limb x = ap[i] + bp[i];                                 \
+            bbi_limb c = (x < bp[i]) | (x + cp[i] < x);                 \
+            rp[i] = x + cp[i];                                          \
+            cp[i] = c;                                                  \
+        }                                                               \
+    } while (0)
+
+typedef void (*bbi_add_lanes_fn)(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, bbi_limb *cp, unsigned int n);
+
+static void _bbi_add_lanes_generic(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, bbi_limb *cp, unsigned int n) {
+    BBI_ADD_LANES_LOOP(bbi_limb);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void _bbi_add_lanes_sse2(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, bbi_limb *cp, unsigned int n) {
+    BBI_ADD_LANES_LOOP(bbi_v128);
+}
+
+__attribute__((target("avx2")))
+static void _bbi_add_lanes_avx2(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, bbi_limb *cp, unsigned int n) {
+    BBI_ADD_LANES_LOOP(bbi_v256);
+}
+
+__attribute__((target("avx512f")))
+static void _bbi_add_lanes_avx512(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, bbi_limb *cp, unsigned int n) {
+    BBI_ADD_LANES_LOOP(bbi_v512);
+}
+#endif
+
+static bbi_add_lanes_fn _bbi_add_lanes_select() {
+    BBI_BITOP_DISPATCH(add_lanes)
+    return _bbi_add_lanes_generic;
+}
+
+void _bbi_add_lanes_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, bbi_limb *cp, unsigned int n) {
+    _bbi_add_lanes_select()(rp, ap, bp, cp, n);
+}
+
+#if BBI_LIMB_BITS == 64
+#define BBI_POPCOUNT __builtin_popcountll
+#define BBI_CLZ __builtin_clzll
+#define BBI_CTZ __builtin_ctzll
+#else
+#define BBI_POPCOUNT __builtin_popcount
+#define BBI_CLZ __builtin_clz
+#define BBI_CTZ __builtin_ctz
+#endif
+
+/* Number of 1 bits in n chunks */
+#define BBI_POPCOUNT_LOOP                                               \
+    do {                                                                \
+        unsigned int count = 0;                                         \
+        unsigned int i;                                                 \
+        for (i = 0; i < n; i++) {                                       \
+            count += BBI_POPCOUNT(ap[i]);                               \
+        }                                                               \
+        return count;                                                   \
+    } while (0)
+
+/* Bit length of n chunks with a non-zero top chunk */
+#define BBI_BIT_LENGTH_BODY return n * BBI_LIMB_BITS - BBI_CLZ(ap[n - 1])
+
+/* Trailing 0 bits of n chunks that aren't all 0 */
+#define BBI_CTZ_BODY                                                    \
+    do {                                                                \
+        unsigned int i = 0;                                             \
+        while (ap[i] == 0) {                                            \
+            i++;                                                        \
+        }                                                               \
+        return i * BBI_LIMB_BITS + BBI_CTZ(ap[i]);                      \
+    } while (0)
+
+typedef unsigned int (*bbi_bitcount_fn)(const bbi_limb *ap, unsigned int n);
+
+static unsigned int _bbi_popcount_generic(const bbi_limb *ap, unsigned int n) {
+    BBI_POPCOUNT_LOOP;
+}
+
+static unsigned int _bbi_bit_length_generic(const bbi_limb *ap, unsigned int n) {
+    BBI_BIT_LENGTH_BODY;
+}
+
+static unsigned int _bbi_ctz_generic(const bbi_limb *ap, unsigned int n) {
+    (void) n;
+    BBI_CTZ_BODY;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("popcnt")))
+static unsigned int _bbi_popcount_popcnt(const bbi_limb *ap, unsigned int n) {
+    BBI_POPCOUNT_LOOP;
+}
+
+__attribute__((target("lzcnt")))
+static unsigned int _bbi_bit_length_lzcnt(const bbi_limb *ap, unsigned int n) {
+    BBI_BIT_LENGTH_BODY;
+}
+
+__attribute__((target("bmi")))
+static unsigned int _bbi_ctz_bmi(const bbi_limb *ap, unsigned int n) {
+    (void) n;
+    BBI_CTZ_BODY;
+}
+#endif
+
+static bbi_bitcount_fn _bbi_popcount_select() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (_bbi_cpu_features() & BBI_CPU_POPCNT) {
+        return _bbi_popcount_popcnt;
+    }
+#endif
+    return _bbi_popcount_generic;
+}
+
+static bbi_bitcount_fn _bbi_bit_length_select() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (_bbi_cpu_features() & BBI_CPU_LZCNT) {
+        return _bbi_bit_length_lzcnt;
+    }
+#endif
+    return _bbi_bit_length_generic;
+}
+
+static bbi_bitcount_fn _bbi_ctz_select() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (_bbi_cpu_features() & BBI_CPU_BMI) {
+        return _bbi_ctz_bmi;
+    }
+#endif
+    return _bbi_ctz_generic;
+}
+
+unsigned int _bbi_popcount_n(const bbi_limb *ap, unsigned int n) {
+    return _bbi_popcount_select()(ap, n);
+}
+
+unsigned int _bbi_bit_length_n(const bbi_limb *ap, unsigned int n) {
+    n = _bbi_normalized_len(ap, n);
+    return n == 0 ? 0 : _bbi_bit_length_select()(ap, n);
+}
+
+unsigned int _bbi_ctz_n(const bbi_limb *ap, unsigned int n) {
+    return _bbi_normalized_len(ap, n) == 0 ? ~0u : _bbi_ctz_select()(ap, n);
+}
@@ -0,0 +1,371 @@
+/*
+ * Modular arithmetic: Montgomery multiplication and modular exponentiation.
+ *
+ * A bbi_mont_ctx is set up once per odd modulus N of n chunks. Values are kept in Montgomery
+ * form, aR mod N with R = 2^(n*BBI_LIMB_BITS), where a product only needs a Montgomery reduction
+ * (REDC) - n multiply-adds of one chunk each - instead of a division by N.
+ *
+ * bbi_powmod_ctx() scans the exponent in sliding windows, multiplying by precomputed odd powers of
+ * the base. With BBI_POWMOD_CONSTTIME it uses fixed windows instead, reads every table entry each
+ * time (keeping one by masking), and reduces without a data-dependent final subtraction, so its
+ * timing and memory accesses depend only on the sizes of the operands.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+
+/* Set up for the odd modulus |list|. Returns NULL if it's even (including 0). */
+bbi_mont_ctx *bbi_mont_ctx_create(bbi_chunk *list) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    bbi_mont_ctx *ctx;
+    bbi_limb *tmp;
+    bbi_limb inv;
+    unsigned int i;
+
+    if (n == 0 || (list->limbs[0] & 1) == 0) {
+        return NULL;
+    }
+    ctx = _bbi_alloc(sizeof(bbi_mont_ctx));
+    ctx->len = n;
+    ctx->mod = _bbi_alloc(3 * n * sizeof(bbi_limb));
+    ctx->one = &ctx->mod[n];
+    ctx->r2 = &ctx->mod[2 * n];
+    memcpy(ctx->mod, list->limbs, n * sizeof(bbi_limb));
+
+    /* -1/N mod 2^BBI_LIMB_BITS by Newton's iteration, as for _bbi_divexact_1() */
+    inv = ctx->mod[0];
+    for (i = 0; i < 5; i++) {
+        inv *= 2 - ctx->mod[0] * inv;
+    }
+    ctx->ninv = -inv;
+
+    /* R mod N and R^2 mod N, by division since this is only done once */
+    tmp = _bbi_alloc((2 * n + 1) * sizeof(bbi_limb));
+    memset(tmp, 0, 2 * n * sizeof(bbi_limb));
+    tmp[2 * n] = 1;
+    _bbi_divrem(NULL, ctx->r2, tmp, 2 * n + 1, ctx->mod, n);
+    _bbi_divrem(NULL, ctx->one, &tmp[n], n + 1, ctx->mod, n);
+    _bbi_free(tmp, (2 * n + 1) * sizeof(bbi_limb));
+    return ctx;
+}
+
+void bbi_mont_ctx_destroy(bbi_mont_ctx *ctx) {
+    _bbi_free(ctx->mod, 3 * ctx->len * sizeof(bbi_limb));
+    _bbi_free(ctx, sizeof(bbi_mont_ctx));
+}
+
+/* Montgomery reduction: rp = tp / R mod N for 2n chunks of tp < N*R, which is overwritten. Each
+   round clears the bottom chunk of tp and parks its carry there, and the carries are added back
+   in at the end. With ct set the final subtraction of N is done whether it's needed or not and the
+   right answer picked by masking. */
+void _bbi_mont_redc(bbi_limb *rp, bbi_limb *tp, const bbi_mont_ctx *ctx, int ct) {
+    const bbi_limb *mp = ctx->mod;
+    unsigned int n = ctx->len;
+    bbi_limb cy;
+    bbi_limb borrow;
+    bbi_limb mask;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        tp[i] = _bbi_addmul_1(&tp[i], mp, n, tp[i] * ctx->ninv);
+    }
+    cy = _bbi_add_n(rp, &tp[n], tp, n);
+    if (ct) {
+        /* tp is free now, so the subtraction goes there */
+        borrow = _bbi_sub_n(tp, rp, mp, n);
+        mask = -(cy | (borrow ^ 1));
+        for (i = 0; i < n; i++) {
+            rp[i] = (tp[i] & mask) | (rp[i] & ~mask);
+        }
+    } else if (cy != 0 || _bbi_cmp(rp, n, mp, n) >= 0) {
+        _bbi_sub_n(rp, rp, mp, n);
+    }
+}
+
+/* rp = ap * bp / R mod N, for n-chunk ap and bp less than N. rp may be ap or bp. tp is 2n chunks
+   of scratch. The constant-time version sticks to the schoolbook multiply, since the faster ones
+   branch on the values of their intermediate results. */
+void _bbi_mont_mul(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, const bbi_mont_ctx *ctx,
+                   bbi_limb *tp, int ct) {
+    unsigned int n = ctx->len;
+
+    if (ct) {
+        if (ap == bp) {
+            _bbi_sqr_basecase(tp, ap, n);
+        } else {
+            _bbi_mul_basecase(tp, ap, n, bp, n);
+        }
+    } else {
+        _bbi_mul(tp, ap, n, bp, n);
+    }
+    _bbi_mont_redc(rp, tp, ctx, ct);
+}
+
+/* |list| mod N into n chunks of rp */
+static void _bbi_mont_load(bbi_limb *rp, bbi_chunk *list, const bbi_mont_ctx *ctx) {
+    unsigned int an = _bbi_normalized_len(list->limbs, list->len);
+    unsigned int n = ctx->len;
+
+    if (an < n || (an == n && _bbi_cmp(list->limbs, n, ctx->mod, n) < 0)) {
+        memcpy(rp, list->limbs, an * sizeof(bbi_limb));
+        memset(&rp[an], 0, (n - an) * sizeof(bbi_limb));
+    } else {
+        _bbi_divrem(NULL, rp, list->limbs, an, ctx->mod, n);
+    }
+}
+
+/* A new bigint from n chunks */
+static bbi_chunk *_bbi_mont_result(const bbi_limb *ap, unsigned int n) {
+    bbi_chunk *result = _bbi_alloc_chunks(n);
+
+    memcpy(result->limbs, ap, n * sizeof(bbi_limb));
+    result->len = _bbi_normalized_len(ap, n);
+    if (result->len == 0) {
+        result->len = 1;
+    }
+    result->sign = 0;
+    return result;
+}
+
+/* Operate on 1 or 2 values brought into the range of n chunks. op is 0 for conversion to Montgomery
+   form, 1 for conversion out of it, 2 for multiplication. */
+static bbi_chunk *_bbi_mont_op(const bbi_mont_ctx *ctx, bbi_chunk *list_a, bbi_chunk *list_b, int op) {
+    unsigned int n = ctx->len;
+    bbi_limb *ap = _bbi_alloc(4 * n * sizeof(bbi_limb));
+    bbi_limb *bp = &ap[n];
+    bbi_limb *tp = &ap[2 * n];
+    bbi_chunk *result;
+
+    _bbi_mont_load(ap, list_a, ctx);
+    if (op == 0) {
+        _bbi_mont_mul(ap, ap, ctx->r2, ctx, tp, 0);
+    } else if (op == 1) {
+        memcpy(tp, ap, n * sizeof(bbi_limb));
+        memset(&tp[n], 0, n * sizeof(bbi_limb));
+        _bbi_mont_redc(ap, tp, ctx, 0);
+    } else if (list_b == list_a) {
+        _bbi_mont_mul(ap, ap, ap, ctx, tp, 0);
+    } else {
+        _bbi_mont_load(bp, list_b, ctx);
+        _bbi_mont_mul(ap, ap, bp, ctx, tp, 0);
+    }
+    result = _bbi_mont_result(ap, n);
+    _bbi_free(ap, 4 * n * sizeof(bbi_limb));
+    return result;
+}
+
+/* aR mod N */
+bbi_chunk *bbi_mont_to(const bbi_mont_ctx *ctx, bbi_chunk *list) {
+    return _bbi_mont_op(ctx, list, NULL, 0);
+}
+
+/* a/R mod N, taking a value back out of Montgomery form */
+bbi_chunk *bbi_mont_from(const bbi_mont_ctx *ctx, bbi_chunk *list) {
+    return _bbi_mont_op(ctx, list, NULL, 1);
+}
+
+/* ab/R mod N - the product of two values in Montgomery form, in Montgomery form */
+bbi_chunk *bbi_mont_mul(const bbi_mont_ctx *ctx, bbi_chunk *list_a, bbi_chunk *list_b) {
+    return _bbi_mont_op(ctx, list_a, list_b, 2);
+}
+
+bbi_chunk *bbi_mont_sqr(const bbi_mont_ctx *ctx, bbi_chunk *list) {
+    return _bbi_mont_op(ctx, list, list, 2);
+}
+
+/* Window size for an exponent of ebits bits, balancing the table's 2^(k-1) multiplications
+   against the roughly ebits/(k+1) saved while scanning */
+static unsigned int _bbi_powmod_window(unsigned int ebits) {
+    static const unsigned int limits[] = {8, 24, 80, 240, 672};
+    unsigned int k = 1;
+
+    while (k <= 5 && ebits > limits[k - 1]) {
+        k++;
+    }
+    return k;
+}
+
+/* Sliding window: the exponent is cut into windows that start and end on a 1 bit, separated by
+   runs of 0s, so only odd powers of the base are needed */
+static void _bbi_powmod_sliding(bbi_limb *rp, const bbi_limb *bp, const bbi_limb *ep, unsigned int en,
+                                const bbi_mont_ctx *ctx, bbi_limb *tp) {
+    unsigned int n = ctx->len;
+    unsigned int ebits = en * BBI_LIMB_BITS - _bbi_limb_clz(ep[en - 1]);
+    unsigned int k = _bbi_powmod_window(ebits);
+    unsigned int tsize = 1u << (k - 1);
+    bbi_limb *table = _bbi_alloc((tsize + 1) * n * sizeof(bbi_limb));
+    bbi_limb *b2 = &table[tsize * n];
+    bbi_limb w;
+    unsigned int i;
+    unsigned int j;
+    int started = 0;
+
+    /* table[i] = b^(2i+1) */
+    memcpy(table, bp, n * sizeof(bbi_limb));
+    _bbi_mont_mul(b2, bp, bp, ctx, tp, 0);
+    for (i = 1; i < tsize; i++) {
+        _bbi_mont_mul(&table[i * n], &table[(i - 1) * n], b2, ctx, tp, 0);
+    }
+
+    i = ebits;
+    while (i > 0) {
+        if (!_bbi_get_bits(ep, en, i - 1, 1)) {
+            _bbi_mont_mul(rp, rp, rp, ctx, tp, 0);
+            i--;
+            continue;
+        }
+        /* The window is bits j to i-1, trimmed so its bottom bit is 1 */
+        j = i > k ? i - k : 0;
+        while (!_bbi_get_bits(ep, en, j, 1)) {
+            j++;
+        }
+        w = _bbi_get_bits(ep, en, j, i - j);
+        if (started) {
+            for (; i > j; i--) {
+                _bbi_mont_mul(rp, rp, rp, ctx, tp, 0);
+            }
+            _bbi_mont_mul(rp, rp, &table[(w >> 1) * n], ctx, tp, 0);
+        } else {
+            memcpy(rp, &table[(w >> 1) * n], n * sizeof(bbi_limb));
+            started = 1;
+        }
+        i = j;
+    }
+    _bbi_free(table, (tsize + 1) * n * sizeof(bbi_limb));
+}
+
+/* Fixed windows of k bits over all en chunks of the exponent, leading zeros included */
+static void _bbi_powmod_fixed(bbi_limb *rp, const bbi_limb *bp, const bbi_limb *ep, unsigned int en,
+                              const bbi_mont_ctx *ctx, bbi_limb *tp) {
+    const unsigned int k = 4;
+    unsigned int n = ctx->len;
+    bbi_limb *table = _bbi_alloc(((1u << k) + 1) * n * sizeof(bbi_limb));
+    bbi_limb *sel = &table[(1u << k) * n];
+    bbi_limb w;
+    bbi_limb mask;
+    unsigned int i;
+    unsigned int j;
+    unsigned int bit;
+
+    /* table[i] = b^i */
+    memcpy(table, ctx->one, n * sizeof(bbi_limb));
+    memcpy(&table[n], bp, n * sizeof(bbi_limb));
+    for (i = 2; i < (1u << k); i++) {
+        _bbi_mont_mul(&table[i * n], &table[(i - 1) * n], bp, ctx, tp, 1);
+    }
+
+    memcpy(rp, ctx->one, n * sizeof(bbi_limb));
+    bit = (en * BBI_LIMB_BITS + k - 1) / k * k;
+    while (bit > 0) {
+        bit -= k;
+        for (i = 0; i < k; i++) {
+            _bbi_mont_mul(rp, rp, rp, ctx, tp, 1);
+        }
+        w = _bbi_get_bits(ep, en, bit, k);
+        memset(sel, 0, n * sizeof(bbi_limb));
+        for (i = 0; i < (1u << k); i++) {
+            mask = -(bbi_limb) (i == w);
+            for (j = 0; j < n; j++) {
+                sel[j] |= table[i * n + j] & mask;
+            }
+        }
+        _bbi_mont_mul(rp, rp, sel, ctx, tp, 1);
+    }
+    _bbi_free(table, ((1u << k) + 1) * n * sizeof(bbi_limb));
+}
+
+/* base^exp mod N, 0 <= result < N. Negative bases are taken mod N first. Returns NULL for a
+   negative exponent. flags can be BBI_POWMOD_CONSTTIME. */
+bbi_chunk *bbi_powmod_ctx(const bbi_mont_ctx *ctx, bbi_chunk *base, bbi_chunk *exp, unsigned int flags) {
+    unsigned int n = ctx->len;
+    unsigned int en = _bbi_normalized_len(exp->limbs, exp->len);
+    bbi_limb *rp;
+    bbi_limb *bp;
+    bbi_limb *tp;
+    bbi_chunk *result;
+    BBI_STAT_SCOPE(BBI_STAT_POWMOD, n + en);
+
+    if (exp->sign && en > 0) {
+        return NULL;
+    }
+    rp = _bbi_alloc(4 * n * sizeof(bbi_limb));
+    bp = &rp[n];
+    tp = &rp[2 * n];
+    _bbi_mont_load(bp, base, ctx);
+    if (base->sign && _bbi_normalized_len(bp, n) > 0) {
+        _bbi_sub_n(bp, ctx->mod, bp, n);
+    }
+    _bbi_mont_mul(bp, bp, ctx->r2, ctx, tp, flags & BBI_POWMOD_CONSTTIME);
+
+    if (flags & BBI_POWMOD_CONSTTIME) {
+        _bbi_powmod_fixed(rp, bp, exp->limbs, exp->len, ctx, tp);
+    } else if (en == 0) {
+        memcpy(rp, ctx->one, n * sizeof(bbi_limb));
+    } else {
+        _bbi_powmod_sliding(rp, bp, exp->limbs, en, ctx, tp);
+    }
+
+    /* Out of Montgomery form */
+    memcpy(tp, rp, n * sizeof(bbi_limb));
+    memset(&tp[n], 0, n * sizeof(bbi_limb));
+    _bbi_mont_redc(rp, tp, ctx, flags & BBI_POWMOD_CONSTTIME);
+    result = _bbi_mont_result(rp, n);
+    _bbi_free(rp, 4 * n * sizeof(bbi_limb));
+    return result;
+}
+
+/* base^exp mod |mod|. Odd moduli go through a temporary bbi_mont_ctx - set one up with
+   bbi_mont_ctx_create() to reuse it. Even ones use square-and-multiply with division. Returns
+   NULL for a 0 modulus or a negative exponent. */
+bbi_chunk *bbi_powmod(bbi_chunk *base, bbi_chunk *exp, bbi_chunk *mod) {
+    unsigned int mn = _bbi_normalized_len(mod->limbs, mod->len);
+    unsigned int en = _bbi_normalized_len(exp->limbs, exp->len);
+    bbi_mont_ctx *ctx;
+    bbi_chunk *result;
+    bbi_limb *rp;
+    bbi_limb *bp;
+    bbi_limb *tp;
+    unsigned int i;
+
+    if (mn == 0 || (exp->sign && en > 0)) {
+        return NULL;
+    }
+    ctx = bbi_mont_ctx_create(mod);
+    if (ctx != NULL) {
+        result = bbi_powmod_ctx(ctx, base, exp, 0);
+        bbi_mont_ctx_destroy(ctx);
+        return result;
+    }
+
+    /* Even modulus - left to right binary, reducing each product by division */
+    rp = _bbi_alloc(4 * mn * sizeof(bbi_limb));
+    bp = &rp[mn];
+    tp = &rp[2 * mn];
+    memset(rp, 0, mn * sizeof(bbi_limb));
+    memset(bp, 0, mn * sizeof(bbi_limb));
+    i = _bbi_normalized_len(base->limbs, base->len);
+    if (i < mn) {
+        memcpy(bp, base->limbs, i * sizeof(bbi_limb));
+    } else {
+        _bbi_divrem(NULL, bp, base->limbs, i, mod->limbs, mn);
+    }
+    if (base->sign && _bbi_normalized_len(bp, mn) > 0) {
+        _bbi_sub_n(bp, mod->limbs, bp, mn);
+    }
+    rp[0] = 1;
+    if (mn == 1 && mod->limbs[0] == 1) {
+        rp[0] = 0;
+    }
+    for (i = en > 0 ? en * BBI_LIMB_BITS - _bbi_limb_clz(exp->limbs[en - 1]) : 0; i > 0; i--) {
+        _bbi_mul(tp, rp, mn, rp, mn);
+        _bbi_divrem(NULL, rp, tp, 2 * mn, mod->limbs, mn);
+        if (_bbi_get_bits(exp->limbs, en, i - 1, 1)) {
+            _bbi_mul(tp, rp, mn, bp, mn);
+            _bbi_divrem(NULL, rp, tp, 2 * mn, mod->limbs, mn);
+        }
+    }
+    result = _bbi_mont_result(rp, mn);
+    _bbi_free(rp, 4 * mn * sizeof(bbi_limb));
+    return result;
+}
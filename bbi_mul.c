@@ -0,0 +1,452 @@
+/*
+ * Multiplication on raw chunk arrays, least-significant chunk first, and the bbi_mul() entry points.
+ *
+ * Balanced n x n products go schoolbook -> Karatsuba -> Toom-3 -> NTT (bbi_ntt.c) as n grows, with
+ * squaring getting its own versions of each that skip the cross products that would be computed
+ * twice. Unbalanced products are cut into balanced pieces, unless they're big enough for the NTT,
+ * which takes them whole. The crossover points start out as the values in
+ * bbi_tune.h, but are variables so that bbi_tune can move them around while it measures.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+#include "bbi_tune.h"
+
+unsigned int _bbi_mul_karatsuba_threshold = BBI_MUL_KARATSUBA_THRESHOLD;
+unsigned int _bbi_mul_toom3_threshold = BBI_MUL_TOOM3_THRESHOLD;
+unsigned int _bbi_sqr_karatsuba_threshold = BBI_SQR_KARATSUBA_THRESHOLD;
+unsigned int _bbi_sqr_toom3_threshold = BBI_SQR_TOOM3_THRESHOLD;
+
+bbi_limb _bbi_mul_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b) {
+    unsigned int i;
+    bbi_limb carry = 0;
+    bbi_dlimb t;
+
+    for (i = 0; i < n; i++) {
+        t = (bbi_dlimb) ap[i] * b + carry;
+        rp[i] = (bbi_limb) t;
+        carry = (bbi_limb) (t >> BBI_LIMB_BITS);
+    }
+    return carry;
+}
+
+bbi_limb _bbi_addmul_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b) {
+    unsigned int i;
+    bbi_limb carry = 0;
+    bbi_dlimb t;
+
+    /* ap[i] * b + rp[i] + carry can't overflow two chunks: (2^w-1)^2 + 2(2^w-1) = 2^2w - 1 */
+    for (i = 0; i < n; i++) {
+        t = (bbi_dlimb) ap[i] * b + rp[i] + carry;
+        rp[i] = (bbi_limb) t;
+        carry = (bbi_limb) (t >> BBI_LIMB_BITS);
+    }
+    return carry;
+}
+
+bbi_limb _bbi_submul_1(bbi_limb *rp, const bbi_limb *ap, unsigned int n, bbi_limb b) {
+    unsigned int i;
+    bbi_limb borrow = 0;
+    bbi_limb lo;
+    bbi_dlimb t;
+
+    for (i = 0; i < n; i++) {
+        t = (bbi_dlimb) ap[i] * b + borrow;
+        lo = (bbi_limb) t;
+        borrow = (bbi_limb) (t >> BBI_LIMB_BITS) + (rp[i] < lo);
+        rp[i] -= lo;
+    }
+    return borrow;
+}
+
+/* Schoolbook multiplication, one row of partial products per chunk of bp */
+void _bbi_mul_basecase(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn) {
+    unsigned int i;
+
+    assert(an > 0 && bn > 0);
+    rp[an] = _bbi_mul_1(rp, ap, an, bp[0]);
+    for (i = 1; i < bn; i++) {
+        rp[an + i] = _bbi_addmul_1(&rp[i], ap, an, bp[i]);
+    }
+}
+
+/* Squaring: each cross product a[i]*a[j], i < j, is computed once and doubled, then the squares
+   of the single chunks are added along the diagonal */
+void _bbi_sqr_basecase(bbi_limb *rp, const bbi_limb *ap, unsigned int n) {
+    unsigned int i;
+    bbi_limb carry = 0;
+    bbi_dlimb sq;
+    bbi_dlimb t;
+
+    memset(rp, 0, 2 * n * sizeof(bbi_limb));
+    for (i = 0; i + 1 < n; i++) {
+        rp[i + n] = _bbi_addmul_1(&rp[2 * i + 1], &ap[i + 1], n - 1 - i, ap[i]);
+    }
+    _bbi_lshift(rp, rp, 2 * n, 1);
+    for (i = 0; i < n; i++) {
+        sq = (bbi_dlimb) ap[i] * ap[i];
+        t = (bbi_dlimb) rp[2 * i] + (bbi_limb) sq + carry;
+        rp[2 * i] = (bbi_limb) t;
+        t = (bbi_dlimb) rp[2 * i + 1] + (bbi_limb) (sq >> BBI_LIMB_BITS) + (bbi_limb) (t >> BBI_LIMB_BITS);
+        rp[2 * i + 1] = (bbi_limb) t;
+        carry = (bbi_limb) (t >> BBI_LIMB_BITS);
+    }
+}
+
+/* rp -= ap over rn chunks, where ap has an <= rn chunks. The result mustn't go negative. */
+static void _bbi_sub_into(bbi_limb *rp, unsigned int rn, const bbi_limb *ap, unsigned int an) {
+    bbi_limb borrow = _bbi_sub_n(rp, rp, ap, an);
+
+    borrow = _bbi_sub_1(&rp[an], &rp[an], rn - an, borrow);
+    assert(borrow == 0);
+    (void) borrow;
+}
+
+/* rp += ap over rn chunks, where ap has an <= rn chunks. The result must fit. */
+static void _bbi_add_into(bbi_limb *rp, unsigned int rn, const bbi_limb *ap, unsigned int an) {
+    bbi_limb carry;
+
+    an = _bbi_normalized_len(ap, an);
+    assert(an <= rn);
+    carry = _bbi_add_n(rp, rp, ap, an);
+    carry = _bbi_add_1(&rp[an], &rp[an], rn - an, carry);
+    assert(carry == 0);
+    (void) carry;
+}
+
+/* rp = |ap - bp| over n chunks, returning 1 if ap < bp */
+static int _bbi_sub_abs(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    if (_bbi_cmp(ap, n, bp, n) < 0) {
+        _bbi_sub_n(rp, bp, ap, n);
+        return 1;
+    }
+    _bbi_sub_n(rp, ap, bp, n);
+    return 0;
+}
+
+static void _bbi_mul_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n);
+
+/* The independent sub-products of one Karatsuba or Toom-3 step */
+struct bbi_mul_task {
+    bbi_limb *rp;
+    const bbi_limb *ap;
+    const bbi_limb *bp;
+    unsigned int n;
+};
+
+static void _bbi_mul_task_run(void *arg, unsigned int i) {
+    struct bbi_mul_task *t = (struct bbi_mul_task *) arg + i;
+
+    _bbi_mul_n(t->rp, t->ap, t->bp, t->n);
+}
+
+/* Work out count sub-products of a size-n step - on the thread pool if n is big enough. Only the
+   outermost step is split; the products inside a task run on its thread. */
+static void _bbi_mul_tasks(struct bbi_mul_task *t, unsigned int count, unsigned int n) {
+    unsigned int i;
+
+    if (n >= _bbi_par_mul_threshold && bbi_threads() > 1) {
+        _bbi_par_run(_bbi_mul_task_run, t, count);
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        _bbi_mul_n(t[i].rp, t[i].ap, t[i].bp, t[i].n);
+    }
+}
+
+/* Karatsuba, splitting each operand as x1 * B^m + x0 with m = ceil(n/2):
+   a*b = z2 B^2m + (z0 + z2 - (a0 - a1)(b0 - b1)) B^m + z0, with z0 = a0 b0, z2 = a1 b1.
+   Three half-size products instead of four. If ap == bp this is a square, and (a0 - a1)^2 is
+   never negative. */
+static void _bbi_karatsuba(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    unsigned int m = (n + 1) / 2;
+    unsigned int h = n - m;
+    int sqr = ap == bp;
+    int neg;
+    bbi_limb *da = _bbi_alloc((6 * m + 1) * sizeof(bbi_limb));
+    bbi_limb *db = da + m;
+    bbi_limb *t = db + m;
+    bbi_limb *mid = t + 2 * m;
+    struct bbi_mul_task tasks[3];
+
+    /* Pad the high halves to m chunks so the differences line up */
+    memcpy(mid, &ap[m], h * sizeof(bbi_limb));
+    mid[h] = 0;
+    neg = _bbi_sub_abs(da, ap, mid, m);
+    if (sqr) {
+        neg = 0;
+    } else {
+        memcpy(mid, &bp[m], h * sizeof(bbi_limb));
+        mid[h] = 0;
+        neg ^= _bbi_sub_abs(db, bp, mid, m);
+    }
+
+    /* t = (a0 - a1)(b0 - b1), z0 and z2, each into its own space */
+    tasks[0].rp = t;
+    tasks[0].ap = da;
+    tasks[0].bp = sqr ? da : db;
+    tasks[0].n = m;
+    tasks[1].rp = rp;
+    tasks[1].ap = ap;
+    tasks[1].bp = bp;
+    tasks[1].n = m;
+    tasks[2].rp = &rp[2 * m];
+    tasks[2].ap = &ap[m];
+    tasks[2].bp = sqr ? &ap[m] : &bp[m];
+    tasks[2].n = h;
+    _bbi_mul_tasks(tasks, 3, n);
+
+    /* mid = z0 + z2 -/+ t, which is at most 2m+1 chunks and never negative */
+    memcpy(mid, rp, 2 * m * sizeof(bbi_limb));
+    mid[2 * m] = 0;
+    _bbi_add_into(mid, 2 * m + 1, &rp[2 * m], 2 * h);
+    if (neg) {
+        _bbi_add_into(mid, 2 * m + 1, t, 2 * m);
+    } else {
+        _bbi_sub_into(mid, 2 * m + 1, t, 2 * m);
+    }
+    _bbi_add_into(&rp[m], 2 * n - m, mid, 2 * m + 1);
+    _bbi_free(da, (6 * m + 1) * sizeof(bbi_limb));
+}
+
+/* Exact division by 3, for Toom-3 interpolation */
+static void _bbi_divexact_3(bbi_limb *rp, unsigned int n) {
+    _bbi_divexact_1(rp, rp, n, 3);
+}
+
+/* p = x0 + c*x1 + c^2*x2, for the k-chunk pieces x0, x1 and the h-chunk piece x2. p has k+1 chunks. */
+static void _bbi_toom3_eval(bbi_limb *p, const bbi_limb *xp, unsigned int k, unsigned int h, bbi_limb c) {
+    memcpy(p, xp, k * sizeof(bbi_limb));
+    p[k] = _bbi_addmul_1(p, &xp[k], k, c);
+    p[k] += _bbi_add_1(&p[h], &p[h], k - h, _bbi_addmul_1(p, &xp[2 * k], h, c * c));
+}
+
+/* Toom-3, splitting each operand in three as x2 B^2k + x1 B^k + x0 and treating them as the
+   quadratics x2 t^2 + x1 t + x0. Their product c4 t^4 + ... + c0 is found from its values at
+   t = 0, 1, 2, 3 and infinity - five products of a third of the size. Using only non-negative
+   points means every step of the interpolation stays non-negative, because the coefficients c0..c4
+   are:
+     w1 = (v1 - c0 - c4)            = c1 +  c2 +  c3
+     w2 = (v2 - c0 - 16 c4) / 2     = c1 + 2c2 + 4c3
+     w3 = (v3 - c0 - 81 c4) / 3     = c1 + 3c2 + 9c3
+     c3 = ((w3 - w2) - (w2 - w1)) / 2, c2 = (w2 - w1) - 3c3, c1 = w1 - c2 - c3 */
+static void _bbi_toom3(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    unsigned int k = (n + 2) / 3;
+    unsigned int h = n - 2 * k;
+    unsigned int vn = 2 * k + 2;
+    int sqr = ap == bp;
+    bbi_limb *pa = _bbi_alloc((6 * (k + 1) + 3 * vn) * sizeof(bbi_limb));
+    bbi_limb *pb = pa + 3 * (k + 1);
+    bbi_limb *w1 = pb + 3 * (k + 1);
+    bbi_limb *w2 = w1 + vn;
+    bbi_limb *w3 = w2 + vn;
+    bbi_limb *w[3];
+    bbi_limb c;
+    unsigned int c4n = 2 * h;
+    struct bbi_mul_task tasks[5];
+    unsigned int i;
+
+    assert(h > 0 && h <= k);
+
+    /* The points 1, 2, 3, each evaluated into its own space so the products are independent */
+    w[0] = w1;
+    w[1] = w2;
+    w[2] = w3;
+    for (i = 0; i < 3; i++) {
+        _bbi_toom3_eval(&pa[i * (k + 1)], ap, k, h, i + 1);
+        if (!sqr) {
+            _bbi_toom3_eval(&pb[i * (k + 1)], bp, k, h, i + 1);
+        }
+        tasks[i].rp = w[i];
+        tasks[i].ap = &pa[i * (k + 1)];
+        tasks[i].bp = sqr ? &pa[i * (k + 1)] : &pb[i * (k + 1)];
+        tasks[i].n = k + 1;
+    }
+    /* c0 and c4 go straight to their places in the result, which they don't overlap */
+    tasks[3].rp = rp;
+    tasks[3].ap = ap;
+    tasks[3].bp = bp;
+    tasks[3].n = k;
+    tasks[4].rp = &rp[4 * k];
+    tasks[4].ap = &ap[2 * k];
+    tasks[4].bp = &bp[2 * k];
+    tasks[4].n = h;
+    _bbi_mul_tasks(tasks, 5, n);
+    memset(&rp[2 * k], 0, 2 * k * sizeof(bbi_limb));
+
+    _bbi_sub_into(w1, vn, rp, 2 * k);
+    _bbi_sub_into(w1, vn, &rp[4 * k], c4n);
+    _bbi_sub_into(w2, vn, rp, 2 * k);
+    c = _bbi_submul_1(w2, &rp[4 * k], c4n, 16);
+    _bbi_sub_1(&w2[c4n], &w2[c4n], vn - c4n, c);
+    _bbi_rshift(w2, w2, vn, 1);
+    _bbi_sub_into(w3, vn, rp, 2 * k);
+    c = _bbi_submul_1(w3, &rp[4 * k], c4n, 81);
+    _bbi_sub_1(&w3[c4n], &w3[c4n], vn - c4n, c);
+    _bbi_divexact_3(w3, vn);
+
+    /* w3 = w3 - w2, w2 = w2 - w1, then w3 = c3, w2 = c2 and w1 = c1 */
+    _bbi_sub_n(w3, w3, w2, vn);
+    _bbi_sub_n(w2, w2, w1, vn);
+    _bbi_sub_n(w3, w3, w2, vn);
+    _bbi_rshift(w3, w3, vn, 1);
+    c = _bbi_submul_1(w2, w3, vn, 3);
+    assert(c == 0);
+    _bbi_sub_n(w1, w1, w2, vn);
+    _bbi_sub_n(w1, w1, w3, vn);
+
+    _bbi_add_into(&rp[k], 2 * n - k, w1, vn);
+    _bbi_add_into(&rp[2 * k], 2 * n - 2 * k, w2, vn);
+    _bbi_add_into(&rp[3 * k], 2 * n - 3 * k, w3, vn);
+    _bbi_free(pa, (6 * (k + 1) + 3 * vn) * sizeof(bbi_limb));
+}
+
+/* Balanced n x n product, choosing the algorithm by size. ap == bp means square. */
+static void _bbi_mul_n(bbi_limb *rp, const bbi_limb *ap, const bbi_limb *bp, unsigned int n) {
+    if (ap == bp) {
+        _bbi_sqr(rp, ap, n);
+    } else if (n < _bbi_mul_karatsuba_threshold || n < 2) {
+        _bbi_mul_basecase(rp, ap, n, bp, n);
+    } else if (n < _bbi_mul_toom3_threshold || n < 5) {
+        _bbi_karatsuba(rp, ap, bp, n);
+    } else if (n < _bbi_mul_ntt_threshold || 2 * (size_t) n > _bbi_mul_ntt_max()) {
+        _bbi_toom3(rp, ap, bp, n);
+    } else {
+        _bbi_mul_ntt(rp, ap, n, bp, n);
+    }
+}
+
+void _bbi_sqr(bbi_limb *rp, const bbi_limb *ap, unsigned int n) {
+    if (n < _bbi_sqr_karatsuba_threshold || n < 2) {
+        _bbi_sqr_basecase(rp, ap, n);
+    } else if (n < _bbi_sqr_toom3_threshold || n < 5) {
+        _bbi_karatsuba(rp, ap, ap, n);
+    } else if (n < _bbi_sqr_ntt_threshold || 2 * (size_t) n > _bbi_mul_ntt_max()) {
+        _bbi_toom3(rp, ap, ap, n);
+    } else {
+        _bbi_mul_ntt(rp, ap, n, ap, n);
+    }
+}
+
+void _bbi_mul(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn) {
+    const bbi_limb *tp;
+    bbi_limb *piece;
+    unsigned int pn;
+    unsigned int i;
+
+    /* Make ap the longer operand */
+    if (an < bn) {
+        tp = ap;
+        ap = bp;
+        bp = tp;
+        i = an;
+        an = bn;
+        bn = i;
+    }
+    if (ap == bp && an == bn) {
+        _bbi_sqr(rp, ap, an);
+        return;
+    }
+    if (bn < _bbi_mul_karatsuba_threshold) {
+        /* Fewer rows is cheaper - the longer operand goes along each row */
+        _bbi_mul_basecase(rp, ap, an, bp, bn);
+        return;
+    }
+    if (an == bn) {
+        _bbi_mul_n(rp, ap, bp, an);
+        return;
+    }
+    if (bn >= _bbi_mul_ntt_threshold && an + (size_t) bn <= _bbi_mul_ntt_max()) {
+        _bbi_mul_ntt(rp, ap, an, bp, bn);
+        return;
+    }
+
+    /* Unbalanced: cut ap into bn-chunk pieces, multiply each by bp and add in at its offset */
+    _bbi_mul_n(rp, ap, bp, bn);
+    piece = _bbi_alloc(2 * bn * sizeof(bbi_limb));
+    for (i = bn; i < an; i += bn) {
+        pn = an - i < bn ? an - i : bn;
+        _bbi_mul(piece, &ap[i], pn, bp, bn);
+        /* rp is only written up to i+bn so far */
+        memset(&rp[i + bn], 0, pn * sizeof(bbi_limb));
+        _bbi_add_into(&rp[i], pn + bn, piece, pn + bn);
+    }
+    _bbi_free(piece, 2 * bn * sizeof(bbi_limb));
+}
+
+/* Multiply two values. The result has as many chunks as the operands' values need between them. */
+bbi_chunk *bbi_mul(bbi_chunk *list_a, bbi_chunk *list_b) {
+    unsigned int an = _bbi_normalized_len(list_a->limbs, list_a->len);
+    unsigned int bn = _bbi_normalized_len(list_b->limbs, list_b->len);
+    bbi_chunk *result;
+    BBI_STAT_SCOPE(BBI_STAT_MUL, an + bn);
+
+    if (an == 0 || bn == 0) {
+        return bbi_create();
+    }
+    result = _bbi_alloc_chunks(an + bn);
+    if (an == 1 && bn == 1) {
+        /* Small values: one widening multiply straight into the inline chunks */
+        bbi_dlimb p = (bbi_dlimb) list_a->limbs[0] * list_b->limbs[0];
+        result->limbs[0] = (bbi_limb) p;
+        result->limbs[1] = (bbi_limb) (p >> BBI_LIMB_BITS);
+        result->len = result->limbs[1] != 0 ? 2 : 1;
+        result->sign = list_a->sign ^ list_b->sign;
+        return result;
+    }
+    _bbi_mul(result->limbs, list_a->limbs, an, list_b->limbs, bn);
+    result->len = _bbi_normalized_len(result->limbs, an + bn);
+    result->sign = list_a->sign ^ list_b->sign;
+    return result;
+}
+
+/* Multiply, storing the result in the first operand. The product is built in scratch space (the
+   algorithms need it separate from their inputs) and copied back, reusing list_a's chunks when
+   they're big enough. */
+bbi_chunk *bbi_mul_inplace(bbi_chunk *list_a, bbi_chunk *list_b) {
+    unsigned int an = _bbi_normalized_len(list_a->limbs, list_a->len);
+    unsigned int bn = _bbi_normalized_len(list_b->limbs, list_b->len);
+    bbi_limb *product;
+    BBI_STAT_SCOPE(BBI_STAT_MUL, an + bn);
+
+    if (an == 0 || bn == 0) {
+        list_a->limbs[0] = 0;
+        list_a->len = 1;
+        list_a->sign = 0;
+        return list_a;
+    }
+    list_a->sign ^= list_b->sign;
+    if (an == 1 && bn == 1) {
+        /* No scratch space needed for a single widening multiply */
+        bbi_dlimb p = (bbi_dlimb) list_a->limbs[0] * list_b->limbs[0];
+        _bbi_reserve(list_a, 2);
+        list_a->limbs[0] = (bbi_limb) p;
+        list_a->limbs[1] = (bbi_limb) (p >> BBI_LIMB_BITS);
+        list_a->len = list_a->limbs[1] != 0 ? 2 : 1;
+        return list_a;
+    }
+    product = _bbi_alloc((an + bn) * sizeof(bbi_limb));
+    _bbi_mul(product, list_a->limbs, an, list_b->limbs, bn);
+    _bbi_reserve(list_a, an + bn);
+    list_a->len = _bbi_normalized_len(product, an + bn);
+    memcpy(list_a->limbs, product, list_a->len * sizeof(bbi_limb));
+    _bbi_free(product, (an + bn) * sizeof(bbi_limb));
+    return list_a;
+}
+
+/* Square a value - quicker than bbi_mul(list, list) */
+bbi_chunk *bbi_sqr(bbi_chunk *list) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    bbi_chunk *result;
+    BBI_STAT_SCOPE(BBI_STAT_SQR, n);
+
+    if (n == 0) {
+        return bbi_create();
+    }
+    result = _bbi_alloc_chunks(2 * n);
+    _bbi_sqr(result->limbs, list->limbs, n);
+    result->len = _bbi_normalized_len(result->limbs, 2 * n);
+    result->sign = 0;
+    return result;
+}
@@ -0,0 +1,344 @@
+/*
+ * Multiplication of very large operands by number-theoretic transform.
+ *
+ * Each chunk is one coefficient. The convolution is done modulo three primes of the form
+ * c * 2^k + 1 just under half the chunk range, and the exact coefficients (which can need nearly
+ * three chunks) are put back together with the Chinese remainder theorem while carrying them into
+ * the product. Arithmetic mod each prime is in Montgomery form, so there's no division in the
+ * transforms.
+ *
+ * The forward transform is decimation-in-frequency and leaves its output in bit-reversed order; the
+ * inverse is decimation-in-time and takes its input in that order, so no reordering pass is needed.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+#include "bbi_tune.h"
+
+unsigned int _bbi_mul_ntt_threshold = BBI_MUL_NTT_THRESHOLD;
+unsigned int _bbi_sqr_ntt_threshold = BBI_SQR_NTT_THRESHOLD;
+
+#define BBI_NTT_PRIMES 3
+
+/* The primes, each with a primitive root. 2^BBI_NTT_MAX_LOG2 divides p-1 for all of them, which
+   sets the longest transform, and the product of the primes is bigger than the largest coefficient
+   of a convolution that long, 2^BBI_NTT_MAX_LOG2 * (2^BBI_LIMB_BITS - 1)^2. */
+static const struct {
+    bbi_limb p;
+    bbi_limb g;
+} _bbi_ntt_primes[BBI_NTT_PRIMES] = {
+#if BBI_LIMB_BITS == 64
+#define BBI_NTT_MAX_LOG2 36
+    {0x7fffff5000000001ULL, 5},
+    {0x7ffffe1000000001ULL, 5},
+    {0x7ffffe0000000001ULL, 7},
+#else
+#define BBI_NTT_MAX_LOG2 24
+    {0x7f000001U, 3},
+    {0x7e000001U, 5},
+    {0x78000001U, 31},
+#endif
+};
+
+/* Constants for Montgomery arithmetic mod p, with R = 2^BBI_LIMB_BITS */
+struct bbi_ntt_mod {
+    bbi_limb p;
+    bbi_limb pinv;  /* -1/p mod R */
+    bbi_limb r1;    /* R mod p, i.e. 1 in Montgomery form */
+    bbi_limb r2;    /* R^2 mod p, to convert into Montgomery form */
+};
+
+static void _bbi_ntt_mod_init(struct bbi_ntt_mod *m, bbi_limb p) {
+    bbi_limb inv = p;
+    unsigned int i;
+
+    /* Newton's iteration for 1/p mod R, doubling the correct bits each time (p*p = 1 mod 8) */
+    for (i = 0; i < 6; i++) {
+        inv *= 2 - p * inv;
+    }
+    m->p = p;
+    m->pinv = -inv;
+    m->r1 = (bbi_limb) ((((bbi_dlimb) 1) << BBI_LIMB_BITS) % p);
+    m->r2 = (bbi_limb) (((bbi_dlimb) m->r1 * m->r1) % p);
+}
+
+/* a * b / R mod p, for a < R/2 and b < p */
+static inline bbi_limb _bbi_ntt_mulmod(bbi_limb a, bbi_limb b, const struct bbi_ntt_mod *m) {
+    bbi_dlimb t = (bbi_dlimb) a * b;
+    bbi_limb q = (bbi_limb) t * m->pinv;
+    bbi_limb r = (bbi_limb) ((t + (bbi_dlimb) q * m->p) >> BBI_LIMB_BITS);
+
+    return r >= m->p ? r - m->p : r;
+}
+
+static inline bbi_limb _bbi_ntt_addmod(bbi_limb a, bbi_limb b, bbi_limb p) {
+    bbi_limb r = a + b;
+
+    return r >= p ? r - p : r;
+}
+
+static inline bbi_limb _bbi_ntt_submod(bbi_limb a, bbi_limb b, bbi_limb p) {
+    return a >= b ? a - b : a + p - b;
+}
+
+/* a^e mod p, in Montgomery form if a is */
+static bbi_limb _bbi_ntt_powmod(bbi_limb a, bbi_limb e, const struct bbi_ntt_mod *m) {
+    bbi_limb r = m->r1;
+
+    while (e != 0) {
+        if (e & 1) {
+            r = _bbi_ntt_mulmod(r, a, m);
+        }
+        a = _bbi_ntt_mulmod(a, a, m);
+        e >>= 1;
+    }
+    return r;
+}
+
+/* Twiddle factors, in Montgomery form: roots[k + j] = w^j for w a primitive 2k-th root of unity,
+   j < k, and k each power of 2 up to size/2. The entries for a given k don't depend on the
+   transform length, so one table serves every length up to size and grows by whole levels when a
+   longer transform comes along. Built on first use and kept per thread, so no locking is needed. */
+struct bbi_ntt_table {
+    bbi_limb *roots;
+    bbi_limb *iroots;
+    size_t size;
+};
+static _Thread_local struct bbi_ntt_table ntt_tables[BBI_NTT_PRIMES];
+
+static const struct bbi_ntt_table *_bbi_ntt_table(unsigned int i, const struct bbi_ntt_mod *m, size_t size) {
+    struct bbi_ntt_table *t = &ntt_tables[i];
+    bbi_limb w;
+    bbi_limb iw;
+    size_t k;
+    size_t j;
+
+    if (t->size >= size) {
+        return t;
+    }
+    t->roots = _bbi_realloc(t->roots, t->size * sizeof(bbi_limb), size * sizeof(bbi_limb));
+    t->iroots = _bbi_realloc(t->iroots, t->size * sizeof(bbi_limb), size * sizeof(bbi_limb));
+    for (k = t->size > 1 ? t->size : 1; k < size; k *= 2) {
+        /* w = g^((p-1)/2k), and its inverse w^(2k-1) */
+        w = _bbi_ntt_powmod(_bbi_ntt_mulmod(_bbi_ntt_primes[i].g, m->r2, m), (m->p - 1) / (2 * k), m);
+        iw = _bbi_ntt_powmod(w, 2 * k - 1, m);
+        t->roots[k] = m->r1;
+        t->iroots[k] = m->r1;
+        for (j = 1; j < k; j++) {
+            t->roots[k + j] = _bbi_ntt_mulmod(t->roots[k + j - 1], w, m);
+            t->iroots[k + j] = _bbi_ntt_mulmod(t->iroots[k + j - 1], iw, m);
+        }
+    }
+    t->size = size;
+    return t;
+}
+
+/* Free this thread's twiddle tables - called from bbi_free_cache() */
+void _bbi_ntt_free_cache() {
+    unsigned int i;
+
+    for (i = 0; i < BBI_NTT_PRIMES; i++) {
+        if (ntt_tables[i].size != 0) {
+            _bbi_free(ntt_tables[i].roots, ntt_tables[i].size * sizeof(bbi_limb));
+            _bbi_free(ntt_tables[i].iroots, ntt_tables[i].size * sizeof(bbi_limb));
+            ntt_tables[i].roots = NULL;
+            ntt_tables[i].iroots = NULL;
+            ntt_tables[i].size = 0;
+        }
+    }
+}
+
+/* Forward transform of size elements (a power of 2), natural order in, bit-reversed order out */
+static void _bbi_ntt_forward(bbi_limb *a, size_t size, const bbi_limb *roots, const struct bbi_ntt_mod *m) {
+    bbi_limb p = m->p;
+    bbi_limb u;
+    bbi_limb v;
+    size_t k;
+    size_t s;
+    size_t j;
+
+    for (k = size / 2; k >= 1; k /= 2) {
+        for (s = 0; s < size; s += 2 * k) {
+            for (j = 0; j < k; j++) {
+                u = a[s + j];
+                v = a[s + j + k];
+                a[s + j] = _bbi_ntt_addmod(u, v, p);
+                a[s + j + k] = _bbi_ntt_mulmod(_bbi_ntt_submod(u, v, p), roots[k + j], m);
+            }
+        }
+    }
+}
+
+/* Inverse transform, bit-reversed order in, natural order out, without the division by size */
+static void _bbi_ntt_inverse(bbi_limb *a, size_t size, const bbi_limb *iroots, const struct bbi_ntt_mod *m) {
+    bbi_limb p = m->p;
+    bbi_limb u;
+    bbi_limb v;
+    size_t k;
+    size_t s;
+    size_t j;
+
+    for (k = 1; k < size; k *= 2) {
+        for (s = 0; s < size; s += 2 * k) {
+            for (j = 0; j < k; j++) {
+                u = a[s + j];
+                v = _bbi_ntt_mulmod(a[s + j + k], iroots[k + j], m);
+                a[s + j] = _bbi_ntt_addmod(u, v, p);
+                a[s + j + k] = _bbi_ntt_submod(u, v, p);
+            }
+        }
+    }
+}
+
+/* Load n chunks, reduced mod p, into a size-element transform buffer padded with zeros. p is just
+   under half the chunk range, so a chunk is less than 3p. */
+static void _bbi_ntt_load(bbi_limb *a, const bbi_limb *ap, unsigned int n, size_t size, bbi_limb p) {
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        a[i] = ap[i] >= p ? ap[i] - p : ap[i];
+        a[i] = a[i] >= p ? a[i] - p : a[i];
+    }
+    memset(&a[n], 0, (size - n) * sizeof(bbi_limb));
+}
+
+/* The cyclic convolution of ap and bp mod the i'th prime, into res. bp == ap means square. */
+static void _bbi_ntt_convolve(bbi_limb *res, bbi_limb *tmp, const bbi_limb *ap, unsigned int an,
+                              const bbi_limb *bp, unsigned int bn, size_t size, unsigned int i,
+                              const struct bbi_ntt_mod *m) {
+    const struct bbi_ntt_table *t = _bbi_ntt_table(i, m, size);
+    bbi_limb scale;
+    size_t j;
+
+    _bbi_ntt_load(res, ap, an, size, m->p);
+    _bbi_ntt_forward(res, size, t->roots, m);
+    if (bp == ap) {
+        for (j = 0; j < size; j++) {
+            res[j] = _bbi_ntt_mulmod(res[j], res[j], m);
+        }
+    } else {
+        _bbi_ntt_load(tmp, bp, bn, size, m->p);
+        _bbi_ntt_forward(tmp, size, t->roots, m);
+        for (j = 0; j < size; j++) {
+            res[j] = _bbi_ntt_mulmod(res[j], tmp[j], m);
+        }
+    }
+    _bbi_ntt_inverse(res, size, t->iroots, m);
+
+    /* The pointwise products left a factor of 1/R and the inverse transform one of size, so
+       multiply by R/size (which is R^2/size in Montgomery form) */
+    scale = _bbi_ntt_powmod(_bbi_ntt_mulmod(size % m->p, m->r2, m), m->p - 2, m);
+    scale = _bbi_ntt_mulmod(scale, m->r2, m);
+    for (j = 0; j < size; j++) {
+        res[j] = _bbi_ntt_mulmod(res[j], scale, m);
+    }
+}
+
+/* The convolutions for the three primes are independent, so with a thread pool each can run on its
+   own thread with its own scratch space */
+struct bbi_ntt_task {
+    bbi_limb *res;
+    bbi_limb *tmp;
+    const bbi_limb *ap;
+    const bbi_limb *bp;
+    unsigned int an;
+    unsigned int bn;
+    size_t size;
+    int par;
+    struct bbi_ntt_mod *m;
+};
+
+static void _bbi_ntt_task_run(void *arg, unsigned int i) {
+    struct bbi_ntt_task *t = arg;
+
+    _bbi_ntt_convolve(&t->res[i * t->size], &t->tmp[t->par ? i * t->size : 0], t->ap, t->an, t->bp, t->bn,
+                      t->size, i, &t->m[i]);
+}
+
+/* Largest operand total (an + bn) the transform can handle */
+size_t _bbi_mul_ntt_max() {
+    return (size_t) 1 << BBI_NTT_MAX_LOG2;
+}
+
+/* Write the an+bn chunk product of ap and bp to rp, which must not overlap either operand.
+   bp == ap means square. an + bn must be at most _bbi_mul_ntt_max(). */
+void _bbi_mul_ntt(bbi_limb *rp, const bbi_limb *ap, unsigned int an, const bbi_limb *bp, unsigned int bn) {
+    struct bbi_ntt_mod m[BBI_NTT_PRIMES];
+    bbi_limb *res;
+    bbi_limb *tmp;
+    bbi_limb p0 = _bbi_ntt_primes[0].p;
+    bbi_limb p1 = _bbi_ntt_primes[1].p;
+    bbi_limb inv01;  /* 1/p0 mod p1, Montgomery form */
+    bbi_limb inv012; /* 1/(p0*p1) mod p2, Montgomery form */
+    bbi_limb p0m2;   /* p0 mod p2, Montgomery form */
+    bbi_limb a0;
+    bbi_limb a1;
+    bbi_limb a2;
+    bbi_limb c0 = 0;
+    bbi_limb c1 = 0;
+    bbi_limb c2 = 0;
+    bbi_dlimb v;
+    bbi_dlimb t;
+    bbi_dlimb s;
+    size_t size = 1;
+    size_t j;
+    unsigned int i;
+    struct bbi_ntt_task task;
+    /* Scratch space for one transform, or for all of them at once on the thread pool */
+    unsigned int ntmp = bbi_threads() > 1 ? BBI_NTT_PRIMES : 1;
+
+    assert(an + (size_t) bn <= _bbi_mul_ntt_max());
+    while (size < an + (size_t) bn) {
+        size *= 2;
+    }
+    res = _bbi_alloc((BBI_NTT_PRIMES + ntmp) * size * sizeof(bbi_limb));
+    tmp = &res[BBI_NTT_PRIMES * size];
+    for (i = 0; i < BBI_NTT_PRIMES; i++) {
+        _bbi_ntt_mod_init(&m[i], _bbi_ntt_primes[i].p);
+    }
+    task.res = res;
+    task.tmp = tmp;
+    task.ap = ap;
+    task.bp = bp;
+    task.an = an;
+    task.bn = bn;
+    task.size = size;
+    task.par = ntmp > 1;
+    task.m = m;
+    if (task.par) {
+        _bbi_par_run(_bbi_ntt_task_run, &task, BBI_NTT_PRIMES);
+    } else {
+        for (i = 0; i < BBI_NTT_PRIMES; i++) {
+            _bbi_ntt_task_run(&task, i);
+        }
+    }
+
+    /* Garner's algorithm: x = a0 + p0 * (a1 + p1 * a2), with each ai < pi */
+    inv01 = _bbi_ntt_powmod(_bbi_ntt_mulmod(p0 % p1, m[1].r2, &m[1]), p1 - 2, &m[1]);
+    p0m2 = _bbi_ntt_mulmod(p0 % m[2].p, m[2].r2, &m[2]);
+    inv012 = _bbi_ntt_powmod(_bbi_ntt_mulmod(_bbi_ntt_mulmod(p1 % m[2].p, m[2].r2, &m[2]), p0m2, &m[2]),
+                             m[2].p - 2, &m[2]);
+    for (j = 0; j < an + (size_t) bn; j++) {
+        a0 = res[j];
+        a1 = _bbi_ntt_submod(res[size + j], a0 >= p1 ? a0 - p1 : a0, p1);
+        a1 = _bbi_ntt_mulmod(a1, inv01, &m[1]);
+        a2 = _bbi_ntt_submod(res[2 * size + j], a0 >= m[2].p ? a0 - m[2].p : a0, m[2].p);
+        a2 = _bbi_ntt_submod(a2, _bbi_ntt_mulmod(a1, p0m2, &m[2]), m[2].p);
+        a2 = _bbi_ntt_mulmod(a2, inv012, &m[2]);
+
+        /* Add x (under three chunks) into the running carry, and shift its bottom chunk out */
+        v = a1 + (bbi_dlimb) p1 * a2;
+        t = (bbi_dlimb) p0 * (bbi_limb) v + a0;
+        s = (bbi_dlimb) c0 + (bbi_limb) t;
+        rp[j] = (bbi_limb) s;
+        t = (bbi_dlimb) p0 * (bbi_limb) (v >> BBI_LIMB_BITS) + (t >> BBI_LIMB_BITS);
+        s = (s >> BBI_LIMB_BITS) + c1 + (bbi_limb) t;
+        c0 = (bbi_limb) s;
+        s = (s >> BBI_LIMB_BITS) + c2 + (bbi_limb) (t >> BBI_LIMB_BITS);
+        c1 = (bbi_limb) s;
+        c2 = (bbi_limb) (s >> BBI_LIMB_BITS);
+    }
+    assert(c0 == 0 && c1 == 0 && c2 == 0);
+    _bbi_free(res, (BBI_NTT_PRIMES + ntmp) * size * sizeof(bbi_limb));
+}
@@ -0,0 +1,194 @@
+/*
+ * Threading.
+ *
+ * The contract: a bigint that no thread is modifying can be read by any number of threads at once,
+ * and different threads can freely operate on different bigints. Nothing else is shared between
+ * threads - the header slab, arena, power-of-ten and NTT tables and statistics are all per thread
+ * (see bbi_alloc.c, bbi_conv.c, bbi_ntt.c), and CPU feature detection uses atomics. What's left is
+ * set-up that must happen before other threads use the library: bbi_set_allocator(), the tuning
+ * thresholds, and bbi_threads_init(). A custom allocator has to be thread-safe if more than one
+ * thread uses the library, which includes the pool below.
+ *
+ * Parallel mode is opt-in: bbi_threads_init(n) starts n - 1 worker threads, and from then on large
+ * enough operations split their independent pieces of work between the workers and the calling
+ * thread - limb ranges of the bitwise operations, the three or five products at the top level of
+ * Karatsuba and Toom-3, the three NTT primes, and the two halves of divide-and-conquer radix
+ * conversion. Only the outermost level is split: work running as a task, or started while another
+ * thread has the pool, just runs serially on its own thread. Each worker has its own caches, which
+ * it frees when the pool is shut down.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "bbi.h"
+
+/* Operations on fewer chunks than these don't gain enough from splitting to pay for waking the
+   workers */
+#ifndef BBI_PAR_BITWISE_THRESHOLD
+#define BBI_PAR_BITWISE_THRESHOLD 32768
+#endif
+#ifndef BBI_PAR_MUL_THRESHOLD
+#define BBI_PAR_MUL_THRESHOLD 1000
+#endif
+#ifndef BBI_PAR_CONV_THRESHOLD
+#define BBI_PAR_CONV_THRESHOLD 1000
+#endif
+
+unsigned int _bbi_par_bitwise_threshold = BBI_PAR_BITWISE_THRESHOLD;
+unsigned int _bbi_par_mul_threshold = BBI_PAR_MUL_THRESHOLD;
+unsigned int _bbi_par_conv_threshold = BBI_PAR_CONV_THRESHOLD;
+
+/* One call of _bbi_par_run(): tasks are claimed by bumping next, and counted off in done */
+struct bbi_par_job {
+    void (*fn)(void *arg, unsigned int i);
+    void *arg;
+    unsigned int ntasks;
+    unsigned int next;
+    unsigned int done;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t *workers = NULL;
+static unsigned int nworkers = 0;
+/* All of these are protected by pool_lock */
+static struct bbi_par_job *current = NULL;
+static unsigned long generation = 0;
+static unsigned int active = 0;
+static int busy = 0;
+static int shutting_down = 0;
+
+/* Set while this thread is running tasks, so anything they start runs serially */
+static _Thread_local int in_task = 0;
+
+static void _bbi_par_tasks(struct bbi_par_job *job) {
+    unsigned int i;
+
+    in_task = 1;
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->ntasks) {
+        job->fn(job->arg, i);
+        __atomic_fetch_add(&job->done, 1, __ATOMIC_RELEASE);
+    }
+    in_task = 0;
+}
+
+static void *_bbi_par_worker(void *unused) {
+    unsigned long seen = 0;
+    struct bbi_par_job *job;
+
+    (void) unused;
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (!shutting_down && (current == NULL || seen == generation)) {
+            pthread_cond_wait(&work_cv, &pool_lock);
+        }
+        if (shutting_down) {
+            break;
+        }
+        seen = generation;
+        job = current;
+        active++;
+        pthread_mutex_unlock(&pool_lock);
+        _bbi_par_tasks(job);
+        pthread_mutex_lock(&pool_lock);
+        active--;
+        pthread_cond_broadcast(&done_cv);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    bbi_free_cache();
+    return NULL;
+}
+
+/* Run fn(arg, 0) ... fn(arg, ntasks - 1), spread over the pool and the calling thread, and return
+   once they've all finished. The tasks must be independent of each other. Without a pool, or when
+   called from inside a task or while another thread is using the pool, they just run in order. */
+void _bbi_par_run(void (*fn)(void *arg, unsigned int i), void *arg, unsigned int ntasks) {
+    struct bbi_par_job job;
+    unsigned int i;
+
+    if (ntasks > 1 && nworkers > 0 && !in_task) {
+        pthread_mutex_lock(&pool_lock);
+        if (!busy) {
+            busy = 1;
+            job.fn = fn;
+            job.arg = arg;
+            job.ntasks = ntasks;
+            job.next = 0;
+            job.done = 0;
+            current = &job;
+            generation++;
+            pthread_cond_broadcast(&work_cv);
+            pthread_mutex_unlock(&pool_lock);
+
+            _bbi_par_tasks(&job);
+
+            /* Wait for the tasks, and for every worker to let go of job before it goes out of scope */
+            pthread_mutex_lock(&pool_lock);
+            while (__atomic_load_n(&job.done, __ATOMIC_ACQUIRE) < ntasks || active > 0) {
+                pthread_cond_wait(&done_cv, &pool_lock);
+            }
+            current = NULL;
+            busy = 0;
+            pthread_mutex_unlock(&pool_lock);
+            return;
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+    for (i = 0; i < ntasks; i++) {
+        fn(arg, i);
+    }
+}
+
+/* Number of threads operations may use, counting the caller - 1 without a pool */
+unsigned int bbi_threads() {
+    return nworkers + 1;
+}
+
+/* Stop the worker threads, if any. Must not be called while operations are running. */
+void bbi_threads_shutdown() {
+    unsigned int i;
+
+    if (workers == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool_lock);
+    shutting_down = 1;
+    pthread_cond_broadcast(&work_cv);
+    pthread_mutex_unlock(&pool_lock);
+    for (i = 0; i < nworkers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+    shutting_down = 0;
+}
+
+/* Let large operations use up to nthreads threads, the calling one included, by starting
+   nthreads - 1 workers (replacing any pool there already is). 0 or 1 goes back to running
+   everything on the calling thread. Like bbi_set_allocator(), call it while no operations are
+   running. Returns 0, or -1 if the threads couldn't be started. */
+int bbi_threads_init(unsigned int nthreads) {
+    unsigned int i;
+
+    bbi_threads_shutdown();
+    if (nthreads <= 1) {
+        return 0;
+    }
+    workers = malloc((nthreads - 1) * sizeof(pthread_t));
+    if (workers == NULL) {
+        return -1;
+    }
+    for (i = 0; i < nthreads - 1; i++) {
+        if (pthread_create(&workers[i], NULL, _bbi_par_worker, NULL) != 0) {
+            break;
+        }
+        nworkers++;
+    }
+    if (nworkers < nthreads - 1) {
+        bbi_threads_shutdown();
+        return -1;
+    }
+    return 0;
+}
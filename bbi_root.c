@@ -0,0 +1,642 @@
+/*
+ * Square roots, k-th roots and perfect powers.
+ *
+ * Square roots use Zimmermann's Karatsuba square root ("Karatsuba Square Root", INRIA research
+ * report 3805, 1999), as GMP does: the root of a normalized 2n-chunk value is the root s' of its
+ * top n chunks, found recursively, extended by the quotient of the remainder and the next n/2
+ * chunks by 2s', with a squaring of that quotient to correct the remainder. The division and the
+ * squaring are the library's fast ones, so a root costs a small constant times one n-chunk
+ * multiplication.
+ *
+ * Other roots use Newton's iteration x <- ((k-1) x + a / x^(k-1)) / k, which decreases to
+ * floor(a^(1/k)) from any start above it. The start is the k-th root of a's top half, found the
+ * same way, so it already has half the bits right and a couple of steps finish: the precision
+ * doubles from one level to the next and only the last level works on all of a.
+ *
+ * bbi_is_square() and bbi_is_perfect_power() turn most values away without taking a root. A k-th
+ * power's trailing zeros come in multiples of k and an odd square is 1 mod 8; its residues mod
+ * small primes q must be k-th power residues, which for q = 1 mod k are only 1 in k of them. A
+ * perfect power's small prime factors also have multiplicities that are multiples of k.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "bbi.h"
+
+/* The odd primes whose product fits in a chunk, with for each one a mask that has bit r set when r
+   is a square mod the prime */
+#if BBI_LIMB_BITS == 64
+#define BBI_NSMALL_PRIMES 14
+#define BBI_SMALL_PRIMES_PRODUCT ((bbi_limb) 307444891294245705ULL)
+#else
+#define BBI_NSMALL_PRIMES 8
+#define BBI_SMALL_PRIMES_PRODUCT ((bbi_limb) 111546435UL)
+#endif
+
+static const unsigned int _bbi_small_primes[14] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47};
+static const uint64_t _bbi_square_masks[14] = {
+    0x3, 0x13, 0x17, 0x23b, 0x161b, 0x1a317, 0x30af3, 0x5335f, 0x13d122f3, 0x121d47b7,
+    0x165e211e9b, 0x1b382b50737, 0x35883a3ee53, 0x4351b2753df};
+
+/* Floor of the square root of a double chunk, by Newton's iteration from a power of 2 above it */
+static bbi_limb _bbi_sqrt_2(bbi_dlimb a) {
+    bbi_limb hi = (bbi_limb) (a >> BBI_LIMB_BITS);
+    unsigned int bits;
+    bbi_dlimb x;
+    bbi_dlimb y;
+
+    if (a == 0) {
+        return 0;
+    }
+    bits = hi != 0 ? 2 * BBI_LIMB_BITS - _bbi_limb_clz(hi) : BBI_LIMB_BITS - _bbi_limb_clz((bbi_limb) a);
+    x = (bbi_dlimb) 1 << (bits + 1) / 2;
+    for (;;) {
+        y = (x + a / x) / 2;
+        if (y >= x) {
+            return (bbi_limb) x;
+        }
+        x = y;
+    }
+}
+
+/* Square root of the 2n chunks of np, whose top chunk is at least B/4 (B = 2^BBI_LIMB_BITS). Writes
+   the n-chunk root to sp and the bottom n chunks of the remainder to np, and returns the
+   remainder's top chunk, 0 or 1. tp is n/2 + 1 chunks of scratch. */
+static bbi_limb _bbi_dc_sqrtrem(bbi_limb *sp, bbi_limb *np, unsigned int n, bbi_limb *tp) {
+    bbi_dlimb a;
+    bbi_dlimb r;
+    bbi_limb q;
+    bbi_limb b;
+    unsigned int l;
+    unsigned int h;
+    int c;
+
+    if (n == 1) {
+        a = (bbi_dlimb) np[1] << BBI_LIMB_BITS | np[0];
+        sp[0] = _bbi_sqrt_2(a);
+        r = a - (bbi_dlimb) sp[0] * sp[0];
+        np[0] = (bbi_limb) r;
+        return (bbi_limb) (r >> BBI_LIMB_BITS);
+    }
+
+    /* The root s' and remainder r' of the top 2h chunks, then (r' B^l + the next l chunks) / 2s'
+       for the low l chunks of the root, found as the quotient by s' and halved */
+    l = n / 2;
+    h = n - l;
+    q = _bbi_dc_sqrtrem(&sp[l], &np[2 * l], h, tp);
+    if (q != 0) {
+        _bbi_sub_n(&np[2 * l], &np[2 * l], &sp[l], h);
+    }
+    _bbi_divrem_preinv(tp, &np[l], &np[l], n, &sp[l], h, 0, _bbi_invert_limb(sp[n - 1]));
+    memcpy(sp, tp, l * sizeof(bbi_limb));
+    q += tp[l];
+    c = sp[0] & 1;
+    _bbi_rshift(sp, sp, l, 1);
+    sp[l - 1] |= q << (BBI_LIMB_BITS - 1);
+    q >>= 1;
+    if (c != 0) {
+        c = (int) _bbi_add_n(&np[l], &np[l], &sp[l], h);
+    }
+
+    /* Take the square of the low half off the remainder, with c tracking its top */
+    _bbi_sqr(&np[n], sp, l);
+    b = q + _bbi_sub_n(np, np, &np[n], 2 * l);
+    c -= l == h ? (int) b : (int) _bbi_sub_1(&np[2 * l], &np[2 * l], 1, b);
+    q = _bbi_add_1(&sp[l], &sp[l], h, q);
+
+    /* A negative remainder means the root is one too big: r += 2s - 1, s -= 1 */
+    if (c < 0) {
+        c += (int) (_bbi_addmul_1(np, sp, n, 2) + 2 * q);
+        c -= (int) _bbi_sub_1(np, np, n, 1);
+        _bbi_sub_1(sp, sp, n, 1);
+    }
+    return (bbi_limb) c;
+}
+
+/* Square root of the nn chunks of np (top chunk non-zero). Writes the (nn+1)/2 chunk root to sp
+   and, if rp isn't NULL, the remainder - at most (nn+1)/2 + 1 chunks - to rp, and returns the
+   remainder's normalized length. The value is shifted up by 2k bits to an even number of chunks
+   with one of the top two bits set, which makes the root k bits too long; shifting it back down
+   leaves the dropped bits' share of the square to add back to the remainder. */
+unsigned int _bbi_sqrtrem(bbi_limb *sp, bbi_limb *rp, const bbi_limb *np, unsigned int nn) {
+    unsigned int tn = (nn + 1) / 2;
+    unsigned int odd = nn & 1;
+    unsigned int c = _bbi_limb_clz(np[nn - 1]) / 2;
+    unsigned int k = c + odd * (BBI_LIMB_BITS / 2);
+    size_t size = (2 * (size_t) tn + tn / 2 + 2) * sizeof(bbi_limb);
+    bbi_limb *tp = _bbi_alloc(size);
+    bbi_limb s0;
+    bbi_dlimb sq;
+    unsigned int rn;
+
+    assert(nn > 0 && np[nn - 1] != 0);
+    tp[0] = 0;
+    if (c != 0) {
+        _bbi_lshift(&tp[odd], np, nn, 2 * c);
+    } else {
+        memcpy(&tp[odd], np, nn * sizeof(bbi_limb));
+    }
+    tp[tn] = _bbi_dc_sqrtrem(sp, tp, tn, &tp[2 * tn]);
+    rn = tn + 1;
+    if (k != 0) {
+        /* With the long root S = s 2^k + s0 and S^2 + R = a 2^2k, a - s^2 = (R + 2 s0 S - s0^2) / 2^2k.
+           k < BBI_LIMB_BITS, so 2 s0 fits in a chunk. */
+        s0 = sp[0] & (((bbi_limb) 1 << k) - 1);
+        sq = (bbi_dlimb) s0 * s0;
+        tp[tn] += _bbi_addmul_1(tp, sp, tn, 2 * s0);
+        _bbi_sub_1(tp, tp, tn + 1, (bbi_limb) sq);
+        _bbi_sub_1(&tp[1], &tp[1], tn, (bbi_limb) (sq >> BBI_LIMB_BITS));
+        _bbi_rshift(sp, sp, tn, k);
+        if (2 * k >= BBI_LIMB_BITS) {
+            memmove(tp, &tp[1], tn * sizeof(bbi_limb));
+            rn--;
+        }
+        if (2 * k % BBI_LIMB_BITS != 0) {
+            _bbi_rshift(tp, tp, rn, 2 * k % BBI_LIMB_BITS);
+        }
+    }
+    rn = _bbi_normalized_len(tp, rn);
+    if (rp != NULL) {
+        memcpy(rp, tp, rn * sizeof(bbi_limb));
+    }
+    _bbi_free(tp, size);
+    return rn;
+}
+
+/* A result chunk list of the normalized value, negated if neg and non-zero */
+static bbi_chunk *_bbi_root_signed(bbi_chunk *list, int neg) {
+    list->len = _bbi_normalized_len(list->limbs, list->len);
+    if (list->len == 0) {
+        list->len = 1;
+        list->limbs[0] = 0;
+        list->sign = 0;
+    } else {
+        list->sign = neg != 0;
+    }
+    return list;
+}
+
+/* A single chunk value */
+static bbi_chunk *_bbi_root_small(bbi_limb v) {
+    bbi_chunk *list = bbi_create();
+
+    list->limbs[0] = v;
+    return list;
+}
+
+/* x^e for e >= 1, by left-to-right binary powering */
+static bbi_chunk *_bbi_root_pow(bbi_chunk *x, unsigned int e) {
+    bbi_chunk *p = bbi_copy(x);
+    bbi_chunk *t;
+    bbi_limb bit = (bbi_limb) 1 << (BBI_LIMB_BITS - 1 - _bbi_limb_clz(e));
+
+    for (bit >>= 1; bit != 0; bit >>= 1) {
+        t = bbi_sqr(p);
+        bbi_destroy(p);
+        p = t;
+        if (e & bit) {
+            t = bbi_mul(p, x);
+            bbi_destroy(p);
+            p = t;
+        }
+    }
+    return p;
+}
+
+/* x^e if that's at most a, otherwise 0, for x > 0 */
+static bbi_limb _bbi_pow_1_upto(bbi_limb x, unsigned int e, bbi_limb a) {
+    bbi_limb p = 1;
+
+    while (e-- > 0) {
+        if (p > a / x) {
+            return 0;
+        }
+        p *= x;
+    }
+    return p;
+}
+
+/* floor(a^(1/k)) of a chunk, for k >= 2, by Newton's iteration from a power of 2 above it */
+static bbi_limb _bbi_root_1(bbi_limb a, unsigned int k) {
+    unsigned int bits;
+    bbi_limb x;
+    bbi_limb y;
+    bbi_limb p;
+
+    if (a < 2) {
+        return a;
+    }
+    bits = BBI_LIMB_BITS - _bbi_limb_clz(a);
+    if (k >= bits) {
+        return 1;
+    }
+    x = (bbi_limb) 1 << (bits + k - 1) / k;
+    for (;;) {
+        p = _bbi_pow_1_upto(x, k - 1, a);
+        y = ((k - 1) * x + (p != 0 ? a / p : 0)) / k;
+        if (y >= x) {
+            return x;
+        }
+        x = y;
+    }
+}
+
+/* floor(a^(1/k)) for a >= 0 of bits bits and k >= 3, by Newton's iteration from (r + 1) 2^s, where r
+   is the root of a's top bits with the bottom k*s taken off - which is above a's root, since
+   (r + 1)^k is above those top bits. s is half the root's length, so r has half its bits. Every
+   step from above a's root lands on or above it, so the first x with x^k <= a is the root. */
+static bbi_chunk *_bbi_root_newton(bbi_chunk *a, unsigned int bits, unsigned int k) {
+    unsigned int rb;
+    unsigned int s;
+    bbi_chunk *top;
+    bbi_chunk *x;
+    bbi_chunk *y;
+    bbi_chunk *p;
+    bbi_chunk *q;
+    bbi_chunk *t;
+
+    if (bits <= BBI_LIMB_BITS) {
+        return _bbi_root_small(_bbi_root_1(a->limbs[0], k));
+    }
+    if (k >= bits) {
+        return _bbi_root_small(1);
+    }
+    rb = bits / k + (bits % k != 0);
+    s = rb / 2;
+    top = bbi_shr(a, k * s);
+    x = _bbi_root_newton(top, bits - k * s, k);
+    bbi_destroy(top);
+    t = _bbi_root_small(1);
+    x = bbi_shl_inplace(bbi_add_inplace(x, t), s);
+    bbi_destroy(t);
+
+    /* Each step's x^(k-1) also gives x^k, which shows when x is the root without another step */
+    t = _bbi_root_small(k - 1);
+    p = _bbi_root_pow(x, k - 1);
+    for (;;) {
+        q = bbi_div(a, p);
+        y = bbi_add_inplace(bbi_mul(x, t), q);
+        _bbi_divrem_1(y->limbs, y->limbs, y->len, k);
+        y = _bbi_root_signed(y, 0);
+        bbi_destroy(p);
+        bbi_destroy(q);
+        if (_bbi_cmp(y->limbs, y->len, x->limbs, x->len) >= 0) {
+            bbi_destroy(y);
+            break;
+        }
+        bbi_destroy(x);
+        x = y;
+        p = _bbi_root_pow(x, k - 1);
+        q = bbi_mul(p, x);
+        if (_bbi_cmp(q->limbs, q->len, a->limbs, a->len) <= 0) {
+            bbi_destroy(q);
+            bbi_destroy(p);
+            break;
+        }
+        bbi_destroy(q);
+    }
+    bbi_destroy(t);
+    return _bbi_root_signed(x, 0);
+}
+
+/* The integer square root of a, floor(sqrt(a)), storing a - root^2 in *rem if rem isn't NULL.
+   Returns NULL for negative a. */
+bbi_chunk *bbi_sqrtrem(bbi_chunk *list, bbi_chunk **rem) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    unsigned int tn = (n + 1) / 2;
+    bbi_chunk *root;
+    bbi_chunk *r;
+    BBI_STAT_SCOPE(BBI_STAT_ROOT, n);
+
+    if (n > 0 && list->sign) {
+        return NULL;
+    }
+    if (n == 0) {
+        if (rem != NULL) {
+            *rem = bbi_create();
+        }
+        return bbi_create();
+    }
+    root = _bbi_alloc_chunks(tn);
+    r = rem != NULL ? _bbi_alloc_chunks(tn + 1) : NULL;
+    if (r != NULL) {
+        r->len = _bbi_sqrtrem(root->limbs, r->limbs, list->limbs, n);
+        *rem = _bbi_root_signed(r, 0);
+    } else {
+        _bbi_sqrtrem(root->limbs, NULL, list->limbs, n);
+    }
+    root->len = tn;
+    return _bbi_root_signed(root, 0);
+}
+
+/* The k-th root of a, rounded towards 0, storing a - root^k in *rem if rem isn't NULL (so the
+   remainder has a's sign, as with a division). Returns NULL for k = 0 or an even root of a negative
+   value. */
+bbi_chunk *bbi_root(bbi_chunk *list, unsigned int k, bbi_chunk **rem) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    int neg = n > 0 && list->sign;
+    bbi_chunk *abs;
+    bbi_chunk *root;
+    bbi_chunk *p;
+    BBI_STAT_SCOPE(BBI_STAT_ROOT, n);
+
+    if (k == 0 || (neg && k % 2 == 0)) {
+        return NULL;
+    }
+    if (k == 2) {
+        return bbi_sqrtrem(list, rem);
+    }
+    abs = bbi_copy(list);
+    abs = _bbi_root_signed(abs, 0);
+    root = k == 1 ? bbi_copy(abs) : _bbi_root_newton(abs, _bbi_bit_length_n(abs->limbs, n), k);
+    if (rem != NULL) {
+        p = _bbi_root_pow(root, k);
+        *rem = _bbi_root_signed(bbi_sub_inplace(abs, p), neg);
+        bbi_destroy(p);
+    } else {
+        bbi_destroy(abs);
+    }
+    return _bbi_root_signed(root, neg);
+}
+
+/* b^e mod q for a small q */
+static unsigned int _bbi_powmod_small(unsigned int b, unsigned int e, unsigned int q) {
+    unsigned long long p = 1;
+    unsigned long long x = b % q;
+
+    for (; e != 0; e >>= 1) {
+        if (e & 1) {
+            p = p * x % q;
+        }
+        x = x * x % q;
+    }
+    return (unsigned int) p;
+}
+
+/* x^e mod m, for m less than the small primes' product */
+static bbi_limb _bbi_powmod_1(bbi_limb x, unsigned int e, bbi_limb m) {
+    bbi_limb p = 1 % m;
+
+    for (x %= m; e != 0; e >>= 1) {
+        if (e & 1) {
+            p = (bbi_limb) ((bbi_dlimb) p * x % m);
+        }
+        x = (bbi_limb) ((bbi_dlimb) x * x % m);
+    }
+    return p;
+}
+
+static int _bbi_is_prime_small(unsigned int q) {
+    unsigned int d;
+
+    if (q % 2 == 0) {
+        return q == 2;
+    }
+    for (d = 3; d <= q / d; d += 2) {
+        if (q % d == 0) {
+            return 0;
+        }
+    }
+    return q > 1;
+}
+
+/* Whether a value whose residue mod the small primes' product is r can be a square: each residue
+   mod a small prime must be a square */
+static int _bbi_square_residues(bbi_limb r) {
+    unsigned int i;
+
+    for (i = 0; i < BBI_NSMALL_PRIMES; i++) {
+        if (!((_bbi_square_masks[i] >> (r % _bbi_small_primes[i])) & 1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Whether it can be a k-th power, k an odd prime: mod a prime q = 1 mod k, a non-zero k-th power
+   residue r has r^((q-1)/k) = 1 */
+static int _bbi_power_residues(bbi_limb r, unsigned int k) {
+    unsigned int q;
+    unsigned int i;
+
+    for (i = 0; i < BBI_NSMALL_PRIMES; i++) {
+        q = _bbi_small_primes[i];
+        if (q % k == 1 && r % q != 0 && _bbi_powmod_small((unsigned int) (r % q), (q - 1) / k, q) != 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* x^e mod 2^BBI_LIMB_BITS */
+static bbi_limb _bbi_pow_lo(bbi_limb x, unsigned int e) {
+    bbi_limb p = 1;
+
+    for (; e != 0; e >>= 1) {
+        if (e & 1) {
+            p *= x;
+        }
+        x *= x;
+    }
+    return p;
+}
+
+/* The k-th root of an odd a mod 2^BBI_LIMB_BITS for an odd k, which is unique. Newton's iteration
+   x <- x - (x^k - a) / (k x^(k-1)) doubles the number of right bits each time, starting from the
+   one bit of x = 1, and the division is by an odd number, so is a multiplication by its inverse. */
+static bbi_limb _bbi_root_2adic(bbi_limb a, unsigned int k) {
+    bbi_limb x = 1;
+    bbi_limb xk1;
+    bbi_limb d;
+    bbi_limb inv;
+    unsigned int bits;
+    unsigned int i;
+
+    for (bits = 1; bits < BBI_LIMB_BITS; bits *= 2) {
+        xk1 = _bbi_pow_lo(x, k - 1);
+        d = k * xk1;
+        inv = d;
+        for (i = 0; i < 5; i++) {
+            inv *= 2 - d * inv;
+        }
+        x -= (xk1 * x - a) * inv;
+    }
+    return x;
+}
+
+/* Whether x^k is the value in o */
+static int _bbi_is_power_of(bbi_chunk *o, bbi_chunk *x, unsigned int k) {
+    bbi_chunk *p = _bbi_root_pow(x, k);
+    int equal = _bbi_cmp(p->limbs, p->len, o->limbs, o->len) == 0;
+
+    bbi_destroy(p);
+    return equal;
+}
+
+/* Whether the odd value o of bits bits, which has no small prime factors and the residue r mod their
+   product, is a k-th power for a prime k */
+static int _bbi_is_power(bbi_chunk *o, unsigned int bits, bbi_limb r, unsigned int k) {
+    unsigned int rb = bits / k + (bits % k != 0);
+    unsigned int found;
+    unsigned int q;
+    unsigned int j;
+    bbi_limb *sp;
+    bbi_chunk *x;
+    bbi_limb rq;
+    int yes;
+
+    if (k == 2) {
+        if ((o->limbs[0] & 7) != 1 || !_bbi_square_residues(r)) {
+            return 0;
+        }
+        sp = _bbi_alloc((o->len + 1) / 2 * sizeof(bbi_limb));
+        yes = _bbi_sqrtrem(sp, NULL, o->limbs, o->len) == 0;
+        _bbi_free(sp, (o->len + 1) / 2 * sizeof(bbi_limb));
+        return yes;
+    }
+    if (!_bbi_power_residues(r, k)) {
+        return 0;
+    }
+
+    /* A root of at most a chunk is the odd x < 2^rb with x^k = o mod 2^rb. Check its residue before
+       its power. */
+    if (rb <= BBI_LIMB_BITS) {
+        x = _bbi_root_small(_bbi_root_2adic(o->limbs[0], k));
+        if (rb < BBI_LIMB_BITS) {
+            x->limbs[0] &= ((bbi_limb) 1 << rb) - 1;
+        }
+        yes = _bbi_powmod_1(x->limbs[0], k, BBI_SMALL_PRIMES_PRODUCT) == r && _bbi_is_power_of(o, x, k);
+        bbi_destroy(x);
+        return yes;
+    }
+
+    /* Longer roots are worth two more residues first, mod the first primes 2jk + 1 */
+    found = 0;
+    for (j = 1; found < 2 && j < 100; j++) {
+        q = 2 * j * k + 1;
+        if (q / 2 / j != k || !_bbi_is_prime_small(q)) {
+            continue;
+        }
+        found++;
+        rq = _bbi_mod_1(o->limbs, o->len, q);
+        if (rq != 0 && _bbi_powmod_small((unsigned int) rq, 2 * j, q) != 1) {
+            return 0;
+        }
+    }
+    x = _bbi_root_newton(o, bits, k);
+    yes = _bbi_is_power_of(o, x, k);
+    bbi_destroy(x);
+    return yes;
+}
+
+/* Whether a is a perfect square. 0 is one. */
+int bbi_is_square(bbi_chunk *list) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    unsigned int t;
+    size_t size;
+    bbi_limb *sp;
+    int yes;
+
+    if (n == 0) {
+        return 1;
+    }
+    if (list->sign) {
+        return 0;
+    }
+    /* Even trailing zeros, then 1 mod 8 above them */
+    t = _bbi_ctz_n(list->limbs, n);
+    if (t % 2 != 0 || _bbi_get_bits(list->limbs, n, t, 3) != 1 ||
+        !_bbi_square_residues(_bbi_mod_1(list->limbs, n, BBI_SMALL_PRIMES_PRODUCT))) {
+        return 0;
+    }
+    size = (n + 1) / 2 * sizeof(bbi_limb);
+    sp = _bbi_alloc(size);
+    yes = _bbi_sqrtrem(sp, NULL, list->limbs, n) == 0;
+    _bbi_free(sp, size);
+    return yes;
+}
+
+/* Whether a = x^k for some integer x and k > 1. 0, 1 and -1 are; a negative a needs an odd k. */
+int bbi_is_perfect_power(bbi_chunk *list) {
+    unsigned int n = _bbi_normalized_len(list->limbs, list->len);
+    int neg = n > 0 && list->sign;
+    bbi_chunk *o;
+    unsigned char *composite;
+    unsigned int t;
+    unsigned int g;
+    unsigned int v;
+    unsigned int q;
+    unsigned int bits;
+    unsigned int kmax;
+    unsigned int k;
+    unsigned int i;
+    bbi_limb r;
+    int yes;
+
+    if (n == 0 || (n == 1 && list->limbs[0] == 1)) {
+        return 1;
+    }
+    /* k has to divide the number of trailing zeros */
+    t = _bbi_ctz_n(list->limbs, n);
+    if (t == 1) {
+        return 0;
+    }
+    o = _bbi_alloc_chunks(n);
+    memcpy(o->limbs, &list->limbs[t / BBI_LIMB_BITS], (n - t / BBI_LIMB_BITS) * sizeof(bbi_limb));
+    o->len = n - t / BBI_LIMB_BITS;
+    if (t % BBI_LIMB_BITS != 0) {
+        _bbi_rshift(o->limbs, o->limbs, o->len, t % BBI_LIMB_BITS);
+    }
+    o = _bbi_root_signed(o, 0);
+
+    /* And the multiplicity of each small prime factor, which are divided out */
+    g = t;
+    r = _bbi_mod_1(o->limbs, o->len, BBI_SMALL_PRIMES_PRODUCT);
+    for (i = 0; i < BBI_NSMALL_PRIMES && g != 1; i++) {
+        q = _bbi_small_primes[i];
+        if (r % q != 0) {
+            continue;
+        }
+        v = 0;
+        do {
+            _bbi_divexact_1(o->limbs, o->limbs, o->len, q);
+            o->len = _bbi_normalized_len(o->limbs, o->len);
+            v++;
+        } while (_bbi_mod_1(o->limbs, o->len, q) == 0);
+        g = (unsigned int) _bbi_gcd_1(g, v);
+    }
+    if (g == 1) {
+        bbi_destroy(o);
+        return 0;
+    }
+
+    if (o->len == 1 && o->limbs[0] == 1) {
+        /* All small primes: any prime k dividing g will do, as long as it's odd for a negative a */
+        yes = !neg || g >> _bbi_limb_ctz(g) != 1;
+    } else {
+        /* The root has no small prime factors so is more than 2^4, and k < bits/4 */
+        r = _bbi_mod_1(o->limbs, o->len, BBI_SMALL_PRIMES_PRODUCT);
+        bits = _bbi_bit_length_n(o->limbs, o->len);
+        kmax = bits / 4;
+        if (g != 0 && g < kmax) {
+            kmax = g;
+        }
+        composite = _bbi_alloc(kmax + 1);
+        memset(composite, 0, kmax + 1);
+        yes = 0;
+        for (k = 2; k <= kmax && !yes; k++) {
+            if (composite[k]) {
+                continue;
+            }
+            for (i = k; i <= kmax / k; i++) {
+                composite[i * k] = 1;
+            }
+            if ((g == 0 || g % k == 0) && !(neg && k == 2)) {
+                yes = _bbi_is_power(o, bits, r, k);
+            }
+        }
+        _bbi_free(composite, kmax + 1);
+    }
+    bbi_destroy(o);
+    return yes;
+}
@@ -0,0 +1,75 @@
+/*
+ * Optional instrumentation: per-thread counts of calls, chunks processed and cycles for each public
+ * operation, plus the allocation and growth events underneath them.
+ *
+ * Compiled in only when the library is built with -DBBI_STATS. Without it the hooks in bbi.h expand
+ * to nothing, so there's no cost at all, and bbi_stats_snapshot() just reports zeros. With it each
+ * hooked function pays two timestamp reads and a few thread-local increments.
+ *
+ * Counters are per thread, like the other caches, so counting never needs atomics or locks - a
+ * snapshot describes the work done by the calling thread since its last bbi_stats_reset().
+ */
+
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#include "bbi.h"
+
+static const char *stat_names[BBI_STAT_NFUNCS] = {
+    "create", "extend", "copy", "destroy", "add", "sub", "mul", "sqr", "divmod", "not", "and", "or",
+    "xor", "shl", "shr", "powmod", "fromstring", "tostring", "gcd", "root", "expr"
+};
+
+#ifdef BBI_STATS
+_Thread_local bbi_stats _bbi_stats;
+
+/* Timestamp counter on x86 (cycles), nanoseconds elsewhere */
+static inline uint64_t _bbi_stat_now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+struct _bbi_stat_scope _bbi_stat_begin(unsigned int fn, uint64_t nlimbs) {
+    struct _bbi_stat_scope scope;
+
+    _bbi_stats.calls[fn]++;
+    _bbi_stats.limbs[fn] += nlimbs;
+    scope.fn = fn;
+    scope.t0 = _bbi_stat_now();
+    return scope;
+}
+
+/* Runs as the scope's cleanup when the hooked function returns, whichever return it takes */
+void _bbi_stat_end(struct _bbi_stat_scope *scope) {
+    _bbi_stats.cycles[scope->fn] += _bbi_stat_now() - scope->t0;
+}
+#endif
+
+/* Copy the calling thread's counters into *out */
+void bbi_stats_snapshot(bbi_stats *out) {
+#ifdef BBI_STATS
+    *out = _bbi_stats;
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+}
+
+/* Zero the calling thread's counters */
+void bbi_stats_reset() {
+#ifdef BBI_STATS
+    memset(&_bbi_stats, 0, sizeof(_bbi_stats));
+#endif
+}
+
+/* Name of a BBI_STAT_* function index, for reports */
+const char *bbi_stats_name(unsigned int fn) {
+    return fn < BBI_STAT_NFUNCS ? stat_names[fn] : NULL;
+}
@@ -1,7 +1,10 @@
 #include <criterion/criterion.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "bbi.h"
+#include "bbi_tune.h"
 
 /* 
    A lot of thise code is testing implementation, not interface,
@@ -11,40 +14,36 @@
 */
 Test(bbi_structures, list_len_one) {
     bbi_chunk *list = bbi_create();
-    list->val = 0;
-    cr_assert(list->val == 0);
+    list->limbs[0] = 0;
+    cr_assert(list->limbs[0] == 0);
     cr_assert(_bbi_count_chunks(list) == 1);
-    list->val = 1000000;
-    cr_assert(list->val == 1000000);
+    list->limbs[0] = 1000000;
+    cr_assert(list->limbs[0] == 1000000);
     bbi_destroy(list);
 }
 
 Test(bbi_structures, list_len_two_extend) {
     bbi_chunk *list = bbi_create();
-    cr_assert(list->val == 0);
+    cr_assert(list->limbs[0] == 0);
     cr_assert(_bbi_count_chunks(list) == 1);
     bbi_extend(list, 1);
     cr_assert(_bbi_count_chunks(list) == 2);
-    list = list->left;
-    cr_assert(list->val == 0);
+    cr_assert(list->limbs[1] == 0);
     bbi_destroy(list);
 }
 
 Test(bbi_structures, list_len_1000_extend) {
-    int i;
     bbi_chunk *list = bbi_create();
-    cr_assert(list->val == 0);
+    cr_assert(list->limbs[0] == 0);
     cr_assert(_bbi_count_chunks(list) == 1);
     bbi_extend(list, 999);
     cr_assert(_bbi_count_chunks(list) == 1000);
-    list = _find_left(list);
-    list->val = 10000;
-    i = 0;
-    while (list->right != NULL && i < 100) {
-        list = list->right;
-        i++;
-    }
-    list->val = 12345;
+    cr_assert(list->cap >= 1000);
+    *_find_left(list) = 10000;
+    cr_assert(list->limbs[999] == 10000);
+    cr_assert(_find_right(list) == &list->limbs[0]);
+    list->limbs[899] = 12345;
+    cr_assert(list->limbs[898] == 0);
     bbi_destroy(list);
 }
 
@@ -111,16 +110,13 @@ Test(bbi_structures, list_pad_first) {
 Test(bbi_structures, list_copy) {
     bbi_chunk *list = bbi_create_nchunks(10);
     bbi_chunk *listcopy;
-    int i = 0;
+    unsigned int i;
 
     cr_assert(_bbi_count_chunks(list) == 10);
     /* Create some values to copy - 0-9, going towards more-significant bits, 1 per chunk */
-    while (list->left != NULL) {
-        list->val = i;
-        i++;
-        list = list->left;
+    for (i = 0; i < 10; i++) {
+        list->limbs[i] = i;
     }
-    list->val = i;
     /*
     printf("list:\n");
     bbi_dump_binary(list);
@@ -132,95 +128,1739 @@ Test(bbi_structures, list_copy) {
     bbi_dump_binary(listcopy);
     */
     cr_assert(_bbi_count_chunks(listcopy) == 10);
-    i = 0;
-    while (listcopy->left != NULL) {
-        cr_assert(listcopy->val == i);
-        i++;
-        listcopy = listcopy->left;
+    cr_assert(listcopy->limbs != list->limbs);
+    for (i = 0; i < 10; i++) {
+        cr_assert(listcopy->limbs[i] == i);
     }
     bbi_destroy(list);
     bbi_destroy(listcopy);
 }
 
+Test(bbi_structures, header_tracks_endpoints) {
+    bbi_chunk *list = bbi_create_nchunks(3);
+    bbi_chunk *listcopy;
+
+    cr_assert(list->sign == 0);
+    cr_assert(_find_right(list) == &list->limbs[0]);
+    cr_assert(_find_left(list) == &list->limbs[2]);
+    bbi_extend(list, 5);
+    cr_assert(_bbi_count_chunks(list) == 8);
+    cr_assert(_find_left(list) == &list->limbs[7]);
+    list->sign = 1;
+    listcopy = bbi_copy(list);
+    cr_assert(listcopy->sign == 1);
+    cr_assert(_bbi_count_chunks(listcopy) == 8);
+    bbi_destroy(list);
+    bbi_destroy(listcopy);
+}
+
+/* Memory management */
+static unsigned int test_alloc_calls;
+static size_t test_bytes_live;
+
+static void *test_alloc(size_t size) {
+    test_alloc_calls++;
+    test_bytes_live += size;
+    return malloc(size);
+}
+
+static void *test_realloc(void *ptr, size_t old_size, size_t new_size) {
+    test_alloc_calls++;
+    test_bytes_live += new_size - old_size;
+    return realloc(ptr, new_size);
+}
+
+static void test_free(void *ptr, size_t size) {
+    test_bytes_live -= size;
+    free(ptr);
+}
+
+Test(bbi_memory, custom_allocator) {
+    bbi_chunk *list;
+
+    bbi_set_allocator(test_alloc, test_realloc, test_free);
+    test_alloc_calls = 0;
+    test_bytes_live = 0;
+    list = bbi_create_nchunks(10);
+    cr_assert(test_alloc_calls == 2);
+    bbi_extend(list, 100);
+    cr_assert(test_alloc_calls == 3);
+    bbi_destroy(list);
+    bbi_free_cache();
+    cr_assert(test_bytes_live == 0);
+    bbi_set_allocator(NULL, NULL, NULL);
+}
+
+Test(bbi_memory, arena_reset) {
+    bbi_chunk *list_a = bbi_create_nchunks(4);
+    bbi_chunk *list_b;
+    bbi_chunk *tmp;
+    unsigned int i;
+
+    list_a->limbs[0] = 12;
+    bbi_set_allocator(test_alloc, test_realloc, test_free);
+    test_alloc_calls = 0;
+    bbi_arena_begin();
+    for (i = 0; i < 1000; i++) {
+        tmp = bbi_add(list_a, list_a);
+        cr_assert(tmp->flags & BBI_FLAG_ARENA);
+        cr_assert(tmp->limbs[0] == 24);
+        bbi_extend(tmp, 3);
+        cr_assert(tmp->limbs[0] == 24);
+        bbi_destroy(tmp);
+    }
+    list_b = bbi_xor(list_a, list_a);
+    bbi_arena_end();
+    /* A handful of arena blocks, not thousands of mallocs */
+    cr_assert(test_alloc_calls < 10);
+    cr_assert(_bbi_count_chunks(list_b) == 4);
+    cr_assert(list_b->limbs[0] == 0);
+    bbi_arena_reset();
+
+    /* Outside the arena, values are heap-allocated again */
+    tmp = bbi_copy(list_a);
+    cr_assert(!(tmp->flags & BBI_FLAG_ARENA));
+    bbi_destroy(tmp);
+    bbi_destroy(list_a);
+    bbi_free_cache();
+    bbi_set_allocator(NULL, NULL, NULL);
+}
+
+Test(bbi_memory, inline_small_values) {
+    bbi_chunk *a;
+    bbi_chunk *b;
+    bbi_chunk *r;
+    unsigned int i;
+
+    bbi_set_allocator(test_alloc, test_realloc, test_free);
+    test_bytes_live = 0;
+    a = bbi_create();
+    b = bbi_create();
+    a->limbs[0] = (bbi_limb) -1;
+    b->limbs[0] = 3;
+    /* Warm up the header slab, then small arithmetic shouldn't touch the allocator at all */
+    bbi_destroy(bbi_create());
+    test_alloc_calls = 0;
+    for (i = 0; i < 100; i++) {
+        r = bbi_mul(a, b);
+        bbi_add_inplace(r, a);
+        bbi_xor_inplace(r, b);
+        bbi_destroy(r);
+    }
+    if (BBI_INLINE_LIMBS >= 2) {
+        cr_assert(test_alloc_calls == 0);
+    }
+
+    /* 3 * (2^B - 1) + (2^B - 1) == 2^(B+2) - 4, then ^ 3 */
+    r = bbi_mul(a, b);
+    bbi_add_inplace(r, a);
+    bbi_xor_inplace(r, b);
+    cr_assert(r->len == 2 && r->limbs[0] == (bbi_limb) -1 && r->limbs[1] == 3);
+    cr_assert(BBI_INLINE_LIMBS < 2 || (r->flags & BBI_FLAG_INLINE));
+
+    /* Growing past the inline chunks moves them to the heap, intact */
+    bbi_extend(r, 10);
+    cr_assert(!(r->flags & BBI_FLAG_INLINE));
+    cr_assert(r->limbs[0] == (bbi_limb) -1 && r->limbs[1] == 3 && r->limbs[11] == 0);
+    bbi_destroy(r);
+    bbi_destroy(a);
+    bbi_destroy(b);
+    bbi_free_cache();
+    cr_assert(test_bytes_live == 0);
+    bbi_set_allocator(NULL, NULL, NULL);
+}
+
+/* Counters are only compiled in with -DBBI_STATS - otherwise everything reads as 0 */
+Test(bbi_memory, stats) {
+    bbi_chunk *a;
+    bbi_chunk *b;
+    bbi_chunk *r;
+    bbi_stats st;
+    unsigned int i;
+
+    bbi_stats_reset();
+    a = bbi_create_nchunks(3);
+    b = bbi_create();
+    r = bbi_add(a, b);
+    bbi_destroy(r);
+    r = bbi_add(b, a);
+    bbi_destroy(r);
+    bbi_destroy(a);
+    bbi_destroy(b);
+    bbi_stats_snapshot(&st);
+#ifdef BBI_STATS
+    cr_assert(st.calls[BBI_STAT_CREATE] == 2);
+    cr_assert(st.calls[BBI_STAT_COPY] == 2);
+    cr_assert(st.calls[BBI_STAT_ADD] == 2);
+    cr_assert(st.limbs[BBI_STAT_ADD] == 8);
+    cr_assert(st.calls[BBI_STAT_DESTROY] == 4);
+    cr_assert(st.headers_alloc == 4 && st.headers_free == 4);
+    /* Only b + a needs the copy of b padded */
+    cr_assert(st.pads == 1);
+    cr_assert(st.calls[BBI_STAT_EXTEND] == 1);
+#else
+    for (i = 0; i < BBI_STAT_NFUNCS; i++) {
+        cr_assert(st.calls[i] == 0 && st.cycles[i] == 0);
+    }
+    cr_assert(st.headers_alloc == 0 && st.pads == 0);
+#endif
+    bbi_stats_reset();
+    bbi_stats_snapshot(&st);
+    cr_assert(st.calls[BBI_STAT_ADD] == 0 && st.allocs == 0);
+    cr_assert(strcmp(bbi_stats_name(BBI_STAT_XOR), "xor") == 0);
+    cr_assert(bbi_stats_name(BBI_STAT_NFUNCS) == NULL);
+    (void) i;
+}
+
 /* Storage and retrieval */
 Test(bbi_storage, load_dec_string_0) {
     bbi_chunk *new = bbi_fromstring_dec("0");
-    while (new->right != NULL) {
-        new = new->right;
-    }   
-    cr_assert(new->val == 0);
+    cr_assert(new->limbs[0] == 0);
     bbi_destroy(new);
 }
 
 Test(bbi_storage, load_dec_string_16bits) {
     bbi_chunk *new = bbi_fromstring_dec("12345");
-    while (new->right != NULL) {
-        new = new->right;
-    }
-    cr_assert(new->val == 12345);
+    cr_assert(new->limbs[0] == 12345);
     bbi_destroy(new);
 }
 
 /* Test either side of 32- and 64-bit boundaries, and bigger higher boundaries */
 Test(bbi_storage, load_dec_string_32bits) {
     bbi_chunk *new = bbi_fromstring_dec("4294967295");
-    while (new->right != NULL) {
-        new = new->right;
-    }
-    cr_assert(new->val == 4294967295);
+    cr_assert(new->limbs[0] == 4294967295);
     bbi_destroy(new);
 }
 
-/*
 Test(bbi_storage, load_dec_string_32bitsplusone) {
     bbi_chunk *new = bbi_fromstring_dec("4294967296");
-    while (new->right != NULL) {
-        new = new->right;
+    unsigned int i;
+
+    cr_assert(bbi_get_bit(new, 32) == 1);
+    for (i = 0; i < 32; i++) {
+        cr_assert(bbi_get_bit(new, i) == 0);
     }
-    cr_assert(new->val == 0);
-    cr_assert(new->left != NULL);
-    cr_assert(new->left->val == 1);
     bbi_destroy(new);
 }
-*/
+
+Test(bbi_storage, load_dec_string_64bitsplusone) {
+    bbi_chunk *new = bbi_fromstring_dec("18446744073709551617");
+    unsigned int i;
+
+    cr_assert(_bbi_count_chunks(new) == 64 / BBI_LIMB_BITS + 1);
+    cr_assert(bbi_get_bit(new, 0) == 1);
+    cr_assert(bbi_get_bit(new, 64) == 1);
+    for (i = 1; i < 64; i++) {
+        cr_assert(bbi_get_bit(new, i) == 0);
+    }
+    bbi_destroy(new);
+}
+
+Test(bbi_storage, load_dec_string_bounded) {
+    const unsigned char digits[] = {'1', '2', '3', '4', '5'};   /* no NUL terminator */
+    bbi_chunk *new = bbi_fromstring_dec_n(digits, 3);
+
+    cr_assert(new->limbs[0] == 123);
+    bbi_destroy(new);
+    new = bbi_fromstring_dec("000000000000000000000000000000042");
+    cr_assert(_bbi_count_chunks(new) == 1);
+    cr_assert(new->limbs[0] == 42);
+    bbi_destroy(new);
+    cr_assert(bbi_fromstring_dec("12a4") == NULL);
+
+    /* A sign with no digits is refused, as the streaming parser does */
+    cr_assert(bbi_fromstring_dec("-") == NULL);
+    cr_assert(bbi_fromstring_dec("+") == NULL);
+    cr_assert(bbi_fromstring_dec("+1") == NULL);
+    cr_assert(bbi_fromstring_dec_n((const unsigned char *) "-5", 1) == NULL);
+}
+
+/* Long enough to go through the divide-and-conquer path several levels deep - check against
+   Horner's rule one digit at a time */
+Test(bbi_storage, load_dec_string_long) {
+    unsigned char s[20001];
+    bbi_limb expect[20001 / 9 + 2];
+    unsigned int n = 0;
+    unsigned int i;
+    bbi_limb carry;
+    bbi_chunk *new;
+
+    srand(5);
+    for (i = 0; i < 20000; i++) {
+        s[i] = '0' + rand() % 10;
+        carry = _bbi_mul_1(expect, expect, n, 10);
+        carry += _bbi_add_1(expect, expect, n, s[i] - '0');
+        if (carry != 0) {
+            expect[n++] = carry;
+        }
+    }
+    s[20000] = '\0';
+    new = bbi_fromstring_dec(s);
+    cr_assert(_bbi_count_chunks(new) == n);
+    cr_assert(memcmp(new->limbs, expect, n * sizeof(bbi_limb)) == 0);
+    bbi_destroy(new);
+}
+
+Test(bbi_storage, tostring_dec) {
+    bbi_chunk *list = bbi_create();
+    bbi_chunk *other;
+    char buf[64];
+
+    cr_assert(bbi_tostring_dec(list, buf, sizeof(buf)) == 1);
+    cr_assert(strcmp(buf, "0") == 0);
+    list->limbs[0] = 4294967295;
+    cr_assert(bbi_tostring_dec(list, buf, sizeof(buf)) == 10);
+    cr_assert(strcmp(buf, "4294967295") == 0);
+    bbi_destroy(list);
+
+    list = bbi_fromstring_dec("340282366920938463463374607431768211456");    /* 2^128 */
+    cr_assert(bbi_tostring_dec(list, NULL, 0) <= sizeof(buf));
+    cr_assert(bbi_tostring_dec(list, buf, 3) == 0);
+    bbi_tostring_dec(list, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "340282366920938463463374607431768211456") == 0);
+
+    other = bbi_fromstring_dec("340282366920938463463374607431768211457");
+    bbi_sub_inplace(list, other);
+    bbi_tostring_dec(list, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "-1") == 0);
+    bbi_destroy(list);
+    bbi_destroy(other);
+}
+
+/* Round trip through the divide-and-conquer paths in both directions, including runs of zeros
+   that have to survive the zero-padding of the low halves */
+Test(bbi_storage, tostring_dec_long) {
+    unsigned char s[30001];
+    char *buf;
+    size_t size;
+    unsigned int i;
+    bbi_chunk *list;
+
+    srand(6);
+    for (i = 0; i < 30000; i++) {
+        s[i] = (i / 1000) % 3 == 1 ? '0' : '0' + rand() % 10;
+    }
+    s[0] = '7';
+    s[30000] = '\0';
+    list = bbi_fromstring_dec(s);
+    size = bbi_tostring_dec(list, NULL, 0);
+    cr_assert(size >= 30001);
+    buf = malloc(size);
+    cr_assert(bbi_tostring_dec(list, buf, size) == 30000);
+    cr_assert(strcmp(buf, (char *) s) == 0);
+    free(buf);
+    bbi_destroy(list);
+}
+
+/* The size query has to cover the longest value of that many chunks: -(2^(2^21) - 1) has 631306
+   digits, which 1233/4096 for log10(2) undercounts by 9 */
+Test(bbi_storage, tostring_dec_bound) {
+    unsigned int n = (1u << 21) / BBI_LIMB_BITS;
+    bbi_chunk *list = bbi_create_nchunks(n);
+    char *buf;
+    size_t size;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        list->limbs[i] = (bbi_limb) -1;
+    }
+    list->sign = 1;
+    size = bbi_tostring_dec(list, NULL, 0);
+    buf = malloc(size);
+    cr_assert(bbi_tostring_dec(list, buf, size) == 631307);
+    cr_assert(size >= 631307 + 1);
+    cr_assert(buf[0] == '-' && buf[631306] == '5');
+    free(buf);
+    bbi_destroy(list);
+}
+
+Test(bbi_storage, tostring_hex) {
+    bbi_chunk *list = bbi_fromstring_dec("340282366920938463463374607431768211455");    /* 2^128-1 */
+    char buf[64];
+
+    cr_assert(bbi_tostring_hex(list, NULL, 0) == 33);
+    cr_assert(bbi_tostring_hex(list, buf, 32) == 0);
+    cr_assert(bbi_tostring_hex(list, buf, sizeof(buf)) == 32);
+    cr_assert(strcmp(buf, "ffffffffffffffffffffffffffffffff") == 0);
+    bbi_destroy(list);
+
+    list = bbi_fromstring_dec("1311768467463790320");    /* 0x123456789abcdef0 */
+    bbi_extend(list, 3);
+    cr_assert(bbi_tostring_hex(list, buf, sizeof(buf)) == 16);
+    cr_assert(strcmp(buf, "123456789abcdef0") == 0);
+    memset(list->limbs, 0, list->len * sizeof(bbi_limb));
+    cr_assert(bbi_tostring_hex(list, buf, sizeof(buf)) == 1);
+    cr_assert(strcmp(buf, "0") == 0);
+    bbi_destroy(list);
+}
+
+Test(bbi_storage, import_export_bytes) {
+    static const unsigned char bytes[] = {0x01, 0x02, 0x03, 0x04, 0x05};
+    static const unsigned char words[] = {0x01, 0x00, 0x03, 0x02};
+    static const size_t sizes[] = {1, 2, 3, 4, 8, 16};
+    static const int endians[] = {BBI_ENDIAN_BIG, BBI_ENDIAN_LITTLE, BBI_ENDIAN_NATIVE};
+    bbi_chunk *big = bbi_fromstring_dec("123456789012345678901234567890123456789012345678901234567890");
+    bbi_chunk *list;
+    unsigned char out[64];
+    char expect[64];
+    char buf[64];
+    unsigned int s;
+    unsigned int e;
+    int order;
+    size_t count;
+
+    list = bbi_import_bytes(bytes, 5, BBI_ORDER_MSW_FIRST, 1, BBI_ENDIAN_BIG);
+    bbi_tostring_hex(list, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "102030405") == 0);
+    bbi_destroy(list);
+    list = bbi_import_bytes(bytes, 5, BBI_ORDER_LSW_FIRST, 1, BBI_ENDIAN_BIG);
+    bbi_tostring_hex(list, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "504030201") == 0);
+    bbi_destroy(list);
+    list = bbi_import_bytes(words, 2, BBI_ORDER_MSW_FIRST, 2, BBI_ENDIAN_LITTLE);
+    bbi_tostring_hex(list, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "10203") == 0);
+    cr_assert(bbi_export_bytes(list, NULL, 0, BBI_ORDER_MSW_FIRST, 2, BBI_ENDIAN_BIG) == 2);
+    cr_assert(bbi_export_bytes(list, out, 3, BBI_ORDER_MSW_FIRST, 2, BBI_ENDIAN_BIG) == 0);
+    cr_assert(bbi_export_bytes(list, out, sizeof(out), BBI_ORDER_MSW_FIRST, 2, BBI_ENDIAN_BIG) == 2);
+    cr_assert(memcmp(out, "\x00\x01\x02\x03", 4) == 0);
+    bbi_destroy(list);
+
+    /* 0 is one word of zeros */
+    list = bbi_create();
+    memset(out, 0xff, sizeof(out));
+    cr_assert(bbi_export_bytes(list, out, sizeof(out), BBI_ORDER_MSW_FIRST, 3, BBI_ENDIAN_BIG) == 1);
+    cr_assert(memcmp(out, "\x00\x00\x00\xff", 4) == 0);
+    bbi_destroy(list);
+
+    /* Every layout round trips */
+    bbi_tostring_hex(big, expect, sizeof(expect));
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (order = -1; order <= 1; order += 2) {
+            for (e = 0; e < 3; e++) {
+                count = bbi_export_bytes(big, NULL, 0, order, sizes[s], endians[e]);
+                cr_assert(count == (25 + sizes[s] - 1) / sizes[s]);
+                cr_assert(bbi_export_bytes(big, out, sizeof(out), order, sizes[s], endians[e]) == count);
+                list = bbi_import_bytes(out, count, order, sizes[s], endians[e]);
+                bbi_tostring_hex(list, buf, sizeof(buf));
+                cr_assert(strcmp(buf, expect) == 0, "size %zu order %d endian %d", sizes[s], order, endians[e]);
+                bbi_destroy(list);
+            }
+        }
+    }
+    bbi_destroy(big);
+}
+
+Test(bbi_storage, serialize) {
+    static const unsigned char bad[][4] = {
+        {0x01},                     /* negative 0 */
+        {0x04, 0x2c},               /* truncated */
+        {0x04, 0x2c, 0x00},         /* leading zero byte */
+        {0x84, 0x00, 0x2c, 0x01},   /* varint with a zero group on the end */
+        {0x80},                     /* varint cut off */
+    };
+    static const size_t badlen[] = {1, 2, 3, 4, 1};
+    bbi_chunk *values[4];
+    bbi_chunk *list;
+    unsigned char buf[256];
+    char hex[2][256];
+    size_t used;
+    size_t pos;
+    size_t n;
+    unsigned int i;
+
+    values[0] = bbi_create();
+    values[1] = bbi_fromstring_dec("300");
+    values[2] = bbi_fromstring_dec("-1");
+    /* 2^1000 - 1: 125 bytes, so a two-byte header */
+    values[3] = bbi_fromstring_dec("-1");
+    bbi_shl_inplace(values[3], 1000);
+    bbi_not_inplace(values[3]);
+
+    cr_assert(bbi_serialize(values[0], buf, sizeof(buf)) == 1 && buf[0] == 0);
+    cr_assert(bbi_serialize(values[1], buf, sizeof(buf)) == 3 && memcmp(buf, "\x04\x2c\x01", 3) == 0);
+    cr_assert(bbi_serialize(values[2], buf, sizeof(buf)) == 2 && memcmp(buf, "\x03\x01", 2) == 0);
+    cr_assert(bbi_serialize(values[3], NULL, 0) == 127);
+    cr_assert(bbi_serialize(values[3], buf, 126) == 0);
+
+    /* Values one after another in a stream read back in order */
+    pos = 0;
+    for (i = 0; i < 4; i++) {
+        n = bbi_serialize(values[i], &buf[pos], sizeof(buf) - pos);
+        cr_assert(n > 0);
+        pos += n;
+    }
+    n = pos;
+    pos = 0;
+    for (i = 0; i < 4; i++) {
+        list = bbi_deserialize(&buf[pos], n - pos, &used);
+        cr_assert(list != NULL);
+        cr_assert(list->sign == values[i]->sign);
+        bbi_tostring_hex(list, hex[0], sizeof(hex[0]));
+        bbi_tostring_hex(values[i], hex[1], sizeof(hex[1]));
+        cr_assert(strcmp(hex[0], hex[1]) == 0, "value %u", i);
+        pos += used;
+        bbi_destroy(list);
+    }
+    cr_assert(pos == n);
+
+    for (i = 0; i < sizeof(badlen) / sizeof(badlen[0]); i++) {
+        cr_assert(bbi_deserialize(bad[i], badlen[i], NULL) == NULL, "bad encoding %u accepted", i);
+    }
+    cr_assert(bbi_deserialize(buf, 0, NULL) == NULL);
+    for (i = 0; i < 4; i++) {
+        bbi_destroy(values[i]);
+    }
+}
+
+Test(bbi_storage, view) {
+    bbi_limb buf[4] = {5, 7, 0, 0};
+    bbi_chunk *one = bbi_fromstring_dec("1");
+    bbi_chunk *view = bbi_view(buf, sizeof(buf));
+    bbi_chunk *copy;
+    bbi_chunk *sum;
+
+    cr_assert(view != NULL);
+    cr_assert(view->limbs == buf && view->len == 2 && view->sign == 0);
+    sum = bbi_add(view, one);
+    cr_assert(sum->len == 2 && sum->limbs[0] == 6 && sum->limbs[1] == 7);
+
+    /* A copy is an ordinary bigint, and growing it leaves the buffer alone */
+    copy = bbi_copy(view);
+    bbi_shl_inplace(copy, 4 * BBI_LIMB_BITS);
+    bbi_destroy(view);
+    cr_assert(buf[0] == 5 && buf[1] == 7 && buf[2] == 0 && buf[3] == 0);
+    cr_assert(copy->len == 6 && copy->limbs[4] == 5 && copy->limbs[5] == 7);
+
+    cr_assert(bbi_view((char *) buf + 1, sizeof(bbi_limb)) == NULL);
+    cr_assert(bbi_view(buf, sizeof(bbi_limb) + 1) == NULL);
+    cr_assert(bbi_view(buf, 0) == NULL);
+    bbi_destroy(copy);
+    bbi_destroy(sum);
+    bbi_destroy(one);
+}
+
+static int same_value(bbi_chunk *x, bbi_chunk *y) {
+    return x->sign == y->sign && _bbi_cmp(x->limbs, x->len, y->limbs, y->len) == 0;
+}
+
+/* Output collected by a bbi_format() callback */
+struct collect {
+    char *buf;
+    size_t len;
+    size_t maxpiece;
+    unsigned int calls;
+    unsigned int fail_at;
+};
+
+static int collect_write(void *ctx, const char *s, size_t len) {
+    struct collect *c = ctx;
+
+    c->calls++;
+    if (c->calls == c->fail_at) {
+        return 7;
+    }
+    memcpy(&c->buf[c->len], s, len);
+    c->len += len;
+    if (len > c->maxpiece) {
+        c->maxpiece = len;
+    }
+    return 0;
+}
+
+Test(bbi_storage, stream_parse) {
+    static const char *bad[] = {"12a", "- 1", "1 2", "", "-", "+", "+1", " \n", "--1", "0x1f"};
+    static const size_t pieces[] = {1, 7, 19, 4096, 100000};
+    /* Several whole blocks, whole blocks with no digits left over, and a few digits */
+    static const size_t lengths[] = {100001, 2 * 19456, 19456 + 38, 30, 2 * 19456 + 5};
+    unsigned char *s = malloc(100003);
+    bbi_chunk *expect;
+    bbi_chunk *list;
+    bbi_parser *p;
+    char hex[1100];
+    size_t len;
+    size_t pos;
+    size_t take;
+    unsigned int i;
+    unsigned int k;
+
+    srand(5);
+    for (k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++) {
+        len = lengths[k];
+        s[0] = '-';
+        for (pos = 1; pos < len; pos++) {
+            s[pos] = '0' + rand() % 10;
+        }
+        s[1] = '0';     /* A leading zero, which the parser has to keep in place */
+        s[len] = '\0';
+        expect = bbi_fromstring_dec(s);
+        for (i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+            p = bbi_parser_create(10);
+            cr_assert(bbi_parser_feed(p, " ", 1) == 0);
+            for (pos = 0; pos < len; pos += take) {
+                take = len - pos < pieces[i] ? len - pos : pieces[i];
+                cr_assert(bbi_parser_feed(p, (char *) &s[pos], take) == 0);
+            }
+            cr_assert(bbi_parser_feed(p, "\n", 1) == 0);
+            list = bbi_parser_finish(p);
+            cr_assert(list != NULL);
+            cr_assert(same_value(list, expect), "%zu digits in pieces of %zu", len, pieces[i]);
+            bbi_destroy(list);
+        }
+        bbi_destroy(expect);
+    }
+
+    /* Whole blocks of leading zeros, so every block flushed is 0 and the digits left over are the
+       whole value */
+    for (k = 1; k <= 2; k++) {
+        len = k * 19456 + 1000;
+        memset(s, '0', len - 1000);
+        memset(&s[len - 1000], '7', 1000);
+        s[len] = '\0';
+        expect = bbi_fromstring_dec(s);
+        p = bbi_parser_create(10);
+        for (pos = 0; pos < len; pos += take) {
+            take = len - pos < 4096 ? len - pos : 4096;
+            cr_assert(bbi_parser_feed(p, (char *) &s[pos], take) == 0);
+        }
+        list = bbi_parser_finish(p);
+        cr_assert(list != NULL);
+        cr_assert(same_value(list, expect), "%u blocks of zeros", k);
+        bbi_destroy(list);
+        bbi_destroy(expect);
+    }
+
+    /* Hex, in either case, with a partial chunk at the bottom */
+    for (pos = 0; pos < 1001; pos++) {
+        hex[pos] = "0123456789abcdef"[rand() % 16];
+    }
+    hex[0] = '7';
+    hex[1001] = '\0';
+    p = bbi_parser_create(16);
+    for (pos = 0; pos < 1001; pos += 10) {
+        cr_assert(bbi_parser_feed(p, &hex[pos], 1001 - pos < 10 ? 1001 - pos : 10) == 0);
+    }
+    list = bbi_parser_finish(p);
+    bbi_tostring_hex(list, (char *) s, 100003);
+    cr_assert(strcmp((char *) s, hex) == 0);
+    bbi_destroy(list);
+    p = bbi_parser_create(16);
+    cr_assert(bbi_parser_feed(p, "-00FfA", 6) == 0);
+    list = bbi_parser_finish(p);
+    cr_assert(list->sign == 1 && list->len == 1 && list->limbs[0] == 0xffa);
+    bbi_destroy(list);
+
+    /* 0, and anything that isn't a value */
+    p = bbi_parser_create(10);
+    cr_assert(bbi_parser_feed(p, "-0000", 5) == 0);
+    list = bbi_parser_finish(p);
+    cr_assert(list->sign == 0 && list->len == 1 && list->limbs[0] == 0);
+    bbi_destroy(list);
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        p = bbi_parser_create(i % 2 == 0 ? 10 : 16);
+        bbi_parser_feed(p, bad[i], strlen(bad[i]));
+        cr_assert(bbi_parser_finish(p) == NULL, "\"%s\" accepted", bad[i]);
+    }
+    cr_assert(bbi_parser_create(8) == NULL);
+    free(s);
+}
+
+Test(bbi_storage, stream_format) {
+    unsigned char *s = malloc(100002);
+    struct collect c;
+    bbi_chunk *list;
+    bbi_chunk *back;
+    char *expect;
+    size_t size;
+    size_t pos;
+    unsigned int base;
+    FILE *f;
+
+    srand(6);
+    s[0] = '-';
+    for (pos = 1; pos < 100001; pos++) {
+        s[pos] = '0' + rand() % 10;
+    }
+    s[1] = '9';
+    s[100001] = '\0';
+    list = bbi_fromstring_dec(s);
+    size = bbi_tostring_dec(list, NULL, 0);
+    expect = malloc(size);
+    c.buf = malloc(size);
+
+    for (base = 10; base <= 16; base += 6) {
+        if (base == 10) {
+            bbi_tostring_dec(list, expect, size);
+        } else {
+            bbi_tostring_hex(list, expect, size);
+        }
+        c.len = 0;
+        c.maxpiece = 0;
+        c.calls = 0;
+        c.fail_at = 0;
+        cr_assert(bbi_format(list, base, collect_write, &c) == 0);
+        cr_assert(c.len == strlen(expect) && memcmp(c.buf, expect, c.len) == 0, "base %u", base);
+        /* In pieces, never the whole string at once */
+        cr_assert(c.calls > 2 && c.maxpiece < c.len / 2);
+
+        /* A callback's error stops the output */
+        c.calls = 0;
+        c.fail_at = 2;
+        cr_assert(bbi_format(list, base, collect_write, &c) == 7);
+        cr_assert(c.calls == 2);
+
+        /* Through a file and back */
+        f = tmpfile();
+        cr_assert(f != NULL);
+        cr_assert(bbi_format_file(list, base, f) == 0);
+        rewind(f);
+        back = bbi_fromfile(f, base);
+        fclose(f);
+        cr_assert(back != NULL && same_value(back, list));
+        bbi_destroy(back);
+    }
+    bbi_destroy(list);
+
+    list = bbi_create();
+    c.len = 0;
+    c.fail_at = 0;
+    cr_assert(bbi_format(list, 10, collect_write, &c) == 0);
+    cr_assert(c.len == 1 && c.buf[0] == '0');
+    cr_assert(bbi_format(list, 2, collect_write, &c) == -1);
+    bbi_destroy(list);
+    free(c.buf);
+    free(expect);
+    free(s);
+}
+
+Test(bbi_arith, divrem) {
+    bbi_chunk *n = bbi_fromstring_dec("123456789012345678901234567890123456789012345678901234567890");
+    bbi_chunk *d = bbi_fromstring_dec("98765432109876543210987654321");
+    bbi_chunk *q = bbi_create_nchunks(n->len - d->len + 1);
+    bbi_chunk *r = bbi_create_nchunks(d->len);
+    char buf[80];
+
+    _bbi_divrem(q->limbs, r->limbs, n->limbs, n->len, d->limbs, d->len);
+    bbi_tostring_dec(q, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "1249999988609375000142382812499") == 0);
+    bbi_tostring_dec(r, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "46440971104644097110464409711") == 0);
+    bbi_destroy(n);
+    bbi_destroy(d);
+    bbi_destroy(q);
+    bbi_destroy(r);
+}
+
+/* q * d + r == n and r < d, over sizes and chunk patterns that exercise the quotient corrections,
+   with Algorithm D alone and with the recursive division down to its smallest size */
+Test(bbi_arith, divrem_random) {
+    bbi_limb np[200];
+    bbi_limb dp[100];
+    bbi_limb qp[200];
+    bbi_limb rp[100];
+    bbi_limb check[201];
+    unsigned int thresholds[] = {1000, 4};
+    unsigned int t;
+    unsigned int nn;
+    unsigned int dn;
+    unsigned int i;
+    unsigned int round;
+
+    srand(7);
+    for (t = 0; t < 2; t++) {
+        _bbi_div_dc_threshold = thresholds[t];
+        for (round = 0; round < 1000; round++) {
+            dn = 1 + rand() % (round % 2 ? 100 : 20);
+            nn = dn + rand() % (dn + 1);
+            for (i = 0; i < nn; i++) {
+                np[i] = rand() % 4 == 0 ? (bbi_limb) -1 : ((bbi_limb) rand() << 20) ^ (bbi_limb) rand() << (BBI_LIMB_BITS - 31);
+            }
+            for (i = 0; i < dn; i++) {
+                dp[i] = rand() % 4 == 0 ? 0 : ((bbi_limb) rand() << 20) ^ (bbi_limb) rand() << (BBI_LIMB_BITS - 31);
+            }
+            if (dp[dn - 1] == 0) {
+                dp[dn - 1] = rand() % 2 ? 1 : (bbi_limb) 1 << (BBI_LIMB_BITS - 1);
+            }
+            _bbi_divrem(qp, rp, np, nn, dp, dn);
+            cr_assert(_bbi_cmp(rp, dn, dp, dn) < 0);
+            _bbi_mul(check, qp, nn - dn + 1, dp, dn);
+            cr_assert(_bbi_add_1(&check[dn], &check[dn], nn - dn + 1, _bbi_add_n(check, check, rp, dn)) == 0);
+            cr_assert(_bbi_cmp(check, nn + 1, np, nn) == 0);
+        }
+    }
+    _bbi_div_dc_threshold = BBI_DIV_DC_THRESHOLD;
+}
+
+Test(bbi_arith, divmod) {
+    bbi_chunk *a = bbi_fromstring_dec("123456789012345678901234567890123456789012345678901234567890");
+    bbi_chunk *b = bbi_fromstring_dec("98765432109876543210987654321");
+    bbi_chunk *zero = bbi_create();
+    bbi_chunk *d23 = bbi_fromstring_dec("23");
+    bbi_chunk *q;
+    bbi_chunk *r;
+    bbi_divisor *div;
+    char buf[80];
+
+    q = bbi_divmod(a, b, &r);
+    bbi_tostring_dec(q, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "1249999988609375000142382812499") == 0);
+    bbi_tostring_dec(r, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "46440971104644097110464409711") == 0);
+    bbi_destroy(q);
+    bbi_destroy(r);
+
+    /* Rounds towards zero, the remainder taking the dividend's sign */
+    a->sign = 1;
+    q = bbi_div(a, b);
+    r = bbi_mod(a, b);
+    bbi_tostring_dec(q, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "-1249999988609375000142382812499") == 0);
+    bbi_tostring_dec(r, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "-46440971104644097110464409711") == 0);
+    bbi_destroy(q);
+    bbi_destroy(r);
+    a->sign = 0;
+
+    /* Smaller dividend, and dividing by 0 */
+    q = bbi_divmod(b, a, &r);
+    cr_assert(q->len == 1 && q->limbs[0] == 0);
+    cr_assert(_bbi_cmp(r->limbs, r->len, b->limbs, b->len) == 0);
+    bbi_destroy(q);
+    bbi_destroy(r);
+    cr_assert(bbi_div(a, zero) == NULL);
+    cr_assert(bbi_divisor_create(zero) == NULL);
+
+    /* A prepared divisor gives the same results for each value divided by it */
+    div = bbi_divisor_create(d23);
+    q = bbi_divmod_pre(a, div, &r);
+    bbi_tostring_dec(q, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "5367686478797638213097155125657541599522275899082662372516") == 0);
+    cr_assert(r->limbs[0] == 22);
+    bbi_destroy(q);
+    bbi_destroy(r);
+    q = bbi_divmod_pre(b, div, &r);
+    bbi_tostring_dec(q, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "4294149222168545356999463231") == 0);
+    cr_assert(r->limbs[0] == 8);
+    bbi_destroy(q);
+    bbi_destroy(r);
+    bbi_divisor_destroy(div);
+
+    bbi_destroy(a);
+    bbi_destroy(b);
+    bbi_destroy(zero);
+    bbi_destroy(d23);
+}
+
+/* Arithmetic */
+static void random_limbs(bbi_limb *p, unsigned int n) {
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        switch (rand() % 4) {
+        case 0:
+            p[i] = (bbi_limb) -1;
+            break;
+        case 1:
+            p[i] = 0;
+            break;
+        default:
+            p[i] = (bbi_limb) (((uint64_t) rand() << 33) ^ ((uint64_t) rand() << 16) ^ rand());
+        }
+    }
+}
+
+/* Karatsuba and Toom-3 against schoolbook, with the thresholds turned right down so small sizes
+   recurse several levels, for balanced, unbalanced and squared operands */
+Test(bbi_arith, mul_algorithms) {
+    bbi_limb a[150];
+    bbi_limb b[150];
+    bbi_limb r[300];
+    bbi_limb expect[300];
+    unsigned int thresholds[][2] = {{2, 5}, {3, 1000}, {4, 9}};
+    unsigned int t;
+    unsigned int an;
+    unsigned int bn;
+
+    srand(9);
+    for (t = 0; t < 3; t++) {
+        _bbi_mul_karatsuba_threshold = _bbi_sqr_karatsuba_threshold = thresholds[t][0];
+        _bbi_mul_toom3_threshold = _bbi_sqr_toom3_threshold = thresholds[t][1];
+        for (an = 1; an < 150; an += 1 + an / 8) {
+            for (bn = 1; bn <= an; bn += 1 + bn / 3) {
+                random_limbs(a, an);
+                random_limbs(b, bn);
+                a[an - 1] |= 1;
+                _bbi_mul_basecase(expect, a, an, b, bn);
+                _bbi_mul(r, a, an, b, bn);
+                cr_assert(memcmp(r, expect, (an + bn) * sizeof(bbi_limb)) == 0);
+                _bbi_mul(r, b, bn, a, an);
+                cr_assert(memcmp(r, expect, (an + bn) * sizeof(bbi_limb)) == 0);
+            }
+            _bbi_mul_basecase(expect, a, an, a, an);
+            _bbi_sqr(r, a, an);
+            cr_assert(memcmp(r, expect, 2 * an * sizeof(bbi_limb)) == 0);
+            _bbi_sqr_basecase(r, a, an);
+            cr_assert(memcmp(r, expect, 2 * an * sizeof(bbi_limb)) == 0);
+        }
+    }
+    _bbi_mul_karatsuba_threshold = BBI_MUL_KARATSUBA_THRESHOLD;
+    _bbi_mul_toom3_threshold = BBI_MUL_TOOM3_THRESHOLD;
+    _bbi_sqr_karatsuba_threshold = BBI_SQR_KARATSUBA_THRESHOLD;
+    _bbi_sqr_toom3_threshold = BBI_SQR_TOOM3_THRESHOLD;
+}
+
+Test(bbi_arith, mul_ntt) {
+    bbi_limb a[300];
+    bbi_limb b[300];
+    bbi_limb r[600];
+    bbi_limb expect[600];
+    unsigned int an;
+    unsigned int bn;
+
+    /* All ones gives the largest possible coefficients */
+    memset(a, 0xff, sizeof(a));
+    _bbi_mul_basecase(expect, a, 300, a, 300);
+    _bbi_mul_ntt(r, a, 300, a, 300);
+    cr_assert(memcmp(r, expect, 600 * sizeof(bbi_limb)) == 0);
+
+    srand(10);
+    for (an = 1; an <= 300; an += 1 + an / 4) {
+        for (bn = 1; bn <= an; bn += 1 + bn / 2) {
+            random_limbs(a, an);
+            random_limbs(b, bn);
+            _bbi_mul_basecase(expect, a, an, b, bn);
+            _bbi_mul_ntt(r, a, an, b, bn);
+            cr_assert(memcmp(r, expect, (an + bn) * sizeof(bbi_limb)) == 0);
+        }
+        _bbi_mul_basecase(expect, a, an, a, an);
+        _bbi_mul_ntt(r, a, an, a, an);
+        cr_assert(memcmp(r, expect, 2 * an * sizeof(bbi_limb)) == 0);
+    }
+
+    /* Picked by size from _bbi_mul(), including for unbalanced operands */
+    _bbi_mul_ntt_threshold = _bbi_sqr_ntt_threshold = 40;
+    random_limbs(a, 300);
+    random_limbs(b, 300);
+    _bbi_mul_basecase(expect, a, 300, b, 50);
+    _bbi_mul(r, a, 300, b, 50);
+    cr_assert(memcmp(r, expect, 350 * sizeof(bbi_limb)) == 0);
+    _bbi_mul_basecase(expect, a, 300, a, 300);
+    _bbi_sqr(r, a, 300);
+    cr_assert(memcmp(r, expect, 600 * sizeof(bbi_limb)) == 0);
+    _bbi_mul_ntt_threshold = BBI_MUL_NTT_THRESHOLD;
+    _bbi_sqr_ntt_threshold = BBI_SQR_NTT_THRESHOLD;
+    bbi_free_cache();
+}
+
+Test(bbi_arith, mul) {
+    bbi_chunk *list_a = bbi_fromstring_dec("123456789012345678901234567890");
+    bbi_chunk *list_b = bbi_fromstring_dec("987654321098765432109876543210");
+    bbi_chunk *zero = bbi_create_nchunks(4);
+    bbi_chunk *result;
+    char buf[80];
+
+    result = bbi_mul(list_a, list_b);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "121932631137021795226185032733622923332237463801111263526900") == 0);
+    bbi_destroy(result);
+
+    result = bbi_sqr(list_a);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "15241578753238836750495351562536198787501905199875019052100") == 0);
+    bbi_destroy(result);
+
+    list_b->sign = 1;
+    bbi_mul_inplace(list_a, list_b);
+    bbi_tostring_dec(list_a, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "-121932631137021795226185032733622923332237463801111263526900") == 0);
+
+    bbi_mul_inplace(list_a, zero);
+    cr_assert(_bbi_count_chunks(list_a) == 1);
+    cr_assert(list_a->limbs[0] == 0);
+    cr_assert(list_a->sign == 0);
+    bbi_destroy(list_a);
+    bbi_destroy(list_b);
+    bbi_destroy(zero);
+}
+
+Test(bbi_arith, add_1chunk) {
+    bbi_chunk *list_a = bbi_create();
+    bbi_chunk *list_b = bbi_create();
+    bbi_chunk *result;
+
+    list_a->limbs[0] = 1354907759;
+    list_b->limbs[0] = 2346067365;
+    result = bbi_add(list_a, list_b);
+    cr_assert(result != list_a);
+    cr_assert(_bbi_count_chunks(result) == 1);
+    cr_assert(result->limbs[0] == (bbi_limb) 1354907759 + 2346067365);
+    cr_assert(list_a->limbs[0] == 1354907759);
+    bbi_destroy(list_a);
+    bbi_destroy(list_b);
+    bbi_destroy(result);
+}
+
+Test(bbi_arith, add_carry_grows_one_chunk) {
+    bbi_chunk *list_a = bbi_create_nchunks(3);
+    bbi_chunk *list_b = bbi_create();
+    unsigned int i;
+
+    for (i = 0; i < 3; i++) {
+        list_a->limbs[i] = (bbi_limb) -1;
+    }
+    list_b->limbs[0] = 1;
+    bbi_add_inplace(list_a, list_b);
+    cr_assert(_bbi_count_chunks(list_a) == 4);
+    for (i = 0; i < 3; i++) {
+        cr_assert(list_a->limbs[i] == 0);
+    }
+    cr_assert(list_a->limbs[3] == 1);
+
+    /* No carry out of the top chunk - no growth */
+    bbi_add_inplace(list_a, list_b);
+    cr_assert(_bbi_count_chunks(list_a) == 4);
+    cr_assert(list_a->limbs[0] == 1);
+    bbi_destroy(list_a);
+    bbi_destroy(list_b);
+}
+
+Test(bbi_arith, add_unequal_lengths) {
+    bbi_chunk *list_a = bbi_create();
+    bbi_chunk *list_b = bbi_create_nchunks(3);
+
+    list_a->limbs[0] = (bbi_limb) -1;
+    list_b->limbs[0] = 2;
+    list_b->limbs[1] = (bbi_limb) -1;
+    list_b->limbs[2] = 7;
+    bbi_add_inplace(list_a, list_b);
+    cr_assert(_bbi_count_chunks(list_a) == 3);
+    cr_assert(list_a->limbs[0] == 1);
+    cr_assert(list_a->limbs[1] == 0);
+    cr_assert(list_a->limbs[2] == 8);
+
+    /* Adding a value to itself doubles it */
+    bbi_add_inplace(list_a, list_a);
+    cr_assert(list_a->limbs[0] == 2);
+    cr_assert(list_a->limbs[2] == 16);
+    bbi_destroy(list_a);
+    bbi_destroy(list_b);
+}
+
+Test(bbi_arith, sub_borrow) {
+    bbi_chunk *list_a = bbi_create_nchunks(3);
+    bbi_chunk *list_b = bbi_create();
+    unsigned int i;
+
+    list_a->limbs[2] = 1;
+    list_b->limbs[0] = 1;
+    bbi_sub_inplace(list_a, list_b);
+    cr_assert(_bbi_count_chunks(list_a) == 3);
+    cr_assert(list_a->sign == 0);
+    for (i = 0; i < 2; i++) {
+        cr_assert(list_a->limbs[i] == (bbi_limb) -1);
+    }
+    cr_assert(list_a->limbs[2] == 0);
+    bbi_destroy(list_a);
+    bbi_destroy(list_b);
+}
+
+Test(bbi_arith, sub_larger_sets_sign) {
+    bbi_chunk *list_a = bbi_create();
+    bbi_chunk *list_b = bbi_create_nchunks(2);
+    bbi_chunk *result;
+
+    list_a->limbs[0] = 5;
+    list_b->limbs[0] = 3;
+    list_b->limbs[1] = 1;
+    result = bbi_sub(list_a, list_b);
+    cr_assert(result->sign == 1);
+    cr_assert(_bbi_count_chunks(result) == 2);
+    cr_assert(result->limbs[0] == (bbi_limb) -2);
+    cr_assert(result->limbs[1] == 0);
+
+    bbi_sub_inplace(list_b, list_b);
+    cr_assert(list_b->sign == 0);
+    cr_assert(_bbi_normalized_len(list_b->limbs, list_b->len) == 0);
+    bbi_destroy(list_a);
+    bbi_destroy(list_b);
+    bbi_destroy(result);
+}
+
+Test(bbi_arith, powmod) {
+    bbi_chunk *base = bbi_fromstring_dec("123456789012345678901234567890");
+    bbi_chunk *exp = bbi_fromstring_dec("98765432109876543210987654321987654321");
+    bbi_chunk *mod = bbi_fromstring_dec("340282366920938463463374607431768211507");
+    bbi_chunk *even = bbi_fromstring_dec("170141183460469231756002634633997963330");
+    bbi_chunk *five = bbi_fromstring_dec("5");
+    bbi_chunk *result;
+    bbi_mont_ctx *ctx;
+    char buf[80];
+
+    result = bbi_powmod(base, exp, mod);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "133846478688520782843219808607023380639") == 0);
+    bbi_destroy(result);
+
+    ctx = bbi_mont_ctx_create(mod);
+    result = bbi_powmod_ctx(ctx, base, exp, BBI_POWMOD_CONSTTIME);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "133846478688520782843219808607023380639") == 0);
+    bbi_destroy(result);
+
+    /* A negative base is reduced to its positive residue first */
+    base->sign = 1;
+    result = bbi_powmod_ctx(ctx, base, five, 0);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "133873686670799235588743165637494026486") == 0);
+    bbi_destroy(result);
+    base->sign = 0;
+    bbi_mont_ctx_destroy(ctx);
+
+    /* Even moduli don't get a Montgomery context */
+    cr_assert(bbi_mont_ctx_create(even) == NULL);
+    result = bbi_powmod(base, exp, even);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "43274932709833196045029319074600460780") == 0);
+    bbi_destroy(result);
+
+    exp->sign = 1;
+    cr_assert(bbi_powmod(base, exp, mod) == NULL);
+
+    bbi_destroy(base);
+    bbi_destroy(exp);
+    bbi_destroy(mod);
+    bbi_destroy(even);
+    bbi_destroy(five);
+}
+
+/* Montgomery products agree with multiplying and dividing, and both exponentiation modes agree,
+   for odd moduli of assorted sizes */
+Test(bbi_arith, mont_random) {
+    bbi_chunk *mod = bbi_create_nchunks(12);
+    bbi_chunk *a = bbi_create_nchunks(12);
+    bbi_chunk *b = bbi_create_nchunks(12);
+    bbi_chunk *exp = bbi_create_nchunks(3);
+    bbi_chunk *am;
+    bbi_chunk *bm;
+    bbi_chunk *prod;
+    bbi_chunk *expect;
+    bbi_chunk *mont;
+    bbi_chunk *r1;
+    bbi_chunk *r2;
+    bbi_mont_ctx *ctx;
+    unsigned int n;
+
+    srand(11);
+    for (n = 1; n <= 12; n++) {
+        mod->len = a->len = b->len = n;
+        random_limbs(mod->limbs, n);
+        random_limbs(a->limbs, n);
+        random_limbs(b->limbs, n);
+        random_limbs(exp->limbs, 3);
+        mod->limbs[0] |= 1;
+        mod->limbs[n - 1] |= 1;
+        ctx = bbi_mont_ctx_create(mod);
+
+        am = bbi_mont_to(ctx, a);
+        bm = bbi_mont_to(ctx, b);
+        mont = bbi_mont_mul(ctx, am, bm);
+        r1 = bbi_mont_from(ctx, mont);
+        prod = bbi_mul(a, b);
+        expect = bbi_mod(prod, mod);
+        cr_assert(_bbi_cmp(r1->limbs, r1->len, expect->limbs, expect->len) == 0);
+        bbi_destroy(mont);
+        bbi_destroy(r1);
+        bbi_destroy(prod);
+        bbi_destroy(expect);
+
+        mont = bbi_mont_sqr(ctx, am);
+        r1 = bbi_mont_from(ctx, mont);
+        prod = bbi_sqr(a);
+        expect = bbi_mod(prod, mod);
+        cr_assert(_bbi_cmp(r1->limbs, r1->len, expect->limbs, expect->len) == 0);
+        bbi_destroy(mont);
+        bbi_destroy(r1);
+        bbi_destroy(prod);
+        bbi_destroy(expect);
+
+        r1 = bbi_powmod_ctx(ctx, a, exp, 0);
+        r2 = bbi_powmod_ctx(ctx, a, exp, BBI_POWMOD_CONSTTIME);
+        cr_assert(_bbi_cmp(r1->limbs, r1->len, r2->limbs, r2->len) == 0);
+        bbi_destroy(r1);
+        bbi_destroy(r2);
+
+        bbi_destroy(am);
+        bbi_destroy(bm);
+        bbi_mont_ctx_destroy(ctx);
+    }
+    bbi_destroy(mod);
+    bbi_destroy(a);
+    bbi_destroy(b);
+    bbi_destroy(exp);
+}
+
+/* Threads: the pool must give the same answers as running serially, with the size thresholds
+   turned down so every split point is used, including while other threads share the operands */
+static bbi_chunk *thread_a;
+static bbi_chunk *thread_b;
+static bbi_chunk *thread_expect;
+
+static void *thread_mul(void *unused) {
+    bbi_chunk *r;
+    int ok;
+    unsigned int i;
+
+    (void) unused;
+    for (i = 0; i < 5; i++) {
+        r = bbi_mul(thread_a, thread_b);
+        ok = _bbi_cmp(r->limbs, r->len, thread_expect->limbs, thread_expect->len) == 0;
+        bbi_destroy(r);
+        if (!ok) {
+            return (void *) 1;
+        }
+    }
+    bbi_free_cache();
+    return NULL;
+}
+
+Test(bbi_threads, pool_matches_serial) {
+    bbi_chunk *a = bbi_create_nchunks(3000);
+    bbi_chunk *b = bbi_create_nchunks(2500);
+    bbi_chunk *a2;
+    bbi_chunk *expect[5];
+    bbi_chunk *results[5];
+    char *dec;
+    size_t declen;
+    pthread_t th[2];
+    void *ret;
+    unsigned int pass;
+    unsigned int i;
+
+    srand(17);
+    random_limbs(a->limbs, 3000);
+    random_limbs(b->limbs, 2500);
+    a->limbs[2999] |= 1;
+    a2 = bbi_copy(a);
+    declen = bbi_tostring_dec(a, NULL, 0);
+    dec = malloc(declen);
+    _bbi_mul_ntt_threshold = _bbi_sqr_ntt_threshold = 2000;
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            cr_assert(bbi_threads_init(4) == 0);
+            cr_assert(bbi_threads() == 4);
+            _bbi_par_mul_threshold = 50;
+            _bbi_par_bitwise_threshold = 64;
+            _bbi_par_conv_threshold = 100;
+        }
+        /* Toom-3 and Karatsuba at the top (2500 chunks), then the NTT (3000 x 3000) */
+        _bbi_mul_ntt_threshold = 3000;
+        results[0] = bbi_mul(a, b);
+        _bbi_mul_ntt_threshold = 2000;
+        results[1] = bbi_sqr(a);
+        results[2] = bbi_mul(a, a2);
+        results[3] = bbi_xor(a, b);
+        bbi_tostring_dec(a, dec, declen);
+        results[4] = bbi_fromstring_dec((unsigned char *) dec);
+        cr_assert(same_value(results[4], a));
+        for (i = 0; i < 5; i++) {
+            if (pass == 0) {
+                expect[i] = results[i];
+            } else {
+                cr_assert(same_value(results[i], expect[i]), "result %u differs", i);
+                bbi_destroy(results[i]);
+            }
+        }
+    }
+
+    /* Two threads multiplying the same operands while the pool is up: one of them gets the pool,
+       the other runs serially, and neither disturbs the operands */
+    thread_a = a;
+    thread_b = b;
+    _bbi_mul_ntt_threshold = 3000;
+    thread_expect = expect[0];
+    for (i = 0; i < 2; i++) {
+        cr_assert(pthread_create(&th[i], NULL, thread_mul, NULL) == 0);
+    }
+    for (i = 0; i < 2; i++) {
+        pthread_join(th[i], &ret);
+        cr_assert(ret == NULL);
+    }
+
+    bbi_threads_shutdown();
+    cr_assert(bbi_threads() == 1);
+    _bbi_mul_ntt_threshold = BBI_MUL_NTT_THRESHOLD;
+    _bbi_sqr_ntt_threshold = BBI_SQR_NTT_THRESHOLD;
+    _bbi_par_mul_threshold = 1000;
+    _bbi_par_bitwise_threshold = 32768;
+    _bbi_par_conv_threshold = 1000;
+    for (i = 0; i < 5; i++) {
+        bbi_destroy(expect[i]);
+    }
+    free(dec);
+    bbi_destroy(a);
+    bbi_destroy(a2);
+    bbi_destroy(b);
+    bbi_free_cache();
+}
+
+/* Batches give the same values as doing the operations one at a time */
+Test(bbi_batch, matches_single) {
+    bbi_chunk *(*single[4])(bbi_chunk *, bbi_chunk *) = {bbi_and, bbi_or, bbi_xor, bbi_add};
+    bbi_chunk **(*array[4])(bbi_chunk **, bbi_chunk **, bbi_chunk **, unsigned int) = {
+        bbi_and_array, bbi_or_array, bbi_xor_array, bbi_add_array};
+    bbi_chunk *a[37];
+    bbi_chunk *b[37];
+    bbi_chunk *out[37];
+    bbi_chunk *expect;
+    bbi_chunk *mod = bbi_create_nchunks(2);
+    bbi_chunk *neg = bbi_create();
+    bbi_divisor *div;
+    bbi_batch *batch;
+    unsigned int pass;
+    unsigned int op;
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < 37; i++) {
+        a[i] = bbi_create_nchunks(1 + i % 5);
+        b[i] = bbi_create_nchunks(1 + i % 3);
+        random_limbs(a[i]->limbs, a[i]->len);
+        random_limbs(b[i]->limbs, b[i]->len);
+        if (i % 4 == 0) {
+            /* All ones, so adding carries out of the top */
+            for (j = 0; j < a[i]->len; j++) {
+                a[i]->limbs[j] = (bbi_limb) -1;
+            }
+        }
+    }
+    random_limbs(mod->limbs, 2);
+    mod->limbs[1] |= 1;
+    div = bbi_divisor_create(mod);
+    neg->limbs[0] = 5;
+    neg->sign = 1;
+
+    /* With the best kernels, with the pool, and with the portable kernels */
+    for (pass = 0; pass < 3; pass++) {
+        if (pass == 1) {
+            cr_assert(bbi_threads_init(3) == 0);
+            _bbi_par_bitwise_threshold = 1;
+        } else if (pass == 2) {
+            bbi_threads_shutdown();
+            _bbi_par_bitwise_threshold = 32768;
+            _bbi_cpu_restrict(0);
+        }
+        for (op = 0; op < 4; op++) {
+            cr_assert(array[op](out, a, b, 37) == out);
+            for (i = 0; i < 37; i++) {
+                expect = single[op](a[i], b[i]);
+                cr_assert(same_value(out[i], expect), "op %u value %u differs", op, i);
+                bbi_destroy(expect);
+                bbi_destroy(out[i]);
+            }
+        }
+        cr_assert(bbi_mod_array(out, a, div, 37) == out);
+        for (i = 0; i < 37; i++) {
+            expect = bbi_mod(a[i], mod);
+            cr_assert(same_value(out[i], expect), "mod value %u differs", i);
+            bbi_destroy(expect);
+            bbi_destroy(out[i]);
+        }
+
+        /* One value broadcast to all of them */
+        batch = bbi_batch_load(a, 37);
+        cr_assert(bbi_batch_add_all(batch, b[4]) == batch);
+        cr_assert(bbi_batch_add_all(batch, neg) == NULL);
+        bbi_batch_store(batch, out);
+        bbi_batch_destroy(batch);
+        for (i = 0; i < 37; i++) {
+            expect = bbi_add(a[i], b[4]);
+            cr_assert(same_value(out[i], expect), "broadcast value %u differs", i);
+            bbi_destroy(expect);
+            bbi_destroy(out[i]);
+        }
+    }
+    _bbi_cpu_restrict(~0u);
+
+    /* Negative operands are refused */
+    a[0]->sign = 1;
+    cr_assert(bbi_add_array(out, a, b, 37) == NULL);
+    cr_assert(bbi_batch_load(a, 37) == NULL);
+    a[0]->sign = 0;
+
+    /* Empty arrays leave out alone */
+    out[0] = NULL;
+    for (op = 0; op < 4; op++) {
+        cr_assert(array[op](out, a, b, 0) == out);
+    }
+    cr_assert(bbi_mod_array(out, a, div, 0) == out);
+    cr_assert(out[0] == NULL);
+
+    for (i = 0; i < 37; i++) {
+        bbi_destroy(a[i]);
+        bbi_destroy(b[i]);
+    }
+    bbi_divisor_destroy(div);
+    bbi_destroy(mod);
+    bbi_destroy(neg);
+    bbi_free_cache();
+}
+
+/* GCD: g = a*s + b*t with g dividing both is the gcd, whatever path found it */
+static void check_gcdext(bbi_chunk *a, bbi_chunk *b) {
+    bbi_chunk *g = bbi_gcd(a, b);
+    bbi_chunk *s;
+    bbi_chunk *t;
+    bbi_chunk *g2 = bbi_gcdext(a, b, &s, &t);
+    bbi_chunk *as = bbi_mul(a, s);
+    bbi_chunk *bt = bbi_mul(b, t);
+    bbi_chunk *sum = bbi_add(as, bt);
+    bbi_chunk *r;
+
+    cr_assert(same_value(g, g2));
+    cr_assert(same_value(sum, g));
+    cr_assert(g->sign == 0);
+    if (_bbi_normalized_len(g->limbs, g->len) > 0) {
+        r = bbi_mod(a, g);
+        cr_assert(_bbi_normalized_len(r->limbs, r->len) == 0);
+        bbi_destroy(r);
+        r = bbi_mod(b, g);
+        cr_assert(_bbi_normalized_len(r->limbs, r->len) == 0);
+        bbi_destroy(r);
+    }
+    bbi_destroy(g);
+    bbi_destroy(g2);
+    bbi_destroy(s);
+    bbi_destroy(t);
+    bbi_destroy(as);
+    bbi_destroy(bt);
+    bbi_destroy(sum);
+}
+
+Test(bbi_gcd, small) {
+    const char *cases[][3] = {
+        {"0", "0", "0"}, {"0", "-5", "5"}, {"-12", "18", "6"}, {"18", "-12", "6"}, {"-7", "-7", "7"},
+        {"1", "340282366920938463463374607431768211507", "1"},
+        {"123456789012345678901234567890", "987654321098765432109876543210", "9000000000900000000090"},
+    };
+    bbi_chunk *a;
+    bbi_chunk *b;
+    bbi_chunk *g;
+    bbi_chunk *m;
+    char buf[80];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        a = bbi_fromstring_dec(cases[i][0]);
+        b = bbi_fromstring_dec(cases[i][1]);
+        g = bbi_gcd(a, b);
+        bbi_tostring_dec(g, buf, sizeof(buf));
+        cr_assert(strcmp(buf, cases[i][2]) == 0);
+        check_gcdext(a, b);
+        bbi_destroy(a);
+        bbi_destroy(b);
+        bbi_destroy(g);
+    }
+    cr_assert(_bbi_gcd_1(12, 18) == 6);
+    cr_assert(_bbi_gcd_1(0, 9) == 9);
+    cr_assert(_bbi_gcd_1((bbi_limb) -1, (bbi_limb) -1 / 3) == (bbi_limb) -1 / 3);
+
+    /* Inverses come back in [0, |m|), for negative a as well; without one there's NULL */
+    a = bbi_fromstring_dec("-3");
+    m = bbi_fromstring_dec("7");
+    g = bbi_invert(a, m);
+    bbi_tostring_dec(g, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "2") == 0);
+    bbi_destroy(g);
+    bbi_destroy(a);
+    a = bbi_fromstring_dec("6");
+    bbi_destroy(m);
+    m = bbi_fromstring_dec("9");
+    cr_assert(bbi_invert(a, m) == NULL);
+    bbi_destroy(m);
+    m = bbi_create();
+    cr_assert(bbi_invert(a, m) == NULL);
+    bbi_destroy(a);
+    bbi_destroy(m);
+}
+
+/* Random values with a common factor, through binary GCD, Lehmer and the half-GCD with its
+   thresholds turned right down, and consecutive Fibonacci numbers, the worst case for Euclid */
+Test(bbi_gcd, random) {
+    unsigned int saved_hgcd = _bbi_hgcd_threshold;
+    unsigned int saved_dc = _bbi_gcd_dc_threshold;
+    unsigned int sizes[] = {1, 2, 3, 5, 17, 60, 150};
+    bbi_chunk *a = bbi_create_nchunks(150);
+    bbi_chunk *b = bbi_create_nchunks(150);
+    bbi_chunk *c = bbi_create_nchunks(40);
+    bbi_chunk *ac;
+    bbi_chunk *bc;
+    bbi_chunk *inv;
+    bbi_chunk *prod;
+    bbi_chunk *r;
+    bbi_chunk *f0;
+    bbi_chunk *f1;
+    bbi_chunk *f2;
+    bbi_chunk *one;
+    unsigned int i;
+    unsigned int j;
+    int pass;
+
+    srand(13);
+    for (pass = 0; pass < 2; pass++) {
+        f1 = bbi_fromstring_dec("1");
+        _bbi_hgcd_threshold = pass ? 4 : saved_hgcd;
+        _bbi_gcd_dc_threshold = pass ? 4 : saved_dc;
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+                a->len = sizes[i];
+                b->len = sizes[j];
+                c->len = 1 + rand() % (sizes[i] < 40 ? sizes[i] : 40);
+                random_limbs(a->limbs, a->len);
+                random_limbs(b->limbs, b->len);
+                random_limbs(c->limbs, c->len);
+                a->sign = rand() % 2;
+                b->sign = rand() % 2;
+                check_gcdext(a, b);
+                ac = bbi_mul(a, c);
+                bc = bbi_mul(b, c);
+                check_gcdext(ac, bc);
+                bbi_destroy(ac);
+                bbi_destroy(bc);
+
+                /* a * a^-1 is 1 mod b, which is 0 when b is 1 */
+                b->limbs[0] |= 1;
+                b->sign = 0;
+                a->limbs[0] |= 1;
+                inv = bbi_invert(a, b);
+                if (inv != NULL) {
+                    cr_assert(inv->sign == 0);
+                    cr_assert(_bbi_cmp(inv->limbs, inv->len, b->limbs, b->len) < 0);
+                    prod = bbi_mul(a, inv);
+                    r = bbi_mod(prod, b);
+                    if (r->sign) {
+                        r = bbi_add_inplace(r, b);
+                    }
+                    one = bbi_mod(f1, b);
+                    cr_assert(same_value(r, one));
+                    bbi_destroy(one);
+                    bbi_destroy(prod);
+                    bbi_destroy(r);
+                    bbi_destroy(inv);
+                }
+            }
+        }
+
+        f0 = bbi_fromstring_dec("0");
+        for (i = 0; i < 3000; i++) {
+            f2 = bbi_add(f0, f1);
+            bbi_destroy(f0);
+            f0 = f1;
+            f1 = f2;
+        }
+        check_gcdext(f1, f0);
+        inv = bbi_invert(f0, f1);
+        cr_assert(inv != NULL);
+        bbi_destroy(inv);
+        bbi_destroy(f0);
+        bbi_destroy(f1);
+    }
+    _bbi_hgcd_threshold = saved_hgcd;
+    _bbi_gcd_dc_threshold = saved_dc;
+    bbi_destroy(a);
+    bbi_destroy(b);
+    bbi_destroy(c);
+    bbi_free_cache();
+}
+
+/* Roots: root^k + remainder gives the value back, and the next root up overshoots it */
+static void check_root(bbi_chunk *a, unsigned int k) {
+    bbi_chunk *rem;
+    bbi_chunk *root = k == 2 ? bbi_sqrtrem(a, &rem) : bbi_root(a, k, &rem);
+    bbi_chunk *one = bbi_fromstring_dec("1");
+    bbi_chunk *p = bbi_copy(one);
+    bbi_chunk *p1 = bbi_copy(one);
+    bbi_chunk *next;
+    bbi_chunk *t;
+    unsigned int i;
+
+    next = bbi_copy(root);
+    next->sign = 0;
+    next = bbi_add_inplace(next, one);
+    for (i = 0; i < k; i++) {
+        t = bbi_mul(p, root);
+        bbi_destroy(p);
+        p = t;
+        t = bbi_mul(p1, next);
+        bbi_destroy(p1);
+        p1 = t;
+    }
+    t = bbi_add(p, rem);
+    cr_assert(same_value(t, a));
+    cr_assert(rem->sign == 0 || rem->sign == a->sign);
+    cr_assert(_bbi_cmp(p1->limbs, p1->len, a->limbs, a->len) > 0);
+    bbi_destroy(t);
+    bbi_destroy(root);
+    bbi_destroy(rem);
+    bbi_destroy(one);
+    bbi_destroy(p);
+    bbi_destroy(p1);
+    bbi_destroy(next);
+}
+
+Test(bbi_root, known) {
+    const char *cases[][4] = {
+        {"0", "2", "0", "0"}, {"1", "2", "1", "0"}, {"99", "2", "9", "18"}, {"-27", "3", "-3", "0"},
+        {"-30", "3", "-3", "-3"}, {"1000000", "6", "10", "0"}, {"7", "1", "7", "0"},
+        {"340282366920938463463374607431768211456", "2", "18446744073709551616", "0"},
+        {"340282366920938463463374607431768211455", "2", "18446744073709551615", "36893488147419103230"},
+        {"123456789012345678901234567890123456789", "5", "41524364", "8608759578343396233015472370965"},
+    };
+    bbi_chunk *a;
+    bbi_chunk *root;
+    bbi_chunk *rem;
+    char buf[80];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        a = bbi_fromstring_dec(cases[i][0]);
+        root = bbi_root(a, (unsigned int) atoi(cases[i][1]), &rem);
+        bbi_tostring_dec(root, buf, sizeof(buf));
+        cr_assert(strcmp(buf, cases[i][2]) == 0);
+        bbi_tostring_dec(rem, buf, sizeof(buf));
+        cr_assert(strcmp(buf, cases[i][3]) == 0);
+        bbi_destroy(root);
+        bbi_destroy(rem);
+        bbi_destroy(a);
+    }
+
+    /* No even roots of negative values, and no 0th roots */
+    a = bbi_fromstring_dec("-4");
+    cr_assert(bbi_sqrtrem(a, NULL) == NULL);
+    cr_assert(bbi_root(a, 4, NULL) == NULL);
+    cr_assert(bbi_root(a, 0, NULL) == NULL);
+    bbi_destroy(a);
+}
+
+/* Random values of up to a few hundred chunks, so the division under the square root goes
+   recursive, and every shape of top chunk */
+Test(bbi_root, random) {
+    unsigned int ks[] = {2, 3, 4, 5, 7, 31, 64, 200};
+    bbi_chunk *a = bbi_create_nchunks(300);
+    unsigned int n;
+    unsigned int i;
+
+    srand(17);
+    for (n = 1; n <= 300; n += n < 24 ? 1 : 37) {
+        for (i = 0; i < sizeof(ks) / sizeof(ks[0]); i++) {
+            a->len = n;
+            random_limbs(a->limbs, n);
+            a->limbs[n - 1] |= (bbi_limb) 1 << (rand() % BBI_LIMB_BITS);
+            a->sign = ks[i] % 2 && rand() % 2;
+            check_root(a, ks[i]);
+        }
+    }
+    bbi_destroy(a);
+    bbi_free_cache();
+}
+
+Test(bbi_root, perfect_powers) {
+    const char *powers[] = {"0", "1", "-1", "4", "8", "-8", "1024", "-243", "729", "2985984", "148877",
+                            "1174711139837", "9682651996416", "-1024", "18446744073709551616"};
+    const char *others[] = {"2", "-4", "12", "-81", "72", "2985983", "148878", "212",
+                            "18446744073709551615", "18446744073709551617"};
+    bbi_chunk *a;
+    bbi_chunk *x;
+    bbi_chunk *p;
+    bbi_chunk *t;
+    bbi_chunk *one = bbi_fromstring_dec("1");
+    unsigned int i;
+    unsigned int k;
+
+    for (i = 0; i < sizeof(powers) / sizeof(powers[0]); i++) {
+        a = bbi_fromstring_dec(powers[i]);
+        cr_assert(bbi_is_perfect_power(a));
+        bbi_destroy(a);
+    }
+    for (i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+        a = bbi_fromstring_dec(others[i]);
+        cr_assert(!bbi_is_perfect_power(a));
+        bbi_destroy(a);
+    }
+    a = bbi_fromstring_dec("152415787532388367504942236884722755800955129");
+    cr_assert(bbi_is_square(a));
+    a = bbi_add_inplace(a, one);
+    cr_assert(!bbi_is_square(a));
+    bbi_destroy(a);
+
+    /* x^k and x^k + 1 for roots of one chunk and of several */
+    srand(19);
+    x = bbi_create_nchunks(3);
+    for (i = 0; i < 40; i++) {
+        x->len = 1 + i % 3;
+        random_limbs(x->limbs, x->len);
+        x->limbs[x->len - 1] |= (bbi_limb) 1 << (BBI_LIMB_BITS - 1);
+        x->limbs[0] |= 1;
+        x->sign = i % 2;
+        p = bbi_copy(one);
+        for (k = 2 + rand() % 15; k > 0; k--) {
+            t = bbi_mul(p, x);
+            bbi_destroy(p);
+            p = t;
+        }
+        cr_assert(bbi_is_perfect_power(p));
+        p->sign = 0;
+        p = bbi_add_inplace(p, one);
+        cr_assert(!bbi_is_perfect_power(p));
+        bbi_destroy(p);
+    }
+    bbi_destroy(x);
+    bbi_destroy(one);
+    bbi_free_cache();
+}
 
 /* Bitwise operations */
 Test(bbi_bitwise, not_inplace_copy_1chunk) {
     bbi_chunk *list = bbi_create();
-    list->val = 100;
+    list->limbs[0] = 100;
+    bbi_not_inplace(list);
+    cr_assert(list->sign == 1 && list->limbs[0] == 101);
     bbi_not_inplace(list);
-    cr_assert(list->val == ~ (unsigned int) 100);
+    cr_assert(list->sign == 0 && list->limbs[0] == 100);
     bbi_destroy(list);
 }
 
 Test(bbi_bitwise, not_inplace_manychunks) {
     bbi_chunk *list = bbi_create_nchunks(50);
-    unsigned int i;
-    unsigned int tmp = 1;
-    while (list->left != NULL) {
-        list->val = tmp;
-        list = list->left;
-        tmp++;
+    bbi_limb i;
+    for (i = 1; i <= 50; i++) {
+        list->limbs[i - 1] = (bbi_limb) -1;
     }
-    list->val = tmp;
 
+    /* ~(2^(50 * BBI_LIMB_BITS) - 1) carries all the way out */
     list = bbi_not_inplace(list);
+    cr_assert(list->sign == 1);
+    cr_assert(_bbi_count_chunks(list) == 51);
     for (i = 1; i <= 50; i++) {
-        cr_assert(list->val = ~i);
-        if (list->left != NULL) {
-            list = list->left;
-        }
+        cr_assert(list->limbs[i - 1] == 0);
     }
+    cr_assert(list->limbs[50] == 1);
+    list = bbi_not_inplace(list);
+    cr_assert(list->sign == 0);
+    for (i = 1; i <= 50; i++) {
+        cr_assert(list->limbs[i - 1] == (bbi_limb) -1);
+    }
+    cr_assert(list->limbs[50] == 0);
     bbi_destroy(list);
 }
 
 Test(bbi_bitwise, not_copy_1chunk) {
     bbi_chunk *list = bbi_create();
     bbi_chunk *result;
-    list->val = 10;
     result = bbi_not(list);
     cr_assert(result != list);
-    cr_assert(result->val == ~ list->val);
+    cr_assert(result->sign == 1 && result->limbs[0] == 1);
+    cr_assert(list->sign == 0 && list->limbs[0] == 0);
     bbi_destroy(list);
     bbi_destroy(result);
 }
@@ -228,21 +1868,19 @@ Test(bbi_bitwise, not_copy_1chunk) {
 Test(bbi_bitwise, not_copy_manychunks) {
     bbi_chunk *list = bbi_create_nchunks(50);
     bbi_chunk *result;
-    unsigned int i;
-    unsigned int tmp = 1;
-    while (list->left != NULL) {
-        list->val = tmp;
-        list = list->left;
-        tmp++;
+    bbi_limb i;
+    for (i = 1; i <= 50; i++) {
+        list->limbs[i - 1] = i;
     }
-    list->val = tmp;
+    list->sign = 1;
     result = bbi_not(list);
-    for (i = 1; i <= 50; i++) {
-        cr_assert(result->val = ~i);
-        if (result->left != NULL) {
-            result = result->left;
-        }
+    cr_assert(result->sign == 0);
+    cr_assert(result->limbs[0] == 0);
+    for (i = 2; i <= 50; i++) {
+        cr_assert(result->limbs[i - 1] == i);
+        cr_assert(list->limbs[i - 1] == i);
     }
+    cr_assert(list->limbs[0] == 1 && list->sign == 1);
     bbi_destroy(result);
     bbi_destroy(list);
 }
@@ -250,15 +1888,15 @@ Test(bbi_bitwise, not_copy_manychunks) {
 Test(bbi_bitwise, and_inplace_1chunk) {
     bbi_chunk *list_a = bbi_create();
     bbi_chunk *list_b = bbi_create();
-    list_a->val = 1354907759;
-    list_b->val = 2346067365;
+    list_a->limbs[0] = 1354907759;
+    list_b->limbs[0] = 2346067365;
     bbi_and_inplace(list_a, list_b);
-    cr_assert(list_a->val == 12714021);
+    cr_assert(list_a->limbs[0] == 12714021);
 
-    list_a->val = 2346067365;
-    list_b->val = 1354907759;
+    list_a->limbs[0] = 2346067365;
+    list_b->limbs[0] = 1354907759;
     bbi_and_inplace(list_a, list_b);
-    cr_assert(list_a->val == 12714021);
+    cr_assert(list_a->limbs[0] == 12714021);
     bbi_destroy(list_a);
     bbi_destroy(list_b);
 }
@@ -268,18 +1906,17 @@ Test(bbi_bitwise, and_inplace_manychunks_unequal) {
     bbi_chunk *list_b = bbi_create_nchunks(5);
     unsigned int i;
 
-    list_a->val = 284464592;
-    list_b->val = 2258786;
-    list_b->left->val = 249875213;
-    list_b->left->left->val = 2234;
-    list_b->left->left->left->val = 8079872;
-    list_b->left->left->left->left->val = 176813765;
+    list_a->limbs[0] = 284464592;
+    list_b->limbs[0] = 2258786;
+    list_b->limbs[1] = 249875213;
+    list_b->limbs[2] = 2234;
+    list_b->limbs[3] = 8079872;
+    list_b->limbs[4] = 176813765;
     bbi_and_inplace(list_a, list_b);
     cr_assert(_bbi_count_chunks(list_a) == 5);
-    cr_assert(list_a->val == 2102592);
-    for (i = 0; i < 4; i++) {
-        list_a = list_a->left;
-        cr_assert(list_a->val == 0);
+    cr_assert(list_a->limbs[0] == 2102592);
+    for (i = 1; i < 5; i++) {
+        cr_assert(list_a->limbs[i] == 0);
     }
     bbi_destroy(list_a);
     bbi_destroy(list_b);
@@ -290,45 +1927,184 @@ Test(bbi_bitwise, and_inplace_manychunks_equal) {
     bbi_chunk *list_b = bbi_create_nchunks(5);
     unsigned int i;
 
-    list_a->val = 87498273;
-    list_b->val = 372872979;
+    list_a->limbs[0] = 87498273;
+    list_b->limbs[0] = 372872979;
     
-    list_a->left->val = 7282987;
-    list_b->left->val = 123456789;
+    list_a->limbs[1] = 7282987;
+    list_b->limbs[1] = 123456789;
 
-    list_a->left->left->val = 34982763;
-    list_b->left->left->val = 7437987;
+    list_a->limbs[2] = 34982763;
+    list_b->limbs[2] = 7437987;
 
-    list_a->left->left->left->val = 92873847;
-    list_b->left->left->left->val = 7983;
+    list_a->limbs[3] = 92873847;
+    list_b->limbs[3] = 7983;
 
-    list_a->left->left->left->left->val = 9287432;
-    list_b->left->left->left->left->val = 72638346;
+    list_a->limbs[4] = 9287432;
+    list_b->limbs[4] = 72638346;
 
     bbi_and_inplace(list_a, list_b);
-    cr_assert(list_a->val == 70325761);
-    cr_assert(list_a->left->val == 4915457);
-    cr_assert(list_a->left->left->val == 1133091);
-    cr_assert(list_a->left->left->left->val == 1063);
-    cr_assert(list_a->left->left->left->left->val == 268040);
+    cr_assert(list_a->limbs[0] == 70325761);
+    cr_assert(list_a->limbs[1] == 4915457);
+    cr_assert(list_a->limbs[2] == 1133091);
+    cr_assert(list_a->limbs[3] == 1063);
+    cr_assert(list_a->limbs[4] == 268040);
+    bbi_destroy(list_a);
+    bbi_destroy(list_b);
+}
+
+/* OR and XOR share the kernel with AND, but the vector body and the chunk-at-a-time tail are
+   separate code - check lengths that use both, with every instruction set this CPU has */
+Test(bbi_bitwise, kernels_all_widths) {
+    unsigned int masks[] = {0, BBI_CPU_SSE2, BBI_CPU_SSE2 | BBI_CPU_AVX2, ~0u};
+    bbi_limb a[37];
+    bbi_limb b[37];
+    bbi_limb r[37];
+    unsigned int m;
+    unsigned int n;
+    unsigned int i;
+
+    srand(8);
+    for (i = 0; i < 37; i++) {
+        a[i] = ((bbi_limb) rand() << 31) ^ rand();
+        b[i] = ((bbi_limb) rand() << 31) ^ rand();
+    }
+    for (m = 0; m < 4; m++) {
+        _bbi_cpu_restrict(masks[m]);
+        for (n = 0; n <= 37; n += 9) {
+            memset(r, 0xab, sizeof(r));
+            _bbi_and_n(r, a, b, n);
+            for (i = 0; i < n; i++) {
+                cr_assert(r[i] == (a[i] & b[i]));
+            }
+            cr_assert(n == 37 || r[n] == r[36]);
+            _bbi_or_n(r, a, b, n);
+            for (i = 0; i < n; i++) {
+                cr_assert(r[i] == (a[i] | b[i]));
+            }
+            _bbi_xor_n(r, a, b, n);
+            for (i = 0; i < n; i++) {
+                cr_assert(r[i] == (a[i] ^ b[i]));
+            }
+            _bbi_not_n(r, a, n);
+            for (i = 0; i < n; i++) {
+                cr_assert(r[i] == (bbi_limb) ~a[i]);
+            }
+        }
+    }
+    _bbi_cpu_restrict(~0u);
+}
+
+Test(bbi_bitwise, or_xor_unequal) {
+    bbi_chunk *list_a = bbi_create();
+    bbi_chunk *list_b = bbi_create_nchunks(3);
+    bbi_chunk *result;
+
+    list_a->limbs[0] = 12;
+    list_b->limbs[0] = 10;
+    list_b->limbs[1] = 5;
+    list_b->limbs[2] = 7;
+    result = bbi_or(list_a, list_b);
+    cr_assert(_bbi_count_chunks(result) == 3);
+    cr_assert(result->limbs[0] == 14);
+    cr_assert(result->limbs[1] == 5);
+    cr_assert(result->limbs[2] == 7);
+    bbi_xor_inplace(list_b, list_a);
+    cr_assert(_bbi_count_chunks(list_b) == 3);
+    cr_assert(list_b->limbs[0] == 6);
+    cr_assert(list_b->limbs[2] == 7);
+    bbi_xor_inplace(list_a, list_b);
+    cr_assert(_bbi_count_chunks(list_a) == 3);
+    cr_assert(list_a->limbs[0] == 10);
+    cr_assert(list_a->limbs[1] == 5);
     bbi_destroy(list_a);
     bbi_destroy(list_b);
+    bbi_destroy(result);
 }
 
-/* OR and XOR have exact same code as AND - except the operator used. 
-   Not worth testing, probably. */
 
+/* Against Python's ints: a, b, a & b, a | b, a ^ b, a + b, a - b */
+static const char *signed_cases[][7] = {
+    {"-5", "3", "3", "-5", "-8", "-2", "-8"},
+    {"5", "-3", "5", "-3", "-8", "2", "8"},
+    {"-5", "-3", "-7", "-1", "6", "-8", "-2"},
+    {"-18446744073709551616", "18446744073709551615", "0", "-1", "-1", "-1", "-36893488147419103231"},
+    {"-340282366920938463463374607431768211456", "340282366920938463463374607431768211455", "0", "-1", "-1", "-1", "-680564733841876926926749214863536422911"},
+    {"123456789012345678901234567890", "-987654321098765432109876543210", "121512828827855409466171785234", "-985710360914275162674813760554", "-1107223189742130572140985545788", "-864197532086419753208641975320", "1111111110111111111011111111100"},
+    {"-123456789012345678901234567890", "-987654321098765432109876543210", "-1109167149926620841576048328442", "-1943960184490269435062782658", "1107223189742130572140985545784", "-1111111110111111111011111111100", "864197532086419753208641975320"},
+    {"-1", "-1", "-1", "-1", "0", "-2", "0"},
+    {"-1", "0", "0", "-1", "-1", "-1", "-1"},
+    {"7", "-7", "1", "-1", "-2", "0", "14"},
+};
+
+static void assert_dec(bbi_chunk *list, const char *expect) {
+    char buf[80];
+
+    bbi_tostring_dec(list, buf, sizeof(buf));
+    cr_assert(strcmp(buf, expect) == 0, "got %s, expected %s", buf, expect);
+    bbi_destroy(list);
+}
+
+Test(bbi_bitwise, signed_twos_complement) {
+    bbi_chunk *(*ops[])(bbi_chunk *, bbi_chunk *) = {bbi_and, bbi_or, bbi_xor, bbi_add, bbi_sub};
+    bbi_chunk *(*ops_inplace[])(bbi_chunk *, bbi_chunk *) = {
+        bbi_and_inplace, bbi_or_inplace, bbi_xor_inplace, bbi_add_inplace, bbi_sub_inplace
+    };
+    bbi_chunk *a;
+    bbi_chunk *b;
+    unsigned int i;
+    unsigned int op;
+
+    for (i = 0; i < sizeof(signed_cases) / sizeof(signed_cases[0]); i++) {
+        a = bbi_fromstring_dec(signed_cases[i][0]);
+        b = bbi_fromstring_dec(signed_cases[i][1]);
+        for (op = 0; op < 5; op++) {
+            assert_dec(ops[op](a, b), signed_cases[i][op + 2]);
+            assert_dec(ops_inplace[op](bbi_copy(a), b), signed_cases[i][op + 2]);
+        }
+        bbi_destroy(a);
+        bbi_destroy(b);
+    }
+
+    /* Result aliasing an operand: x & x == x | x == x, x ^ x == 0 */
+    a = bbi_fromstring_dec("-987654321098765432109876543210");
+    assert_dec(bbi_and_inplace(bbi_or_inplace(a, a), a), "-987654321098765432109876543210");
+    a = bbi_fromstring_dec("-987654321098765432109876543210");
+    assert_dec(bbi_xor_inplace(a, a), "0");
+}
+
+Test(bbi_bitwise, signed_shr_floors) {
+    const char *cases[][6] = {
+        {"-5", "-3", "-2", "-1", "-1", "-1"},
+        {"-4", "-2", "-1", "-1", "-1", "-1"},
+        {"-340282366920938463463374607431768211457", "-170141183460469231731687303715884105729",
+         "-85070591730234615865843651857942052865", "-18446744073709551617", "-1", "-1"},
+        {"-340282366920938463463374607431768211456", "-170141183460469231731687303715884105728",
+         "-85070591730234615865843651857942052864", "-18446744073709551616", "-1", "-1"},
+    };
+    unsigned int shift[] = {1, 2, 64, 129, 200};
+    bbi_chunk *list;
+    unsigned int i;
+    unsigned int k;
+
+    for (i = 0; i < 4; i++) {
+        list = bbi_fromstring_dec(cases[i][0]);
+        for (k = 0; k < 5; k++) {
+            assert_dec(bbi_shr(list, shift[k]), cases[i][k + 1]);
+        }
+        bbi_destroy(list);
+    }
+}
 
 Test(bbi_bitwise, get_bit) {
     bbi_chunk *list = bbi_create();
     bbi_chunk *list2 = bbi_create_nchunks(2);
 
-    list->val = 2;
+    list->limbs[0] = 2;
     cr_assert(bbi_get_bit(list, 0) == 0);
     cr_assert(bbi_get_bit(list, 1) == 1);
     cr_assert(bbi_get_bit(list, 2) == 0);
 
-    list->val = 1227838087;
+    list->limbs[0] = 1227838087;
     cr_assert(bbi_get_bit(list, 0) == 1);
     cr_assert(bbi_get_bit(list, 1) == 1);
     cr_assert(bbi_get_bit(list, 2) == 1);
@@ -339,8 +2115,12 @@ Test(bbi_bitwise, get_bit) {
     cr_assert(bbi_get_bit(list, 30) == 1);
     cr_assert(bbi_get_bit(list, 31) == 0);
 
-    list2->val = 1344967868;
-    list2->left->val = 2031461461;
+#if BBI_LIMB_BITS == 64
+    list2->limbs[0] = ((bbi_limb) 2031461461 << 32) | 1344967868;
+#else
+    list2->limbs[0] = 1344967868;
+    list2->limbs[1] = 2031461461;
+#endif
     cr_assert(bbi_get_bit(list2, 0) == 0);
     cr_assert(bbi_get_bit(list2, 2) == 1);
     cr_assert(bbi_get_bit(list2, 5) == 1);
@@ -354,10 +2134,306 @@ Test(bbi_bitwise, get_bit) {
     cr_assert(bbi_get_bit(list2, 62) == 1);
     cr_assert(bbi_get_bit(list2, 63) == 0);
 
+    /* Negative values read as two's complement: -2 is ...1110, and -3 * 2^BBI_LIMB_BITS has a
+       whole chunk of 0s under ...1101 */
+    list->limbs[0] = 2;
+    list->sign = 1;
+    cr_assert(bbi_get_bit(list, 0) == 0);
+    cr_assert(bbi_get_bit(list, 1) == 1);
+    cr_assert(bbi_get_bit(list, 100) == 1);
+    list2->limbs[0] = 0;
+    list2->limbs[1] = 3;
+    list2->sign = 1;
+    cr_assert(bbi_get_bit(list2, BBI_LIMB_BITS - 1) == 0);
+    cr_assert(bbi_get_bit(list2, BBI_LIMB_BITS) == 1);
+    cr_assert(bbi_get_bit(list2, BBI_LIMB_BITS + 1) == 0);
+    cr_assert(bbi_get_bit(list2, BBI_LIMB_BITS + 2) == 1);
+    cr_assert(bbi_get_bit(list2, 1000) == 1);
+
     bbi_destroy(list);
     bbi_destroy(list2);
 }
 
+Test(bbi_bitwise, get_bits) {
+    bbi_chunk *list = bbi_fromstring_dec("340282366920938463463374607431768211507");   /* 2^128 + 51 */
+
+    cr_assert(bbi_get_bits(list, 0, 6) == 51);
+    cr_assert(bbi_get_bits(list, 1, 3) == 1);
+    cr_assert(bbi_get_bits(list, 4, 8) == 3);
+    /* Across a chunk boundary, and past the top */
+    cr_assert(bbi_get_bits(list, 126, 4) == 4);
+    cr_assert(bbi_get_bits(list, 128, 1) == 1);
+    cr_assert(bbi_get_bits(list, 129, BBI_LIMB_BITS) == 0);
+    cr_assert(bbi_get_bits(list, 1000, 3) == 0);
+    cr_assert(bbi_get_bits(list, 0, BBI_LIMB_BITS) == 51);
+
+    /* -(2^128 + 51): -51 at the bottom, 1s up to bit 127, then ~1 */
+    list->sign = 1;
+    cr_assert(bbi_get_bits(list, 0, 6) == 13);
+    cr_assert(bbi_get_bits(list, 126, 4) == 11);
+    cr_assert(bbi_get_bits(list, 1000, 3) == 7);
+    cr_assert(bbi_get_bits(list, 0, BBI_LIMB_BITS) == (bbi_limb) -51);
+    bbi_destroy(list);
+}
+
+Test(bbi_bitwise, shifts) {
+    bbi_chunk *list = bbi_fromstring_dec("340282366920938463463374607431768211507");   /* 2^128 + 51 */
+    bbi_chunk *result;
+    char buf[80];
+
+    result = bbi_shl(list, 70);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "401734511064747568885490523085290650690760921102286185299968") == 0);
+    bbi_shr_inplace(result, 70);
+    cr_assert(_bbi_cmp(result->limbs, result->len, list->limbs, list->len) == 0);
+    /* Whole chunks only */
+    bbi_shl_inplace(result, 2 * BBI_LIMB_BITS);
+    cr_assert(result->limbs[0] == 0 && result->limbs[1] == 0 && result->limbs[2] == 51);
+    bbi_shr_inplace(result, 2 * BBI_LIMB_BITS + 1);
+    bbi_tostring_dec(result, buf, sizeof(buf));
+    cr_assert(strcmp(buf, "170141183460469231731687303715884105753") == 0);
+    bbi_destroy(result);
+
+    result = bbi_shr(list, 129);
+    cr_assert(result->len == 1 && result->limbs[0] == 0);
+    bbi_destroy(result);
+    bbi_destroy(list);
+}
+
+Test(bbi_bitwise, bit_fields) {
+    bbi_chunk *list = bbi_fromstring_dec("340282366920938463463374607431768211507");   /* 2^128 + 51 */
+    bbi_chunk *result;
+
+    cr_assert(bbi_bit_length(list) == 129);
+    cr_assert(bbi_popcount(list) == 5);
+    cr_assert(bbi_ctz(list) == 0);
+
+    bbi_set_bit(list, 0, 0);
+    bbi_set_bit(list, 1, 0);
+    cr_assert(bbi_ctz(list) == 4);
+    bbi_set_bit(list, 200, 1);
+    cr_assert(bbi_bit_length(list) == 201);
+    bbi_set_bit(list, 300, 0);
+    cr_assert(bbi_bit_length(list) == 201);
+
+    /* Bits 4 to 131: 3 at the bottom and 2^124 */
+    result = bbi_extract_bits(list, 4, 128);
+    cr_assert(bbi_bit_length(result) == 125);
+    cr_assert(bbi_get_bits(result, 0, 8) == 3);
+    cr_assert(bbi_popcount(result) == 3);
+    bbi_destroy(result);
+    result = bbi_extract_bits(list, 5, 3);
+    cr_assert(result->limbs[0] == 1 && bbi_bit_length(result) == 1);
+    bbi_destroy(result);
+    result = bbi_extract_bits(list, 400, 10);
+    cr_assert(bbi_bit_length(result) == 0);
+    cr_assert(bbi_ctz(result) == ~0u);
+    bbi_destroy(result);
+    bbi_destroy(list);
+
+    /* Negative values are two's complement, and stay negative */
+    assert_dec(bbi_set_bit(bbi_fromstring_dec("-1"), 1, 1), "-1");
+    assert_dec(bbi_set_bit(bbi_fromstring_dec("-1"), 1, 0), "-3");
+    assert_dec(bbi_set_bit(bbi_fromstring_dec("-1"), 100, 0), "-1267650600228229401496703205377");
+    assert_dec(bbi_set_bit(bbi_fromstring_dec("-4"), 0, 1), "-3");
+    assert_dec(bbi_set_bit(bbi_fromstring_dec("-4"), 5, 1), "-4");
+    assert_dec(bbi_set_bit(bbi_fromstring_dec("-18446744073709551616"), 64, 0), "-36893488147419103232");
+    list = bbi_fromstring_dec("-2");
+    assert_dec(bbi_extract_bits(list, 0, 8), "254");
+    assert_dec(bbi_extract_bits(list, 100, 3), "7");
+    bbi_destroy(list);
+}
+
+/* Single bits and bit fields of signed values agree with the bitwise operations and shifts */
+Test(bbi_bitwise, bit_fields_signed) {
+    static const char *values[] = {
+        "-1", "-2", "-51", "-18446744073709551616", "-340282366920938463463374607431768211507",
+        "-6277101735386680763835789423207666416102355444464034512896", "123456789012345678901234567890",
+    };
+    static const unsigned int bits[] = {0, 1, 5, 31, 32, 63, 64, 65, 127, 128, 129, 192, 300};
+    bbi_chunk *one = bbi_fromstring_dec("1");
+    bbi_chunk *list;
+    bbi_chunk *pow;
+    bbi_chunk *expect;
+    bbi_chunk *result;
+    unsigned int i;
+    unsigned int j;
+    unsigned int k;
+
+    for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        list = bbi_fromstring_dec(values[i]);
+        for (j = 0; j < sizeof(bits) / sizeof(bits[0]); j++) {
+            pow = bbi_shl(one, bits[j]);
+
+            /* x & 2^k */
+            expect = bbi_and(list, pow);
+            cr_assert(bbi_get_bit(list, bits[j]) == (bbi_bit_length(expect) != 0), "%s bit %u", values[i], bits[j]);
+            cr_assert(bbi_get_bits(list, bits[j], 1) == (bbi_bit_length(expect) != 0));
+            bbi_destroy(expect);
+
+            /* x | 2^k and x & ~2^k */
+            expect = bbi_or(list, pow);
+            result = bbi_set_bit(bbi_copy(list), bits[j], 1);
+            cr_assert(same_value(result, expect), "%s set bit %u", values[i], bits[j]);
+            bbi_destroy(result);
+            bbi_destroy(expect);
+            bbi_not_inplace(pow);
+            expect = bbi_and(list, pow);
+            result = bbi_set_bit(bbi_copy(list), bits[j], 0);
+            cr_assert(same_value(result, expect), "%s clear bit %u", values[i], bits[j]);
+            bbi_destroy(result);
+            bbi_destroy(expect);
+            bbi_destroy(pow);
+
+            /* (x >> k) & (2^len - 1) */
+            for (k = 1; k <= 2 * BBI_LIMB_BITS + 3; k += BBI_LIMB_BITS / 2 + 1) {
+                pow = bbi_shl(one, k);
+                bbi_sub_inplace(pow, one);
+                expect = bbi_shr(list, bits[j]);
+                bbi_and_inplace(expect, pow);
+                result = bbi_extract_bits(list, bits[j], k);
+                cr_assert(same_value(result, expect), "%s bits %u to %u", values[i], bits[j], bits[j] + k);
+                cr_assert(bbi_get_bits(list, bits[j], k < BBI_LIMB_BITS ? k : BBI_LIMB_BITS) ==
+                          bbi_get_bits(expect, 0, k < BBI_LIMB_BITS ? k : BBI_LIMB_BITS));
+                bbi_destroy(result);
+                bbi_destroy(expect);
+                bbi_destroy(pow);
+            }
+        }
+        bbi_destroy(list);
+    }
+    bbi_destroy(one);
+}
+
+/* The bit counts agree with and without popcnt/lzcnt/tzcnt */
+Test(bbi_bitwise, bit_counts_all_cpus) {
+    bbi_limb a[9];
+    unsigned int expect[3];
+    unsigned int i;
+
+    srand(12);
+    random_limbs(a, 9);
+    a[0] = 0;
+    a[8] = 5;
+    _bbi_cpu_restrict(0);
+    expect[0] = _bbi_popcount_n(a, 9);
+    expect[1] = _bbi_bit_length_n(a, 9);
+    expect[2] = _bbi_ctz_n(a, 9);
+    _bbi_cpu_restrict(~0u);
+    cr_assert(_bbi_popcount_n(a, 9) == expect[0]);
+    cr_assert(_bbi_bit_length_n(a, 9) == expect[1]);
+    cr_assert(_bbi_ctz_n(a, 9) == expect[2]);
+    cr_assert(expect[1] == 8 * BBI_LIMB_BITS + 3);
+    for (i = 0; i < 9; i++) {
+        a[i] = 0;
+    }
+    cr_assert(_bbi_bit_length_n(a, 9) == 0);
+}
+
+/* Deferred expressions */
+Test(bbi_expr, signed_cases) {
+    bbi_expr *e = bbi_expr_create();
+    bbi_chunk *a;
+    bbi_chunk *b;
+    int x;
+    int y;
+    int roots[5];
+    unsigned int i;
+    unsigned int op;
+
+    for (i = 0; i < sizeof(signed_cases) / sizeof(signed_cases[0]); i++) {
+        a = bbi_fromstring_dec(signed_cases[i][0]);
+        b = bbi_fromstring_dec(signed_cases[i][1]);
+        bbi_expr_reset(e);
+        x = bbi_expr_value(e, a);
+        y = bbi_expr_value(e, b);
+        roots[0] = bbi_expr_and(e, x, y);
+        roots[1] = bbi_expr_or(e, x, y);
+        roots[2] = bbi_expr_xor(e, x, y);
+        roots[3] = bbi_expr_add(e, x, y);
+        roots[4] = bbi_expr_sub(e, x, y);
+        for (op = 0; op < 5; op++) {
+            assert_dec(bbi_expr_eval(e, roots[op], NULL), signed_cases[i][op + 2]);
+        }
+        /* Into an operand: a = a - b */
+        cr_assert(bbi_expr_eval(e, roots[4], a) == a);
+        assert_dec(a, signed_cases[i][6]);
+        bbi_destroy(b);
+    }
+
+    /* Nodes only refer back to nodes already made */
+    bbi_expr_reset(e);
+    cr_assert(bbi_expr_not(e, 0) == -1);
+    x = bbi_expr_value(e, NULL);
+    cr_assert(bbi_expr_and(e, x, 1) == -1);
+    cr_assert(bbi_expr_eval(e, 1, NULL) == NULL);
+    cr_assert(bbi_expr_eval(e, -1, NULL) == NULL);
+    bbi_expr_destroy(e);
+}
+
+/* Random expressions against the same operations done one at a time, with values long enough to
+   take several blocks so the carries and a negative value's borrow cross block boundaries */
+Test(bbi_expr, random) {
+    bbi_chunk *(*ops[])(bbi_chunk *, bbi_chunk *) = {bbi_and, bbi_or, bbi_xor, bbi_add, bbi_sub};
+    int (*expr_ops[])(bbi_expr *, int, int) = {
+        bbi_expr_and, bbi_expr_or, bbi_expr_xor, bbi_expr_add, bbi_expr_sub
+    };
+    bbi_expr *e = bbi_expr_create();
+    bbi_chunk *values[4];
+    bbi_chunk *expect[20];
+    bbi_chunk *result;
+    int nodes[20];
+    unsigned int n;
+    unsigned int t;
+    unsigned int i;
+    unsigned int op;
+    unsigned int x;
+    unsigned int y;
+
+    srand(23);
+    for (t = 0; t < 60; t++) {
+        bbi_expr_reset(e);
+        for (i = 0; i < 4; i++) {
+            n = 1 + rand() % (t % 3 ? 8 : 700);
+            values[i] = bbi_create_nchunks(n);
+            random_limbs(values[i]->limbs, n);
+            values[i]->limbs[n - 1] |= 1;
+            values[i]->sign = rand() % 2;
+            nodes[i] = bbi_expr_value(e, values[i]);
+            expect[i] = bbi_copy(values[i]);
+        }
+        for (; i < 20; i++) {
+            op = rand() % 6;
+            x = rand() % i;
+            y = rand() % i;
+            if (op == 5) {
+                nodes[i] = bbi_expr_not(e, nodes[x]);
+                expect[i] = bbi_not(expect[x]);
+            } else {
+                nodes[i] = expr_ops[op](e, nodes[x], nodes[y]);
+                expect[i] = ops[op](expect[x], expect[y]);
+            }
+        }
+        for (i = 4; i < 20; i++) {
+            result = bbi_expr_eval(e, nodes[i], NULL);
+            cr_assert(same_value(result, expect[i]), "t %u node %u", t, i);
+            cr_assert(result->len == 1 || result->limbs[result->len - 1] != 0);
+            bbi_destroy(result);
+        }
+        /* Into the first value, which the expression reads too */
+        cr_assert(bbi_expr_eval(e, nodes[19], values[0]) == values[0]);
+        cr_assert(same_value(values[0], expect[19]));
+        for (i = 0; i < 20; i++) {
+            bbi_destroy(expect[i]);
+        }
+        for (i = 0; i < 4; i++) {
+            bbi_destroy(values[i]);
+        }
+    }
+    bbi_expr_destroy(e);
+    bbi_free_cache();
+}
+
 /* Helper */
 Test(bbi_helper, dump_binary) {
     unsigned n = sizeof(unsigned int)*8+3+1;
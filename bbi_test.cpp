@@ -0,0 +1,237 @@
+#include <criterion/criterion.h>
+#include <climits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "bbi.hpp"
+
+using bbi::BigInt;
+
+/* Whether f() throws an E */
+template <typename E, typename F>
+static bool throws(F f) {
+    try {
+        f();
+    } catch (const E &) {
+        return true;
+    }
+    return false;
+}
+
+static void assert_str(const BigInt &a, const char *expect) {
+    cr_assert(a.to_string() == expect, "got %s, expected %s", a.to_string().c_str(), expect);
+}
+
+Test(bbi_cpp, construct) {
+    assert_str(BigInt(), "0");
+    assert_str(BigInt(0), "0");
+    assert_str(BigInt(-1), "-1");
+    assert_str(BigInt(LLONG_MIN), "-9223372036854775808");
+    assert_str(BigInt(ULLONG_MAX), "18446744073709551615");
+    assert_str(BigInt((unsigned char) 200), "200");
+    assert_str(BigInt("-123456789012345678901234567890"), "-123456789012345678901234567890");
+    assert_str(BigInt("  00042 "), "42");
+    cr_assert(BigInt("-DeadBeef", 16).to_string(16) == "-deadbeef");
+    cr_assert(BigInt(255).to_string(16) == "ff");
+    cr_assert(throws<std::invalid_argument>([&] { BigInt("12x"); }));
+    cr_assert(throws<std::invalid_argument>([&] { BigInt("12", 8); }));
+
+    std::ostringstream os;
+    os << BigInt(-255) << ' ' << std::hex << BigInt(255);
+    cr_assert(os.str() == "-255 ff");
+}
+
+/* Against Python's ints, as the C tests */
+Test(bbi_cpp, operators) {
+    BigInt a("123456789012345678901234567890");
+    BigInt b("-987654321098765432109876543210");
+    BigInt c(7);
+
+    assert_str(a & b, "121512828827855409466171785234");
+    assert_str(a | b, "-985710360914275162674813760554");
+    assert_str(a ^ b, "-1107223189742130572140985545788");
+    assert_str(a + b, "-864197532086419753208641975320");
+    assert_str(a - b, "1111111110111111111011111111100");
+    assert_str(b - a, "-1111111110111111111011111111100");
+    assert_str(a * b, "-121932631137021795226185032733622923332237463801111263526900");
+    assert_str(b / a, "-8");
+    assert_str(b % a, "-9000000000900000000090");
+    assert_str(-a, "-123456789012345678901234567890");
+    assert_str(~c, "-8");
+    assert_str(c << 100, "8873554201597605810476922437632");
+    assert_str(b >> 64, "-53540848030");
+    assert_str((a ^ b) & ~c, "-1107223189742130572140985545792");
+    assert_str(a + 1, "123456789012345678901234567891");
+    assert_str(1 - a, "-123456789012345678901234567889");
+
+    cr_assert(b < a && a > b && a >= a && a <= a && a != b && a == BigInt(a));
+    cr_assert(BigInt(-2) < BigInt(-1) && BigInt(-1) < BigInt(0) && !BigInt(0));
+    cr_assert(BigInt(-2).bit(100) && BigInt(-2).bit(1) && !BigInt(-2).bit(0));
+    cr_assert(bbi::gcd(BigInt(84), BigInt(-36)) == BigInt(12));
+    cr_assert(bbi::sqrt(BigInt(99)) == BigInt(9));
+    cr_assert(bbi::powmod(BigInt(3), BigInt(200), BigInt(1000007)) == BigInt(959082));
+
+    cr_assert(throws<std::domain_error>([&] { a / BigInt(0); }));
+    cr_assert(throws<std::domain_error>([&] { a %= BigInt(0); }));
+    cr_assert(throws<std::domain_error>([&] { bbi::sqrt(b); }));
+}
+
+/* Results land in an rvalue operand's chunks rather than new ones */
+Test(bbi_cpp, reuse) {
+    BigInt a("123456789012345678901234567890");
+    BigInt b("-987654321098765432109876543210");
+    BigInt x(a);
+    BigInt y(b);
+    BigInt r;
+    bbi_chunk *px = x.get();
+    bbi_chunk *py = y.get();
+    bbi_limb *limbs;
+
+    r = std::move(x) + b;
+    cr_assert(r.get() == px);
+    assert_str(r, "-864197532086419753208641975320");
+    x = a;
+    px = x.get();
+
+    r = a * std::move(y);
+    cr_assert(r.get() == py);
+    y = b;
+    py = y.get();
+
+    r = a - std::move(y);
+    cr_assert(r.get() == py);
+    assert_str(r, "1111111110111111111011111111100");
+
+    r = (std::move(x) ^ b) & ~BigInt(7);
+    cr_assert(r.get() == px);
+    assert_str(r, "-1107223189742130572140985545792");
+
+    /* Compound operators and copy assignment keep the chunks they have room in */
+    x = BigInt("340282366920938463463374607431768211456");
+    x += a;
+    x &= b;
+    limbs = x.get()->limbs;
+    x -= a;
+    x ^= b;
+    x = a;
+    cr_assert(x.get()->limbs == limbs);
+    assert_str(x, "123456789012345678901234567890");
+
+    /* The same value on both sides */
+    x += x;
+    assert_str(x, "246913578024691357802469135780");
+    x -= x;
+    assert_str(x, "0");
+    cr_assert(!x.is_negative());
+
+    /* Moving hands the chunk over; the moved-from value can be assigned again */
+    px = x.get();
+    r = std::move(x);
+    cr_assert(r.get() == px);
+    x = a;
+    assert_str(x, "123456789012345678901234567890");
+    bbi_destroy(r.release());
+    r = BigInt::adopt(bbi_copy(a.get()));
+    cr_assert(r == a);
+}
+
+/* Fixed width */
+using bbi::UInt;
+
+/* 3^k the long way, at compile time when asked for a constant */
+template <unsigned int Bits>
+constexpr UInt<Bits> pow3(unsigned int k) {
+    UInt<Bits> r(1);
+
+    while (k-- > 0) {
+        r *= UInt<Bits>(3);
+    }
+    return r;
+}
+
+static_assert(UInt<256>(-1) + 1 == UInt<256>(), "wraps");
+static_assert(UInt<256>() - 1 == ~UInt<256>(), "wraps");
+static_assert((UInt<256>(1) << 255) >> 255 == UInt<256>(1), "shifts");
+static_assert(((UInt<512>(0xff) << 300) >> 296).limbs[0] == 0xff0, "shifts");
+static_assert(-UInt<256>(5) + UInt<256>(7) == UInt<256>(2), "negates");
+static_assert(UInt<256>(-7) * UInt<256>(-7) == UInt<256>(49), "multiplies");
+/* (2^256 - 1)^2 = 2^512 - 2^257 + 1 */
+static_assert(mul_wide(UInt<256>(-1), UInt<256>(-1)) == UInt<512>(1) - (UInt<512>(1) << 257), "multiplies");
+static_assert(pow3<1024>(500) != UInt<1024>(), "constexpr");
+static_assert(UInt<256>(2) < UInt<256>(-1) && UInt<256>(1).bit(0) && !UInt<256>(1).bit(300), "compares");
+
+static std::string random_hex(unsigned int ndigits) {
+    std::string s;
+
+    while (s.size() < ndigits) {
+        switch (rand() % 4) {
+        case 0:
+            s += "ffffffff";
+            break;
+        case 1:
+            s += "00000000";
+            break;
+        default:
+            s += "0123456789abcdef"[rand() % 16];
+        }
+    }
+    return "1" + s.substr(0, ndigits - 1);
+}
+
+template <unsigned int Bits>
+static void check_uint() {
+    unsigned int shifts[] = {0, 1, 31, 32, 63, 64, 65, Bits / 2 + 3, Bits - 1, Bits, Bits + 40};
+    UInt<Bits> ua;
+    UInt<Bits> ub;
+    UInt<Bits> q;
+    UInt<Bits> r;
+    unsigned int t;
+    unsigned int i;
+
+    for (t = 0; t < 200; t++) {
+        BigInt a(random_hex(1 + rand() % (Bits / 4)), 16);
+        BigInt b(random_hex(1 + rand() % (Bits / 4)), 16);
+
+        ua = UInt<Bits>(a);
+        ub = UInt<Bits>(b);
+        cr_assert(BigInt(ua) == a);
+        cr_assert(ua + ub == UInt<Bits>(a + b));
+        cr_assert(ua - ub == UInt<Bits>(a - b));
+        cr_assert(ub - ua == UInt<Bits>(b - a));
+        cr_assert(ua * ub == UInt<Bits>(a * b));
+        cr_assert(BigInt(mul_wide(ua, ub)) == a * b);
+        cr_assert((ua & ~ub) == UInt<Bits>(a & ~b));
+        cr_assert((ua | ub) == UInt<Bits>(a | b));
+        cr_assert((ua ^ -ub) == UInt<Bits>(a ^ -b));
+        cr_assert(compare(ua, ub) == a.compare(b));
+        UInt<Bits>::divmod(ua, ub, q, r);
+        cr_assert(BigInt(q) == a / b && BigInt(r) == a % b);
+        cr_assert(ua / UInt<Bits>(7) == UInt<Bits>(a / 7) && ua % UInt<Bits>(7) == UInt<Bits>(a % 7));
+        for (i = 0; i < sizeof(shifts) / sizeof(shifts[0]); i++) {
+            cr_assert((ua << shifts[i]) == UInt<Bits>(a << shifts[i]), "%u << %u", Bits, shifts[i]);
+            cr_assert((ua >> shifts[i]) == UInt<Bits>(a >> shifts[i]), "%u >> %u", Bits, shifts[i]);
+        }
+    }
+}
+
+/* Against the dynamic type, with the result wrapped to the width */
+Test(bbi_cpp, fixed_width) {
+    constexpr UInt<1024> c = pow3<1024>(500);
+    BigInt big(1);
+    unsigned int i;
+
+    srand(31);
+    check_uint<256>();
+    check_uint<512>();
+    check_uint<1024>();
+    check_uint<2048>();
+
+    /* The same answer at compile time and at run time */
+    for (i = 0; i < 500; i++) {
+        big *= 3;
+    }
+    cr_assert(c == UInt<1024>(big) && pow3<1024>(500) == c);
+    cr_assert(UInt<256>(-1).to_string(16) == std::string(64, 'f'));
+    cr_assert(UInt<256>(BigInt(-2)) == UInt<256>(-2));
+    cr_assert(throws<std::domain_error>([&] { UInt<256>(1) / UInt<256>(); }));
+}
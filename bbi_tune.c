@@ -0,0 +1,186 @@
+/*
+ * Measure the algorithm crossover points on this machine, and print them as a replacement for
+ * bbi_tune.h - see the tune target in the Makefile.
+ *
+ * For each threshold, sizes are stepped upwards, timing the operation with the faster algorithm
+ * switched off and then switched on for the top level only (so everything below still uses the
+ * slower one). The threshold is the first size where switching it on wins several sizes in a row.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bbi.h"
+#include "bbi_tune.h"
+
+#define MAXN 20000
+#define MAXDIGITS 40000
+/* How many consecutive wins count as a crossover */
+#define STREAK 3
+
+static bbi_limb a[MAXN];
+static bbi_limb b[MAXN];
+static bbi_limb r[2 * MAXN];
+static unsigned char digits[MAXDIGITS];
+static bbi_chunk *value;
+static bbi_chunk *value2;
+static char *outbuf;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_mul(unsigned int n) {
+    _bbi_mul(r, a, n, b, n);
+}
+
+static void run_sqr(unsigned int n) {
+    _bbi_sqr(r, a, n);
+}
+
+/* 2n by n chunk division, quotient to r and remainder to b */
+static void run_div(unsigned int n) {
+    _bbi_divrem(r, b, a, 2 * n, a, n);
+}
+
+static void run_fromdec(unsigned int n) {
+    bbi_destroy(bbi_fromstring_dec_n(digits, n));
+}
+
+static void run_todec(unsigned int n) {
+    value->len = n;
+    bbi_tostring_dec(value, outbuf, MAXN * BBI_LIMB_BITS / 3 + 3);
+}
+
+static void run_gcd(unsigned int n) {
+    value->len = n;
+    value2->len = n;
+    bbi_destroy(bbi_gcd(value, value2));
+}
+
+/* The half-GCD runs on a third of the gcd's operands at the top level */
+static void run_hgcd(unsigned int n) {
+    run_gcd(3 * n);
+}
+
+/* Best-of-five time for one call of fn(n), each sample running for at least a millisecond */
+static double measure(void (*fn)(unsigned int), unsigned int n) {
+    double best = 0;
+    double start;
+    double elapsed;
+    unsigned long iters;
+    unsigned long i;
+    int sample;
+
+    for (sample = 0; sample < 5; sample++) {
+        iters = 0;
+        start = now_ns();
+        do {
+            for (i = 0; i < 4; i++) {
+                fn(n);
+            }
+            iters += 4;
+            elapsed = now_ns() - start;
+        } while (elapsed < 1e6);
+        if (sample == 0 || elapsed / iters < best) {
+            best = elapsed / iters;
+        }
+    }
+    return best;
+}
+
+/* Find the crossover for *threshold between lo and hi. Returns hi if the faster algorithm never
+   won. */
+static unsigned int tune(const char *name, unsigned int *threshold, void (*fn)(unsigned int),
+                         unsigned int lo, unsigned int hi) {
+    unsigned int n;
+    unsigned int first = 0;
+    unsigned int wins = 0;
+    double off;
+    double on;
+
+    for (n = lo; n < hi; n += 1 + n / 16) {
+        *threshold = hi * 16;
+        off = measure(fn, n);
+        *threshold = n;
+        on = measure(fn, n);
+        fprintf(stderr, "%s %6u: %12.0f ns vs %12.0f ns\n", name, n, off, on);
+        if (on < off) {
+            if (wins == 0) {
+                first = n;
+            }
+            if (++wins == STREAK) {
+                *threshold = first;
+                return first;
+            }
+        } else {
+            wins = 0;
+        }
+    }
+    *threshold = hi;
+    return hi;
+}
+
+int main() {
+    unsigned int i;
+
+    srand(1);
+    for (i = 0; i < MAXN; i++) {
+        a[i] = ((bbi_limb) rand() << 16) ^ rand();
+        b[i] = ((bbi_limb) rand() << 16) ^ rand();
+    }
+    for (i = 0; i < MAXDIGITS; i++) {
+        digits[i] = '1' + rand() % 9;
+    }
+    value = bbi_create_nchunks(MAXN);
+    value2 = bbi_create_nchunks(MAXN);
+    for (i = 0; i < MAXN; i++) {
+        value->limbs[i] = a[i] | 1;
+        value2->limbs[i] = b[i] | 1;
+    }
+    outbuf = malloc(MAXN * BBI_LIMB_BITS / 3 + 3);
+
+    /* Each algorithm is tuned with the one above it switched off */
+    _bbi_mul_toom3_threshold = MAXN * 16;
+    _bbi_mul_ntt_threshold = MAXN * 16;
+    tune("mul karatsuba", &_bbi_mul_karatsuba_threshold, run_mul, 4, 200);
+    tune("mul toom3", &_bbi_mul_toom3_threshold, run_mul, _bbi_mul_karatsuba_threshold * 2, 800);
+    _bbi_sqr_toom3_threshold = MAXN * 16;
+    _bbi_sqr_ntt_threshold = MAXN * 16;
+    tune("sqr karatsuba", &_bbi_sqr_karatsuba_threshold, run_sqr, 4, 200);
+    tune("sqr toom3", &_bbi_sqr_toom3_threshold, run_sqr, _bbi_sqr_karatsuba_threshold * 2, 800);
+    tune("mul ntt", &_bbi_mul_ntt_threshold, run_mul, _bbi_mul_toom3_threshold * 2, MAXN);
+    tune("sqr ntt", &_bbi_sqr_ntt_threshold, run_sqr, _bbi_sqr_toom3_threshold * 2, MAXN);
+    tune("div dc", &_bbi_div_dc_threshold, run_div, 8, 400);
+    tune("fromdec", &_bbi_fromdec_dc_threshold, run_fromdec, 100, MAXDIGITS);
+    tune("todec", &_bbi_todec_dc_threshold, run_todec, 4, 2000);
+    _bbi_gcd_dc_threshold = 4;
+    tune("hgcd", &_bbi_hgcd_threshold, run_hgcd, 20, 400);
+    tune("gcd dc", &_bbi_gcd_dc_threshold, run_gcd, 50, 1500);
+
+    printf("/* Algorithm crossover points - sizes in chunks, except BBI_FROMDEC_DC_THRESHOLD which is in digits.\n");
+    printf("   Measured by bbi_tune for %d-bit chunks - run \"make tune\" to regenerate this file. Any of them\n",
+           BBI_LIMB_BITS);
+    printf("   can also be overridden with -D when building. */\n");
+    printf("#ifndef BBI_TUNE_H\n#define BBI_TUNE_H\n\n");
+#define EMIT(NAME, VAR) printf("#ifndef " #NAME "\n#define " #NAME " %u\n#endif\n", VAR)
+    EMIT(BBI_MUL_KARATSUBA_THRESHOLD, _bbi_mul_karatsuba_threshold);
+    EMIT(BBI_MUL_TOOM3_THRESHOLD, _bbi_mul_toom3_threshold);
+    EMIT(BBI_SQR_KARATSUBA_THRESHOLD, _bbi_sqr_karatsuba_threshold);
+    EMIT(BBI_SQR_TOOM3_THRESHOLD, _bbi_sqr_toom3_threshold);
+    EMIT(BBI_MUL_NTT_THRESHOLD, _bbi_mul_ntt_threshold);
+    EMIT(BBI_SQR_NTT_THRESHOLD, _bbi_sqr_ntt_threshold);
+    EMIT(BBI_DIV_DC_THRESHOLD, _bbi_div_dc_threshold);
+    EMIT(BBI_FROMDEC_DC_THRESHOLD, _bbi_fromdec_dc_threshold);
+    EMIT(BBI_TODEC_DC_THRESHOLD, _bbi_todec_dc_threshold);
+    EMIT(BBI_HGCD_THRESHOLD, _bbi_hgcd_threshold);
+    EMIT(BBI_GCD_DC_THRESHOLD, _bbi_gcd_dc_threshold);
+    printf("\n#endif\n");
+
+    free(outbuf);
+    bbi_destroy(value);
+    bbi_destroy(value2);
+    return 0;
+}
@@ -0,0 +1,41 @@
+/* Algorithm crossover points - sizes in chunks, except BBI_FROMDEC_DC_THRESHOLD which is in digits.
+   Measured by bbi_tune for 64-bit chunks - run "make tune" to regenerate this file. Any of them
+   can also be overridden with -D when building. */
+#ifndef BBI_TUNE_H
+#define BBI_TUNE_H
+
+#ifndef BBI_MUL_KARATSUBA_THRESHOLD
+#define BBI_MUL_KARATSUBA_THRESHOLD 20
+#endif
+#ifndef BBI_MUL_TOOM3_THRESHOLD
+#define BBI_MUL_TOOM3_THRESHOLD 146
+#endif
+#ifndef BBI_SQR_KARATSUBA_THRESHOLD
+#define BBI_SQR_KARATSUBA_THRESHOLD 58
+#endif
+#ifndef BBI_SQR_TOOM3_THRESHOLD
+#define BBI_SQR_TOOM3_THRESHOLD 234
+#endif
+#ifndef BBI_MUL_NTT_THRESHOLD
+#define BBI_MUL_NTT_THRESHOLD 2829
+#endif
+#ifndef BBI_SQR_NTT_THRESHOLD
+#define BBI_SQR_NTT_THRESHOLD 1597
+#endif
+#ifndef BBI_DIV_DC_THRESHOLD
+#define BBI_DIV_DC_THRESHOLD 18
+#endif
+#ifndef BBI_FROMDEC_DC_THRESHOLD
+#define BBI_FROMDEC_DC_THRESHOLD 158
+#endif
+#ifndef BBI_TODEC_DC_THRESHOLD
+#define BBI_TODEC_DC_THRESHOLD 30
+#endif
+#ifndef BBI_HGCD_THRESHOLD
+#define BBI_HGCD_THRESHOLD 60
+#endif
+#ifndef BBI_GCD_DC_THRESHOLD
+#define BBI_GCD_DC_THRESHOLD 400
+#endif
+
+#endif